@@ -24,17 +24,21 @@ int main() {
 
     /**
     **  And you are done, the result has already been calculated.. now you just need to decide
-    **  how you want the output... you have 3 options
+    **  how you want the output... you have 4 options
     **      - as a string       :   c.result_s();
     **      - as a char *       :   c.result_c_str();
     **      - as a long double  :   c.result_d();
+    **      - into your buffer  :   c.format_to(buf, sizeof(buf));   (no allocations)
     */
+    char buf[64];
+    c.format_to(buf, sizeof(buf), calc_noformat);
     cout << "result_s :     \t" << c.result_s() << "\n\t";
     cout << "result_c_str : \t" << c.result_c_str(calc_formula) << "\n\t";
-    cout << "result_d :     \t" << c.result_d() << endl;
+    cout << "result_d :     \t" << c.result_d() << "\n\t";
+    cout << "format_to :    \t" << buf << endl;
     /**
     **  As you can see in the 'result_c_str()' There are some flags you can set to control the output
-    **  this flags are only valid in 'result_s()' and 'result_c_str()'
+    **  this flags are only valid in 'result_s()', 'result_c_str()' and 'format_to()'
     **      calc_formula        -   Display the formula with the results
     **      calc_noresult       -   Do not output the result
     **      calc_noerror        -   Do not show error msg
@@ -33,14 +33,21 @@
 
 /* INCLUDES! */
 #include <cerrno>
+#include <cfenv>
 #include <cmath>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <stdio.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sstream>
+#include <stdint.h>
 #include <vector>
+#include "calc_errors.h"
+#include "calc_table.h"
 using namespace std;
 
 /* Let us Disable some annoying warnings... */
@@ -53,7 +60,7 @@ using namespace std;
 
 /* GLOBALS! */
 #ifdef CALC_DEBUG_CONSOLE
-    #define C_DBG_INIT
+    #define C_DBG_INIT(formula)
     #define C_DBG_START printf("(Line %i):%s:(begin)\n",__LINE__,__FUNCTION__);
     #define C_DBG_MSG(...) \
         do{\
@@ -61,46 +68,58 @@ using namespace std;
             printf("\n");\
         } while(0);
     #define C_DBG_END printf("(Line %i):%s:(end)\n",__LINE__,__FUNCTION__);
-    #define C_DBG_FINISH
-#elif defined(CALC_DEBUG_FILE)
-    #include <time.h>
-    FILE *calc_debug;
-    clock_t calc_t_init;
-    #define C_DBG_INIT \
-        do { \
-            calc_t_init = clock();\
-            calc_debug = fopen("calc_debug.log","a+"); \
-            fprintf(calc_debug, "=================================================\n");\
-            fprintf(calc_debug, "   Session Start %s :: %s\n", __DATE__, __TIME__);\
-            fprintf(calc_debug, "=================================================\n");\
+    #define C_DBG_FINISH(error, result)
+#elif defined(CALC_DEBUG_FILE) || defined(CALC_DEBUG_TRACE)
+    /* CALC_DEBUG_FILE: everything, to calc_debug.fct (read it with tools/calc_trace) */
+    #if defined(CALC_DEBUG_FILE) && !defined(CALC_TRACE_DEFAULT_FILE)
+        #define CALC_TRACE_DEFAULT_FILE     "calc_debug.fct"
+        #define CALC_TRACE_DEFAULT_LEVEL    calc_trace_msg
+    #endif
+    #include "calc_trace.h"
+    /* Every call site keeps the id of its function name */
+    #define C_DBG_INIT(formula) \
+        bool calc_dbg_open = CalcTrace::open(formula);
+    #define C_DBG_START \
+        do {\
+            if (CalcTrace::on(calc_trace_stage)) {\
+                static const uint16_t calc_dbg_stage = CalcTrace::stage(__FUNCTION__);\
+                CalcTrace::begin(calc_dbg_stage, __LINE__);\
+            }\
         } while(0);
-    #define C_DBG_START fprintf(calc_debug, "(Line %i):%s:(begin)\n", __LINE__, __FUNCTION__);
     #define C_DBG_MSG(...) \
         do {\
-            fprintf(calc_debug, __VA_ARGS__);\
-            fprintf(calc_debug, "\n");\
+            if (CalcTrace::on(calc_trace_msg)) {\
+                static const uint16_t calc_dbg_stage = CalcTrace::stage(__FUNCTION__);\
+                CalcTrace::msg(calc_dbg_stage, __LINE__, __VA_ARGS__);\
+            }\
+        } while(0);
+    #define C_DBG_END \
+        do {\
+            if (CalcTrace::on(calc_trace_stage)) {\
+                static const uint16_t calc_dbg_stage = CalcTrace::stage(__FUNCTION__);\
+                CalcTrace::end(calc_dbg_stage, __LINE__);\
+            }\
         } while(0);
-    #define C_DBG_END fprintf(calc_debug, "(Line %i):%s:(end)\n",__LINE__,__FUNCTION__);
-    #define C_DBG_FINISH \
-        do { \
-            fprintf(calc_debug, "=================================================\n");\
-            double calc_t_end = (clock() - calc_t_init);\
-            calc_t_end /= CLOCKS_PER_SEC;\
-            fprintf(calc_debug, "   Session End :: Elapsed time: %Gs\n", calc_t_end);\
-            fprintf(calc_debug, "=================================================\n\n\n");\
-            fclose(calc_debug);\
-        } while (0);
+    #define C_DBG_FINISH(error, result) \
+        do { if (calc_dbg_open) { CalcTrace::close(error, result); } } while(0);
 #else
-    #define C_DBG_INIT
+    #define C_DBG_INIT(formula)
     #define C_DBG_START
     #define C_DBG_MSG(...)
     #define C_DBG_END
-    #define C_DBG_FINISH
+    #define C_DBG_FINISH(error, result)
 #endif
 
 #define PI  3.1415926535897932384626433832795
 #define EXP 2.7182818284590452353602874713527
 
+/* Default CalcLimits (0 is no limit) */
+#define CALC_LIMIT_LENGTH   65536       //Characters of a formula
+#define CALC_LIMIT_SIZE     1048576     //Characters once the 'a=1,b=2;' vars are expanded
+#define CALC_LIMIT_DEPTH    256         //Nested parentheses (and sub formulas)
+#define CALC_LIMIT_NODES    20000       //Numbers, names and operators
+#define CALC_LIMIT_STEPS    1000000     //Sub formulas Calc evaluates
+
 enum FunkiiCalcOptions_t {
     calc_formula        =   1 << 0, //Display the formula with the results
     calc_noresult       =   1 << 1, //Do not output the result (maybe you want the formula only)
@@ -111,29 +130,45 @@ enum FunkiiCalcOptions_t {
 
     calc_default        =   0       //Default Options
 };
-enum FunkiiCalcErrors_t {
-        CE_NADA             =   0,
-        CE_EMPTY            =   1,
-        CE_SYNTAX           =   2,
-        CE_SYNTAX_VARS      =   3,
-        CE_SYN_VARS_INFLOOP =   4,
-        CE_SYN_PAR          =   5,
-        CE_SYN_EMPTY_PAR    =   6,
-        CE_SYN_INVALIDCHAR  =   7,
-        CE_DIV0             =   8,
-        CE_EDOM             =   9,
-        CE_ERANGE           =   10,
-        CE_FIB_OB           =   11,
-        CE_BIN              =   12,
-        CE_OCT              =   13,
-        CE_HEX              =   14,
-        CE_FACT_OB          =   15,
-        CE_INT_BITSHIFT     =   16,
+enum FunkiiCalcErrorModes_t {
+    calc_err_errno      =   0,      //Check errno after every function (default)
+    calc_err_fenv       =   1       //Test the FP exception flags once per evaluation (FE_INVALID, FE_DIVBYZERO, FE_OVERFLOW)
+};
+/**
+ *  calc_strtonum
+ *
+ *  Parses a number into the numeric type of the calculator (picked by the 2nd argument).
+ *  long double keeps strtod so Calc parses exactly like it always did, but for integers:
+ *  strtold() has them exact up to 2^64 (isprime(1000000000000000003)).
+ */
+inline float calc_strtonum(const char *s, float) { return strtof(s, NULL); }
+inline double calc_strtonum(const char *s, double) { return strtod(s, NULL); }
+inline long double calc_strtonum(const char *s, long double) {
+    const char *d = (*s == '-' ? s + 1 : s);
+    size_t n = strspn(d, "0123456789");
+    return (n > 0 && d[n] == '\0' ? strtold(s, NULL) : strtod(s, NULL));
+}
+/**
+ *  CalcLimits
+ *
+ *  What a formula may cost before it's rejected, so one formula can't stall the thread
+ *  evaluating it. Everything is checked while it's parsed (and the steps while Calc
+ *  evaluates), each one fails with its own Error (CE_LIM_*). 0 is no limit.
+ *  The size is worked out before a var is put in its place, so a vars bomb like
+ *  'v0=x+x+x+x,v1=v0+v0+v0+v0,...,v9=v8+v8+v8+v8,x=1;v9' fails in milliseconds.
+ */
+struct CalcLimits {
+    size_t length;                  /* Characters of the formula (CE_LIM_LENGTH) */
+    size_t size;                    /* Characters once the 'a=1,b=2;' vars are expanded (CE_LIM_SIZE) */
+    size_t depth;                   /* Nested parentheses and sub formulas calculate() recurses into (CE_LIM_DEPTH) */
+    size_t nodes;                   /* Numbers, names and operators (CE_LIM_NODES) */
+    size_t steps;                   /* Sub formulas Calc evaluates, every calculate() (CE_LIM_STEPS) */
 
-        CE_EPIC             =   100
-    };
+    CalcLimits() : length(CALC_LIMIT_LENGTH), size(CALC_LIMIT_SIZE), depth(CALC_LIMIT_DEPTH),
+                   nodes(CALC_LIMIT_NODES), steps(CALC_LIMIT_STEPS) { }
+};
 /**
- * Calc Class
+ * BasicCalc Class (Calc)
  *
  *  This Class is a Calculator that evaluates an Input Formula
  *  and returns a result in various forms (string, char * or long double)
@@ -155,8 +190,17 @@ enum FunkiiCalcErrors_t {
  *
  *  Output:
  *      300 seconds is 5mins
+ *
+ *  T is the numeric type everything is calculated in, the math functions are the
+ *  <cmath> overloads of T (picked at compile time): Calc is BasicCalc<long double>,
+ *  BasicCalc<double> and BasicCalc<float> skip the x87 and run on SSE/AVX.
  */
-class Calc {
+template <typename T>
+class BasicCalc {
+    friend class CalcProgram;
+    friend class CalcGrad;
+    friend class CalcStream;
+    friend class CalcEdit;
 public:
     /**
      *  Calc Constructor
@@ -164,7 +208,7 @@ public:
      *  Will call Calc::assign with "0" as a formula
      *
      */
-    Calc();
+    BasicCalc();
     /**
      *  Calc Constructor
      *
@@ -172,7 +216,7 @@ public:
      *
      * @param   string     string containing the raw formula.
      */
-    Calc(string);
+    BasicCalc(string);
     /**
      *  Calc Constructor
      *
@@ -180,7 +224,7 @@ public:
      *
      * @param   int
      */
-    Calc(int);
+    BasicCalc(int);
     /**
      *  Calc Constructor
      *
@@ -188,7 +232,7 @@ public:
      *
      * @param   float
      */
-    Calc(float);
+    BasicCalc(float);
     /**
      *  Calc Constructor
      *
@@ -196,7 +240,7 @@ public:
      *
      * @param   double
      */
-    Calc(double);
+    BasicCalc(double);
     /**
      *  Calc Constructor
      *
@@ -204,11 +248,11 @@ public:
      *
      * @param   long double
      */
-    Calc(long double);
+    BasicCalc(long double);
     /**
-     * ~Calc Destructor
+     * ~BasicCalc Destructor
      */
-    ~Calc();
+    ~BasicCalc();
     /**
      *  assign
      *
@@ -269,6 +313,9 @@ public:
     /**
      * result_c_str
      *
+     *  The pointer is owned by the Calc instance and stays valid until the next
+     *  assign() or result_c_str()/result_s() call with different options.
+     *
      * @return  (char *)        NULL terminated string containing Result of Formula or Error message.
      */
     char *result_c_str();
@@ -280,12 +327,35 @@ public:
      * @return  (char *)        NULL terminated string containing Result of Formula or Error message.
      */
     char *result_c_str(enum FunkiiCalcOptions_t);
+    /**
+     *  format_to
+     *
+     *  Writes the result with default options into a caller owned buffer (no allocations).
+     *
+     * @param   buf             Output buffer (may be NULL if cap is 0).
+     * @param   cap             Size of buf in bytes, including the NULL terminator.
+     *
+     * @return  size_t          Length of the full result (like snprintf), if >= cap the output was truncated.
+     */
+    size_t format_to(char *, size_t);
+    /**
+     *  format_to overload function
+     *
+     *  Writes the result with specified options into a caller owned buffer (no allocations).
+     *
+     * @param   buf             Output buffer (may be NULL if cap is 0).
+     * @param   cap             Size of buf in bytes, including the NULL terminator.
+     * @param   enum FunkiiCalcOptions_t
+     *
+     * @return  size_t          Length of the full result (like snprintf), if >= cap the output was truncated.
+     */
+    size_t format_to(char *, size_t, enum FunkiiCalcOptions_t);
     /**
      * result_d
      *
      * @return  (long double)   Result of Formula as a Number (check with calc_error() to see if there was an error).
      */
-    long double result_d();
+    T result_d();
     /**
      * calc_error
      *
@@ -303,6 +373,23 @@ public:
      * @return  string  the error message
      */
     string get_error();
+    /**
+     * get_error_code
+     *
+     *  Returns the error number (CE_NADA if there was no error)
+     *
+     * @return  enum FunkiiCalcErrors_t
+     */
+    enum FunkiiCalcErrors_t get_error_code();
+    /**
+     * get_error_c_str
+     *
+     *  Returns the static message of an error number (no allocations)
+     *
+     *  @param   enum FunkiiCalcErrors_t
+     *  @result (const char *)  "" for CE_NADA
+     */
+    static const char *get_error_c_str(enum FunkiiCalcErrors_t);
     /**
      * fibonacci
      *
@@ -338,19 +425,126 @@ public:
      *
      * @return  string      Specified Format or Error string.
      */
-    string duration(int);
+    string duration(int = 0);
+    /**
+     * error_mode
+     *
+     *  How the math errors are detected from the next assign() on: errno after every
+     *  function, or the FP exception flags once per formula (cheaper, and it also catches
+     *  the functions that only raise a flag). The results are the same, except that
+     *  with calc_err_fenv a pole (i.e: ln(0)) is CE_DIV0 instead of CE_ERANGE.
+     *  calc_err_fenv is the only one that still works when built with -fno-math-errno.
+     *
+     * @param   enum FunkiiCalcErrorModes_t
+     */
+    void error_mode(enum FunkiiCalcErrorModes_t);
+    /**
+     * limits
+     *
+     *  Limits of the formulas from the next assign() on (CalcLimits() by default).
+     *
+     * @param   lim             The limits.
+     */
+    void limits(const CalcLimits &);
+    /**
+     * fenv_clear
+     *
+     *  Clears the FP exception flags tested by fenv_error().
+     */
+    static void fenv_clear();
+    /**
+     * fenv_error
+     *
+     *  Maps the FP exception flags raised since fenv_clear() to an Error:
+     *  FE_INVALID is CE_EDOM, FE_DIVBYZERO is CE_DIV0 and FE_OVERFLOW is CE_ERANGE.
+     *
+     * @return  enum FunkiiCalcErrors_t     CE_NADA if none was raised.
+     */
+    static enum FunkiiCalcErrors_t fenv_error();
+    /**
+     * bind
+     *
+     *  Binds an array to a name for the aggregate functions (sum, avg, min, max, stddev,
+     *  dot, gcd...), from the next assign() on: 'sum(prices)' is the sum of every value bound
+     *  to prices, 'max(prices, 100)' adds 100 to the list. Binding 0 values removes it.
+     *
+     *  Usage Example:
+     *      long double w[3] = { 1, 2, 3 };
+     *      Calc calculator;
+     *      calculator.bind("w", w, 3);
+     *      calculator.assign("dot(w, 4, 5, 6) / sum(w)");
+     *
+     * @param   name        Array name (not case sensitive).
+     * @param   values      The values (copied).
+     * @param   n           Number of values.
+     */
+    void bind(string, const T *, size_t);
+    /**
+     * table
+     *
+     *  Registers a table for the table functions, from the next assign() on:
+     *  'lookup(rates, x)', 'interp(rates, x)' and 'step(rates, x)' (see CalcTable).
+     *  The table isn't copied, it has to outlive this Calc (or be removed first).
+     *
+     *  Usage Example:
+     *      CalcTable rates;
+     *      rates.load("rates.txt");
+     *      Calc calculator;
+     *      calculator.table("rates", &rates);
+     *      calculator.assign("100 * interp(rates, 7.5)");
+     *
+     * @param   name        Table name (not case sensitive).
+     * @param   table       The table, NULL removes it.
+     */
+    void table(string, const CalcTable *);
 private:
     enum FunkiiCalcErrors_t mError; /* Error String. */
-    long double mResult;            /* Result of the Formula. */
+    enum FunkiiCalcErrorModes_t mErrMode;   /* How math errors are detected. */
+    CalcLimits mLimits;             /* What a formula may cost. */
+    size_t mSteps;                  /* calculate() calls of the formula being evaluated. */
+    size_t mDepth;                  /* calculate() calls in progress (nested). */
+    T mResult;                      /* Result of the Formula. */
     string mFormula;                /* Sanity Checked Formula. */
             /* Comparison Global Vars */
     bool mIsCompare;                /* Flag to determine if it's a comparison Formula i.e: 3 > 2 */
     bool mCompare[1000];            /* List of Comparison Results */
     vector<string> mList;           /* List of Comparison Formulas */
-    string mOutput;                 /* Comparison Output Message. */
     string mCompOutputRes;          /* Comparison Result. */
-    long double mCompRes[1000];     /* List of each Option for comparison Results */
+    T mCompRes[1000];               /* List of each Option for comparison Results */
+    int mCompType[1000];            /* List of Comparison operators (see checkandcompare) */
+    int mCompCount;                 /* Number of Comparison operators */
+            /* Output Cache */
+    string mCache;                  /* Last formatted result (returned by result_s/result_c_str). */
+    int mCacheOpts;                 /* Options mCache was formatted with. */
+    bool mCacheValid;               /* false after assign(), mCache has to be rebuilt. */
+    map<string, vector<T> > mArrays;    /* Arrays bound with bind(). */
+    map<string, const CalcTable *> mTables; /* Tables registered with table(). */
+            /* Sub-expression Memo (CalcEdit) */
+    struct Memo {
+        T value;                    /* What calculate() returned */
+        enum FunkiiCalcErrors_t err;    /* Last Error it set, CE_NADA if none */
+        int err_no;                 /* errno it left */
+        size_t steps;               /* calculate() calls it took */
+        uint64_t gen;               /* Last evaluation that used it */
+    };
+    map<string, Memo> *mMemo;       /* calculate() results by formula, level, function and errno, NULL if off. */
+    uint64_t mMemoGen;              /* Bumped by every evaluation that uses mMemo. */
+    size_t mMemoUsed;               /* Entries used by the evaluation mMemoGen. */
+    /**
+     * Lex
+     *
+     *  Where clean() is between two chars of a raw formula.
+     */
+    struct Lex {
+        int type;                   /* Number literal being read: 0=dec ; 1=bin ; 2=oct ; 3=hex */
+        int p;                      /* Open parentheses */
+        vector<int> calls;          /* For each open parenthesis: 0 not a call, 1 a call, 2 an aggregate or table call, 3 if() */
+        Lex() : type(0), p(0) { }
+        bool operator==(const Lex &o) const { return (type == o.type && p == o.p && calls == o.calls); }
+    };
     static const char *func_array[];
+    static const char *agg_array[];
+    static const char *tab_array[];
 
     /**
      * calcthis
@@ -362,6 +556,19 @@ private:
      * @param   formula         string containing the raw formula.
      */
     void calcthis(string);
+    /**
+     * reset
+     *
+     *  Forgets the last formula, its result and its Error (the start of calcthis()).
+     */
+    void reset();
+    /**
+     * evaluate
+     *
+     *  Evaluates mFormula (sanity checked by syntax()) into mResult: the logic, the aggregates,
+     *  then a comparison or a plain calculation. Sets mError on Error.
+     */
+    void evaluate();
     /**
      * calcthis
      *
@@ -371,6 +578,31 @@ private:
      *  @result string
      */
     string get_error_string(enum FunkiiCalcErrors_t);
+    /**
+     * append_c_str
+     *
+     *  Appends n chars of s to buf, never writing past cap - 1. len is always advanced by n.
+     *
+     * @param   buf         Output buffer.
+     * @param   cap         Size of buf.
+     * @param   len         Current length of the output.
+     * @param   s           chars to append.
+     * @param   n           Number of chars in s.
+     */
+    static void append_c_str(char *, size_t, size_t &, const char *, size_t);
+    /**
+     * append_number
+     *
+     *  Appends a number printed with 15 digits of precision to buf, comma separated
+     *  the same way as Calc::format() unless noformat is set.
+     *
+     * @param   buf         Output buffer.
+     * @param   cap         Size of buf.
+     * @param   len         Current length of the output.
+     * @param   num         Number to print.
+     * @param   noformat    Do not comma separate.
+     */
+    static void append_number(char *, size_t, size_t &, long double, bool);
     /**
      * parse_vars
      *
@@ -383,6 +615,18 @@ private:
      *  @return  string     Formula with variables replaced
      */
     string parse_vars(int, string);
+    /**
+     * find_name
+     *
+     *  Finds a variable name as a whole word (the 'a' of 'a+max(a,2)' but not of max).
+     *
+     * @param   formula     string to search.
+     * @param   name        The name.
+     * @param   from        Where to start looking.
+     *
+     * @return  size_t      Where it starts, string::npos if it isn't there.
+     */
+    static size_t find_name(const string &, const string &, size_t);
     /**
      * syntax
      *
@@ -395,6 +639,48 @@ private:
      * @return  true        Valid Formula! (also sets mFormula).
      */
     bool syntax(string);
+    /**
+     * syntax overload function
+     *
+     *  With args set, commas inside the parentheses of a call i.e: max(a,b) are kept
+     *  as argument separators (everywhere else they are thousand separators and dropped).
+     *
+     * @param   formula     string, containing the raw formula.
+     * @param   args        keep the argument separators.
+     *
+     * @return  false       Some kind of  Error. Not a Valid Formula.
+     * @return  true        Valid Formula! (also sets mFormula).
+     */
+    bool syntax(string, bool);
+    /**
+     * clean
+     *
+     *  The first half of syntax(): lowercases the raw chars from..to, drops the spaces and the
+     *  invalid ones and opens the \b \o \x literals, appending them to out. Can be called
+     *  again from where it stopped with the same Lex (CalcEdit re-lexes only what changed).
+     *
+     * @param   raw         The raw formula.
+     * @param   from        First char.
+     * @param   to          Stops before this char (a literal's escape may read one past it).
+     * @param   out         Sanity checked chars so far.
+     * @param   lex         Where it is, updated.
+     * @param   args        keep the argument separators (see syntax()).
+     *
+     * @return  size_t      Next char to clean, string::npos on Error (sets mError).
+     */
+    size_t clean(const string &, size_t, size_t, string &, Lex &, bool);
+    /**
+     * check
+     *
+     *  The second half of syntax(): checks the cleaned formula as a whole.
+     *
+     * @param   formula     Output of clean() (literal closed).
+     * @param   p           Parentheses left open.
+     *
+     * @return  false       Some kind of  Error. Not a Valid Formula.
+     * @return  true        Valid Formula! (also sets mFormula).
+     */
+    bool check(const string &, int);
     /**
      * format
      *
@@ -441,6 +727,89 @@ private:
      * @return  0               Not a Function.
      */
     int isFunc(string);
+    /**
+     * isAgg
+     *
+     *  Checks if input string is one of the aggregate functions (agg_array).
+     *
+     * @param   in              string to be compared
+     *
+     * @return  (int) > 0       Number of the aggregate (1 based).
+     * @return  0               Not an aggregate.
+     */
+    int isAgg(string);
+    /**
+     * isTab
+     *
+     *  Checks if input string is one of the table functions (tab_array).
+     *
+     * @param   in              string to be compared
+     *
+     * @return  (int) > 0       FunkiiCalcTableFuncs_t of the function.
+     * @return  0               Not a table function.
+     */
+    int isTab(string);
+    /**
+     * aggregates
+     *
+     *  Evaluates every aggregate and table function call of a sanity checked formula,
+     *  innermost first, and puts its result in the formula in its place (the same way
+     *  parse_vars() does). Sets mError on error.
+     *
+     * @param   formula     Sanity checked formula.
+     *
+     * @return  string      Formula without aggregate or table function calls.
+     */
+    string aggregates(string);
+    /**
+     * logic
+     *
+     *  Evaluates the logic of a sanity checked formula and puts the results in its place
+     *  (the same way aggregates() does): a || b and a && b (from the left, only the
+     *  operands needed), !a, if(cond, a, b) (only the branch taken) and the parentheses
+     *  that hold comparisons, so they can be used inside arithmetic: '(x > 2) * 10'.
+     *  Sets mError on error.
+     *
+     *  i.e:
+     *      'if(x > 0, ln(x), 0) + 1'      ->  '(1.09861228866810969)+1'      (x is 3)
+     *
+     * @param   formula     Sanity checked formula.
+     *
+     * @return  string      Formula with nothing but arithmetic and comparisons outside parentheses.
+     */
+    string logic(string);
+    /**
+     * value
+     *
+     *  Evaluates a piece of a formula on its own: logic(), aggregates() and then a
+     *  comparison chain (1 or 0) or calculate().
+     *
+     * @param   formula     Sanity checked piece of a formula.
+     *
+     * @return  (long double)   The value, 0 on Error (mError is set).
+     */
+    T value(string);
+    /**
+     * closing
+     *
+     * @param   formula     Formula.
+     * @param   open        Position of an opening parenthesis.
+     *
+     * @return  size_t      Position of its closing parenthesis, string::npos if there isn't one.
+     */
+    static size_t closing(const string &, size_t);
+    /**
+     * logic_in
+     *
+     * @return  true        The formula has comparisons, &&, ||, ! or if() (not counting bitshifts).
+     */
+    static bool logic_in(const string &);
+    /**
+     * paren
+     *
+     * @return  string      A value as it's put back in a formula: '(value)', with every digit of T.
+     */
+    static string paren(T);
     /**
      * fib
      *
@@ -450,7 +819,7 @@ private:
      *
      * @return  (long double)   Fibonacci of n.
      */
-    long double fib(long double);
+    T fib(T);
     /**
      * calculate
      *
@@ -463,7 +832,13 @@ private:
      *
      * @return  (long double)   Always returns a number.
      */
-    long double calculate(string, int, int);
+    T calculate(string, int, int);
+    /**
+     * compute
+     *
+     *  What calculate() does, without looking in mMemo first (its sub-expressions still do).
+     */
+    T compute(string, int, int);
     /**
      * bin2dec
      *
@@ -473,7 +848,7 @@ private:
      *
      * @return  (long double)   input converted into a decimal.
      */
-    long double bin2dec(string);
+    T bin2dec(string);
     /**
      * oct2dec
      *
@@ -483,7 +858,7 @@ private:
      *
      * @return  (long double)   input converted into a decimal.
      */
-    long double oct2dec(string);
+    T oct2dec(string);
     /**
      * hex2dec
      *
@@ -493,60 +868,218 @@ private:
      *
      * @return  (long double)   input converted into a decimal.
      */
-    long double hex2dec(string);
+    T hex2dec(string);
     /**
      * factorial
      *
      *      Calculates Factorial of number
      *
      * @param   long double
+     * @param   err             set to CE_FACT_OB if the number is not a positive integer.
      *
      * @return  long double
      */
-    long double factorial(long double);
+    static T factorial(T, enum FunkiiCalcErrors_t &);
+    /**
+     * to_uint
+     *
+     *      The exact 64 bit integer of a value, for the integer functions.
+     *
+     * @param   v               The value.
+     * @param   u               set to v (|v| if negatives are fine).
+     * @param   neg             Take |v| of negatives instead of failing.
+     *
+     * @return  true            v is an integer up to 2^64-1.
+     */
+    static bool to_uint(T, uint64_t &, bool);
+    /**
+     * gcd
+     *
+     *      Binary GCD (Stein's): the common powers of 2 come off with one count of the
+     *      trailing zeros, then it's only shifts and subtractions, no divisions.
+     */
+    static uint64_t gcd(uint64_t, uint64_t);
+    /**
+     * mulmod
+     *
+     *      a * b % m without overflowing (128 bit product where the compiler has one).
+     */
+    static uint64_t mulmod(uint64_t, uint64_t, uint64_t);
+    /**
+     * powmod
+     *
+     *      x^y % m by square and multiply, log2(y) steps exact at any size.
+     */
+    static uint64_t powmod(uint64_t, uint64_t, uint64_t);
+    /**
+     * isprime
+     *
+     *      Deterministic Miller-Rabin: the first 12 primes as bases are enough for every
+     *      64 bit number (trial division of the small ones first).
+     */
+    static bool isprime(uint64_t);
+    /**
+     * popcount / clz
+     *
+     *      Bits set and leading zero bits (64 for 0) of a 64 bit integer, the CPU
+     *      instruction where the compiler has a builtin for it.
+     */
+    static int popcount(uint64_t);
+    static int clz(uint64_t);
+    /**
+     * apply_oper
+     *
+     *  Applies a binary operator (+ - * / % ^ and the bitshifts '<' '>') to res and tmp.
+     *  Shared by calculate() and the compiled programs (CalcProgram).
+     *
+     * @param   oper            Operator char.
+     * @param   res             Left hand side.
+     * @param   tmp             Right hand side.
+     * @param   err             set on Error (CE_DIV0, CE_INT_BITSHIFT).
+     *
+     * @return  (long double)   Result of the operation.
+     */
+    static T apply_oper(char, T, T, enum FunkiiCalcErrors_t &);
+    /**
+     * apply_func
+     *
+     *  Applies function number oper_func (see func_array, 1 based) to res and checks errno.
+     *  Shared by calculate() and the compiled programs (CalcProgram).
+     *
+     * @param   oper_func       Function number.
+     * @param   res             Argument.
+     * @param   err             set on Error (CE_EDOM, CE_ERANGE, CE_FACT_OB...).
+     *
+     * @return  (long double)   Result of the function, 0 on Error.
+     */
+    static T apply_func(int, T, enum FunkiiCalcErrors_t &);
+    /**
+     * eval_func
+     *
+     *  apply_func() without the errno check, for the calc_err_fenv mode.
+     *
+     * @param   oper_func       Function number.
+     * @param   res             Argument.
+     * @param   err             set on Error (CE_FACT_OB, CE_BIN...), math errors only raise FP flags.
+     *
+     * @return  (long double)   Result of the function.
+     */
+    static T eval_func(int, T, enum FunkiiCalcErrors_t &);
+    /**
+     * apply_aggregate
+     *
+     *  Applies aggregate number agg (see agg_array, 1 based) to a list of values.
+     *  Shared by calculate() and the compiled programs (CalcProgram).
+     *      sum, avg    pairwise summation (error grows with log(n), not n)
+     *      min, max
+     *      stddev      population standard deviation, two passes (mean, then deviations)
+     *      dot         the first half of the list times the second half
+     *      gcd, lcm    of the magnitudes, integers up to 2^64-1 (lcm past that is CE_ERANGE)
+     *      powmod      powmod(x, y, m) is x^y % m, exact where 'x^y % m' rounds once x^y
+     *                  passes 2^64 (x may be negative, the result is in 0..m-1)
+     *
+     * @param   agg             Aggregate number.
+     * @param   v               The values.
+     * @param   n               Number of values.
+     * @param   err             set to CE_REG_ARGS on an empty list (an odd one for dot, not 3
+     *                          values for powmod), CE_INT_ARG on a non integer.
+     *
+     * @return  (long double)   Result, 0 on Error.
+     */
+    static T apply_aggregate(int, const T *, size_t, enum FunkiiCalcErrors_t &);
+    /**
+     * pairwise
+     *
+     *  Pairwise sum of n terms, K picks the term: 0 a[i], 1 (a[i] - m)^2, 2 a[i] * b[i].
+     *  Up to 128 terms go into 8 independent partial sums (the compiler keeps them in
+     *  SIMD registers without changing the result), longer runs are split in halves.
+     */
+    template <int K>
+    static T pairwise(const T *, const T *, size_t, T);
 };
-const char *Calc::func_array[] = {  "sqrt", "floor","ceil", "sin",  "cos",
+/* The original calculator, every Calc:: still works on long double */
+typedef BasicCalc<long double> Calc;
+
+template <typename T>
+const char *BasicCalc<T>::func_array[] = {  "sqrt", "floor","ceil", "sin",  "cos",
                                     "tan",  "asin", "acos", "atan", "sinh",
                                     "cosh", "tanh", "ln",   "log",  "abs",
                                     "fabs", "bin",  "oct",  "hex",  "round",
-                                    "fact"
+                                    "fact", "isprime", "popcount", "clz"
+                                };
+template <typename T>
+const char *BasicCalc<T>::agg_array[] = {   "sum",  "avg",  "min",  "max",  "stddev",
+                                    "dot",  "gcd",  "lcm",  "powmod"
                                 };
-Calc::Calc() { assign("0"); }
-Calc::Calc(string formula) { assign(formula); }
-Calc::Calc(int number) { assign(number); }
-Calc::Calc(float number) { assign(number); }
-Calc::Calc(double number) { assign(number); }
-Calc::Calc(long double number) { assign(number); }
-Calc::~Calc() { /* NOTHING YET */ }
-void Calc::assign(string formula) { calcthis(formula); }
-void Calc::assign(int number) { stringstream ss; ss << number; calcthis(ss.str()); }
-void Calc::assign(float number) { stringstream ss; ss << number; calcthis(ss.str()); }
-void Calc::assign(double number) { stringstream ss; ss << setprecision(15) << number; calcthis(ss.str()); }
-void Calc::assign(long double number) { stringstream ss; ss << setprecision(15) << number; calcthis(ss.str()); }
-void Calc::calcthis(string formula) {
-    C_DBG_INIT;
+template <typename T>
+const char *BasicCalc<T>::tab_array[] = {   "lookup", "interp", "step"
+                                };
+template <typename T>
+BasicCalc<T>::BasicCalc() : mErrMode(calc_err_errno), mMemo(NULL), mMemoGen(0), mMemoUsed(0) { assign("0"); }
+template <typename T>
+BasicCalc<T>::BasicCalc(string formula) : mErrMode(calc_err_errno), mMemo(NULL), mMemoGen(0), mMemoUsed(0) { assign(formula); }
+template <typename T>
+BasicCalc<T>::BasicCalc(int number) : mErrMode(calc_err_errno), mMemo(NULL), mMemoGen(0), mMemoUsed(0) { assign(number); }
+template <typename T>
+BasicCalc<T>::BasicCalc(float number) : mErrMode(calc_err_errno), mMemo(NULL), mMemoGen(0), mMemoUsed(0) { assign(number); }
+template <typename T>
+BasicCalc<T>::BasicCalc(double number) : mErrMode(calc_err_errno), mMemo(NULL), mMemoGen(0), mMemoUsed(0) { assign(number); }
+template <typename T>
+BasicCalc<T>::BasicCalc(long double number) : mErrMode(calc_err_errno), mMemo(NULL), mMemoGen(0), mMemoUsed(0) { assign(number); }
+template <typename T>
+BasicCalc<T>::~BasicCalc() { /* NOTHING YET */ }
+template <typename T>
+void BasicCalc<T>::assign(string formula) { calcthis(formula); }
+template <typename T>
+void BasicCalc<T>::assign(int number) { stringstream ss; ss << number; calcthis(ss.str()); }
+template <typename T>
+void BasicCalc<T>::assign(float number) { stringstream ss; ss << number; calcthis(ss.str()); }
+template <typename T>
+void BasicCalc<T>::assign(double number) { stringstream ss; ss << setprecision(15) << number; calcthis(ss.str()); }
+template <typename T>
+void BasicCalc<T>::assign(long double number) { stringstream ss; ss << setprecision(15) << number; calcthis(ss.str()); }
+template <typename T>
+void BasicCalc<T>::calcthis(string formula) {
+    C_DBG_INIT(formula);
     C_DBG_START;
-    mError = CE_NADA; mFormula.clear(); mResult=0; mIsCompare=false; errno = 0;
+    reset();
     if ( syntax(formula) ) {
         C_DBG_MSG("oo, you returned '%s' ",mFormula.c_str());
-        int e = mFormula.find("="), g = mFormula.find_first_of(">"), l = mFormula.find_first_of("<");
-        bool check=true;
-        while (check && g>0) {
-            if (mFormula.at(g+1) == '>') { g = mFormula.find_first_of(">",(g+2)); }
-            else { check = false; }
-        }
-        check=true;
-        while (check && l>0) {
-            if (mFormula.at(l+1) == '<') { l = mFormula.find_first_of("<",(l+2)); }
-            else { check = false; }
-        }
-        if (e > 0 || g > 0 || l > 0) { checkandcompare(mFormula); }
-        else { mResult = calculate(mFormula,0,0); }
+        evaluate();
     }
     C_DBG_END;
-    C_DBG_FINISH;
+    C_DBG_FINISH(mError, mResult);
 }
-string Calc::parse_vars(int found, string formula) {
+template <typename T>
+void BasicCalc<T>::reset() {
+    mError = CE_NADA; mFormula.clear(); mResult=0; mIsCompare=false; mCompCount=0; mCacheValid=false; mSteps=0; mDepth=0; errno = 0;
+    if (mErrMode == calc_err_fenv) { fenv_clear(); }
+}
+template <typename T>
+void BasicCalc<T>::evaluate() {
+    string f = logic(mFormula);
+    if (mError == CE_NADA) { f = aggregates(f); }
+    int e = f.find("="), g = f.find_first_of(">"), l = f.find_first_of("<");
+    bool check=true;
+    while (check && g>0) {
+        if (f.at(g+1) == '>') { g = f.find_first_of(">",(g+2)); }
+        else { check = false; }
+    }
+    check=true;
+    while (check && l>0) {
+        if (f.at(l+1) == '<') { l = f.find_first_of("<",(l+2)); }
+        else { check = false; }
+    }
+    if (mError != CE_NADA) { mResult = 0; }
+    else if (e > 0 || g > 0 || l > 0) { checkandcompare(f); }
+    else { mResult = calculate(f,0,0); }
+    if (mErrMode == calc_err_fenv && mError == CE_NADA) {
+        mError = fenv_error();
+        if (mError != CE_NADA) { mResult = 0; }
+    }
+}
+template <typename T>
+string BasicCalc<T>::parse_vars(int found, string formula) {
     C_DBG_START;
     string tmp,tmp2;
     vector<string> _vars,_vals;
@@ -590,30 +1123,66 @@ string Calc::parse_vars(int found, string formula) {
     //now we replace the variables in the formula
     for (int i = 0, j = 0; i < (int)_vars.size() && j < 6; i++) {
         if (j == 0) { C_DBG_MSG("vars[%d]: '%s' == '%s'",i,_vals[i].c_str(),_vars[i].c_str()); }
-        int x = formula.find(_vals[i]);
-        if (j == 5 && x >=0) { mError = CE_SYN_VARS_INFLOOP; C_DBG_END; return formula; }
-        while (x >= 0) {
-            formula.replace(x, (int)(_vals[i].length()), _vars[i]);
+        size_t x = find_name(formula, _vals[i], 0), count = 0, y = 0;
+        if (j == 5 && x != string::npos) { mError = CE_SYN_VARS_INFLOOP; C_DBG_END; return formula; }
+        //count first, a var used 4 times by a var used 4 times by... is refused before it is built
+        for (y = x; y != string::npos; y = find_name(formula, _vals[i], y + _vals[i].length())) { count++; }
+        if (count > 0) {
+            size_t grow = (_vars[i].length() > _vals[i].length() ? _vars[i].length() - _vals[i].length() : 0);
+            if (mLimits.size > 0 && grow > (formula.length() < mLimits.size ? mLimits.size - formula.length() : 0) / count) { mError = CE_LIM_SIZE; C_DBG_END; return formula; }
+            //then all of them in one pass, nothing is scanned twice
+            string out;
+            out.reserve(formula.length() + count * grow);
+            for (y = 0; x != string::npos; x = find_name(formula, _vals[i], y)) {
+                out.append(formula, y, x - y);
+                out.append(_vars[i]);
+                y = x + _vals[i].length();
+            }
+            out.append(formula, y, string::npos);
+            formula.swap(out);
             C_DBG_MSG("\t\tReplaced :: '%s'",formula.c_str());
-            x = formula.find(_vals[i]);
         }
         if ((i + 1) == (int)_vars.size()) { j++; i=-1; }
     }
     C_DBG_END;
     return formula;
 }
-bool Calc::syntax(string formula) {
+template <typename T>
+size_t BasicCalc<T>::find_name(const string &formula, const string &name, size_t from) {
+    for (size_t x = formula.find(name, from); x != string::npos && !name.empty(); x = formula.find(name, x + 1)) {
+        char b = (x > 0 ? formula.at(x - 1) : ' '), a = (x + name.length() < formula.length() ? formula.at(x + name.length()) : ' ');
+        if (!isalnum((unsigned char)b) && b != '_' && !isalnum((unsigned char)a) && a != '_') { return x; }
+    }
+    return string::npos;
+}
+template <typename T>
+bool BasicCalc<T>::syntax(string formula) { return syntax(formula, false); }
+template <typename T>
+bool BasicCalc<T>::syntax(string formula, bool args) {
     C_DBG_START;
     mFormula.clear();
-    string tmp;
+    if (mLimits.length > 0 && formula.length() > mLimits.length) { mError = CE_LIM_LENGTH; C_DBG_END; return false; }
     int found = formula.find_last_of(';');
-    if (found > 0) { formula = parse_vars(found, formula); }
-    int p=0, type=0;    //Type 0=dec ; 1=bin ; 2=oct ; 3=hex;
-    bool yes_p=false;   //flag that tells me if the formula has parentheses
-    tmp.assign(formula); formula.clear();
-    C_DBG_MSG("\tBefore:: %s",tmp.c_str());
+    if (found > 0) {
+        formula = parse_vars(found, formula);
+        if (mError == CE_LIM_SIZE) { C_DBG_END; return false; }
+    }
+    Lex lex;
+    string clean_formula;
+    C_DBG_MSG("\tBefore:: %s",formula.c_str());
+    if (clean(formula, 0, formula.length(), clean_formula, lex, args) == string::npos) { C_DBG_END; return false; }
+    if (lex.type != 0) { clean_formula.push_back(')'); }
+    C_DBG_END;
+    return check(clean_formula, lex.p);
+}
+template <typename T>
+size_t BasicCalc<T>::clean(const string &tmp, size_t from, size_t to, string &formula, Lex &lex, bool args) {
+    C_DBG_START;
+    int &type = lex.type, &p = lex.p;   //Type 0=dec ; 1=bin ; 2=oct ; 3=hex;
+    vector<int> &calls = lex.calls;
+    int i;
     //Clean up the Formula: Make all Lowercase, Remove Spaces and make sure it's all valid chars.
-    for (int i = 0; i < (int)tmp.length(); i++) {
+    for (i = (int)from; i < (int)to; i++) {
         if ((int)tmp.at(i) == 32) { continue; /* IGNORE SPACES */ }
         else {
             if (type == 1) {
@@ -635,9 +1204,24 @@ bool Calc::syntax(string formula) {
                 else { formula.push_back(')'); type=0; i--; }
             }
             else {
-                if (tmp.at(i) == '(') { p++; }
-                else if (tmp.at(i) == ')') { p--; }
-                if ((int)tmp.at(i) != 37 &&                             //%
+                if (tmp.at(i) == '(') {
+                    p++;
+                    if (mLimits.depth > 0 && (size_t)p > mLimits.depth) { mError = CE_LIM_DEPTH; C_DBG_END; return string::npos; }
+                    size_t w = formula.length();
+                    while (w > 0 && formula.at(w - 1) >= 'a' && formula.at(w - 1) <= 'z') { w--; }
+                    if (w < formula.length() && (isAgg(formula.substr(w)) > 0 || isTab(formula.substr(w)) > 0)) { calls.push_back(2); }
+                    else if (w < formula.length() && formula.substr(w) == "if") { calls.push_back(3); }
+                    else {
+                        calls.push_back((!formula.empty() &&
+                                         ((formula.at(formula.length() - 1) >= 'a' && formula.at(formula.length() - 1) <= 'z') ||
+                                          (formula.at(formula.length() - 1) >= '0' && formula.at(formula.length() - 1) <= '9'))) ? 1 : 0);
+                    }
+                }
+                else if (tmp.at(i) == ')') { p--; if (!calls.empty()) { calls.pop_back(); } }
+                if ((int)tmp.at(i) != 33 &&                             //!
+                    (int)tmp.at(i) != 37 &&                             //%
+                    (int)tmp.at(i) != 38 &&                             //&
+                    (int)tmp.at(i) != 124 &&                            //|
                     !((int)tmp.at(i) >= 40 && (int)tmp.at(i) <= 43) &&  //(, ), *, +
                     !((int)tmp.at(i) >= 45 && (int)tmp.at(i) <= 57) &&  //-, ., /, 0-9
                     !((int)tmp.at(i) >= 65 && (int)tmp.at(i) <= 90) &&  //A-Z
@@ -652,9 +1236,13 @@ bool Calc::syntax(string formula) {
                             else {
                                 mError = CE_SYNTAX;
                                 C_DBG_END;
-                                return false;
+                                return string::npos;
                             }
                         }
+                        else if (tmp.at(i) == ',' && !calls.empty() && (calls.back() >= 2 || (args && calls.back() == 1))) {
+                            //the items of an aggregate (sum(1,2,3)), the arguments of if() or of a call
+                            formula.push_back(',');
+                        }
                         else { C_DBG_MSG("\t\tDO NOT WANT pos[%d]: %c",i,tmp.at(i)); }
                 }
                 else {
@@ -665,13 +1253,20 @@ bool Calc::syntax(string formula) {
             }
         }
     }
-    if (type != 0) { formula.push_back(')'); }
+    C_DBG_END;
+    return (size_t)i;
+}
+template <typename T>
+bool BasicCalc<T>::check(const string &formula, int p) {
+    C_DBG_START;
+    bool yes_p=false;   //flag that tells me if the formula has parentheses
     C_DBG_MSG("\tAfter :: %s",formula.c_str());
     C_DBG_MSG("if (p == 0) :: p: %d",p);
     if(p == 0 && !formula.empty()) {
         int c = formula.at(0);
         //check if the first char is not a valid char
-        if (c != 40 && c != 43 && c != 45 &&    //(, +, -
+        if (c != 33 &&                          //!
+            c != 40 && c != 43 && c != 45 &&    //(, +, -
             !(c >= 48 && c <= 57) &&            //0-9
             !(c >= 97 && c <= 122)              //a-z
             ) {
@@ -686,7 +1281,8 @@ bool Calc::syntax(string formula) {
             formula.at(c) == '*' || formula.at(c) == '/' ||
             formula.at(c) == '%' || formula.at(c) == '^' ||
             formula.at(c) == '>' || formula.at(c) == '<' ||
-            formula.at(c) == '=' || formula.at(c) == '(') {
+            formula.at(c) == '=' || formula.at(c) == '(' ||
+            formula.at(c) == '&' || formula.at(c) == '|' || formula.at(c) == '!') {
                 mError = CE_SYNTAX;
                 C_DBG_END;
                 return false;
@@ -707,6 +1303,20 @@ bool Calc::syntax(string formula) {
                 C_DBG_END;
                 return false;
             }
+            //&& and || between two operands, ! before one (and not after one, so no '5!' or '!=')
+            if (formula.at(i) == '&' || formula.at(i) == '|' || formula.at(i) == '!') {
+                size_t n = (formula.at(i) == '!' ? 1 : 2);
+                char prev = (i > 0 ? formula.at(i-1) : '('), next = ((i+n) < formula.length() ? formula.at(i+n) : '\0');
+                bool after = ((prev >= '0' && prev <= '9') || (prev >= 'a' && prev <= 'z') || prev == ')' || prev == '.');
+                if ((n == 2 && (formula.at(i+1) != formula.at(i) || !after)) || (n == 1 && after) ||
+                    !(next == '(' || next == '-' || next == '+' || next == '!' || (next >= '0' && next <= '9') || (next >= 'a' && next <= 'z'))) {
+                        mError = CE_SYNTAX;
+                        C_DBG_END;
+                        return false;
+                }
+                i += (int)n - 1;
+                continue;
+            }
             if (formula.at(i) == '+' || formula.at(i) == '-' ||
                 formula.at(i) == '*' || formula.at(i) == '/' ||
                 formula.at(i) == '%' || formula.at(i) == '^' ||
@@ -721,7 +1331,7 @@ bool Calc::syntax(string formula) {
                             i+=2; continue; //all is ok
                     }
                 }
-                if (formula.at(i+1) != '(' &&
+                if (formula.at(i+1) != '(' && formula.at(i+1) != '!' &&
                     !((int)formula.at(i+1) >= 48 && (int)formula.at(i+1) <= 57) &&
                     !((int)formula.at(i+1) >= 97 && (int)formula.at(i+1) <= 122)
                     ) {
@@ -767,6 +1377,20 @@ bool Calc::syntax(string formula) {
             }
         }
         //*/
+        if (mLimits.nodes > 0) {
+            //every operator and every number or name (a word after anything but a word)
+            size_t nodes = 0;
+            for (size_t i = 0; i < formula.length(); i++) {
+                char ch = formula.at(i);
+                bool word = ((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || ch == '.');
+                if (ch == '(' || ch == ')' || ch == ',') { continue; }
+                if (word && i > 0) {
+                    char pr = formula.at(i - 1);
+                    if ((pr >= '0' && pr <= '9') || (pr >= 'a' && pr <= 'z') || pr == '.') { continue; }
+                }
+                if (++nodes > mLimits.nodes) { mError = CE_LIM_NODES; C_DBG_END; return false; }
+            }
+        }
         //we've reached the end! this Formula seems valid :D
         C_DBG_MSG("Final Product!! :: '%s'",formula.c_str());
         mFormula = formula;
@@ -783,9 +1407,10 @@ bool Calc::syntax(string formula) {
     return false;
 }
 
-void Calc::checkandcompare(string formula) {
-    mIsCompare=true; mList.clear(); mOutput.clear(); mCompOutputRes.clear();
-    int last=0, found=formula.find_first_of("<>="), j=0, type[1000];
+template <typename T>
+void BasicCalc<T>::checkandcompare(string formula) {
+    mIsCompare=true; mList.clear(); mCompOutputRes.clear();
+    int last=0, found=formula.find_first_of("<>="), j=0, *type = mCompType;
     /*
         types:
             [0]  <   [1]  >   [2]  =   [3]  <>
@@ -822,52 +1447,17 @@ void Calc::checkandcompare(string formula) {
     mCompRes[j] = calculate(mList[j],0,0);
     for(int i=0; i < (int)mList.size(); i++) { C_DBG_MSG("\t\tFormula[%d]: %s",i,mList[i].c_str()); }
     for(int i=0; i < j; i++) {
-        stringstream ss;
-        if (i == 0) {
-            ss << setprecision(15) << mCompRes[i];
-            mOutput += format(ss.str());
-        }
         switch(type[i]) {
-            case 0: {
-                mOutput += " < ";
-                if (mCompRes[i] < mCompRes[i+1]) { mCompare[i]=true; }
-                else { mCompare[i]=false; }
-                    } break;
-            case 1: {
-                mOutput += " > ";
-                if (mCompRes[i] > mCompRes[i+1]) { mCompare[i]=true; }
-                else { mCompare[i]=false; }
-                    } break;
-            case 2: {
-                mOutput += " = ";
-                if (mCompRes[i] == mCompRes[i+1]) { mCompare[i]=true; }
-                else { mCompare[i]=false; }
-                    } break;
-            case 3: {
-                mOutput += " <> ";
-                if (mCompRes[i] != mCompRes[i+1]) { mCompare[i]=true; }
-                else { mCompare[i]=false; }
-                    } break;
-            case 4: {
-                mOutput += " <= ";
-                if (mCompRes[i] <= mCompRes[i+1]) { mCompare[i]=true; }
-                else { mCompare[i]=false; }
-                    } break;
-            case 5: {
-                mOutput += " >= ";
-                if (mCompRes[i] >= mCompRes[i+1]) { mCompare[i]=true; }
-                else { mCompare[i]=false; }
-                    } break;
-            case 6: {
-                mOutput += " == ";
-                if (mCompRes[i] == mCompRes[i+1]) { mCompare[i]=true; }
-                else { mCompare[i]=false; }
-                    } break;
+            case 0: { mCompare[i] = (mCompRes[i] < mCompRes[i+1]); } break;
+            case 1: { mCompare[i] = (mCompRes[i] > mCompRes[i+1]); } break;
+            case 2:
+            case 6: { mCompare[i] = (mCompRes[i] == mCompRes[i+1]); } break;
+            case 3: { mCompare[i] = (mCompRes[i] != mCompRes[i+1]); } break;
+            case 4: { mCompare[i] = (mCompRes[i] <= mCompRes[i+1]); } break;
+            case 5: { mCompare[i] = (mCompRes[i] >= mCompRes[i+1]); } break;
         }
-        ss.str(""); ss.clear();
-        ss << setprecision(15) << mCompRes[i + 1];
-        mOutput += format(ss.str());
     }
+    mCompCount = j;
     bool tmpcmp = mCompare[0];
     for(int i=1; i < j; i++) {
         if (!tmpcmp) { break; }
@@ -877,44 +1467,100 @@ void Calc::checkandcompare(string formula) {
     if (tmpcmp) { mResult = 1; }
     else { mResult = 0; }
 }
-string Calc::result_s() { enum FunkiiCalcOptions_t nada = calc_default; return result_s(nada); }
-string Calc::result_s(enum FunkiiCalcOptions_t Options) {
-    if ((mError != CE_NADA) && !(Options & calc_noerror)) { return get_error_string(mError); }
-    else {
-        string res;
-        if (mIsCompare) {
-            if (Options & calc_formula) { res = mOutput; }
-            if (!(Options & calc_noresult)) {
-                if (Options & calc_formula) { res += " :: "; }
-                if (Options & calc_numtruefalse) { res += (mResult == 1 ? "1" : "0"); }
-                else { res += (mResult == 1 ? "true" : "false"); }
+template <typename T>
+string BasicCalc<T>::result_s() { enum FunkiiCalcOptions_t nada = calc_default; return result_s(nada); }
+template <typename T>
+string BasicCalc<T>::result_s(enum FunkiiCalcOptions_t Options) {
+    if (!mCacheValid || mCacheOpts != (int)Options) {
+        size_t n = format_to(NULL, 0, Options);
+        mCache.resize(n + 1);
+        format_to(&mCache[0], n + 1, Options);
+        mCache.resize(n);
+        mCacheOpts = (int)Options; mCacheValid = true;
+    }
+    return mCache;
+}
+template <typename T>
+char *BasicCalc<T>::result_c_str() { enum FunkiiCalcOptions_t nada = calc_default; return result_c_str(nada); }
+template <typename T>
+char *BasicCalc<T>::result_c_str(enum FunkiiCalcOptions_t Options) { result_s(Options); return (char *)mCache.c_str(); }
+template <typename T>
+size_t BasicCalc<T>::format_to(char *buf, size_t cap) { enum FunkiiCalcOptions_t nada = calc_default; return format_to(buf, cap, nada); }
+template <typename T>
+size_t BasicCalc<T>::format_to(char *buf, size_t cap, enum FunkiiCalcOptions_t Options) {
+    size_t len = 0;
+    if ((mError != CE_NADA) && !(Options & calc_noerror)) {
+        const char *e = get_error_c_str(mError);
+        append_c_str(buf, cap, len, e, strlen(e));
+    }
+    else if (mIsCompare) {
+        if (Options & calc_formula) {
+            /* The comparison output is only built when it's requested */
+            const char *txt[] = { " < ", " > ", " = ", " <> ", " <= ", " >= ", " == " };
+            append_number(buf, cap, len, mCompRes[0], false);
+            for (int i = 0; i < mCompCount; i++) {
+                append_c_str(buf, cap, len, txt[mCompType[i]], strlen(txt[mCompType[i]]));
+                append_number(buf, cap, len, mCompRes[i + 1], false);
             }
         }
-        else {
-            stringstream ss;
-            ss << setprecision(15) << mResult;
-            if (Options & calc_formula) { res = mFormula; }
-            if (!(Options & calc_noresult)) {
-                if (Options & calc_formula) { res += " = "; }
-                if (Options & calc_noformat) { res += ss.str(); }
-                else { res += format(ss.str()); }
-            }
+        if (!(Options & calc_noresult)) {
+            if (Options & calc_formula) { append_c_str(buf, cap, len, " :: ", 4); }
+            if (Options & calc_numtruefalse) { append_c_str(buf, cap, len, (mResult == 1 ? "1" : "0"), 1); }
+            else if (mResult == 1) { append_c_str(buf, cap, len, "true", 4); }
+            else { append_c_str(buf, cap, len, "false", 5); }
         }
-        return res;
+    }
+    else {
+        if (Options & calc_formula) { append_c_str(buf, cap, len, mFormula.c_str(), mFormula.length()); }
+        if (!(Options & calc_noresult)) {
+            if (Options & calc_formula) { append_c_str(buf, cap, len, " = ", 3); }
+            append_number(buf, cap, len, mResult, (Options & calc_noformat) != 0);
+        }
+    }
+    if (cap > 0) { buf[(len < cap ? len : cap - 1)] = '\0'; }
+    return len;
+}
+template <typename T>
+void BasicCalc<T>::append_c_str(char *buf, size_t cap, size_t &len, const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++, len++) {
+        if ((len + 1) < cap) { buf[len] = s[i]; }
     }
 }
-char *Calc::result_c_str() { enum FunkiiCalcOptions_t nada = calc_default; return result_c_str(nada); }
-char *Calc::result_c_str(enum FunkiiCalcOptions_t Options) { return (char *)result_s(Options).c_str(); }
-long double Calc::result_d() {
+template <typename T>
+void BasicCalc<T>::append_number(char *buf, size_t cap, size_t &len, long double num, bool noformat) {
+    char in[64];
+    //15 digits, or less if T can't hold them (float)
+    int prec = (numeric_limits<T>::digits10 < 15 ? numeric_limits<T>::digits10 : 15);
+    int n = snprintf(in, sizeof(in), "%.*Lg", prec, num);
+    if (n < 0) { n = 0; }
+    else if (n >= (int)sizeof(in)) { n = (int)sizeof(in) - 1; }
+    if (noformat) { append_c_str(buf, cap, len, in, n); return; }
+    //same rules as Calc::format()
+    int epos = n, found = -1, lim = (in[0] == '-' ? 1 : 0);
+    for (int i = n - 1; i > 0; i--) { if (in[i] == 'e') { epos = i; break; } }
+    for (int i = epos - 1; i >= 0; i--) { if (in[i] == '.') { found = i; break; } }
+    if (found <= 0) { found = epos; }
+    for (int i = 0; i < n; i++) {
+        if (i > lim && i < found && ((found - i) % 3) == 0) { append_c_str(buf, cap, len, ",", 1); }
+        append_c_str(buf, cap, len, in + i, 1);
+    }
+}
+template <typename T>
+T BasicCalc<T>::result_d() {
     if (mError == CE_NADA) { return mResult; }
     else { return 0; }
 }
-bool Calc::error() {
+template <typename T>
+bool BasicCalc<T>::error() {
     if (mError == CE_NADA) { return false; }
     else { return true; }
 }
-string Calc::get_error() { return get_error_string(mError); }
-string Calc::fibonacci() {
+template <typename T>
+string BasicCalc<T>::get_error() { return get_error_string(mError); }
+template <typename T>
+enum FunkiiCalcErrors_t BasicCalc<T>::get_error_code() { return mError; }
+template <typename T>
+string BasicCalc<T>::fibonacci() {
     C_DBG_START;
     if (mError == CE_NADA) {
         if (mResult > 1475 || mResult < 0) { return get_error_string(CE_FIB_OB); }
@@ -927,29 +1573,32 @@ string Calc::fibonacci() {
     }
     else { C_DBG_END; return get_error_string(mError); }
 }
-string Calc::tocelsius() {
+template <typename T>
+string BasicCalc<T>::tocelsius() {
     C_DBG_START;
     if (mError == CE_NADA) {
         string conv("(("); conv += this->result_s(); conv += "-32)*(5/9))";
-        Calc x(conv); conv.clear();
+        BasicCalc x(conv); conv.clear();
         conv.assign(x.result_s()); conv += "°C";
         C_DBG_END;
         return conv;
     }
     else { C_DBG_END; return get_error_string(mError); }
 }
-string Calc::tofahrenheit() {
+template <typename T>
+string BasicCalc<T>::tofahrenheit() {
     C_DBG_START;
     if (mError == CE_NADA) {
         string conv("(("); conv += this->result_s(); conv += "*1.8)+32)";
-        Calc x(conv); conv.clear();
+        BasicCalc x(conv); conv.clear();
         conv.assign(x.result_s()); conv += "°F";
         C_DBG_END;
         return conv;
     }
     else { C_DBG_END; return get_error_string(mError); }
 }
-string Calc::duration(int type = 0) {
+template <typename T>
+string BasicCalc<T>::duration(int type) {
     C_DBG_START;
     if (mError == CE_NADA) {
         stringstream ss;
@@ -1000,7 +1649,8 @@ string Calc::duration(int type = 0) {
     }
     else { C_DBG_END; return get_error_string(mError); }
 }
-string Calc::format(string input) {
+template <typename T>
+string BasicCalc<T>::format(string input) {
     C_DBG_START;
     string in(input);
     string e;
@@ -1013,7 +1663,8 @@ string Calc::format(string input) {
     C_DBG_END;
     return in;
 }
-bool Calc::IsValidNum(string n) {
+template <typename T>
+bool BasicCalc<T>::IsValidNum(string n) {
     C_DBG_START;
     bool is_e = false;
     C_DBG_MSG("IsValidNum... in: %s",n.c_str());
@@ -1038,7 +1689,8 @@ bool Calc::IsValidNum(string n) {
     return true;
 }
 
-int Calc::isFunc(string in) {
+template <typename T>
+int BasicCalc<T>::isFunc(string in) {
     C_DBG_START;
     int num = (int)((sizeof(func_array)/sizeof(char *)) - 1), ret=0;
     while (num >= 0) {
@@ -1049,9 +1701,262 @@ int Calc::isFunc(string in) {
     C_DBG_END;
     return ret;
 }
-long double Calc::fib(long double n) {
+template <typename T>
+int BasicCalc<T>::isAgg(string in) {
+    int num = (int)((sizeof(agg_array)/sizeof(char *)) - 1);
+    while (num >= 0) {
+        if (in.compare(agg_array[num]) == 0) { return (num + 1); }
+        num--;
+    }
+    return 0;
+}
+template <typename T>
+int BasicCalc<T>::isTab(string in) {
+    int num = (int)((sizeof(tab_array)/sizeof(char *)) - 1);
+    while (num >= 0) {
+        if (in.compare(tab_array[num]) == 0) { return (num + 1); }
+        num--;
+    }
+    return 0;
+}
+template <typename T>
+string BasicCalc<T>::aggregates(string formula) {
+    C_DBG_START;
+    //from the last parenthesis backwards, so the aggregates inside the list of another one go first
+    size_t p = formula.length();
+    while (mError == CE_NADA && p > 0 && (p = formula.rfind('(', p - 1)) != string::npos) {
+        size_t w = p;
+        while (w > 0 && formula.at(w - 1) >= 'a' && formula.at(w - 1) <= 'z') { w--; }
+        if (w == p) { continue; }
+        int agg = isAgg(formula.substr(w, p - w)), tab = (agg == 0 ? isTab(formula.substr(w, p - w)) : 0);
+        if (agg == 0 && tab == 0) { continue; }
+        vector<T> items;
+        const CalcTable *table = NULL;
+        size_t from = p + 1, i;
+        int depth = 0;
+        for (i = p + 1; i < formula.length() && mError == CE_NADA; i++) {
+            char c = formula.at(i);
+            if (c == '(') { depth++; continue; }
+            if (c == ')' && depth > 0) { depth--; continue; }
+            if ((c != ',' && c != ')') || depth > 0) { continue; }
+            //one item: a bound array or a formula (the first one of a table function is the table)
+            string item = formula.substr(from, i - from);
+            typename map<string, vector<T> >::iterator it = mArrays.find(item);
+            if (tab > 0 && from == p + 1) {
+                map<string, const CalcTable *>::iterator t = mTables.find(item);
+                if (t != mTables.end()) { table = t->second; }
+                else { mError = (item.empty() ? CE_SYNTAX : CE_REG_UNDEF); }
+            }
+            else if (tab == 0 && it != mArrays.end()) { items.insert(items.end(), it->second.begin(), it->second.end()); }
+            else if (item.empty()) { mError = CE_SYNTAX; }
+            else { items.push_back(calculate(item,0,0)); }
+            from = i + 1;
+            if (c == ')') { break; }
+        }
+        if (mError != CE_NADA) { break; }
+        if (tab > 0 && items.size() != 1) { mError = CE_REG_ARGS; break; }
+        enum FunkiiCalcErrors_t e = CE_NADA;
+        T res = (tab > 0 ? table->apply(tab, items[0], e) : apply_aggregate(agg, (items.empty() ? NULL : &items[0]), items.size(), e));
+        if (e != CE_NADA) { mError = e; break; }
+        C_DBG_MSG("%s(%d items) = %s",(tab > 0 ? tab_array[tab - 1] : agg_array[agg - 1]),(int)items.size(),paren(res).c_str());
+        formula.replace(w, i + 1 - w, paren(res));
+        p = w;
+    }
+    C_DBG_END;
+    return formula;
+}
+template <typename T>
+string BasicCalc<T>::logic(string formula) {
     C_DBG_START;
-    long double fx = 3, f1 = 1, f2 = 1,tmp;
+    //a || b, then a && b: the lowest precedence, only the operands needed are evaluated
+    for (int pass = 0; pass < 2; pass++) {
+        char op = (pass == 0 ? '|' : '&');
+        vector<string> parts;
+        size_t from = 0;
+        int depth = 0;
+        for (size_t i = 0; (i + 1) < formula.length(); i++) {
+            char c = formula.at(i);
+            if (c == '(') { depth++; }
+            else if (c == ')') { depth--; }
+            else if (c == op && depth == 0 && formula.at(i + 1) == op) {
+                parts.push_back(formula.substr(from, i - from));
+                from = i + 2; i++;
+            }
+        }
+        if (parts.empty()) { continue; }
+        parts.push_back(formula.substr(from));
+        bool res = (op == '&');
+        for (size_t i = 0; i < parts.size() && res == (op == '&'); i++) {
+            res = (value(parts[i]) != 0);
+            if (mError != CE_NADA) { break; }
+        }
+        C_DBG_MSG("%d operands of %c%c = %d",(int)parts.size(),op,op,(int)res);
+        C_DBG_END;
+        return (res ? "(1)" : "(0)");
+    }
+    //!a, from the last one so !!a works
+    while (mError == CE_NADA) {
+        size_t bang = string::npos;
+        int depth = 0;
+        for (size_t i = 0; i < formula.length(); i++) {
+            if (formula.at(i) == '(') { depth++; }
+            else if (formula.at(i) == ')') { depth--; }
+            else if (formula.at(i) == '!' && depth == 0) { bang = i; }
+        }
+        if (bang == string::npos) { break; }
+        //its operand: a number, a name, a group or a function call, with its signs
+        size_t end = bang + 1;
+        while (end < formula.length() && (formula.at(end) == '-' || formula.at(end) == '+')) { end++; }
+        while (end < formula.length() && ((formula.at(end) >= '0' && formula.at(end) <= '9') || (formula.at(end) >= 'a' && formula.at(end) <= 'z') || formula.at(end) == '.')) {
+            end++;
+        }
+        if (end < formula.length() && formula.at(end) == '(') {
+            end = closing(formula, end);
+            if (end == string::npos) { mError = CE_SYN_PAR; break; }
+            end++;
+        }
+        T v = value(formula.substr(bang + 1, end - bang - 1));
+        if (mError != CE_NADA) { break; }
+        formula.replace(bang, end - bang, (v == 0 ? "(1)" : "(0)"));
+    }
+    //the groups: if() only evaluates the branch it takes, the others only if they have logic in them
+    for (size_t i = 0; i < formula.length() && mError == CE_NADA; i++) {
+        if (formula.at(i) != '(') { continue; }
+        size_t end = closing(formula, i), w = i;
+        if (end == string::npos) { mError = CE_SYN_PAR; break; }
+        while (w > 0 && formula.at(w - 1) >= 'a' && formula.at(w - 1) <= 'z') { w--; }
+        string name = formula.substr(w, i - w), inner = formula.substr(i + 1, end - i - 1);
+        vector<string> args;
+        if (name == "if" || isAgg(name) > 0 || isTab(name) > 0) {
+            size_t from = 0;
+            int depth = 0;
+            for (size_t j = 0; j <= inner.length(); j++) {
+                char c = (j < inner.length() ? inner.at(j) : ',');
+                if (c == '(') { depth++; }
+                else if (c == ')') { depth--; }
+                else if (c == ',' && depth == 0) { args.push_back(inner.substr(from, j - from)); from = j + 1; }
+            }
+        }
+        string res;
+        if (name == "if") {
+            if (args.size() != 3) { mError = CE_SYNTAX; break; }
+            T cond = value(args[0]);
+            T v = (mError == CE_NADA ? value(cond != 0 ? args[1] : args[2]) : 0);
+            if (mError != CE_NADA) { break; }
+            formula.replace(w, end + 1 - w, paren(v));
+            i = w + paren(v).length() - 1;
+            continue;
+        }
+        if (isAgg(name) > 0 || isTab(name) > 0) {
+            //every item on its own (sum(x > 1, y > 1) counts them)
+            for (size_t j = 0; j < args.size() && mError == CE_NADA; j++) {
+                if (logic_in(args[j])) { args[j] = paren(value(args[j])); }
+                res += (j > 0 ? "," : "") + args[j];
+            }
+            if (mError != CE_NADA) { break; }
+            res = "(" + res + ")";
+        }
+        else if (logic_in(inner)) {
+            T v = value(inner);
+            if (mError != CE_NADA) { break; }
+            res = paren(v);
+        }
+        else { i = end; continue; }
+        formula.replace(i, end + 1 - i, res);
+        i += res.length() - 1;
+    }
+    C_DBG_MSG("logic :: %s",formula.c_str());
+    C_DBG_END;
+    return formula;
+}
+template <typename T>
+bool BasicCalc<T>::logic_in(const string &formula) {
+    for (size_t i = 0; i < formula.length(); i++) {
+        char c = formula.at(i);
+        if (c == '&' || c == '|' || c == '!' || c == '=') { return true; }
+        if (c == '<' || c == '>') {
+            //but not a bitshift
+            if ((i + 1) < formula.length() && formula.at(i + 1) == c) { i++; continue; }
+            return true;
+        }
+        if (c == '(' && i >= 2 && formula.compare(i - 2, 2, "if") == 0 &&
+            (i == 2 || formula.at(i - 3) < 'a' || formula.at(i - 3) > 'z')) { return true; }
+    }
+    return false;
+}
+template <typename T>
+T BasicCalc<T>::value(string formula) {
+    string f = logic(formula);
+    if (mError == CE_NADA) { f = aggregates(f); }
+    if (mError != CE_NADA) { return 0; }
+    //a comparison chain is 1 if every comparison is true (like checkandcompare())
+    T l = 0;
+    int type = -1;      //same types as checkandcompare()
+    bool res = true;
+    size_t from = 0;
+    for (size_t i = 0; i <= f.length(); i++) {
+        int next = -1;
+        size_t n = 1;
+        if (i < f.length()) {
+            char c = f.at(i), c1 = ((i + 1) < f.length() ? f.at(i + 1) : '\0');
+            if ((c == '<' || c == '>') && c1 == c) { i++; continue; }
+            if (c == '<') { next = (c1 == '>' ? 3 : (c1 == '=' ? 4 : 0)); }
+            else if (c == '>') { next = (c1 == '=' ? 5 : 1); }
+            else if (c == '=') { next = (c1 == '=' ? 6 : 2); }
+            else { continue; }
+            if (next > 2) { n = 2; }
+        }
+        T r = calculate(f.substr(from, i - from),0,0);
+        if (mError != CE_NADA) { return 0; }
+        switch (type) {
+            case 0: res = res && (l < r); break;
+            case 1: res = res && (l > r); break;
+            case 2:
+            case 6: res = res && (l == r); break;
+            case 3: res = res && (l != r); break;
+            case 4: res = res && (l <= r); break;
+            case 5: res = res && (l >= r); break;
+        }
+        if (next < 0) { return (type < 0 ? r : (res ? 1 : 0)); }
+        l = r; type = next; from = i + n; i += n - 1;
+    }
+    return 0;
+}
+template <typename T>
+size_t BasicCalc<T>::closing(const string &formula, size_t open) {
+    int depth = 0;
+    for (size_t i = open; i < formula.length(); i++) {
+        if (formula.at(i) == '(') { depth++; }
+        else if (formula.at(i) == ')' && --depth == 0) { return i; }
+    }
+    return string::npos;
+}
+template <typename T>
+string BasicCalc<T>::paren(T value) {
+    stringstream ss;
+    ss << "(" << setprecision(numeric_limits<T>::digits10 + 3) << value << ")";
+    return ss.str();
+}
+template <typename T>
+void BasicCalc<T>::bind(string name, const T *values, size_t n) {
+    for (size_t i = 0; i < name.length(); i++) {
+        if (name.at(i) >= 'A' && name.at(i) <= 'Z') { name.at(i) = (char)(name.at(i) + 32); }
+    }
+    if (n == 0) { mArrays.erase(name); }
+    else { mArrays[name].assign(values, values + n); }
+}
+template <typename T>
+void BasicCalc<T>::table(string name, const CalcTable *table) {
+    for (size_t i = 0; i < name.length(); i++) {
+        if (name.at(i) >= 'A' && name.at(i) <= 'Z') { name.at(i) = (char)(name.at(i) + 32); }
+    }
+    if (table == NULL) { mTables.erase(name); }
+    else { mTables[name] = table; }
+}
+template <typename T>
+T BasicCalc<T>::fib(T n) {
+    C_DBG_START;
+    T fx = 3, f1 = 1, f2 = 1,tmp;
     bool neg = false;
     if (n < 0) { n *= -1; neg = true; }
     if (n < 1476) {
@@ -1070,30 +1975,66 @@ long double Calc::fib(long double n) {
     }
     else { C_DBG_END; return 0; }
 }
-long double Calc::calculate(string formula, int level = 0, int oper_func = 0) {
+template <typename T>
+T BasicCalc<T>::calculate(string formula, int level, int oper_func) {
+    if (mMemo == NULL || mErrMode == calc_err_fenv) { return compute(formula, level, oper_func); }
+    //the result only depends on the formula, the level, the function and errno (apply_func()
+    //sees what the ones before left), so a sub-expression that didn't change is looked up
+    string key(formula);
+    key.push_back('\0'); key.push_back((char)(level + 1)); key.push_back((char)(oper_func + 2)); key.push_back((char)errno);
+    typename map<string, Memo>::iterator it = mMemo->find(key);
+    if (it != mMemo->end() && (mLimits.steps == 0 || mSteps + it->second.steps <= mLimits.steps)) {
+        Memo &m = it->second;
+        if (m.gen != mMemoGen) { m.gen = mMemoGen; mMemoUsed++; }
+        mSteps += m.steps;
+        if (m.err != CE_NADA) { mError = m.err; }
+        errno = m.err_no;
+        return m.value;
+    }
+    enum FunkiiCalcErrors_t before = mError;
+    size_t steps = mSteps;
+    mError = CE_NADA;
+    T res = compute(formula, level, oper_func);
+    Memo m;
+    m.value = res; m.err = mError; m.err_no = errno; m.steps = mSteps - steps; m.gen = mMemoGen;
+    //but not the ones cut short by the step budget or the depth, that depends on what came before
+    if (mError != CE_LIM_STEPS && mError != CE_LIM_DEPTH) {
+        if (it == mMemo->end()) { mMemo->insert(make_pair(key, m)); }
+        else { it->second = m; }
+        mMemoUsed++;
+    }
+    if (mError == CE_NADA) { mError = before; }
+    return res;
+}
+template <typename T>
+T BasicCalc<T>::compute(string formula, int level, int oper_func) {
     C_DBG_START;
     bool skip = false;
-    long double res=0, tmp;
+    T res=0, tmp;
     C_DBG_MSG("Formula: '%s' :\tLevel: %d :\tOper: %d",formula.c_str(),level,oper_func);
+    if (mLimits.steps > 0 && ++mSteps > mLimits.steps) { mError = CE_LIM_STEPS; C_DBG_END; return 0; }
+    //not only parentheses nest: every operator of 2^1^1^1... is one calculate() deeper
+    if (mLimits.depth > 0 && mDepth > mLimits.depth) { mError = CE_LIM_DEPTH; C_DBG_END; return 0; }
+    mDepth++;
     if (IsValidNum(formula)) {
         C_DBG_MSG("IsValidNum");
         if(oper_func == 17) { res = bin2dec(formula); }
         else if(oper_func == 18) { res = oct2dec(formula); }
         else if(oper_func == 19) { res = hex2dec(formula); }
         else if(formula.compare("e") == 0) { C_DBG_MSG("return e"); res = EXP; }
-        else { res = strtod(formula.c_str(),NULL); }
+        else { res = calc_strtonum(formula.c_str(), res); }
         skip = true;
     }
     else if (level > 4) {
         skip = true;
         if (formula.compare("pi") == 0) { C_DBG_MSG("return PI"); res = PI; }
-        else { C_DBG_MSG("IsNothing"); res = strtod(formula.c_str(),NULL); }
+        else { C_DBG_MSG("IsNothing"); res = calc_strtonum(formula.c_str(), res); }
     }
     if (!skip) {
         vector<string> oper, operations;
         oper.resize(1000); operations.resize(1000);
         string s;
-        int oper_flags[1000], p = 0, o = 0, op = 0, is_f[1000];
+        int oper_flags[1000] = {0}, p = 0, o = 0, op = 0, is_f[1000] = {0};
         bool record, is_e = false, neg = false;
         oper_flags[0] = 0;
         is_f[0] = -1;
@@ -1153,7 +2094,13 @@ long double Calc::calculate(string formula, int level = 0, int oper_func = 0) {
 	                }
 	                else { s.push_back(c); }
 	            }
-	            else { s.push_back(c); }
+	            else {
+                    //no more room for operands at this level
+                    mError = CE_LIM_NODES;
+                    mDepth--;
+                    C_DBG_END;
+                    return 0;
+                }
             }
             if (record) {
                 if (s.empty()) { continue; }
@@ -1223,86 +2170,44 @@ long double Calc::calculate(string formula, int level = 0, int oper_func = 0) {
         }
         C_DBG_MSG("\t\tEND the FOR");
         res = calculate(operations[0], oper_flags[0], is_f[0]);
-        for (int i = 1,j = 0; i < o && j < op; i++,j++) {
+        for (int i = 1,j = 0; i < o && j < op && mError != CE_LIM_DEPTH; i++,j++) {
+            enum FunkiiCalcErrors_t e = CE_NADA;
             tmp = calculate(operations[i],oper_flags[i],is_f[i]);
-            switch (oper[j].at(0)) {
-                case '-': res -= tmp; break;
-                case '+': res += tmp; break;
-                case '*': res = res * tmp; break;
-                case '%':
-                case '/': {
-                            if (tmp == 0) { mError = CE_DIV0; res = -1; i=o; } //ERROR: can't divide by 0
-                            else {
-                                if (oper[j].at(0) == '%') { res = fmod(res,tmp); }
-                                else { res = res / tmp; }
-                            }
-                        } break;
-                case '^': res = powl(res,tmp); break;
-                case '>':
-                case '<': {
-                            if( (res - floor(res)) == 0 ) {
-                                if (oper[j].at(0) == '<') { res = (int)res << (int)tmp; }
-                                else { res = (int)res >> (int)tmp; }
-                            }
-                            else { mError = CE_INT_BITSHIFT; res = -1; i=o; }
-                        } break;
-            }
+            if (mError == CE_LIM_DEPTH) { break; }
+            res = apply_oper(oper[j].at(0), res, tmp, e);
+            if (e != CE_NADA) { mError = e; res = -1; i=o; }
         }
     }
+    mDepth--;
+    if (mError == CE_LIM_DEPTH) { C_DBG_END; return 0; }
     if (oper_func > 0) {
-        switch (oper_func) {
-            case 1: { res = sqrt(res); } break;
-            case 2: { res = floor(res); } break;
-            case 3: { res = ceil(res); } break;
-            case 4: { res = sin(res); } break;
-            case 5: { res = cos(res); } break;
-            case 6: { res = tan(res); } break;
-            case 7: { res = asin(res); } break;
-            case 8: { res = acos(res); } break;
-            case 9: { res = atan(res); } break;
-            case 10: { res = sinh(res); } break;
-            case 11: { res = cosh(res); } break;
-            case 12: { res = tanh(res); } break;
-            case 13: { res = log(res); } break;
-            case 14: { res = log10(res); } break;
-            case 15:
-            case 16: { res = fabs(res); } break;
-            case 20: {
-                    if( (res - floor(res)) >= 0.5 ) { res = ceil(res); }
-                    else { res = floor(res); }
-                     } break;
-            case 21: { res = factorial(res); }break;
-            default: break;
-        }
-        if (errno) {
-            switch(errno) {
-                case EDOM: mError = CE_EDOM; break;
-                case ERANGE: mError = CE_ERANGE; break;
-                default: mError = CE_EPIC;
-            }
-            res = 0;
-        }
+        enum FunkiiCalcErrors_t e = CE_NADA;
+        if (mErrMode == calc_err_fenv) { res = eval_func(oper_func, res, e); }
+        else { res = apply_func(oper_func, res, e); }
+        if (e != CE_NADA) { mError = e; }
     }
-    C_DBG_MSG("return %LG",res);
+    C_DBG_MSG("return %LG",(long double)res);
     C_DBG_END;
     return res;
 }
-long double Calc::bin2dec(string num) {
-    long double ret = 0;
+template <typename T>
+T BasicCalc<T>::bin2dec(string num) {
+    T ret = 0;
     for(int z = num.length() - 1; z >= 0; z--) {
         if (num.at(z) == '0') { continue; }
-        else if (num.at(z) == '1') { ret += powl((long double)2, (long double)((num.length() - 1) - z)); }
+        else if (num.at(z) == '1') { ret += pow((T)2, (T)((num.length() - 1) - z)); }
         else {
             mError = CE_BIN;
             ret = 0;
             break;
         }
     }
-    C_DBG_MSG("BIN to DEC :: '%s' :: '%LG'",num.c_str(),ret);
+    C_DBG_MSG("BIN to DEC :: '%s' :: '%LG'",num.c_str(),(long double)ret);
     return ret;
 }
-long double Calc::oct2dec(string num) {
-    long double ret = 0;
+template <typename T>
+T BasicCalc<T>::oct2dec(string num) {
+    T ret = 0;
     int oct;
     C_DBG_MSG("OCT to DEC :: %s",num.c_str());
     for(int z = num.length() - 1; z >= 0; z--) {
@@ -1318,12 +2223,13 @@ long double Calc::oct2dec(string num) {
             default: { mError = CE_OCT; ret = 0; oct = -1; }
         }
         if (oct == -1) { break; }
-        else { ret += oct * powl((long double)8,(long double)((num.length() - 1) - z)); }
+        else { ret += oct * pow((T)8,(T)((num.length() - 1) - z)); }
     }
     return ret;
 }
-long double Calc::hex2dec(string num) {
-    long double ret = 0;
+template <typename T>
+T BasicCalc<T>::hex2dec(string num) {
+    T ret = 0;
     int nhex;
     C_DBG_MSG("HEX to DEC :: %s",num.c_str());
     for( int z = num.length() - 1; z >= 0; z--) {
@@ -1347,42 +2253,331 @@ long double Calc::hex2dec(string num) {
             default: { mError = CE_HEX; ret = 0; nhex = -1; }
         }
         if (nhex == -1) { break; }
-        else { ret += nhex * powl((long double)16,(long double)((num.length() - 1) - z)); }
+        else { ret += nhex * pow((T)16,(T)((num.length() - 1) - z)); }
     }
     return ret;
 }
-long double Calc::factorial(long double num) {
-    long double ret=0;
-    if (num < 0) { mError = CE_FACT_OB; }
-    else if( (num - floor(num)) > 0 ) { mError = CE_FACT_OB; }
-    else { ret = 1; for (int i = 0; i <= num; i++) { ret*=i; } }
+template <typename T>
+T BasicCalc<T>::factorial(T num, enum FunkiiCalcErrors_t &err) {
+    T ret=0;
+    if (num < 0) { err = CE_FACT_OB; }
+    else if( (num - floor(num)) > 0 ) { err = CE_FACT_OB; }
+    else {
+        //past ~1754! (170! in double) it's Inf, no need to go on to num
+        ret = 1;
+        for (T i = 1; i <= num && ret <= numeric_limits<T>::max(); i++) { ret*=i; }
+    }
     return ret;
 }
-string Calc::get_error_string(enum FunkiiCalcErrors_t n) {
-    string e;
-    if (n != CE_NADA) {
-        e = "[CALC] Error: ";
-        switch((int)n) {
-            case CE_EMPTY:              e += "wut? no formula?"; break;
-            case CE_SYNTAX:             e += "Syntax Error!! l2syntax~!"; break;
-            case CE_SYNTAX_VARS:        e += "Syntax Error!! you suck at assigning Vars!"; break;
-            case CE_SYN_VARS_INFLOOP:   e += "Possible Infinite Loop While assigning Vars!"; break;
-            case CE_SYN_PAR:            e += "Parentheses Error!! you suck at punctuation!"; break;
-            case CE_SYN_EMPTY_PAR:      e += "Syntax Error!! l2fillparenthesis!"; break;
-            case CE_SYN_INVALIDCHAR:    e += "Syntax Error!! you suck chars!"; break;
-            case CE_DIV0:               e += "Yeah... i can't divide by 0.. :("; break;
-            case CE_EDOM:               e += "Domain Error... l2calc!!"; break;
-            case CE_ERANGE:             e += "Out of Range... damn you basterd l2stayinrange!!"; break;
-            case CE_FIB_OB:             e += "Out of Bounds, cannot Fibonacci!"; break;
-            case CE_BIN:                e += "Dude l2binary . . ."; break;
-            case CE_OCT:                e += "srsly man l2octal . . ."; break;
-            case CE_HEX:                e += "l2hex . . . *sigh* "; break;
-            case CE_FACT_OB:            e += "Can only factorial POSITIVE integers... "; break;
-            case CE_EPIC:               e += "oo noes Epic error... l2noterror!!"; break;
-            case CE_INT_BITSHIFT:       e += "Can only shift int! l2bitshift~!"; break;
-            default:                    e += "Epic Error!";
+template <typename T>
+bool BasicCalc<T>::to_uint(T v, uint64_t &u, bool neg) {
+    if (neg && v < 0) { v = -v; }
+    if (!(v >= 0 && v < (T)18446744073709551616.0L) || v != floor(v)) { return false; }
+    u = (uint64_t)v;
+    return true;
+}
+template <typename T>
+uint64_t BasicCalc<T>::gcd(uint64_t a, uint64_t b) {
+    if (a == 0 || b == 0) { return a | b; }
+#if defined(__GNUC__)
+    int shift = __builtin_ctzll(a | b);
+    a >>= __builtin_ctzll(a);
+    do {
+        b >>= __builtin_ctzll(b);
+        if (a > b) { uint64_t t = b; b = a; a = t; }
+        b -= a;
+    } while (b != 0);
+#else
+    int shift = 0;
+    while (((a | b) & 1) == 0) { a >>= 1; b >>= 1; shift++; }
+    while ((a & 1) == 0) { a >>= 1; }
+    do {
+        while ((b & 1) == 0) { b >>= 1; }
+        if (a > b) { uint64_t t = b; b = a; a = t; }
+        b -= a;
+    } while (b != 0);
+#endif
+    return a << shift;
+}
+template <typename T>
+uint64_t BasicCalc<T>::mulmod(uint64_t a, uint64_t b, uint64_t m) {
+#if defined(__SIZEOF_INT128__)
+    return (uint64_t)(((unsigned __int128)a * b) % m);
+#else
+    uint64_t r = 0;
+    a %= m;
+    for (; b > 0; b >>= 1) {
+        if (b & 1) { r = (r >= m - a ? r - (m - a) : r + a); }
+        a = (a >= m - a ? a - (m - a) : a + a);
+    }
+    return r;
+#endif
+}
+template <typename T>
+uint64_t BasicCalc<T>::powmod(uint64_t x, uint64_t y, uint64_t m) {
+    uint64_t r = 1 % m;
+    x %= m;
+    for (; y > 0; y >>= 1) {
+        if (y & 1) { r = mulmod(r, x, m); }
+        x = mulmod(x, x, m);
+    }
+    return r;
+}
+template <typename T>
+bool BasicCalc<T>::isprime(uint64_t n) {
+    static const uint64_t small[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+    if (n < 2) { return false; }
+    for (int i = 0; i < 12; i++) {
+        if (n % small[i] == 0) { return (n == small[i]); }
+    }
+    if (n < 41 * 41) { return true; }
+    //n - 1 = d * 2^s
+    uint64_t d = n - 1;
+    int s = 0;
+    while ((d & 1) == 0) { d >>= 1; s++; }
+    for (int i = 0; i < 12; i++) {
+        uint64_t x = powmod(small[i], d, n);
+        if (x == 1 || x == n - 1) { continue; }
+        int r = 1;
+        for (; r < s; r++) {
+            x = mulmod(x, x, n);
+            if (x == n - 1) { break; }
+        }
+        if (r == s) { return false; }
+    }
+    return true;
+}
+template <typename T>
+int BasicCalc<T>::popcount(uint64_t u) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(u);
+#else
+    int c = 0;
+    for (; u != 0; u &= u - 1) { c++; }
+    return c;
+#endif
+}
+template <typename T>
+int BasicCalc<T>::clz(uint64_t u) {
+    if (u == 0) { return 64; }
+#if defined(__GNUC__)
+    return __builtin_clzll(u);
+#else
+    int c = 0;
+    for (; (u & ((uint64_t)1 << 63)) == 0; u <<= 1) { c++; }
+    return c;
+#endif
+}
+template <typename T>
+T BasicCalc<T>::apply_oper(char oper, T res, T tmp, enum FunkiiCalcErrors_t &err) {
+    switch (oper) {
+        case '-': res -= tmp; break;
+        case '+': res += tmp; break;
+        case '*': res = res * tmp; break;
+        case '%':
+        case '/': {
+                    if (tmp == 0) { err = CE_DIV0; res = -1; } //ERROR: can't divide by 0
+                    else {
+                        if (oper == '%') { res = fmod(res,tmp); }
+                        else { res = res / tmp; }
+                    }
+                } break;
+        case '^': res = pow(res,tmp); break;
+        case '>':
+        case '<': {
+                    if( (res - floor(res)) == 0 ) {
+                        if (oper == '<') { res = (int)res << (int)tmp; }
+                        else { res = (int)res >> (int)tmp; }
+                    }
+                    else { err = CE_INT_BITSHIFT; res = -1; }
+                } break;
+    }
+    return res;
+}
+template <typename T>
+T BasicCalc<T>::eval_func(int oper_func, T res, enum FunkiiCalcErrors_t &err) {
+    switch (oper_func) {
+        case 1: { res = sqrt(res); } break;
+        case 2: { res = floor(res); } break;
+        case 3: { res = ceil(res); } break;
+        case 4: { res = sin(res); } break;
+        case 5: { res = cos(res); } break;
+        case 6: { res = tan(res); } break;
+        case 7: { res = asin(res); } break;
+        case 8: { res = acos(res); } break;
+        case 9: { res = atan(res); } break;
+        case 10: { res = sinh(res); } break;
+        case 11: { res = cosh(res); } break;
+        case 12: { res = tanh(res); } break;
+        case 13: { res = log(res); } break;
+        case 14: { res = log10(res); } break;
+        case 15:
+        case 16: { res = fabs(res); } break;
+        case 20: {
+                if( (res - floor(res)) >= 0.5 ) { res = ceil(res); }
+                else { res = floor(res); }
+                 } break;
+        case 21: { res = factorial(res, err); }break;
+        case 22:
+        case 23:
+        case 24: {
+                uint64_t u;
+                if (!to_uint(res, u, false)) { err = CE_INT_ARG; res = 0; break; }
+                if (oper_func == 22) { res = (isprime(u) ? 1 : 0); }
+                else { res = (T)(oper_func == 23 ? popcount(u) : clz(u)); }
+                 } break;
+        default: break;
+    }
+    return res;
+}
+template <typename T>
+T BasicCalc<T>::apply_func(int oper_func, T res, enum FunkiiCalcErrors_t &err) {
+    res = eval_func(oper_func, res, err);
+    if (errno) {
+        switch(errno) {
+            case EDOM: err = CE_EDOM; break;
+            case ERANGE: err = CE_ERANGE; break;
+            default: err = CE_EPIC;
         }
+        res = 0;
+    }
+    return res;
+}
+template <typename T>
+template <int K>
+T BasicCalc<T>::pairwise(const T *a, const T *b, size_t n, T m) {
+    if (n > 128) {
+        size_t h = (n / 2) & ~(size_t)7;
+        return pairwise<K>(a, b, h, m) + pairwise<K>(a + h, b + h, n - h, m);
+    }
+    T acc[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (int j = 0; j < 8; j++) {
+            T d = a[i + j] - m;
+            acc[j] += (K == 0 ? a[i + j] : (K == 1 ? d * d : a[i + j] * b[i + j]));
+        }
+    }
+    T res = ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+    for (; i < n; i++) {
+        T d = a[i] - m;
+        res += (K == 0 ? a[i] : (K == 1 ? d * d : a[i] * b[i]));
+    }
+    return res;
+}
+template <typename T>
+T BasicCalc<T>::apply_aggregate(int agg, const T *v, size_t n, enum FunkiiCalcErrors_t &err) {
+    if (n == 0 || (agg == 6 && (n % 2) != 0) || (agg == 9 && n != 3)) { err = CE_REG_ARGS; return 0; }
+    switch (agg) {
+        case 1: return pairwise<0>(v, v, n, 0);
+        case 2: return pairwise<0>(v, v, n, 0) / (T)n;
+        case 3:
+        case 4: {
+                T acc[8];
+                size_t i = 0;
+                for (int j = 0; j < 8; j++) { acc[j] = v[0]; }
+                for (; i + 8 <= n; i += 8) {
+                    for (int j = 0; j < 8; j++) {
+                        if (agg == 3) { acc[j] = (v[i + j] < acc[j] ? v[i + j] : acc[j]); }
+                        else { acc[j] = (v[i + j] > acc[j] ? v[i + j] : acc[j]); }
+                    }
+                }
+                for (; i < n; i++) { if (agg == 3 ? v[i] < acc[0] : v[i] > acc[0]) { acc[0] = v[i]; } }
+                for (int j = 1; j < 8; j++) { if (agg == 3 ? acc[j] < acc[0] : acc[j] > acc[0]) { acc[0] = acc[j]; } }
+                return acc[0];
+            }
+        case 5: {
+                T mean = pairwise<0>(v, v, n, 0) / (T)n;
+                return sqrt(pairwise<1>(v, v, n, mean) / (T)n);
+            }
+        case 6: return pairwise<2>(v, v + n / 2, n / 2, 0);
+        case 7:
+        case 8: {
+                uint64_t acc, u;
+                if (!to_uint(v[0], acc, true)) { err = CE_INT_ARG; return 0; }
+                for (size_t i = 1; i < n; i++) {
+                    if (!to_uint(v[i], u, true)) { err = CE_INT_ARG; return 0; }
+                    if (agg == 7) { acc = gcd(acc, u); continue; }
+                    if (acc == 0 || u == 0) { acc = 0; continue; }
+                    u /= gcd(acc, u);
+                    if (acc > ~(uint64_t)0 / u) { err = CE_ERANGE; return 0; }
+                    acc *= u;
+                }
+                return (T)acc;
+            }
+        case 9: {
+                uint64_t x, y, m;
+                if (!to_uint(v[0], x, true) || !to_uint(v[1], y, false) || !to_uint(v[2], m, false)) { err = CE_INT_ARG; return 0; }
+                if (m == 0) { err = CE_DIV0; return 0; }
+                x %= m;
+                if (v[0] < 0 && x != 0) { x = m - x; }
+                return (T)powmod(x, y, m);
+            }
+        default: err = CE_EPIC; return 0;
+    }
+}
+template <typename T>
+void BasicCalc<T>::error_mode(enum FunkiiCalcErrorModes_t mode) { mErrMode = mode; }
+template <typename T>
+void BasicCalc<T>::limits(const CalcLimits &lim) { mLimits = lim; }
+template <typename T>
+void BasicCalc<T>::fenv_clear() { feclearexcept(FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW); }
+template <typename T>
+enum FunkiiCalcErrors_t BasicCalc<T>::fenv_error() {
+    int raised = fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW);
+    if (raised & FE_INVALID) { return CE_EDOM; }
+    if (raised & FE_DIVBYZERO) { return CE_DIV0; }
+    if (raised & FE_OVERFLOW) { return CE_ERANGE; }
+    return CE_NADA;
+}
+template <typename T>
+string BasicCalc<T>::get_error_string(enum FunkiiCalcErrors_t n) { return string(get_error_c_str(n)); }
+template <typename T>
+const char *BasicCalc<T>::get_error_c_str(enum FunkiiCalcErrors_t n) {
+    if (n == CE_NADA) { return ""; }
+    switch((int)n) {
+        case CE_EMPTY:              return "[CALC] Error: wut? no formula?";
+        case CE_SYNTAX:             return "[CALC] Error: Syntax Error!! l2syntax~!";
+        case CE_SYNTAX_VARS:        return "[CALC] Error: Syntax Error!! you suck at assigning Vars!";
+        case CE_SYN_VARS_INFLOOP:   return "[CALC] Error: Possible Infinite Loop While assigning Vars!";
+        case CE_SYN_PAR:            return "[CALC] Error: Parentheses Error!! you suck at punctuation!";
+        case CE_SYN_EMPTY_PAR:      return "[CALC] Error: Syntax Error!! l2fillparenthesis!";
+        case CE_SYN_INVALIDCHAR:    return "[CALC] Error: Syntax Error!! you suck chars!";
+        case CE_DIV0:               return "[CALC] Error: Yeah... i can't divide by 0.. :(";
+        case CE_EDOM:               return "[CALC] Error: Domain Error... l2calc!!";
+        case CE_ERANGE:             return "[CALC] Error: Out of Range... damn you basterd l2stayinrange!!";
+        case CE_FIB_OB:             return "[CALC] Error: Out of Bounds, cannot Fibonacci!";
+        case CE_BIN:                return "[CALC] Error: Dude l2binary . . .";
+        case CE_OCT:                return "[CALC] Error: srsly man l2octal . . .";
+        case CE_HEX:                return "[CALC] Error: l2hex . . . *sigh* ";
+        case CE_FACT_OB:            return "[CALC] Error: Can only factorial POSITIVE integers... ";
+        case CE_EPIC:               return "[CALC] Error: oo noes Epic error... l2noterror!!";
+        case CE_INT_BITSHIFT:       return "[CALC] Error: Can only shift int! l2bitshift~!";
+        case CE_LIB_IO:             return "[CALC] Error: Can't read the formula library... l2file!";
+        case CE_LIB_FORMAT:         return "[CALC] Error: That's not a formula library (or it's broken)!";
+        case CE_LIB_VERSION:        return "[CALC] Error: Formula library version mismatch, recompile it!";
+        case CE_LIB_CHECKSUM:       return "[CALC] Error: Formula library checksum mismatch, recompile it!";
+        case CE_REG_UNDEF:          return "[CALC] Error: Undefined formula or variable... l2define!";
+        case CE_REG_ARGS:           return "[CALC] Error: Wrong number of arguments... l2count!";
+        case CE_REG_CYCLE:          return "[CALC] Error: Formulas calling each other in circles!";
+        case CE_REG_DUP:            return "[CALC] Error: There's already a formula with that name!";
+        case CE_REG_SEALED:         return "[CALC] Error: Registry Error!! add() before seal(), eval() after!";
+        case CE_MSG_FORMAT:         return "[CALC] Error: Broken message... l2protocol!";
+        case CE_MSG_SIZE:           return "[CALC] Error: Message too big, split it!";
+        case CE_SOLVE_NOROOT:       return "[CALC] Error: No root there, the target isn't bracketed (or the slope is flat)!";
+        case CE_SOLVE_BUDGET:       return "[CALC] Error: Didn't converge, out of evaluations... l2tolerance!";
+        case CE_LIM_LENGTH:         return "[CALC] Error: Formula too long!";
+        case CE_LIM_SIZE:           return "[CALC] Error: The vars blew the formula up, too big!";
+        case CE_LIM_DEPTH:          return "[CALC] Error: Nested too deep (parentheses or operators)... l2flatten!";
+        case CE_LIM_NODES:          return "[CALC] Error: Too many numbers and operators!";
+        case CE_LIM_STEPS:          return "[CALC] Error: Took too many steps, gave up!";
+        case CE_INT_ARG:            return "[CALC] Error: Integers only (0 to 2^64-1)... l2integer!";
+        case CE_WIN_ARG:            return "[CALC] Error: Windows take a constant size (1 to 2^24 rows), ewma a weight (0 to 1]!";
+        case CE_SHARD_CRASH:        return "[CALC] Error: The worker process died on these rows, every time!";
+        case CE_TABLE_KEY:          return "[CALC] Error: That key isn't in the table... l2lookup!";
+        case CE_TABLE_DATA:         return "[CALC] Error: Broken table (empty, duplicate keys or not a number)!";
+        case CE_SYN_GROUP:          return "[CALC] Error: Calc groups this one its own way... l2parentheses!";
+        default:                    return "[CALC] Error: Epic Error!";
     }
-    return e;
 }
 #endif
@@ -0,0 +1,123 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+/**
+**  calc_c
+**
+**  The C API (calc_c.h) over CalcProgram. Nothing but the funkiicalc_* functions is
+**  exported, and no C++ exception gets past them (they turn into CE_EPIC).
+*/
+#include "calc_c.h"
+#include "calc_program.h"
+#include <new>
+
+#define FUNKIICALC_VARS 64          /* Variables funkiicalc_eval converts on the stack */
+
+struct funkiicalc {
+    CalcProgram prog;
+};
+
+int funkiicalc_abi(void) { return FUNKIICALC_ABI; }
+funkiicalc_t *funkiicalc_compile(const char *formula, enum FunkiiCalcErrors_t *err) {
+    enum FunkiiCalcErrors_t e = CE_EMPTY;
+    funkiicalc_t *p = NULL;
+    if (formula != NULL) {
+        try {
+            p = new funkiicalc_t;
+            p->prog.compile(string(formula));
+            e = p->prog.get_error_code();
+        } catch (...) { e = CE_EPIC; }
+        if (e != CE_NADA) { delete p; p = NULL; }
+    }
+    if (err != NULL) { *err = e; }
+    return p;
+}
+void funkiicalc_release(funkiicalc_t *p) { delete p; }
+size_t funkiicalc_vars(const funkiicalc_t *p) { return (p == NULL ? 0 : p->prog.symbols().size()); }
+const char *funkiicalc_var(const funkiicalc_t *p, size_t i) {
+    if (p == NULL || i >= p->prog.symbols().size()) { return NULL; }
+    return p->prog.symbols()[i].c_str();
+}
+int funkiicalc_slot(const funkiicalc_t *p, const char *name) {
+    if (p == NULL || name == NULL) { return -1; }
+    const vector<string> &syms = p->prog.symbols();
+    for (size_t i = 0; i < syms.size(); i++) {
+        if (syms[i].compare(name) == 0) { return (int)i; }
+    }
+    return -1;
+}
+enum FunkiiCalcErrors_t funkiicalc_eval(const funkiicalc_t *p, const double *vars, double *out) {
+    enum FunkiiCalcErrors_t err = CE_EMPTY;
+    if (out != NULL) { *out = 0; }
+    if (p == NULL || out == NULL) { return err; }
+    size_t n = p->prog.symbols().size();
+    if (n > 0 && vars == NULL) { return err; }
+    try {
+        long double fixed[FUNKIICALC_VARS];
+        vector<long double> big;
+        long double *row = fixed;
+        if (n > FUNKIICALC_VARS) { big.resize(n); row = &big[0]; }
+        for (size_t i = 0; i < n; i++) { row[i] = vars[i]; }
+        long double res = p->prog.eval(row, err);
+        if (err == CE_NADA) {
+            *out = (double)res;
+            if (isfinite(res) && !isfinite(*out)) { *out = 0; err = CE_ERANGE; }
+        }
+    } catch (...) { err = CE_EPIC; }
+    return err;
+}
+/**
+ *  batch
+ *
+ *  funkiicalc_eval_batch in double or float.
+ */
+template <typename T>
+static size_t batch(const funkiicalc_t *p, const T *const *cols, size_t rows, T *out, uint8_t *errs) {
+    if (rows == 0 || out == NULL || errs == NULL) { return 0; }
+    size_t failed = 0;
+    if (p == NULL || (p->prog.symbols().size() > 0 && cols == NULL)) {
+        for (size_t i = 0; i < rows; i++) { out[i] = 0; errs[i] = (uint8_t)CE_EMPTY; }
+        return rows;
+    }
+    try {
+        p->prog.eval(cols, rows, out, errs);
+    } catch (...) {
+        for (size_t i = 0; i < rows; i++) { out[i] = 0; errs[i] = (uint8_t)CE_EPIC; }
+    }
+    for (size_t i = 0; i < rows; i++) { failed += (errs[i] != CE_NADA); }
+    return failed;
+}
+size_t funkiicalc_eval_batch(const funkiicalc_t *p, const double *const *cols, size_t rows, double *out, uint8_t *errs) {
+    return batch(p, cols, rows, out, errs);
+}
+size_t funkiicalc_eval_batchf(const funkiicalc_t *p, const float *const *cols, size_t rows, float *out, uint8_t *errs) {
+    return batch(p, cols, rows, out, errs);
+}
+const char *funkiicalc_error(enum FunkiiCalcErrors_t err) { return Calc::get_error_c_str(err); }
@@ -0,0 +1,163 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+/**
+**  calc_c
+**
+**  C API of the calculator, for the languages that can't include calc.h (Python, Go,
+**  Rust...). It's compiled into a shared library once, with every C++ symbol hidden so
+**  it never clashes with another copy of calc.h in the same process:
+**
+**      g++ -O2 -fno-math-errno -fPIC -shared -fvisibility=hidden -o libfunkiicalc.so src/calc_c.cpp
+**
+**  A formula compiles into an opaque handle (a CalcProgram), its variables are numbered
+**  in order of appearance (funkiicalc_var). The handle is never changed after compiling,
+**  so every thread can evaluate it at once. The batch functions read the caller's columns
+**  and write the caller's buffers as they are, no copies (i.e: NumPy arrays straight
+**  from ctypes):
+**
+**      p = lib.funkiicalc_compile(b"price * qty * (1 - disc)", byref(err))
+**      cols = (c_void_p * 3)(price.ctypes.data, qty.ctypes.data, disc.ctypes.data)
+**      lib.funkiicalc_eval_batch(p, cols, n, out.ctypes.data, errs.ctypes.data)
+**      lib.funkiicalc_release(p)
+**
+**  Errors are FunkiiCalcErrors_t codes (calc_errors.h), CE_NADA is no Error.
+*/
+#ifndef _FUNKII_CALC_C_H_
+#define _FUNKII_CALC_C_H_
+
+/* INCLUDES! */
+#include <stddef.h>
+#include <stdint.h>
+#include "calc_errors.h"
+
+#define FUNKIICALC_ABI 1            /* Bumped whenever a signature below changes */
+
+#if defined(_WIN32)
+    #define FUNKIICALC_API __declspec(dllexport)
+#else
+    #define FUNKIICALC_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct funkiicalc funkiicalc_t;
+
+/**
+ * funkiicalc_abi
+ *
+ * @return  int             FUNKIICALC_ABI the library was built with, check it against the header.
+ */
+FUNKIICALC_API int funkiicalc_abi(void);
+/**
+ * funkiicalc_compile
+ *
+ *  Compiles a formula (see CalcProgram::compile).
+ *
+ * @param   formula         The formula (nul terminated).
+ * @param   err             set to CE_NADA or the Error, may be NULL.
+ *
+ * @return  funkiicalc_t*   The program (free it with funkiicalc_release), NULL on Error.
+ */
+FUNKIICALC_API funkiicalc_t *funkiicalc_compile(const char *formula, enum FunkiiCalcErrors_t *err);
+/**
+ * funkiicalc_release
+ *
+ * @param   p               Program to free (NULL is fine).
+ */
+FUNKIICALC_API void funkiicalc_release(funkiicalc_t *p);
+/**
+ * funkiicalc_vars
+ *
+ * @return  size_t          Number of variables, the columns the evaluation takes.
+ */
+FUNKIICALC_API size_t funkiicalc_vars(const funkiicalc_t *p);
+/**
+ * funkiicalc_var
+ *
+ * @param   i               Variable number (0..funkiicalc_vars()-1).
+ *
+ * @return  const char*     Its lowercase name (lives as long as the program), NULL if out of bounds.
+ */
+FUNKIICALC_API const char *funkiicalc_var(const funkiicalc_t *p, size_t i);
+/**
+ * funkiicalc_slot
+ *
+ * @param   name            Variable name (lowercase).
+ *
+ * @return  int             Its number, -1 if the formula doesn't use it.
+ */
+FUNKIICALC_API int funkiicalc_slot(const funkiicalc_t *p, const char *name);
+/**
+ * funkiicalc_eval
+ *
+ *  Evaluates one row.
+ *
+ * @param   vars            Value of every variable (funkiicalc_vars() of them, NULL if none).
+ * @param   out             The result (0 on Error).
+ *
+ * @return  FunkiiCalcErrors_t  CE_NADA or the Error.
+ */
+FUNKIICALC_API enum FunkiiCalcErrors_t funkiicalc_eval(const funkiicalc_t *p, const double *vars, double *out);
+/**
+ * funkiicalc_eval_batch
+ *
+ *  Evaluates many rows in place (see CalcProgram::batch).
+ *
+ * @param   cols            Column of every variable (rows values each, NULL if none).
+ * @param   rows            Number of rows.
+ * @param   out             Result of every row (0 on Error).
+ * @param   errs            FunkiiCalcErrors_t of every row.
+ *
+ * @return  size_t          Rows that failed.
+ */
+FUNKIICALC_API size_t funkiicalc_eval_batch(const funkiicalc_t *p, const double *const *cols, size_t rows, double *out, uint8_t *errs);
+/**
+ * funkiicalc_eval_batchf
+ *
+ *  Same thing in float (twice the SIMD lanes, ~7 digits).
+ */
+FUNKIICALC_API size_t funkiicalc_eval_batchf(const funkiicalc_t *p, const float *const *cols, size_t rows, float *out, uint8_t *errs);
+/**
+ * funkiicalc_error
+ *
+ * @param   err             An Error code.
+ *
+ * @return  const char*     Its message (static).
+ */
+FUNKIICALC_API const char *funkiicalc_error(enum FunkiiCalcErrors_t err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,912 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_CONST_H_
+#define _FUNKII_CALC_CONST_H_
+
+#if __cplusplus < 202002L
+    #error "calc_const.h needs C++20 (consteval), build with -std=c++20"
+#endif
+
+/* INCLUDES! */
+#include "calc.h"
+#include <stddef.h>
+
+/* Max length of a formula (and of every variable) evaluated at compile time */
+#define CALC_CONST_MAX      1024
+/* Max number of variables in the 'a=1,b=2;' prefix */
+#define CALC_CONST_VARS     16
+
+/**
+ * CalcConst Class
+ *
+ *  Parses and evaluates constant formulas while compiling: same syntax as Calc
+ *  (syntax() rules, functions, pi/e, \b \o \x, comparisons, if() && || !, 'a=1,b=2;' vars)
+ *  and the same precedence as CalcProgram, so formulas that Calc groups its own way don't
+ *  compile ("100/10*2"_calc, Calc gives 100/(10*2): see CalcProgram), the math is done with
+ *  its own constexpr functions in long double. Any Error (syntax, division by 0, domain...) is a compile error that
+ *  names it, i.e: "call to non-'constexpr' function 'static void CalcConst::division_by_zero()'".
+ *  It is stricter than Calc: names that aren't a function, 'e', 'pi' or a var are an
+ *  Error (Calc makes them 0), and so are NaN or infinite results. Like Calc, the branch of
+ *  if() and the operand of && || that aren't taken can't fail: "if(1, 2, 1/0)"_calc is 2.
+ *
+ *  Usage Example:
+ *      constexpr long double f2c = "5/9"_calc;
+ *      constexpr double limit = CalcConst::eval("1.5 * 2^10");
+ *      static_assert("1<2<3"_calc == 1);
+ *
+ *  value() is the same thing as a plain constexpr function that returns the Error
+ *  instead (it can also run at runtime).
+ */
+class CalcConst {
+public:
+    /**
+     *  Literal
+     *
+     *  A string literal as a template argument (see operator""_calc).
+     */
+    template <size_t N>
+    struct Literal {
+        char s[N];
+        consteval Literal(const char (&in)[N]) : s() { for (size_t i = 0; i < N; i++) { s[i] = in[i]; } }
+    };
+    /**
+     * eval
+     *
+     *  Evaluates a formula while compiling.
+     *
+     * @param   formula         string literal containing the raw formula.
+     *
+     * @return  (long double)   Result (comparisons are 1 or 0), any Error doesn't compile.
+     */
+    static consteval long double eval(const char *formula) {
+        enum FunkiiCalcErrors_t err = CE_NADA;
+        long double res = value(formula, err);
+        fail(err);
+        return res;
+    }
+    /**
+     * value
+     *
+     *  eval() without the compile errors.
+     *
+     * @param   formula         string containing the raw formula.
+     * @param   err             set to CE_NADA or the Error.
+     *
+     * @return  (long double)   Result, 0 on Error.
+     */
+    static constexpr long double value(const char *formula, enum FunkiiCalcErrors_t &err) {
+        State st;
+        err = CE_NADA;
+        size_t len = 0;
+        while (formula[len] != '\0') { len++; }
+        //'a=1,b=2;formula', the vars are before the last ';'
+        size_t semi = len;
+        for (size_t i = 0; i < len; i++) { if (formula[i] == ';') { semi = i; } }
+        if (semi < len && semi > 0) {
+            if (!vars(st, formula, semi)) { err = st.err; return 0; }
+            formula += semi + 1;
+            len -= semi + 1;
+        }
+        if (!clean(st, formula, len, st.src)) { err = st.err; return 0; }
+        long double res = parse(st, st.src);
+        if (st.err == CE_NADA && !finite(res)) { st.err = (res != res ? CE_EDOM : CE_ERANGE); }
+        err = st.err;
+        return (err == CE_NADA ? res : 0);
+    }
+
+    /* The math, in long double */
+    static constexpr long double PI_L = 3.141592653589793238462643383279502884L;
+    static constexpr long double LN2_L = 0.693147180559945309417232121458176568L;
+    static constexpr long double LN10_L = 2.302585092994045684017991454684364208L;
+
+    static constexpr bool finite(long double x) { return (x == x && x - x == 0); }
+    static constexpr long double floor(long double x) {
+        //past 2^63 every long double is an integer
+        if (!finite(x) || x >= 9.2e18L || x <= -9.2e18L) { return x; }
+        long double f = (long double)(long long)x;
+        return (f > x ? f - 1 : f);
+    }
+    static constexpr long double ceil(long double x) { return -floor(-x); }
+    static constexpr long double fabs(long double x) { return (x < 0 ? -x : x); }
+    static constexpr long double fmod(long double a, long double b) {
+        long double q = a / b;
+        q = (q < 0 ? ceil(q) : floor(q));
+        return a - q * b;
+    }
+    /* x * 2^k */
+    static constexpr long double scale(long double x, int k) {
+        for (; k >= 32; k -= 32) { x *= 4294967296.0L; }
+        for (; k <= -32; k += 32) { x /= 4294967296.0L; }
+        for (; k > 0; k--) { x *= 2; }
+        for (; k < 0; k++) { x /= 2; }
+        return x;
+    }
+    static constexpr long double sqrt(long double x) {
+        if (x <= 0 || !finite(x)) { return (x == 0 || x > 0 ? x : nan()); }
+        //x = y * 4^k, y in [1, 4), then Newton from (1 + y) / 2
+        int k = 0;
+        long double y = x;
+        while (y >= 18446744073709551616.0L) { y /= 18446744073709551616.0L; k += 32; }
+        while (y < 1.0L / 18446744073709551616.0L) { y *= 18446744073709551616.0L; k -= 32; }
+        while (y >= 4) { y /= 4; k++; }
+        while (y < 1) { y *= 4; k--; }
+        long double g = (1 + y) / 2;
+        for (int i = 0; i < 8; i++) { g = (g + y / g) / 2; }
+        return scale(g, k);
+    }
+    static constexpr long double exp(long double x) {
+        if (x != x) { return x; }
+        if (x > 11357) { return inf(); }
+        if (x < -11400) { return 0; }
+        //x = k * ln2 + r, |r| <= ln2 / 2
+        long double kf = floor(x / LN2_L + 0.5L);
+        long double r = x - kf * LN2_L, term = 1, sum = 1;
+        for (int n = 1; n < 30; n++) { term *= r / n; sum += term; }
+        return scale(sum, (int)kf);
+    }
+    static constexpr long double log(long double x) {
+        if (x < 0 || x != x) { return nan(); }
+        if (x == 0) { return -inf(); }
+        if (!finite(x)) { return x; }
+        //x = m * 2^k, m in [sqrt(1/2), sqrt(2)), log(m) = 2 atanh((m - 1) / (m + 1))
+        int k = 0;
+        while (x >= 4294967296.0L) { x /= 4294967296.0L; k += 32; }
+        while (x < 1.0L / 4294967296.0L) { x *= 4294967296.0L; k -= 32; }
+        while (x >= 2) { x /= 2; k++; }
+        while (x < 1) { x *= 2; k--; }
+        if (x > 1.41421356237309504880L) { x /= 2; k++; }
+        long double s = (x - 1) / (x + 1), s2 = s * s, term = s, sum = 0;
+        for (int n = 1; n < 60; n += 2) { sum += term / n; term *= s2; }
+        return 2 * sum + k * LN2_L;
+    }
+    static constexpr long double sin(long double x) { return trig(x, 0); }
+    static constexpr long double cos(long double x) { return trig(x, 1); }
+    static constexpr long double tan(long double x) { return trig(x, 0) / trig(x, 1); }
+    static constexpr long double atan(long double x) {
+        if (x != x) { return x; }
+        if (x < 0) { return -atan(-x); }
+        if (x > 1) { return PI_L / 2 - atan(1 / x); }
+        //atan(x) = 2 atan(x / (1 + sqrt(1 + x^2))), twice: x <= tan(pi/16)
+        long double y = x;
+        for (int i = 0; i < 2; i++) { y = y / (1 + sqrt(1 + y * y)); }
+        long double y2 = y * y, term = y, sum = 0;
+        for (int n = 1; n < 80; n += 2) { sum += ((n & 2) ? -term : term) / n; term *= y2; }
+        return 4 * sum;
+    }
+    static constexpr long double asin(long double x) {
+        if (x > 1 || x < -1 || x != x) { return nan(); }
+        if (x == 1 || x == -1) { return x * PI_L / 2; }
+        return atan(x / sqrt(1 - x * x));
+    }
+    static constexpr long double acos(long double x) {
+        if (x > 1 || x < -1 || x != x) { return nan(); }
+        return PI_L / 2 - asin(x);
+    }
+    static constexpr long double sinh(long double x) {
+        if (fabs(x) < 1) {
+            long double x2 = x * x, term = x, sum = x;
+            for (int n = 3; n < 40; n += 2) { term *= x2 / ((n - 1) * n); sum += term; }
+            return sum;
+        }
+        long double e = exp(x);
+        return (e - 1 / e) / 2;
+    }
+    static constexpr long double cosh(long double x) {
+        long double e = exp(fabs(x));
+        return (e + 1 / e) / 2;
+    }
+    static constexpr long double tanh(long double x) {
+        if (x > 40) { return 1; }
+        if (x < -40) { return -1; }
+        return sinh(x) / cosh(x);
+    }
+    static constexpr long double pow(long double a, long double b) {
+        if (a != a || b != b) { return nan(); }
+        if (b == 0) { return 1; }
+        if (b == floor(b) && fabs(b) < 9.2e18L) {
+            //integer exponent: by squaring
+            unsigned long long n = (unsigned long long)fabs(b);
+            long double r = 1, p = a;
+            while (n > 0) { if (n & 1) { r *= p; } p *= p; n >>= 1; }
+            return (b < 0 ? 1 / r : r);
+        }
+        if (a < 0) { return nan(); }
+        if (a == 0) { return (b > 0 ? 0 : inf()); }
+        return exp(b * log(a));
+    }
+private:
+    struct Text {
+        char s[CALC_CONST_MAX];     /* Sanity Checked Formula. */
+        size_t n;                   /* Length */
+    };
+    struct Cursor {
+        const Text *t;              /* Text being parsed */
+        size_t pos;                 /* Parse position */
+    };
+    /* The operands and operators of a term, see CalcProgram::Term (vars are groups) */
+    struct Term {
+        int atoms;                  /* Operands read */
+        int kind[2];                /* Of the first two operands */
+        bool rest;                  /* An operand after the second one isn't a number, e or pi */
+        bool lone;                  /* A literal with a signed exponent */
+        int oper;                   /* Last operator: 1 *, 2 / %, 3 ^, 4 << >> */
+        bool bad;                   /* Calc groups it its own way, wherever it is */
+        constexpr Term() : atoms(0), kind(), rest(false), lone(false), oper(0), bad(false) { }
+    };
+    struct State {
+        enum FunkiiCalcErrors_t err;    /* First Error */
+        Text src;                   /* The formula */
+        Text vals[CALC_CONST_VARS]; /* Value of every var */
+        char names[CALC_CONST_VARS][32];    /* Name of every var */
+        int nvars;                  /* Number of vars */
+        int depth;                  /* Vars being evaluated inside each other */
+        int skip;                   /* Untaken branches being parsed inside each other */
+        Term *term;                 /* Term being parsed */
+        int kind;                   /* Operand parse_unary() just read (see Term) */
+        constexpr State() : err(CE_NADA), src(), vals(), names(), nvars(0), depth(0), skip(0), term(NULL), kind(0) { }
+    };
+
+    static constexpr long double nan() { return __builtin_nanl(""); }
+    static constexpr long double inf() { return __builtin_infl(); }
+    static constexpr bool is_digit(char c) { return (c >= '0' && c <= '9'); }
+    static constexpr bool is_alpha(char c) { return (c >= 'a' && c <= 'z'); }
+    static constexpr bool is_oper(char c) {
+        return (c == '+' || c == '-' || c == '*' || c == '/' || c == '%' || c == '^' || c == '>' || c == '<' || c == '=');
+    }
+    static constexpr bool is_logic(char c) { return (c == '&' || c == '|' || c == '!'); }
+    /* A math Error, unless it's in an untaken branch (then the value doesn't matter) */
+    static constexpr long double math_error(State &st, enum FunkiiCalcErrors_t err) {
+        if (st.skip == 0) { st.err = err; }
+        return 0;
+    }
+    /* sin (c = 0) or cos (c = 1) */
+    static constexpr long double trig(long double x, int c) {
+        if (!finite(x)) { return nan(); }
+        //x = q * pi/2 + r, |r| <= pi/4
+        long double qf = floor(x / (PI_L / 2) + 0.5L);
+        long double r = x - qf * (PI_L / 2), r2 = r * r;
+        int q = (int)fmod(qf, 4) + c;
+        if (q < 0) { q += 4; }
+        long double s = r, cs = 1, ts = r, tc = 1;
+        for (int n = 1; n < 16; n++) {
+            ts *= -r2 / ((2 * n) * (2 * n + 1)); s += ts;
+            tc *= -r2 / ((2 * n - 1) * (2 * n)); cs += tc;
+        }
+        switch (q & 3) {
+            case 0: return s;
+            case 1: return cs;
+            case 2: return -s;
+            default: return -cs;
+        }
+    }
+
+    /* Errors: calling one of these while compiling is the compile error */
+    static void empty_formula() { }
+    static void syntax_error() { }
+    static void vars_syntax_error() { }
+    static void vars_infinite_loop() { }
+    static void parentheses_error() { }
+    static void empty_parentheses() { }
+    static void invalid_char() { }
+    static void division_by_zero() { }
+    static void domain_error() { }
+    static void out_of_range() { }
+    static void not_a_binary_number() { }
+    static void not_an_octal_number() { }
+    static void not_a_hex_number() { }
+    static void factorial_of_a_non_positive_integer() { }
+    static void bitshift_of_a_non_integer() { }
+    static void unknown_name() { }
+    static void formula_too_long() { }
+    static void not_an_integer() { }
+    static void calc_groups_it_another_way() { }
+    static constexpr void fail(enum FunkiiCalcErrors_t err) {
+        switch (err) {
+            case CE_NADA: break;
+            case CE_EMPTY: empty_formula(); break;
+            case CE_SYNTAX_VARS: vars_syntax_error(); break;
+            case CE_SYN_VARS_INFLOOP: vars_infinite_loop(); break;
+            case CE_SYN_PAR: parentheses_error(); break;
+            case CE_SYN_EMPTY_PAR: empty_parentheses(); break;
+            case CE_SYN_INVALIDCHAR: invalid_char(); break;
+            case CE_DIV0: division_by_zero(); break;
+            case CE_EDOM: domain_error(); break;
+            case CE_ERANGE: out_of_range(); break;
+            case CE_BIN: not_a_binary_number(); break;
+            case CE_OCT: not_an_octal_number(); break;
+            case CE_HEX: not_a_hex_number(); break;
+            case CE_FACT_OB: factorial_of_a_non_positive_integer(); break;
+            case CE_INT_BITSHIFT: bitshift_of_a_non_integer(); break;
+            case CE_REG_UNDEF: unknown_name(); break;
+            case CE_MSG_SIZE: formula_too_long(); break;
+            case CE_INT_ARG: not_an_integer(); break;
+            case CE_SYN_GROUP: calc_groups_it_another_way(); break;
+            default: syntax_error(); break;
+        }
+    }
+    /**
+     * vars
+     *
+     *  Splits the 'a=1,b=2' prefix into names and cleaned values.
+     */
+    static constexpr bool vars(State &st, const char *s, size_t len) {
+        size_t from = 0;
+        while (from < len) {
+            size_t end = from, eq = len;
+            while (end < len && s[end] != ',') { if (s[end] == '=') { eq = end; } end++; }
+            if (eq >= end || st.nvars >= CALC_CONST_VARS) { st.err = CE_SYNTAX_VARS; return false; }
+            char *name = st.names[st.nvars];
+            size_t n = 0;
+            for (size_t i = from; i < eq; i++) {
+                char c = s[i];
+                if (c >= 'A' && c <= 'Z') { c = (char)(c + 32); }
+                if (c == ' ') { continue; }
+                if (!(is_alpha(c) || (n > 0 && is_digit(c))) || n >= 31) { st.err = CE_SYNTAX_VARS; return false; }
+                name[n++] = c;
+            }
+            if (n == 0) { st.err = CE_SYNTAX_VARS; return false; }
+            name[n] = '\0';
+            if (!clean(st, s + eq + 1, end - eq - 1, st.vals[st.nvars])) { return false; }
+            st.nvars++;
+            from = end + 1;
+        }
+        return true;
+    }
+    /**
+     * clean
+     *
+     *  Calc::syntax(): lowercase, no spaces, only valid chars, \b \o \x to bin( oct( hex(
+     *  and the same syntax checks.
+     */
+    static constexpr bool clean(State &st, const char *in, size_t len, Text &out) {
+        char *f = out.s;
+        size_t n = 0;
+        int p = 0, type = 0;
+        bool ifs[CALC_CONST_MAX] = { };     //for each open parenthesis: is it if()
+        for (size_t i = 0; i < len; i++) {
+            char c = in[i];
+            if (n + 5 >= CALC_CONST_MAX) { st.err = CE_MSG_SIZE; return false; }
+            if (c == ' ') { continue; }
+            if (c >= 'A' && c <= 'Z') { c = (char)(c + 32); }
+            if (type == 1 || type == 2 || type == 3) {
+                bool ok = (type == 1 ? (c == '0' || c == '1') :
+                          (type == 2 ? (c >= '0' && c <= '8') : (is_digit(c) || is_alpha(c))));
+                if (ok) { f[n++] = c; }
+                else { f[n++] = ')'; type = 0; i--; }
+                continue;
+            }
+            if (c == '(') {
+                if (p >= 0) { ifs[p] = (n >= 2 && f[n - 2] == 'i' && f[n - 1] == 'f' && (n == 2 || !is_alpha(f[n - 3]))); }
+                p++;
+            }
+            else if (c == ')') { p--; }
+            if (c == '%' || (c >= '(' && c <= '+') || (c >= '-' && c <= '9') || c == '^' || is_alpha(c) || (c >= '<' && c <= '>') || is_logic(c)) {
+                f[n++] = c;
+            }
+            else if (c == ',' && p > 0 && ifs[p - 1]) {
+                //the arguments of if()
+                f[n++] = c;
+            }
+            else if (c == '\\' && i + 1 < len) {
+                char t = in[i + 1];
+                const char *fn = (t == 'b' ? "bin(" : (t == 'o' ? "oct(" : (t == 'x' ? "hex(" : "")));
+                if (fn[0] == '\0') { st.err = CE_SYNTAX; return false; }
+                for (int j = 0; j < 4; j++) { f[n++] = fn[j]; }
+                type = (t == 'b' ? 1 : (t == 'o' ? 2 : 3));
+                i++;
+            }
+            //anything else is dropped (i.e: '1,000')
+        }
+        if (type != 0) { f[n++] = ')'; }
+        f[n] = '\0';
+        out.n = n;
+        if (p != 0) { st.err = CE_SYN_PAR; return false; }
+        if (n == 0) { st.err = CE_EMPTY; return false; }
+        if (!(f[0] == '(' || f[0] == '+' || f[0] == '-' || f[0] == '!' || is_digit(f[0]) || is_alpha(f[0]))) { st.err = CE_SYN_INVALIDCHAR; return false; }
+        if (is_oper(f[n - 1]) || is_logic(f[n - 1]) || f[n - 1] == '(') { st.err = CE_SYNTAX; return false; }
+        size_t lo = n, lc = n;
+        for (size_t i = 0; i < n; i++) { if (f[i] == '(') { lo = i; } if (f[i] == ')') { lc = i; } }
+        if (lo != n && (lc == n || lo > lc)) { st.err = CE_SYN_PAR; return false; }
+        //"3+*2", "6>*2", "()"... same checks as Calc::syntax()
+        for (size_t i = 0; i + 1 < n; i++) {
+            if (f[i] == '(' && f[i + 1] == ')') { st.err = CE_SYN_EMPTY_PAR; return false; }
+            if (is_logic(f[i])) {
+                //&& and || between two operands, ! before one (and not after one, so no '5!' or '!=')
+                size_t w = (f[i] == '!' ? 1 : 2);
+                char prev = (i > 0 ? f[i - 1] : '('), next = (i + w < n ? f[i + w] : '\0');
+                bool after = (is_digit(prev) || is_alpha(prev) || prev == ')' || prev == '.');
+                if ((w == 2 && (f[i + 1] != f[i] || !after)) || (w == 1 && after) ||
+                    !(next == '(' || next == '-' || next == '+' || next == '!' || is_digit(next) || is_alpha(next))) {
+                    st.err = CE_SYNTAX; return false;
+                }
+                i += w - 1;
+                continue;
+            }
+            if (!is_oper(f[i])) { continue; }
+            if (i + 2 < n && f[i + 1] == '-' && (is_digit(f[i + 2]) || is_alpha(f[i + 2]) || f[i + 2] == '(')) { i += 2; continue; }
+            char c1 = f[i + 1];
+            if (c1 != '(' && c1 != '!' && !is_digit(c1) && !is_alpha(c1)) {
+                if (f[i] == '>' && (c1 == '=' || c1 == '>')) { i++; continue; }
+                if (f[i] == '<' && (i == 0 || f[i - 1] != '<') && (c1 == '=' || c1 == '>' || c1 == '<')) { i++; continue; }
+                if (f[i] == '=' && c1 == '=') { i++; continue; }
+                st.err = CE_SYNTAX; return false;
+            }
+            if ((f[i] == '=' || f[i] == '<' || f[i] == '>') && i > 0 && (f[i - 1] == '=' || f[i - 1] == '<' || f[i - 1] == '>')) {
+                st.err = CE_SYNTAX; return false;
+            }
+        }
+        return true;
+    }
+    static constexpr char at(const Cursor &c) { return (c.pos < c.t->n ? c.t->s[c.pos] : '\0'); }
+    static constexpr char at(const Cursor &c, size_t off) { return (c.pos + off < c.t->n ? c.t->s[c.pos + off] : '\0'); }
+    /**
+     * parse
+     *
+     *  Evaluates a whole cleaned formula.
+     */
+    static constexpr long double parse(State &st, const Text &t) {
+        Cursor c = { &t, 0 };
+        long double res = parse_or(st, c);
+        if (st.err == CE_NADA && c.pos != t.n) { st.err = (at(c) == ')' ? CE_SYN_PAR : CE_SYNTAX); }
+        return res;
+    }
+    /**
+     * apply
+     *
+     *  One operation, with the Errors of Calc plus NaN/Inf results.
+     */
+    static constexpr long double apply(State &st, char op, long double a, long double b) {
+        long double r = 0;
+        switch (op) {
+            case '+': r = a + b; break;
+            case '-': r = a - b; break;
+            case '*': r = a * b; break;
+            case '/': if (b == 0) { return math_error(st, CE_DIV0); } r = a / b; break;
+            case '%': if (b == 0) { return math_error(st, CE_DIV0); } r = fmod(a, b); break;
+            case '^': r = pow(a, b); break;
+            case 'l':
+            case 'r':
+                if (a != floor(a) || b != floor(b) || fabs(a) > 2147483647.0L || b < 0 || b > 31) { return math_error(st, CE_INT_BITSHIFT); }
+                r = (op == 'l' ? (long double)((int)a << (int)b) : (long double)((int)a >> (int)b));
+                break;
+        }
+        if (!finite(r)) { return math_error(st, (r != r ? CE_EDOM : CE_ERANGE)); }
+        return r;
+    }
+    /* || and && only parse the right side when the left one doesn't decide (skip otherwise) */
+    static constexpr long double parse_or(State &st, Cursor &c) {
+        long double l = parse_and(st, c);
+        while (st.err == CE_NADA && at(c) == '|' && at(c, 1) == '|') {
+            c.pos += 2;
+            bool t = (l != 0);
+            if (t) { st.skip++; }
+            long double r = parse_and(st, c);
+            if (t) { st.skip--; }
+            if (st.err != CE_NADA) { return 0; }
+            l = ((t || r != 0) ? 1 : 0);
+        }
+        return (st.err != CE_NADA ? 0 : l);
+    }
+    static constexpr long double parse_and(State &st, Cursor &c) {
+        long double l = parse_cmp(st, c);
+        while (st.err == CE_NADA && at(c) == '&' && at(c, 1) == '&') {
+            c.pos += 2;
+            bool f = (l == 0);
+            if (f) { st.skip++; }
+            long double r = parse_cmp(st, c);
+            if (f) { st.skip--; }
+            if (st.err != CE_NADA) { return 0; }
+            l = ((!f && r != 0) ? 1 : 0);
+        }
+        return (st.err != CE_NADA ? 0 : l);
+    }
+    static constexpr long double parse_cmp(State &st, Cursor &c) {
+        long double l = parse_sum(st, c), res = 1;
+        bool cmp = false;
+        while (st.err == CE_NADA && c.pos < c.t->n) {
+            char ch = at(c), c1 = at(c, 1);
+            int code = 0;   //1 <, 2 >, 3 =, 4 <>, 5 <=, 6 >=
+            if (ch == '<') {
+                if (c1 == '<') { break; }
+                code = (c1 == '>' ? 4 : (c1 == '=' ? 5 : 1));
+                if (code != 1) { c.pos++; }
+            }
+            else if (ch == '>') {
+                code = (c1 == '=' ? 6 : 2);
+                if (code != 2) { c.pos++; }
+            }
+            else if (ch == '=') { if (c1 == '=') { c.pos++; } code = 3; }
+            else { break; }
+            c.pos++;
+            long double r = parse_sum(st, c);
+            if (st.err != CE_NADA) { return 0; }
+            //a < b < c is (a < b) and (b < c)
+            bool t = (code == 1 ? l < r : (code == 2 ? l > r : (code == 3 ? l == r : (code == 4 ? l != r : (code == 5 ? l <= r : l >= r)))));
+            if (!t) { res = 0; }
+            cmp = true;
+            l = r;
+        }
+        return (st.err != CE_NADA ? 0 : (cmp ? res : l));
+    }
+    static constexpr long double parse_sum(State &st, Cursor &c) {
+        Term *outer = st.term, t;
+        int terms = 0, first = -1;
+        st.term = &t;
+        long double l = parse_prod(st, c);
+        while (st.err == CE_NADA && (at(c) == '+' || at(c) == '-')) {
+            char op = at(c);
+            c.pos++;
+            if (!grouping(st, t, terms++, false)) { break; }
+            if (terms == 1 && t.atoms == 1) { first = t.kind[0]; }
+            t = Term();
+            long double r = parse_prod(st, c);
+            if (st.err != CE_NADA) { break; }
+            l = apply(st, op, l, r);
+        }
+        if (st.err == CE_NADA && grouping(st, t, terms, true) && terms == 1 && first == 5 && t.atoms == 1 && (t.kind[0] == 0 || t.kind[0] == 5)) {
+            //e-1 and 3e2+1 pass Calc::IsValidNum(), strtod() makes them 0 and 300
+            st.err = CE_SYN_GROUP;
+        }
+        st.term = outer;
+        return (st.err != CE_NADA ? 0 : l);
+    }
+    static constexpr long double parse_prod(State &st, Cursor &c) {
+        long double l = parse_quot(st, c);
+        while (st.err == CE_NADA && at(c) == '*') {
+            oper(st, 1);
+            c.pos++;
+            long double r = parse_quot(st, c);
+            if (st.err != CE_NADA) { return 0; }
+            l = apply(st, '*', l, r);
+        }
+        return (st.err != CE_NADA ? 0 : l);
+    }
+    static constexpr long double parse_quot(State &st, Cursor &c) {
+        long double l = parse_pow(st, c);
+        while (st.err == CE_NADA && (at(c) == '/' || at(c) == '%')) {
+            char op = at(c);
+            oper(st, 2);
+            c.pos++;
+            long double r = parse_pow(st, c);
+            if (st.err != CE_NADA) { return 0; }
+            l = apply(st, op, l, r);
+        }
+        return (st.err != CE_NADA ? 0 : l);
+    }
+    static constexpr long double parse_pow(State &st, Cursor &c) {
+        long double l = parse_shift(st, c);
+        if (st.err == CE_NADA && at(c) == '^') {
+            oper(st, 3);
+            c.pos++;
+            long double r = parse_pow(st, c);
+            if (st.err != CE_NADA) { return 0; }
+            l = apply(st, '^', l, r);
+        }
+        return (st.err != CE_NADA ? 0 : l);
+    }
+    static constexpr long double parse_shift(State &st, Cursor &c) {
+        long double l = parse_unary(st, c);
+        if (st.err == CE_NADA) { operand(st); }
+        while (st.err == CE_NADA && ((at(c) == '<' && at(c, 1) == '<') || (at(c) == '>' && at(c, 1) == '>'))) {
+            char op = (at(c) == '<' ? 'l' : 'r');
+            oper(st, 4);
+            c.pos += 2;
+            long double r = parse_unary(st, c);
+            if (st.err != CE_NADA) { return 0; }
+            operand(st);
+            l = apply(st, op, l, r);
+        }
+        return (st.err != CE_NADA ? 0 : l);
+    }
+    static constexpr long double parse_unary(State &st, Cursor &c) {
+        if (at(c) == '-') {
+            c.pos++;
+            bool twice = (at(c) == '-');
+            long double v = parse_unary(st, c);
+            //Calc only gets one sign, of a number, a var or a group
+            if (twice || st.kind == 2 || st.kind == 3 || st.kind == 5 || st.kind == 6) { st.kind = 4; }
+            return -v;
+        }
+        if (at(c) == '+') { c.pos++; long double v = parse_unary(st, c); st.kind = 4; return v; }
+        if (at(c) == '!') {
+            c.pos++;
+            long double v = parse_unary(st, c);
+            //Calc puts (0) or (1) in its place (but it ends 1e-5 at the e)
+            st.kind = (st.kind == 3 ? 4 : 1);
+            return (v == 0 ? 1 : 0);
+        }
+        return parse_atom(st, c);
+    }
+    /* CalcProgram::operand(), oper() and grouping() */
+    static constexpr void operand(State &st) {
+        Term &t = *st.term;
+        if (t.atoms < 2) { t.kind[t.atoms] = st.kind; }
+        else if (st.kind != 0 && st.kind < 5) { t.rest = true; }
+        if (st.kind == 3) { t.lone = true; }
+        if (st.kind == 4) { t.bad = true; }
+        t.atoms++;
+    }
+    static constexpr void oper(State &st, int level) {
+        Term &t = *st.term;
+        if (t.oper > level || (t.oper == level && level != 1 && level != 3)) { t.bad = true; }
+        t.oper = level;
+    }
+    static constexpr bool grouping(State &st, const Term &t, int index, bool last) {
+        bool ok = !t.bad && (!t.lone || (t.atoms == 1 && index == 0 && last));
+        if (ok && t.atoms > 1) {
+            bool plain0 = (t.kind[0] == 0 || t.kind[0] >= 5), plain1 = (t.kind[1] == 0 || t.kind[1] >= 5);
+            if (t.rest) { ok = false; }
+            else if (index == 0) { ok = (plain1 || (t.kind[1] == 1 && t.atoms == 2)); }
+            else if (last) { ok = plain1; }
+            else { ok = (plain0 && plain1); }
+        }
+        if (!ok) { st.err = CE_SYN_GROUP; }
+        return ok;
+    }
+    static constexpr long double parse_atom(State &st, Cursor &c) {
+        if (c.pos >= c.t->n) { st.err = CE_SYNTAX; return 0; }
+        if (at(c) == '(') {
+            c.pos++;
+            long double v = parse_or(st, c);
+            if (st.err != CE_NADA) { return 0; }
+            if (at(c) != ')') { st.err = CE_SYN_PAR; return 0; }
+            c.pos++;
+            st.kind = 1;
+            return v;
+        }
+        size_t start = c.pos;
+        while (is_digit(at(c)) || is_alpha(at(c)) || at(c) == '.') { c.pos++; }
+        if (c.pos == start) { st.err = CE_SYNTAX; return 0; }
+        if (c.pos - start > 1 && c.t->s[c.pos - 1] == 'e' && (at(c) == '-' || at(c) == '+') && is_digit(at(c, 1))) {
+            //the sign of an exponent is part of the number: 1e-5 isn't 1e - 5
+            bool num = true;
+            for (size_t i = start; i + 1 < c.pos; i++) { if (!is_digit(c.t->s[i]) && c.t->s[i] != '.') { num = false; } }
+            if (num) { for (c.pos += 2; is_digit(at(c)); c.pos++) { } }
+        }
+        const char *w = c.t->s + start;
+        size_t wn = c.pos - start;
+        st.kind = 0;
+        for (size_t i = 0; i < wn; i++) {
+            if (w[i] == 'e' && (wn == 1 || is_digit(w[0]) || w[0] == '.')) { st.kind = (i + 1 < wn && (w[i + 1] == '-' || w[i + 1] == '+') ? 3 : 5); break; }
+        }
+        if (wn == 2 && w[0] == 'p' && w[1] == 'i') { st.kind = 6; }
+        if (at(c) == '(' && wn == 2 && w[0] == 'i' && w[1] == 'f') {
+            //if(cond, a, b): the branch that isn't taken is skipped
+            c.pos++;
+            long double cond = parse_or(st, c), v = 0;
+            for (int arg = 0; arg < 2 && st.err == CE_NADA; arg++) {
+                if (at(c) != ',') { st.err = (at(c) == ')' ? CE_SYNTAX : CE_SYN_PAR); return 0; }
+                c.pos++;
+                bool taken = ((cond != 0) == (arg == 0));
+                if (!taken) { st.skip++; }
+                long double r = parse_or(st, c);
+                if (!taken) { st.skip--; }
+                if (taken) { v = r; }
+            }
+            if (st.err != CE_NADA) { return 0; }
+            if (at(c) != ')') { st.err = (at(c) == ',' ? CE_SYNTAX : CE_SYN_PAR); return 0; }
+            c.pos++;
+            st.kind = 1;
+            return v;
+        }
+        if (at(c) == '(') {
+            int f = func(w, wn);
+            c.pos++;
+            st.kind = 2;
+            if (f == 0) { st.err = CE_SYNTAX; return 0; }
+            if (f >= 17 && f <= 19) {
+                //bin(), oct() and hex() of a literal (what syntax() makes of \b, \o and \x)
+                size_t end = c.pos;
+                while (is_digit(c.t->s[end]) || is_alpha(c.t->s[end]) || c.t->s[end] == '.') { end++; }
+                if (end > c.pos && end < c.t->n && c.t->s[end] == ')') {
+                    long double v = 0;
+                    int base = (f == 17 ? 2 : (f == 18 ? 8 : 16));
+                    for (size_t i = c.pos; i < end; i++) {
+                        char d = c.t->s[i];
+                        int dv = (is_digit(d) ? d - '0' : (d >= 'a' && d <= 'f' ? d - 'a' + 10 : 99));
+                        if (dv >= base) { st.err = (f == 17 ? CE_BIN : (f == 18 ? CE_OCT : CE_HEX)); return 0; }
+                        v = v * base + dv;
+                    }
+                    c.pos = end + 1;
+                    return v;
+                }
+            }
+            long double a = parse_or(st, c);
+            if (st.err != CE_NADA) { return 0; }
+            if (at(c) != ')') { st.err = CE_SYN_PAR; return 0; }
+            c.pos++;
+            st.kind = 2;
+            return call(st, f, a);
+        }
+        if (is_digit(w[0]) || w[0] == '.') { return number(w, wn); }
+        if (wn == 1 && w[0] == 'e') { return EXP; }
+        if (wn == 2 && w[0] == 'p' && w[1] == 'i') { return PI; }
+        for (int v = st.nvars - 1; v >= 0; v--) {
+            size_t i = 0;
+            while (i < wn && st.names[v][i] == w[i]) { i++; }
+            if (i == wn && st.names[v][i] == '\0') {
+                //like parse_vars(), vars can use other vars, but not forever
+                if (st.depth >= 6) { st.err = CE_SYN_VARS_INFLOOP; return 0; }
+                st.depth++;
+                long double val = parse(st, st.vals[v]);
+                st.depth--;
+                //parse_vars() puts it in parentheses
+                st.kind = 1;
+                return val;
+            }
+        }
+        st.err = CE_REG_UNDEF;
+        return 0;
+    }
+    /* a * b % m, adding and doubling so it never overflows */
+    static constexpr unsigned long long mulmod(unsigned long long a, unsigned long long b, unsigned long long m) {
+        unsigned long long r = 0;
+        a %= m;
+        for (; b > 0; b >>= 1) {
+            if (b & 1) { r = (r >= m - a ? r - (m - a) : r + a); }
+            a = (a >= m - a ? a - (m - a) : a + a);
+        }
+        return r;
+    }
+    /* Calc::isprime(): Miller-Rabin with the first 12 primes as bases */
+    static constexpr bool prime(unsigned long long n) {
+        const unsigned long long small[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+        if (n < 2) { return false; }
+        for (int i = 0; i < 12; i++) { if (n % small[i] == 0) { return (n == small[i]); } }
+        unsigned long long d = n - 1;
+        int s = 0;
+        while ((d & 1) == 0) { d >>= 1; s++; }
+        for (int i = 0; i < 12; i++) {
+            unsigned long long x = 1, b = small[i];
+            for (unsigned long long y = d; y > 0; y >>= 1) {
+                if (y & 1) { x = mulmod(x, b, n); }
+                b = mulmod(b, b, n);
+            }
+            if (x == 1 || x == n - 1) { continue; }
+            int k = 1;
+            for (; k < s; k++) {
+                x = mulmod(x, x, n);
+                if (x == n - 1) { break; }
+            }
+            if (k == s) { return false; }
+        }
+        return true;
+    }
+    /* Calc::isFunc() */
+    static constexpr int func(const char *w, size_t wn) {
+        const char *names[] = { "sqrt", "floor","ceil", "sin",  "cos",
+                                "tan",  "asin", "acos", "atan", "sinh",
+                                "cosh", "tanh", "ln",   "log",  "abs",
+                                "fabs", "bin",  "oct",  "hex",  "round",
+                                "fact", "isprime", "popcount", "clz" };
+        for (int f = 0; f < 24; f++) {
+            size_t i = 0;
+            while (i < wn && names[f][i] == w[i]) { i++; }
+            if (i == wn && names[f][i] == '\0') { return f + 1; }
+        }
+        return 0;
+    }
+    /* Calc::apply_func() */
+    static constexpr long double call(State &st, int f, long double x) {
+        long double r = 0;
+        switch (f) {
+            case 1: if (x < 0) { return math_error(st, CE_EDOM); } r = sqrt(x); break;
+            case 2: r = floor(x); break;
+            case 3: r = ceil(x); break;
+            case 4: r = sin(x); break;
+            case 5: r = cos(x); break;
+            case 6: r = tan(x); break;
+            case 7: r = asin(x); break;
+            case 8: r = acos(x); break;
+            case 9: r = atan(x); break;
+            case 10: r = sinh(x); break;
+            case 11: r = cosh(x); break;
+            case 12: r = tanh(x); break;
+            case 13:
+            case 14:
+                if (x == 0) { return math_error(st, CE_ERANGE); }
+                r = (f == 13 ? log(x) : log(x) / LN10_L);
+                break;
+            case 15:
+            case 16: r = fabs(x); break;
+            case 20: r = ((x - floor(x)) >= 0.5L ? ceil(x) : floor(x)); break;
+            case 21:
+                if (x < 0 || x != floor(x)) { return math_error(st, CE_FACT_OB); }
+                if (x > 1754) { return math_error(st, CE_ERANGE); }
+                r = 1;
+                for (int i = 1; i <= (int)x; i++) { r *= i; }
+                break;
+            case 22:
+            case 23:
+            case 24: {
+                if (x < 0 || x >= 18446744073709551616.0L || x != floor(x)) { return math_error(st, CE_INT_ARG); }
+                unsigned long long u = (unsigned long long)x;
+                int c = 0;
+                if (f == 22) { r = (prime(u) ? 1 : 0); break; }
+                if (f == 23) { for (; u != 0; u &= u - 1) { c++; } }
+                else { for (c = 64; u != 0; u >>= 1) { c--; } }
+                r = c;
+            } break;
+            default: r = x; break;
+        }
+        if (!finite(r)) { return math_error(st, (r != r ? CE_EDOM : CE_ERANGE)); }
+        return r;
+    }
+    /* strtod() of a word: the longest number at its start */
+    static constexpr long double number(const char *w, size_t wn) {
+        unsigned long long m = 0;
+        int exp10 = 0, digits = 0;
+        size_t i = 0;
+        bool dot = false;
+        if (wn > 2 && w[0] == '0' && w[1] == 'x') {
+            //strtod() also reads hex (integers here)
+            long double h = 0;
+            for (i = 2; i < wn; i++) {
+                int dv = (is_digit(w[i]) ? w[i] - '0' : (w[i] >= 'a' && w[i] <= 'f' ? w[i] - 'a' + 10 : -1));
+                if (dv < 0) { break; }
+                h = h * 16 + dv;
+            }
+            if (i > 2) { return (long double)(double)h; }
+            i = 0;
+        }
+        for (; i < wn; i++) {
+            if (w[i] == '.' && !dot) { dot = true; continue; }
+            if (!is_digit(w[i])) { break; }
+            if (digits < 19) { m = m * 10 + (unsigned long long)(w[i] - '0'); if (m > 0) { digits++; } if (dot) { exp10--; } }
+            else if (!dot) { exp10++; }
+        }
+        if (i == wn && !dot) {
+            //calc_strtonum() has integers exact (strtold)
+            long double n = 0;
+            for (i = 0; i < wn; i++) { n = n * 10 + (w[i] - '0'); }
+            return n;
+        }
+        size_t s = (i + 2 < wn && (w[i + 1] == '-' || w[i + 1] == '+') ? i + 2 : i + 1);
+        if (s < wn && w[i] == 'e' && is_digit(w[s])) {
+            int e = 0;
+            for (i = s; i < wn && is_digit(w[i]); i++) { if (e < 100000) { e = e * 10 + (w[i] - '0'); } }
+            exp10 += (w[s - 1] == '-' ? -e : e);
+        }
+        long double v = (long double)m, p = 1, b = 10;
+        for (int e = (exp10 < 0 ? -exp10 : exp10); e > 0; e >>= 1) { if (e & 1) { p *= b; } b *= b; }
+        v = (exp10 < 0 ? v / p : v * p);
+        //strtod() returns a double
+        return (long double)(double)v;
+    }
+};
+/**
+ *  "..."_calc
+ *
+ *  Compile time value of a constant formula, see CalcConst::eval().
+ */
+template <CalcConst::Literal F>
+consteval long double operator""_calc() { return CalcConst::eval(F.s); }
+#endif
@@ -0,0 +1,324 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_EDIT_H_
+#define _FUNKII_CALC_EDIT_H_
+
+/* INCLUDES! */
+#include "calc.h"
+
+/* Raw chars between two lexer checkpoints */
+#define CALC_EDIT_BLOCK     256
+/* Evaluations a sub-expression result is kept for after it was last used (undo, retyping) */
+#define CALC_EDIT_KEEP      64
+
+/**
+ *  CalcEditStats
+ *
+ *  What the last edit cost.
+ */
+struct CalcEditStats {
+    uint64_t edits;                 /* Edits (and assigns) so far */
+    size_t relexed;                 /* Raw chars cleaned again */
+    size_t reused;                  /* Raw chars whose cleaned output was kept (the lexer only) */
+    size_t memo;                    /* Sub-expression results remembered */
+    size_t used;                    /* Of those, looked up or computed by the last evaluation */
+};
+/**
+ * CalcEdit Class
+ *
+ *  An editing session: the formula of a text box that is evaluated again on every
+ *  keystroke. The edits come in as (offset, chars erased, text inserted) and the result
+ *  and the Error are always the ones Calc::assign() of the whole text gives, but:
+ *      - The lexer (Calc::clean()) leaves a checkpoint every CALC_EDIT_BLOCK raw chars.
+ *        An edit is cleaned again from the checkpoint before it until the lexer is back
+ *        in the state it was at an old checkpoint past the edit, the rest of the cleaned
+ *        text is kept as it was.
+ *      - Every calculate() of a sub-expression is remembered by its text (plus the level,
+ *        the function and errno, the only other things it depends on), so only the
+ *        sub-expressions around the edit are parsed and evaluated again, the others are
+ *        a lookup. The results not used by the last CALC_EDIT_KEEP evaluations are
+ *        dropped every time the memo doubles.
+ *  Formulas with variables (';') are substituted as a whole, those are lexed from the
+ *  start (the evaluation is still remembered). calc_err_fenv doesn't remember anything.
+ *  Only those two are incremental: Calc::check(), logic(), aggregates() and the split of
+ *  the formula into its operands still go over the whole cleaned text on every edit, and
+ *  so does the lookup of every sub-expression around the edit (its text is the key). An
+ *  edit is linear in the length of the formula, a fraction of what Calc::assign() costs,
+ *  not a function of the size of the edit.
+ *
+ *  Usage Example:
+ *      CalcEdit ed("sqrt(16) + 2");
+ *      ed.edit(10, 1, "(3 * 4)");      //sqrt(16) + (3 * 4)
+ *      cout << ed.result_s();          //16
+ */
+class CalcEdit {
+public:
+    /**
+     *  CalcEdit Constructor
+     *
+     *  Empty text (CE_EMPTY, like Calc("")).
+     */
+    CalcEdit();
+    /**
+     *  CalcEdit Constructor
+     *
+     * @param   text            The whole text.
+     */
+    CalcEdit(string);
+    /**
+     * assign
+     *
+     *  Replaces the whole text.
+     *
+     * @param   text            The whole text.
+     */
+    void assign(string);
+    /**
+     * edit
+     *
+     *  Replaces part of the text and evaluates it.
+     *
+     * @param   offset          First char replaced (past the end is the end).
+     * @param   erase           Chars erased from there (past the end is to the end).
+     * @param   insert          Text inserted in their place.
+     */
+    void edit(size_t, size_t, const string &);
+    /**
+     * text
+     *
+     * @return  const string&   The text as edited.
+     */
+    const string &text() const;
+    /**
+     * result_d / result_s / error / get_error / get_error_code
+     *
+     *  Those of Calc, for the text as edited.
+     */
+    long double result_d();
+    string result_s();
+    string result_s(enum FunkiiCalcOptions_t);
+    bool error();
+    string get_error();
+    enum FunkiiCalcErrors_t get_error_code();
+    /**
+     * limits / error_mode / bind / table
+     *
+     *  Those of Calc, from the next edit on.
+     */
+    void limits(const CalcLimits &);
+    void error_mode(enum FunkiiCalcErrorModes_t);
+    void bind(string, const long double *, size_t);
+    void table(string, const CalcTable *);
+    /**
+     * stats
+     *
+     * @return  CalcEditStats   Of the last edit.
+     */
+    CalcEditStats stats() const;
+private:
+    struct Mark {
+        size_t raw;                 /* Next raw char to clean */
+        size_t out;                 /* Length of the cleaned text up to there */
+        Calc::Lex lex;              /* Lexer state there */
+    };
+    Calc mCalc;
+    string mText;                   /* Raw text */
+    string mClean;                  /* Cleaned text (Calc::clean() of all of mText) */
+    vector<Mark> mMarks;            /* Checkpoints, mMarks[0] is the start and the last one the end */
+    bool mLexed;                    /* mMarks and mClean are those of mText */
+    bool mComplete;                 /* and they go to its end (no lexer Error) */
+    map<string, Calc::Memo> mMemo;
+    size_t mSweep;                  /* mMemo size that drops the old results */
+    CalcEditStats mStats;
+
+    /**
+     * update
+     *
+     *  Evaluates the text after mText[offset, offset + inserted) replaced erased chars.
+     */
+    void update(size_t, size_t, size_t);
+    /**
+     * lex
+     *
+     *  Brings mClean and mMarks up to date with the edit (everything if !mLexed).
+     *
+     * @return  false           Lexer Error (mCalc.mError is set).
+     */
+    bool lex(size_t, size_t, size_t);
+    /**
+     * same_name
+     *
+     *  Whether the letters and digits the cleaned text ends with (a name or a number, what
+     *  clean() looks back at on a '(') are the same at n as at o in the old text, which
+     *  is mClean up to base then tail.
+     */
+    bool same_name(size_t, const string &, size_t, size_t) const;
+};
+inline CalcEdit::CalcEdit() : mCalc(string("")), mLexed(false), mComplete(false), mSweep(1024) {
+    memset(&mStats, 0, sizeof(mStats));
+    update(0, 0, 0);
+}
+inline CalcEdit::CalcEdit(string text) : mCalc(string("")), mText(text), mLexed(false), mComplete(false), mSweep(1024) {
+    memset(&mStats, 0, sizeof(mStats));
+    update(0, 0, text.length());
+}
+inline void CalcEdit::assign(string text) {
+    mText = text;
+    mLexed = false;
+    update(0, 0, text.length());
+}
+inline void CalcEdit::edit(size_t offset, size_t erase, const string &insert) {
+    if (offset > mText.length()) { offset = mText.length(); }
+    if (erase > mText.length() - offset) { erase = mText.length() - offset; }
+    mText.replace(offset, erase, insert);
+    update(offset, erase, insert.length());
+}
+inline const string &CalcEdit::text() const { return mText; }
+inline long double CalcEdit::result_d() { return mCalc.result_d(); }
+inline string CalcEdit::result_s() { return mCalc.result_s(); }
+inline string CalcEdit::result_s(enum FunkiiCalcOptions_t Options) { return mCalc.result_s(Options); }
+inline bool CalcEdit::error() { return mCalc.error(); }
+inline string CalcEdit::get_error() { return mCalc.get_error(); }
+inline enum FunkiiCalcErrors_t CalcEdit::get_error_code() { return mCalc.get_error_code(); }
+inline void CalcEdit::limits(const CalcLimits &lim) {
+    mCalc.limits(lim);
+    mLexed = false;     //the depth limit stops the lexer
+}
+inline void CalcEdit::error_mode(enum FunkiiCalcErrorModes_t mode) { mCalc.error_mode(mode); }
+inline void CalcEdit::bind(string name, const long double *values, size_t n) { mCalc.bind(name, values, n); }
+inline void CalcEdit::table(string name, const CalcTable *table) { mCalc.table(name, table); }
+inline CalcEditStats CalcEdit::stats() const { return mStats; }
+inline void CalcEdit::update(size_t offset, size_t erased, size_t inserted) {
+    mStats.edits++;
+    mStats.relexed = mStats.reused = 0;
+    mCalc.reset();
+    mCalc.mMemo = &mMemo;
+    mCalc.mMemoGen++;
+    mCalc.mMemoUsed = 0;
+    //what Calc::syntax() does, the checks in the same order
+    if (mCalc.mLimits.length > 0 && mText.length() > mCalc.mLimits.length) {
+        mCalc.mError = CE_LIM_LENGTH;
+        mLexed = false;
+    }
+    else if (mText.find(';', 1) != string::npos) {
+        //the variables are substituted in the raw text
+        mLexed = false;
+        mStats.relexed = mText.length();
+        if (mCalc.syntax(mText)) { mCalc.evaluate(); }
+    }
+    else if (lex(offset, erased, inserted)) {
+        const Calc::Lex &end = mMarks.back().lex;
+        bool ok;
+        if (end.type != 0) { ok = mCalc.check(mClean + ")", end.p); }
+        else { ok = mCalc.check(mClean, end.p); }
+        if (ok) { mCalc.evaluate(); }
+    }
+    mCalc.mMemo = NULL;
+    //the ones the text hasn't had for a while
+    if (mMemo.size() > mSweep) {
+        for (map<string, Calc::Memo>::iterator it = mMemo.begin(); it != mMemo.end(); ) {
+            if (it->second.gen + CALC_EDIT_KEEP <= mCalc.mMemoGen) { mMemo.erase(it++); }
+            else { ++it; }
+        }
+        mSweep = 2 * mMemo.size() + 1024;
+    }
+    mStats.memo = mMemo.size();
+    mStats.used = mCalc.mMemoUsed;
+}
+inline bool CalcEdit::same_name(size_t n, const string &tail, size_t base, size_t o) const {
+    while (true) {
+        char a = (n > 0 ? mClean.at(n - 1) : ' ');
+        char b = (o > 0 ? (o > base ? tail.at(o - 1 - base) : mClean.at(o - 1)) : ' ');
+        bool an = ((a >= 'a' && a <= 'z') || (a >= '0' && a <= '9')), bn = ((b >= 'a' && b <= 'z') || (b >= '0' && b <= '9'));
+        if (!an || !bn) { return (an == bn); }
+        if (a != b) { return false; }
+        n--; o--;
+    }
+}
+inline bool CalcEdit::lex(size_t offset, size_t erased, size_t inserted) {
+    //from the last checkpoint before the edit (the char before it too: a '\' reads the next one)
+    size_t k = 0;
+    if (mLexed) {
+        while (k + 1 < mMarks.size() && mMarks[k + 1].raw < offset) { k++; }
+    }
+    else {
+        mMarks.clear();
+        mMarks.push_back(Mark());
+        mMarks[0].raw = mMarks[0].out = 0;
+        mClean.clear();
+    }
+    vector<Mark> old(mMarks.begin() + k + 1, mMarks.end());
+    string tail = mClean.substr(mMarks[k].out);
+    size_t base = mMarks[k].out, j = 0;
+    mMarks.resize(k + 1);
+    mClean.resize(base);
+    Calc::Lex lex = mMarks[k].lex;
+    size_t pos = mMarks[k].raw, len = mText.length(), start = pos;
+    //on an Error the checkpoints before it are still good, the next edit starts from them,
+    //but there's nothing after them to go back to
+    bool reuse = (mLexed && mComplete);
+    mLexed = true; mComplete = false;
+    while (pos < len) {
+        size_t to = (len - pos > CALC_EDIT_BLOCK ? pos + CALC_EDIT_BLOCK : len);
+        //past the edit the blocks end where the old checkpoints moved to, to meet them
+        while (reuse && j < old.size() && (old[j].raw < offset + erased || old[j].raw + inserted <= pos + erased)) { j++; }
+        if (reuse && j < old.size() && old[j].raw + inserted - erased < to) { to = old[j].raw + inserted - erased; }
+        pos = mCalc.clean(mText, pos, to, mClean, lex, false);
+        if (pos == string::npos) {
+            mClean.resize(mMarks.back().out);
+            mStats.relexed = len - start;
+            return false;
+        }
+        Mark m;
+        m.raw = pos; m.out = mClean.length(); m.lex = lex;
+        mMarks.push_back(m);
+        //past the edit, the same state at the same (moved) place as before: the rest is the same
+        while (reuse && j < old.size() && (old[j].raw < offset + erased || old[j].raw + inserted < pos + erased)) { j++; }
+        if (reuse && j < old.size() && old[j].raw + inserted == pos + erased && old[j].lex == lex &&
+            same_name(mClean.length(), tail, base, old[j].out)) {
+            mStats.relexed = pos - start;
+            mStats.reused = len - pos;
+            mClean.append(tail, old[j].out - base, string::npos);
+            for (size_t r = j + 1; r < old.size(); r++) {
+                Mark moved = old[r];
+                moved.raw = moved.raw + inserted - erased;
+                moved.out = moved.out - old[j].out + m.out;
+                mMarks.push_back(moved);
+            }
+            mComplete = true;
+            return true;
+        }
+    }
+    mStats.relexed = len - start;
+    mComplete = true;
+    return true;
+}
+#endif
@@ -0,0 +1,86 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_ERRORS_H_
+#define _FUNKII_CALC_ERRORS_H_
+
+/**
+ *  FunkiiCalcErrors_t
+ *
+ *  Every Error the calculator reports (the messages are in Calc::get_error_c_str).
+ *  Plain C so the C API (calc_c.h) hands back the very same codes.
+ */
+enum FunkiiCalcErrors_t {
+        CE_NADA             =   0,
+        CE_EMPTY            =   1,
+        CE_SYNTAX           =   2,
+        CE_SYNTAX_VARS      =   3,
+        CE_SYN_VARS_INFLOOP =   4,
+        CE_SYN_PAR          =   5,
+        CE_SYN_EMPTY_PAR    =   6,
+        CE_SYN_INVALIDCHAR  =   7,
+        CE_DIV0             =   8,
+        CE_EDOM             =   9,
+        CE_ERANGE           =   10,
+        CE_FIB_OB           =   11,
+        CE_BIN              =   12,
+        CE_OCT              =   13,
+        CE_HEX              =   14,
+        CE_FACT_OB          =   15,
+        CE_INT_BITSHIFT     =   16,
+        CE_LIB_IO           =   17,
+        CE_LIB_FORMAT       =   18,
+        CE_LIB_VERSION      =   19,
+        CE_LIB_CHECKSUM     =   20,
+        CE_REG_UNDEF        =   21,
+        CE_REG_ARGS         =   22,
+        CE_REG_CYCLE        =   23,
+        CE_REG_DUP          =   24,
+        CE_REG_SEALED       =   25,
+        CE_MSG_FORMAT       =   26,
+        CE_MSG_SIZE         =   27,
+        CE_SOLVE_NOROOT     =   28,
+        CE_SOLVE_BUDGET     =   29,
+        CE_LIM_LENGTH       =   30,
+        CE_LIM_SIZE         =   31,
+        CE_LIM_DEPTH        =   32,
+        CE_LIM_NODES        =   33,
+        CE_LIM_STEPS        =   34,
+        CE_INT_ARG          =   35,
+        CE_WIN_ARG          =   36,
+        CE_SHARD_CRASH      =   37,
+        CE_TABLE_KEY        =   38,
+        CE_TABLE_DATA       =   39,
+        CE_SYN_GROUP        =   40,
+
+        CE_EPIC             =   100
+    };
+
+#endif
@@ -0,0 +1,519 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_GRAD_H_
+#define _FUNKII_CALC_GRAD_H_
+
+/* INCLUDES! */
+#include "calc_program.h"
+
+/**
+ * CalcGrad Class
+ *
+ *  Evaluates a compiled formula (CalcCode) and its partial derivatives with respect to
+ *  every variable slot in one pass (forward mode automatic differentiation): every value
+ *  on the evaluation stack carries the derivatives of the sub expression that made it
+ *  and every instruction applies the chain rule to them.
+ *  The results are exact derivatives of the formula as written (no step size):
+ *      - floor, ceil, round, fact, comparisons, && || ! and the bitshifts are flat (0).
+ *      - abs(x) is 0 at x = 0, min() and max() follow the first item that wins.
+ *      - if(c, a, b) is the derivative of the branch taken.
+ *      - calls to other formulas (CO_CALL) get the derivatives of their arguments.
+ *      - interp() follows the curve between the keys around x, lookup() and step() are flat.
+ *  Derivatives that don't exist where they are evaluated (sqrt(x) at x = 0, x^y with
+ *  x <= 0 and a variable y...) are an Error like NaN/Inf results: CE_ERANGE or CE_EDOM.
+ *
+ *  Usage Example:
+ *      CalcProgram prog("y * x^2 + sin(y)");
+ *      long double vars[2], grad[2];
+ *      vars[prog.slot("x")] = 3; vars[prog.slot("y")] = 0;
+ *      enum FunkiiCalcErrors_t err;
+ *      long double v = CalcGrad::run(prog.code(), vars, grad, err);
+ *
+ *  Output:
+ *      v = 0, grad[x] = 0, grad[y] = 10
+ */
+class CalcGrad {
+public:
+    /**
+     * run
+     *
+     *  Evaluates a formula and its gradient (errors as CalcProgram::run()).
+     *
+     * @param   code            Program to run.
+     * @param   vars            Value of every variable slot.
+     * @param   grad            Set to the partial derivative of every variable slot (0 on Error).
+     * @param   err             set to CE_NADA or the Error.
+     *
+     * @return  (long double)   Result, 0 on Error.
+     */
+    static long double run(const CalcCode &, const long double *, long double *, enum FunkiiCalcErrors_t &);
+    /**
+     * batch
+     *
+     *  run() of many rows, CALC_BATCH_BLOCK at a time like CalcProgram::batch(): every
+     *  instruction runs over the whole block, its value and then every derivative column,
+     *  in plain loops the compiler can vectorize. The rows of a block that raised a FP flag
+     *  or ended up with a NaN or Inf are evaluated again one by one with run(), and so are
+     *  the whole blocks that call other formulas or whose rows don't take the same way
+     *  of an if(), && or ||.
+     *
+     * @param   code            Program to run.
+     * @param   vars            Column of every variable slot (rows values each).
+     * @param   rows            Number of rows.
+     * @param   out             Result of every row (0 on Error).
+     * @param   grad            Column of derivatives of every variable slot (0 on Error).
+     * @param   errs            FunkiiCalcErrors_t of every row.
+     */
+    template <typename T>
+    static void batch(const CalcCode &, const T *const *, size_t, T *, T *const *, uint8_t *);
+    /**
+     * batch overload function
+     *
+     *  Same thing with the evaluation stack kept by the caller, so it's only allocated the
+     *  first time.
+     *
+     * @param   stk             Evaluation stack (values and derivatives), grown as needed.
+     */
+    template <typename T>
+    static void batch(const CalcCode &, const T *const *, size_t, T *, T *const *, uint8_t *, vector<T> &);
+    /**
+     * slope
+     *
+     *  Derivative of a function of Calc::func_array.
+     *
+     * @param   func            Function number (CO_FUNC argument).
+     * @param   x               Argument.
+     * @param   y               func(x).
+     *
+     * @return  T               func'(x).
+     */
+    template <typename T>
+    static T slope(int, T, T);
+private:
+    /**
+     * exec
+     *
+     *  The run() loop: the derivatives of var slot s are seed[s * nd ... s * nd + nd - 1]
+     *  (the derivatives of the arguments of a CO_CALL), or the unit vector s if seed is NULL.
+     *
+     * @param   nd              Number of derivatives.
+     */
+    static long double exec(const CalcCode &, const long double *, const long double *, uint32_t, long double *, enum FunkiiCalcErrors_t &);
+    /**
+     * aggregate
+     *
+     *  Calc::apply_aggregate() of argc items and its derivatives (item j's are d[j * nd ...]).
+     */
+    static long double aggregate(int, const long double *, const long double *, int, uint32_t, long double *, enum FunkiiCalcErrors_t &);
+    /**
+     * block
+     *
+     *  Runs a program over one block of batch() rows, the derivatives of stack entry s are
+     *  the columns stk[(depth + s * nvars) * CALC_BATCH_BLOCK ...].
+     *
+     * @return  false           The block has to be evaluated one row at a time.
+     */
+    template <typename T>
+    static bool block(const CalcCode &, const T *const *, size_t, size_t, T *, T *, T *const *, uint8_t *);
+    /* d = d * k, a 0 derivative stays 0 (k may be Inf where it doesn't matter) */
+    template <typename T>
+    static T chain(T d, T k) { return (d == 0 ? 0 : d * k); }
+};
+template <typename T>
+T CalcGrad::slope(int func, T x, T y) {
+    switch (func) {
+        case 1: return (T)0.5 / y;
+        case 4: return cos(x);
+        case 5: return -sin(x);
+        case 6: return 1 + y * y;
+        case 7: return 1 / sqrt(1 - x * x);
+        case 8: return -1 / sqrt(1 - x * x);
+        case 9: return 1 / (1 + x * x);
+        case 10: return cosh(x);
+        case 11: return sinh(x);
+        case 12: return 1 - y * y;
+        case 13: return 1 / x;
+        case 14: return (T)0.434294481903251827651128918916605082L / x;
+        case 15:
+        case 16: return (x > 0 ? 1 : (x < 0 ? -1 : 0));
+        case 17:
+        case 18:
+        case 19: return 1;     //bin(), oct() and hex() of a value are the value
+        default: return 0;     //floor, ceil, round, fact and the integer functions
+    }
+}
+inline long double CalcGrad::run(const CalcCode &code, const long double *vars, long double *grad, enum FunkiiCalcErrors_t &err) {
+    err = CE_NADA; errno = 0;
+    long double res = exec(code, vars, NULL, code.nvars, grad, err);
+    for (uint32_t s = 0; s < code.nvars && err == CE_NADA; s++) {
+        if (!isfinite(grad[s])) { err = (grad[s] != grad[s] ? CE_EDOM : CE_ERANGE); }
+    }
+    if (err != CE_NADA) {
+        for (uint32_t s = 0; s < code.nvars; s++) { grad[s] = 0; }
+        return 0;
+    }
+    return res;
+}
+inline long double CalcGrad::exec(const CalcCode &code, const long double *vars, const long double *seed, uint32_t nd, long double *grad, enum FunkiiCalcErrors_t &err) {
+    size_t depth = (code.stack > 0 ? code.stack : 1), need = depth * (nd + 1) + nd;
+    long double local[CALC_PROGRAM_STACK * 4], *stk = local;
+    vector<long double> big;
+    if (need > CALC_PROGRAM_STACK * 4) { big.resize(need); stk = &big[0]; }
+    long double *d = stk + depth, *tmp = d + depth * nd;
+    int sp = -1;
+    for (uint32_t pc = 0; pc < code.nops; pc++) {
+        const CalcOp &op = code.ops[pc];
+        int e = errno;
+        switch (op.code) {
+            case CO_CONST:
+                stk[++sp] = code.consts[op.arg];
+                for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = 0; }
+                break;
+            case CO_VAR:
+                stk[++sp] = vars[op.arg];
+                for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = (seed != NULL ? seed[op.arg * nd + k] : (k == op.arg ? 1 : 0)); }
+                break;
+            case CO_NEG:
+                stk[sp] = -stk[sp];
+                for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = -d[sp * nd + k]; }
+                break;
+            case CO_NOT:
+                stk[sp] = (stk[sp] == 0 ? 1 : 0);
+                for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = 0; }
+                break;
+            case CO_JZ:
+                if (stk[sp] == 0) { pc += op.arg; }
+                else { sp--; }
+                break;
+            case CO_JMP: pc += op.arg; break;
+            case CO_IF:
+                sp--;
+                stk[sp] = stk[sp + 1];
+                for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = d[(sp + 1) * nd + k]; }
+                break;
+            case CO_JF:
+            case CO_JT:
+                if ((stk[sp] != 0) == (op.code == CO_JT)) {
+                    stk[sp] = (op.code == CO_JT ? 1 : 0);
+                    for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = 0; }
+                    pc += op.arg;
+                }
+                break;
+            case CO_CALL: {
+                    //the arguments are the vars of the callee, their derivatives its seed
+                    sp -= op.argc;
+                    long double r = exec(code.calls[op.arg], stk + sp + 1, d + (sp + 1) * nd, nd, tmp, err);
+                    stk[++sp] = r;
+                    for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = tmp[k]; }
+                } break;
+            case CO_AGG:
+                sp -= op.argc - 1;
+                stk[sp] = aggregate((int)op.arg, stk + sp, d + sp * nd, op.argc, nd, tmp, err);
+                for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = tmp[k]; }
+                break;
+            case CO_LOOKUP:
+            case CO_INTERP:
+            case CO_STEP: {
+                    const CalcTable *t = code.tables[op.arg];
+                    long double x = stk[sp], s = (op.code == CO_INTERP ? t->slope(x) : 0);
+                    stk[sp] = t->apply(op.code - CO_LOOKUP + 1, x, err);
+                    if (err != CE_NADA) { return 0; }
+                    for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = chain(d[sp * nd + k], s); }
+                } break;
+            case CO_FUNC: {
+                    long double x = stk[sp];
+                    stk[sp] = CalcProgram::apply(op.code, op.arg, x, 0, err);
+                    if (err != CE_NADA) { return 0; }
+                    e = errno;
+                    long double s = slope(op.arg, x, stk[sp]);
+                    for (uint32_t k = 0; k < nd; k++) { d[sp * nd + k] = chain(d[sp * nd + k], s); }
+                } break;
+            default: {
+                    sp--;
+                    long double a = stk[sp], b = stk[sp + 1], ka = 0, kb = 0;
+                    long double r = CalcProgram::apply(op.code, op.arg, a, b, err);
+                    if (err != CE_NADA) { return 0; }
+                    e = errno;
+                    stk[sp] = r;
+                    long double *da = d + sp * nd, *db = da + nd;
+                    switch (op.code) {
+                        case CO_ADD: ka = 1; kb = 1; break;
+                        case CO_SUB: ka = 1; kb = -1; break;
+                        case CO_MUL: ka = b; kb = a; break;
+                        case CO_DIV: ka = 1 / b; kb = -r / b; break;
+                        case CO_MOD: ka = 1; kb = -(a - r) / b; break;     //a - trunc(a / b) * b
+                        case CO_POW: {
+                                ka = (b == 0 ? 0 : b * pow(a, b - 1));
+                                bool db0 = true;
+                                for (uint32_t k = 0; k < nd; k++) { if (db[k] != 0) { db0 = false; } }
+                                //x^y only has a derivative in y for x > 0
+                                if (!db0) { kb = (a > 0 ? r * log(a) : NAN); }
+                            } break;
+                        default: break;     //comparisons, logic and bitshifts are flat
+                    }
+                    for (uint32_t k = 0; k < nd; k++) { da[k] = chain(da[k], ka) + chain(db[k], kb); }
+                } break;
+        }
+        //errno is only for the values, not for the derivatives
+        errno = e;
+        if (err != CE_NADA) { return 0; }
+    }
+    for (uint32_t k = 0; k < nd; k++) { grad[k] = (sp < 0 ? 0 : d[sp * nd + k]); }
+    return (sp < 0 ? 0 : stk[sp]);
+}
+inline long double CalcGrad::aggregate(int agg, const long double *v, const long double *d, int argc, uint32_t nd, long double *out, enum FunkiiCalcErrors_t &err) {
+    long double r = Calc::apply_aggregate(agg, v, argc, err);
+    for (uint32_t k = 0; k < nd; k++) { out[k] = 0; }
+    if (err != CE_NADA) { return 0; }
+    switch (agg) {
+        case 1:
+        case 2:
+            for (int j = 0; j < argc; j++) { for (uint32_t k = 0; k < nd; k++) { out[k] += d[j * nd + k]; } }
+            if (agg == 2) { for (uint32_t k = 0; k < nd; k++) { out[k] /= argc; } }
+            break;
+        case 3:
+        case 4:
+            for (int j = 0; j < argc; j++) {
+                if (v[j] != r) { continue; }
+                for (uint32_t k = 0; k < nd; k++) { out[k] = d[j * nd + k]; }
+                break;
+            }
+            break;
+        case 5: {
+                //d stddev = sum((v - mean) * d v) / (n * stddev), flat if all the items are equal
+                if (r == 0) { break; }
+                long double mean = 0;
+                for (int j = 0; j < argc; j++) { mean += v[j]; }
+                mean /= argc;
+                for (int j = 0; j < argc; j++) {
+                    long double w = (v[j] - mean) / (argc * r);
+                    for (uint32_t k = 0; k < nd; k++) { out[k] += chain(d[j * nd + k], w); }
+                }
+            } break;
+        case 6: {
+                int h = argc / 2;
+                for (int j = 0; j < h; j++) {
+                    for (uint32_t k = 0; k < nd; k++) { out[k] += chain(d[j * nd + k], v[h + j]) + chain(d[(h + j) * nd + k], v[j]); }
+                }
+            } break;
+    }
+    return r;
+}
+template <typename T>
+void CalcGrad::batch(const CalcCode &code, const T *const *vars, size_t rows, T *out, T *const *grad, uint8_t *errs) {
+    vector<T> stk;
+    batch(code, vars, rows, out, grad, errs, stk);
+}
+template <typename T>
+void CalcGrad::batch(const CalcCode &code, const T *const *vars, size_t rows, T *out, T *const *grad, uint8_t *errs, vector<T> &stk) {
+    size_t need = (size_t)(code.stack > 0 ? code.stack : 1) * (code.nvars + 1) * CALC_BATCH_BLOCK;
+    if (stk.size() < need) { stk.resize(need); }
+    vector<long double> row(code.nvars + 1), g(code.nvars + 1);
+    uint8_t lane[CALC_BATCH_BLOCK];
+    for (size_t from = 0; from < rows; from += CALC_BATCH_BLOCK) {
+        size_t n = (rows - from < CALC_BATCH_BLOCK ? rows - from : CALC_BATCH_BLOCK);
+        T *res = out + from;
+        memset(lane, CE_NADA, n);
+        Calc::fenv_clear();
+        bool all = !block(code, vars, from, n, &stk[0], res, grad, lane) || (Calc::fenv_error() != CE_NADA);
+        for (size_t i = 0; i < n; i++) {
+            errs[from + i] = CE_NADA;
+            bool fine = (!all && lane[i] == CE_NADA && isfinite(res[i]));
+            for (uint32_t s = 0; s < code.nvars && fine; s++) { fine = isfinite(grad[s][from + i]); }
+            if (fine) { continue; }
+            //something went wrong in this block, the scalar run tells which rows and why
+            for (uint32_t s = 0; s < code.nvars; s++) { row[s] = vars[s][from + i]; }
+            enum FunkiiCalcErrors_t err;
+            long double v = run(code, &row[0], &g[0], err);
+            res[i] = (T)v;
+            if (err == CE_NADA && isfinite(v) && !isfinite(res[i])) { err = CE_ERANGE; }
+            for (uint32_t s = 0; s < code.nvars; s++) {
+                grad[s][from + i] = (T)g[s];
+                if (err == CE_NADA && !isfinite(grad[s][from + i])) { err = CE_ERANGE; }
+            }
+            if (err != CE_NADA) {
+                res[i] = 0;
+                for (uint32_t s = 0; s < code.nvars; s++) { grad[s][from + i] = 0; }
+                errs[from + i] = (uint8_t)err;
+            }
+        }
+    }
+}
+template <typename T>
+bool CalcGrad::block(const CalcCode &code, const T *const *vars, size_t from, size_t n, T *stk, T *out, T *const *grad, uint8_t *lane) {
+    const size_t B = CALC_BATCH_BLOCK, nd = code.nvars, depth = (code.stack > 0 ? code.stack : 1);
+    T *const d = stk + depth * B;
+    T x[CALC_BATCH_BLOCK], ka[CALC_BATCH_BLOCK], kb[CALC_BATCH_BLOCK];
+    int sp = -1;
+    for (uint32_t pc = 0; pc < code.nops; pc++) {
+        const CalcOp &op = code.ops[pc];
+        if (op.code == CO_CALL || op.code == CO_AGG) { return false; }
+        if (op.code == CO_JZ || op.code == CO_JF || op.code == CO_JT) {
+            //a plain jump if every row goes the same way, the rows can't be blended here
+            T *a = stk + (size_t)sp * B;
+            size_t go = 0;
+            for (size_t i = 0; i < n; i++) { go += (op.code == CO_JT ? a[i] == 0 : a[i] != 0); }
+            if (go != 0 && go != n) { return false; }
+            if (go == 0) {
+                if (op.code != CO_JZ) {
+                    for (size_t i = 0; i < n; i++) { a[i] = (op.code == CO_JF ? 0 : 1); }
+                    for (size_t k = 0; k < nd; k++) { memset(d + (sp * nd + k) * B, 0, n * sizeof(T)); }
+                }
+                pc += op.arg;
+            }
+            else if (op.code == CO_JZ) { sp--; }
+            continue;
+        }
+        if (op.code == CO_JMP) { pc += op.arg; continue; }
+        if (op.code == CO_IF) {
+            sp--;
+            memcpy(stk + (size_t)sp * B, stk + (size_t)(sp + 1) * B, n * sizeof(T));
+            memcpy(d + sp * nd * B, d + (sp + 1) * nd * B, nd * B * sizeof(T));
+            continue;
+        }
+        if (op.code == CO_CONST) {
+            T *a = stk + (size_t)(++sp) * B, v = (T)code.consts[op.arg];
+            for (size_t i = 0; i < n; i++) { a[i] = v; }
+            for (size_t k = 0; k < nd; k++) { memset(d + (sp * nd + k) * B, 0, n * sizeof(T)); }
+            continue;
+        }
+        if (op.code == CO_VAR) {
+            memcpy(stk + (size_t)(++sp) * B, vars[op.arg] + from, n * sizeof(T));
+            for (size_t k = 0; k < nd; k++) {
+                T *dk = d + (sp * nd + k) * B, v = (T)(k == op.arg ? 1 : 0);
+                for (size_t i = 0; i < n; i++) { dk[i] = v; }
+            }
+            continue;
+        }
+        if (op.code == CO_LOOKUP || op.code == CO_INTERP || op.code == CO_STEP) {
+            const CalcTable *t = code.tables[op.arg];
+            T *a = stk + (size_t)sp * B, *da = d + sp * nd * B;
+            if (op.code == CO_INTERP) { for (size_t i = 0; i < n; i++) { ka[i] = t->slope(a[i]); } }
+            else { memset(ka, 0, n * sizeof(T)); }
+            t->apply(op.code - CO_LOOKUP + 1, a, n, a, lane);
+            for (size_t k = 0; k < nd; k++) {
+                T *dk = da + k * B;
+                for (size_t i = 0; i < n; i++) { dk[i] = chain(dk[i], ka[i]); }
+            }
+            continue;
+        }
+        if (op.code == CO_NEG || op.code == CO_NOT || op.code == CO_FUNC) {
+            T *a = stk + (size_t)sp * B, *da = d + sp * nd * B;
+            if (op.code == CO_NEG) {
+                for (size_t i = 0; i < n; i++) { a[i] = -a[i]; }
+                for (size_t i = 0; i < nd * B; i++) { da[i] = -da[i]; }
+                continue;
+            }
+            if (op.code == CO_NOT) {
+                for (size_t i = 0; i < n; i++) { a[i] = (a[i] == 0 ? 1 : 0); }
+                memset(da, 0, nd * B * sizeof(T));
+                continue;
+            }
+            memcpy(x, a, n * sizeof(T));
+            if (!CalcSimd::apply((int)op.arg, (enum FunkiiCalcMathTiers_t)code.math, a, n, lane)) {
+                for (size_t i = 0; i < n; i++) {
+                    enum FunkiiCalcErrors_t err = CE_NADA;
+                    a[i] = BasicCalc<T>::eval_func((int)op.arg, a[i], err);
+                    if (err != CE_NADA) { return false; }
+                }
+            }
+            for (size_t i = 0; i < n; i++) { ka[i] = slope((int)op.arg, x[i], a[i]); }
+            for (size_t k = 0; k < nd; k++) {
+                T *dk = da + k * B;
+                for (size_t i = 0; i < n; i++) { dk[i] = chain(dk[i], ka[i]); }
+            }
+            continue;
+        }
+        sp--;
+        T *a = stk + (size_t)sp * B, *b = a + B, *da = d + sp * nd * B, *db = da + nd * B;
+        bool flat = false;
+        switch (op.code) {
+            case CO_ADD:
+                for (size_t i = 0; i < n; i++) { a[i] += b[i]; }
+                for (size_t i = 0; i < nd * B; i++) { da[i] += db[i]; }
+                continue;
+            case CO_SUB:
+                for (size_t i = 0; i < n; i++) { a[i] -= b[i]; }
+                for (size_t i = 0; i < nd * B; i++) { da[i] -= db[i]; }
+                continue;
+            case CO_MUL:
+                for (size_t i = 0; i < n; i++) { ka[i] = b[i]; kb[i] = a[i]; a[i] *= b[i]; }
+                break;
+            case CO_DIV:
+                for (size_t i = 0; i < n; i++) { a[i] /= b[i]; ka[i] = 1 / b[i]; kb[i] = -a[i] / b[i]; }
+                break;
+            case CO_MOD:
+                for (size_t i = 0; i < n; i++) { T r = fmod(a[i], b[i]); ka[i] = 1; kb[i] = -(a[i] - r) / b[i]; a[i] = r; }
+                break;
+            case CO_POW:
+                for (size_t i = 0; i < n; i++) {
+                    T r = pow(a[i], b[i]);
+                    ka[i] = (b[i] == 0 ? 0 : b[i] * pow(a[i], b[i] - 1));
+                    kb[i] = (a[i] > 0 ? r * log(a[i]) : 0);
+                    //x <= 0 with a derivative in y: the row is an Error, run() tells which
+                    for (size_t k = 0; k < nd; k++) { if (a[i] <= 0 && db[k * B + i] != 0) { kb[i] = NAN; } }
+                    a[i] = r;
+                }
+                break;
+            case CO_LT: for (size_t i = 0; i < n; i++) { a[i] = (a[i] < b[i] ? 1 : 0); } flat = true; break;
+            case CO_GT: for (size_t i = 0; i < n; i++) { a[i] = (a[i] > b[i] ? 1 : 0); } flat = true; break;
+            case CO_EQ: for (size_t i = 0; i < n; i++) { a[i] = (a[i] == b[i] ? 1 : 0); } flat = true; break;
+            case CO_NE: for (size_t i = 0; i < n; i++) { a[i] = (a[i] != b[i] ? 1 : 0); } flat = true; break;
+            case CO_LE: for (size_t i = 0; i < n; i++) { a[i] = (a[i] <= b[i] ? 1 : 0); } flat = true; break;
+            case CO_GE: for (size_t i = 0; i < n; i++) { a[i] = (a[i] >= b[i] ? 1 : 0); } flat = true; break;
+            case CO_AND: for (size_t i = 0; i < n; i++) { a[i] = ((a[i] != 0 && b[i] != 0) ? 1 : 0); } flat = true; break;
+            case CO_OR: for (size_t i = 0; i < n; i++) { a[i] = ((a[i] != 0 || b[i] != 0) ? 1 : 0); } flat = true; break;
+            default:
+                //bitshifts, one row at a time
+                for (size_t i = 0; i < n; i++) {
+                    enum FunkiiCalcErrors_t err = CE_NADA;
+                    a[i] = (T)CalcProgram::apply(op.code, op.arg, a[i], b[i], err);
+                    if (err != CE_NADA) { return false; }
+                }
+                flat = true;
+        }
+        if (flat) { memset(da, 0, nd * B * sizeof(T)); continue; }
+        for (size_t k = 0; k < nd; k++) {
+            T *dak = da + k * B, *dbk = db + k * B;
+            for (size_t i = 0; i < n; i++) { dak[i] = chain(dak[i], ka[i]) + chain(dbk[i], kb[i]); }
+        }
+    }
+    if (sp < 0) {
+        for (size_t i = 0; i < n; i++) { out[i] = 0; }
+        for (size_t k = 0; k < nd; k++) { memset(grad[k] + from, 0, n * sizeof(T)); }
+    }
+    else {
+        memcpy(out, stk, n * sizeof(T));
+        for (size_t k = 0; k < nd; k++) { memcpy(grad[k] + from, d + k * B, n * sizeof(T)); }
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,509 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_LIBRARY_H_
+#define _FUNKII_CALC_LIBRARY_H_
+
+/* INCLUDES! */
+#include "calc_program.h"
+#include <algorithm>
+#ifdef _WIN32
+    #include <stdio.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#define CALC_LIB_MAGIC      "FKCALCLB"
+#define CALC_LIB_VERSION    1
+#define CALC_LIB_ENDIAN     0x01020304
+
+/**
+ *  Formula Library file layout
+ *
+ *  Everything is addressed by offsets from the start of the file (position independent)
+ *  and every section is 8 byte aligned, so a mapped file is used as it is:
+ *
+ *      CalcLibHeader
+ *      CalcLibEntry    entries[count]      one per formula, in source order
+ *      uint32_t        names[nnames]       entry numbers of the named formulas, sorted by name
+ *      CalcOp          ops[nops]           instructions of every formula
+ *      double          consts[nconsts]     constant pools of every formula
+ *      CalcLibSymbol   symbols[nsymbols]   variable names of every formula
+ *      char            strings[nstrings]   formula and variable names (NULL terminated)
+ */
+struct CalcLibHeader {
+    char magic[8];                  /* CALC_LIB_MAGIC */
+    uint32_t version;               /* CALC_LIB_VERSION */
+    uint32_t endian;                /* CALC_LIB_ENDIAN as written by the compiler */
+    uint32_t header_size;           /* sizeof(CalcLibHeader) */
+    uint32_t entry_size;            /* sizeof(CalcLibEntry) */
+    uint32_t count;                 /* Number of formulas */
+    uint32_t nnames;                /* Number of named formulas */
+    uint64_t size;                  /* Size of the whole file */
+    uint64_t source_hash;           /* CalcLibrary::hash() of the source text */
+    uint64_t payload_hash;          /* CalcLibrary::hash() of everything after the header */
+    uint32_t entries, names, ops, consts, symbols, strings;    /* Section offsets */
+    uint32_t nops, nconsts, nsymbols, nstrings;                /* Section sizes (items, strings in bytes) */
+};
+struct CalcLibEntry {
+    uint32_t name, name_len;        /* Formula name (offset into strings), "" if unnamed */
+    uint32_t ops, nops;             /* First instruction and count */
+    uint32_t consts, nconsts;       /* First constant and count */
+    uint32_t symbols, nsymbols;     /* First symbol and count (= variable slots) */
+    uint32_t stack, math;           /* Max depth of the evaluation stack, FunkiiCalcMathTiers_t */
+    uint64_t source_hash;           /* CalcLibrary::hash() of the formula text */
+};
+struct CalcLibSymbol {
+    uint32_t name, len;             /* offset into strings and length */
+};
+/**
+ * CalcLibrary Class
+ *
+ *  A read only, memory mapped library of compiled formulas (see tools/calc_compile.cpp).
+ *  Loading it is a single mmap() plus the checks, formulas are evaluated straight from
+ *  the mapping: nothing is deserialized and nothing is allocated per formula.
+ *
+ *  Usage Example:
+ *      CalcLibrary lib;
+ *      if (!lib.open("rules.fcl")) { cout << lib.get_error(); }
+ *      int f = lib.find("margin");
+ *      long double vars[1] = { 120 };
+ *      FunkiiCalcErrors_t err;
+ *      long double m = lib.code(f).eval(vars, err);
+ */
+class CalcLibrary {
+public:
+    /**
+     *  CalcLibrary Constructor
+     *
+     *  Empty library.
+     */
+    CalcLibrary();
+    /**
+     * ~CalcLibrary Destructor
+     *
+     *  Unmaps the file (every CalcCode of this library becomes invalid).
+     */
+    ~CalcLibrary();
+    /**
+     *  open
+     *
+     *  Maps a library file and checks it (including the checksum).
+     *
+     * @param   path            Library file.
+     *
+     * @return  true            Loaded.
+     * @return  false           Error (check get_error()).
+     */
+    bool open(const char *);
+    /**
+     *  open overload function
+     *
+     * @param   path            Library file.
+     * @param   verify          false skips the checksum and the program checks (trusted files only).
+     *
+     * @return  true            Loaded.
+     * @return  false           Error (check get_error()).
+     */
+    bool open(const char *, bool);
+    /**
+     *  attach
+     *
+     *  Uses a library that is already in memory (owned by the caller, 8 byte aligned).
+     *
+     * @param   data            Library image.
+     * @param   size            Size of the image.
+     *
+     * @return  true            Loaded.
+     * @return  false           Error (check get_error()).
+     */
+    bool attach(const void *, size_t);
+    /**
+     *  close
+     *
+     *  Unmaps the file.
+     */
+    void close();
+    bool error();
+    string get_error();
+    enum FunkiiCalcErrors_t get_error_code();
+    /**
+     * size
+     *
+     * @return  uint32_t        Number of formulas.
+     */
+    uint32_t size();
+    /**
+     * find
+     *
+     *  Binary search of a formula by name.
+     *
+     * @param   name            Formula name.
+     *
+     * @return  int             Formula number, -1 if not found.
+     */
+    int find(const char *);
+    /**
+     * name
+     *
+     * @param   i               Formula number.
+     *
+     * @return  (const char *)  Formula name ("" if unnamed).
+     */
+    const char *name(uint32_t);
+    /**
+     * code
+     *
+     * @param   i               Formula number.
+     *
+     * @return  CalcCode        The program, pointing into the mapping.
+     */
+    CalcCode code(uint32_t);
+    /**
+     * slot
+     *
+     * @param   i               Formula number.
+     * @param   var             Variable name.
+     *
+     * @return  int             Variable slot, -1 if the formula doesn't use it.
+     */
+    int slot(uint32_t, const char *);
+    /**
+     * symbol
+     *
+     * @param   i               Formula number.
+     * @param   slot            Variable slot.
+     *
+     * @return  (const char *)  Variable name.
+     */
+    const char *symbol(uint32_t, uint32_t);
+    /**
+     * source_hash
+     *
+     * @param   i               Formula number.
+     *
+     * @return  uint64_t        Hash of the formula text.
+     */
+    uint64_t source_hash(uint32_t);
+    /**
+     * stale
+     *
+     *  Compares the library against the source text it should have been compiled from.
+     *
+     * @param   source          Source text.
+     *
+     * @return  true            The library was compiled from something else (or isn't loaded).
+     */
+    bool stale(const string &);
+    /**
+     * hash
+     *
+     *  64 bit FNV-1a, used for every checksum of the library.
+     *
+     * @return  uint64_t
+     */
+    static uint64_t hash(const void *, size_t);
+    /**
+     * write
+     *
+     *  Builds a library image and writes it to a file.
+     *
+     * @param   path            Output file.
+     * @param   names           Formula names ("" for unnamed ones), names must be unique.
+     * @param   sources         Formula texts (for the per formula hash).
+     * @param   progs           Compiled formulas (without errors, nor table functions that weren't folded).
+     * @param   source_hash     hash() of the whole source text.
+     * @param   err             set on Error.
+     *
+     * @return  true            Written.
+     */
+    static bool write(const char *, const vector<string> &, const vector<string> &, const vector<CalcProgram> &, uint64_t, enum FunkiiCalcErrors_t &);
+private:
+    enum FunkiiCalcErrors_t mError; /* Load Error. */
+    const char *mData;              /* Library image. */
+    size_t mSize;                   /* Size of the image. */
+    bool mMapped;                   /* mData is ours (mmap or malloc) */
+    const CalcLibHeader *mHeader;
+    const CalcLibEntry *mEntries;
+    const uint32_t *mNames;
+    const CalcOp *mOps;
+    const double *mConsts;
+    const CalcLibSymbol *mSymbols;
+    const char *mStrings;
+
+    CalcLibrary(const CalcLibrary &);
+    CalcLibrary &operator=(const CalcLibrary &);
+    /**
+     * load
+     *
+     *  Checks the image and sets the section pointers.
+     *
+     * @param   verify          Check the checksum and every program.
+     *
+     * @return  true            Valid library.
+     */
+    bool load(bool);
+    /**
+     * section
+     *
+     *  Checks that a section is aligned and inside the image.
+     *
+     * @return  true            Valid section.
+     */
+    bool section(uint32_t, uint64_t, size_t);
+};
+inline CalcLibrary::CalcLibrary() : mError(CE_NADA), mData(NULL), mSize(0), mMapped(false), mHeader(NULL) { }
+inline CalcLibrary::~CalcLibrary() { close(); }
+inline bool CalcLibrary::open(const char *path) { return open(path, true); }
+inline bool CalcLibrary::open(const char *path, bool verify) {
+    C_DBG_START;
+    close();
+#ifdef _WIN32
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) { mError = CE_LIB_IO; C_DBG_END; return false; }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void *p = (n > 0 ? malloc(n) : NULL);
+    if (p == NULL || fread(p, 1, n, f) != (size_t)n) { free(p); fclose(f); mError = CE_LIB_IO; C_DBG_END; return false; }
+    fclose(f);
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) { mError = CE_LIB_IO; C_DBG_END; return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) { ::close(fd); mError = CE_LIB_IO; C_DBG_END; return false; }
+    size_t n = (size_t)st.st_size;
+    void *p = mmap(NULL, n, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) { mError = CE_LIB_IO; C_DBG_END; return false; }
+#endif
+    mData = (const char *)p; mSize = (size_t)n; mMapped = true;
+    if (!load(verify)) { enum FunkiiCalcErrors_t e = mError; close(); mError = e; C_DBG_END; return false; }
+    C_DBG_MSG("Library '%s' :: %u formulas",path,mHeader->count);
+    C_DBG_END;
+    return true;
+}
+inline bool CalcLibrary::attach(const void *data, size_t size) {
+    close();
+    mData = (const char *)data; mSize = size; mMapped = false;
+    if (!load(true)) { enum FunkiiCalcErrors_t e = mError; close(); mError = e; return false; }
+    return true;
+}
+inline void CalcLibrary::close() {
+    if (mMapped && mData != NULL) {
+#ifdef _WIN32
+        free((void *)mData);
+#else
+        munmap((void *)mData, mSize);
+#endif
+    }
+    mError = CE_NADA; mData = NULL; mSize = 0; mMapped = false; mHeader = NULL;
+}
+inline bool CalcLibrary::error() { return (mError != CE_NADA); }
+inline string CalcLibrary::get_error() { return string(Calc::get_error_c_str(mError)); }
+inline enum FunkiiCalcErrors_t CalcLibrary::get_error_code() { return mError; }
+inline uint32_t CalcLibrary::size() { return (mHeader == NULL ? 0 : mHeader->count); }
+inline int CalcLibrary::find(const char *name) {
+    if (mHeader == NULL) { return -1; }
+    uint32_t lo = 0, hi = mHeader->nnames;
+    while (lo < hi) {
+        uint32_t mid = lo + ((hi - lo) / 2);
+        int c = strcmp(mStrings + mEntries[mNames[mid]].name, name);
+        if (c == 0) { return (int)mNames[mid]; }
+        else if (c < 0) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return -1;
+}
+inline const char *CalcLibrary::name(uint32_t i) { return mStrings + mEntries[i].name; }
+inline CalcCode CalcLibrary::code(uint32_t i) {
+    const CalcLibEntry &e = mEntries[i];
+    CalcCode c;
+    c.ops = mOps + e.ops; c.consts = mConsts + e.consts; c.calls = NULL; c.tables = NULL;
+    c.nops = e.nops; c.nconsts = e.nconsts; c.ncalls = 0; c.ntables = 0; c.nvars = e.nsymbols; c.stack = e.stack; c.math = e.math;
+    return c;
+}
+inline int CalcLibrary::slot(uint32_t i, const char *var) {
+    const CalcLibEntry &e = mEntries[i];
+    for (uint32_t s = 0; s < e.nsymbols; s++) {
+        if (strcmp(mStrings + mSymbols[e.symbols + s].name, var) == 0) { return (int)s; }
+    }
+    return -1;
+}
+inline const char *CalcLibrary::symbol(uint32_t i, uint32_t slot) { return mStrings + mSymbols[mEntries[i].symbols + slot].name; }
+inline uint64_t CalcLibrary::source_hash(uint32_t i) { return mEntries[i].source_hash; }
+inline bool CalcLibrary::stale(const string &source) {
+    if (mHeader == NULL) { return true; }
+    return (mHeader->source_hash != hash(source.data(), source.length()));
+}
+inline uint64_t CalcLibrary::hash(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) { h ^= p[i]; h *= 1099511628211ULL; }
+    return h;
+}
+inline bool CalcLibrary::section(uint32_t off, uint64_t count, size_t size) {
+    return ((off % 8) == 0 && off >= sizeof(CalcLibHeader) && off <= mSize && (count * size) <= (mSize - off));
+}
+inline bool CalcLibrary::load(bool verify) {
+    mError = CE_LIB_FORMAT;
+    if (mData == NULL || mSize < sizeof(CalcLibHeader) || ((size_t)mData % 8) != 0) { return false; }
+    mHeader = (const CalcLibHeader *)mData;
+    if (memcmp(mHeader->magic, CALC_LIB_MAGIC, 8) != 0 || mHeader->endian != CALC_LIB_ENDIAN) { return false; }
+    if (mHeader->version != CALC_LIB_VERSION) { mError = CE_LIB_VERSION; return false; }
+    if (mHeader->header_size != sizeof(CalcLibHeader) || mHeader->entry_size != sizeof(CalcLibEntry) ||
+        mHeader->size != mSize || mHeader->nnames > mHeader->count ||
+        !section(mHeader->entries, mHeader->count, sizeof(CalcLibEntry)) ||
+        !section(mHeader->names, mHeader->nnames, sizeof(uint32_t)) ||
+        !section(mHeader->ops, mHeader->nops, sizeof(CalcOp)) ||
+        !section(mHeader->consts, mHeader->nconsts, sizeof(double)) ||
+        !section(mHeader->symbols, mHeader->nsymbols, sizeof(CalcLibSymbol)) ||
+        !section(mHeader->strings, mHeader->nstrings, 1) ||
+        mHeader->nstrings == 0 || mData[mHeader->strings + mHeader->nstrings - 1] != '\0') {
+        return false;
+    }
+    mEntries = (const CalcLibEntry *)(mData + mHeader->entries);
+    mNames = (const uint32_t *)(mData + mHeader->names);
+    mOps = (const CalcOp *)(mData + mHeader->ops);
+    mConsts = (const double *)(mData + mHeader->consts);
+    mSymbols = (const CalcLibSymbol *)(mData + mHeader->symbols);
+    mStrings = mData + mHeader->strings;
+    if (verify) {
+        if (hash(mData + sizeof(CalcLibHeader), mSize - sizeof(CalcLibHeader)) != mHeader->payload_hash) {
+            mError = CE_LIB_CHECKSUM;
+            return false;
+        }
+        for (uint32_t i = 0; i < mHeader->nnames; i++) {
+            if (mNames[i] >= mHeader->count) { return false; }
+        }
+        for (uint32_t i = 0; i < mHeader->nsymbols; i++) {
+            if (mSymbols[i].name >= mHeader->nstrings) { return false; }
+        }
+        for (uint32_t i = 0; i < mHeader->count; i++) {
+            const CalcLibEntry &e = mEntries[i];
+            if (e.name >= mHeader->nstrings ||
+                (uint64_t)e.ops + e.nops > mHeader->nops ||
+                (uint64_t)e.consts + e.nconsts > mHeader->nconsts ||
+                (uint64_t)e.symbols + e.nsymbols > mHeader->nsymbols ||
+                e.math > calc_math_fast ||
+                !CalcProgram::verify(code(i))) {
+                return false;
+            }
+        }
+    }
+    mError = CE_NADA;
+    return true;
+}
+/* sorts the name index of CalcLibrary::write() */
+struct CalcLibNameLess {
+    const vector<string> *names;
+    bool operator()(uint32_t a, uint32_t b) const { return (*names)[a] < (*names)[b]; }
+};
+inline bool CalcLibrary::write(const char *path, const vector<string> &names, const vector<string> &sources,
+                        const vector<CalcProgram> &progs, uint64_t source_hash, enum FunkiiCalcErrors_t &err) {
+    C_DBG_START;
+    CalcLibHeader h;
+    vector<CalcLibEntry> entries;
+    vector<uint32_t> index;
+    vector<CalcOp> ops;
+    vector<double> consts;
+    vector<CalcLibSymbol> symbols;
+    string strings(1, '\0');        //offset 0 is ""
+    err = CE_NADA;
+    for (size_t i = 0; i < progs.size(); i++) {
+        CalcCode c = progs[i].code();
+        //the tables live in memory, a library can't point at them
+        if (c.ntables > 0) { err = CE_LIB_FORMAT; C_DBG_END; return false; }
+        const vector<string> &syms = progs[i].symbols();
+        CalcLibEntry e;
+        memset(&e, 0, sizeof(e));
+        if (!names[i].empty()) {
+            e.name = (uint32_t)strings.length(); e.name_len = (uint32_t)names[i].length();
+            strings.append(names[i]); strings.push_back('\0');
+            index.push_back((uint32_t)i);
+        }
+        e.ops = (uint32_t)ops.size(); e.nops = c.nops;
+        ops.insert(ops.end(), c.ops, c.ops + c.nops);
+        e.consts = (uint32_t)consts.size(); e.nconsts = c.nconsts;
+        consts.insert(consts.end(), c.consts, c.consts + c.nconsts);
+        e.symbols = (uint32_t)symbols.size(); e.nsymbols = (uint32_t)syms.size();
+        for (size_t s = 0; s < syms.size(); s++) {
+            CalcLibSymbol sym;
+            sym.name = (uint32_t)strings.length(); sym.len = (uint32_t)syms[s].length();
+            strings.append(syms[s]); strings.push_back('\0');
+            symbols.push_back(sym);
+        }
+        e.stack = c.stack; e.math = c.math;
+        e.source_hash = hash(sources[i].data(), sources[i].length());
+        entries.push_back(e);
+    }
+    CalcLibNameLess less; less.names = &names;
+    sort(index.begin(), index.end(), less);
+    for (size_t i = 1; i < index.size(); i++) {
+        if (names[index[i]] == names[index[i - 1]]) { err = CE_LIB_FORMAT; C_DBG_END; return false; }
+    }
+    //lay out the sections, 8 byte aligned
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CALC_LIB_MAGIC, 8);
+    h.version = CALC_LIB_VERSION; h.endian = CALC_LIB_ENDIAN;
+    h.header_size = sizeof(CalcLibHeader); h.entry_size = sizeof(CalcLibEntry);
+    h.count = (uint32_t)entries.size(); h.nnames = (uint32_t)index.size();
+    h.nops = (uint32_t)ops.size(); h.nconsts = (uint32_t)consts.size();
+    h.nsymbols = (uint32_t)symbols.size(); h.nstrings = (uint32_t)strings.length();
+    uint64_t off = sizeof(CalcLibHeader);
+    h.entries = (uint32_t)off; off += ((entries.size() * sizeof(CalcLibEntry)) + 7) & ~(uint64_t)7;
+    h.names = (uint32_t)off; off += ((index.size() * sizeof(uint32_t)) + 7) & ~(uint64_t)7;
+    h.ops = (uint32_t)off; off += ((ops.size() * sizeof(CalcOp)) + 7) & ~(uint64_t)7;
+    h.consts = (uint32_t)off; off += ((consts.size() * sizeof(double)) + 7) & ~(uint64_t)7;
+    h.symbols = (uint32_t)off; off += ((symbols.size() * sizeof(CalcLibSymbol)) + 7) & ~(uint64_t)7;
+    h.strings = (uint32_t)off; off += (strings.length() + 7) & ~(uint64_t)7;
+    if (off > 0xFFFFFFFFULL) { err = CE_LIB_FORMAT; C_DBG_END; return false; }
+    h.size = off; h.source_hash = source_hash;
+    vector<char> img((size_t)off, 0);
+    if (!entries.empty()) { memcpy(&img[h.entries], &entries[0], entries.size() * sizeof(CalcLibEntry)); }
+    if (!index.empty()) { memcpy(&img[h.names], &index[0], index.size() * sizeof(uint32_t)); }
+    if (!ops.empty()) { memcpy(&img[h.ops], &ops[0], ops.size() * sizeof(CalcOp)); }
+    if (!consts.empty()) { memcpy(&img[h.consts], &consts[0], consts.size() * sizeof(double)); }
+    if (!symbols.empty()) { memcpy(&img[h.symbols], &symbols[0], symbols.size() * sizeof(CalcLibSymbol)); }
+    memcpy(&img[h.strings], strings.data(), strings.length());
+    h.payload_hash = hash(&img[sizeof(CalcLibHeader)], img.size() - sizeof(CalcLibHeader));
+    memcpy(&img[0], &h, sizeof(h));
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) { err = CE_LIB_IO; C_DBG_END; return false; }
+    bool ok = (fwrite(&img[0], 1, img.size(), f) == img.size());
+    if (fclose(f) != 0) { ok = false; }
+    if (!ok) { err = CE_LIB_IO; }
+    C_DBG_END;
+    return ok;
+}
+#endif
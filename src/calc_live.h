@@ -0,0 +1,465 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_LIVE_H_
+#define _FUNKII_CALC_LIVE_H_
+
+/* INCLUDES! */
+#include "calc_library.h"
+#include "calc_registry.h"
+#include <pthread.h>
+#ifdef __linux__
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+/* Reader slots: threads that can read at once */
+#define CALC_LIVE_READERS   256
+
+/**
+ *  CalcLiveStats
+ *
+ *  Counters of a CalcLive.
+ */
+struct CalcLiveStats {
+    uint64_t version;               /* Version readers get now (1 the first one published, 0 none) */
+    uint64_t published;             /* Versions published */
+    uint64_t failed;                /* Sources that didn't compile (the version in use stayed) */
+    uint64_t unchanged;             /* Reloads of the very same source, skipped */
+    uint64_t retired;               /* Old versions some reader may still be using */
+    uint64_t reclaimed;             /* Old versions freed */
+    uint32_t readers;               /* Reader slots taken */
+    uint32_t formulas;              /* Formulas of the current version */
+};
+/**
+ * CalcLive Class
+ *
+ *  A set of named formulas (a sealed CalcRegistry) that can be replaced while it's being
+ *  used: publish() compiles the new version on the side and swaps one pointer, readers
+ *  never wait for it and never take a lock (RCU). Every reader thread takes a slot once
+ *  (a CalcLive::Reader) and writes in it the epoch it's reading at, a replaced version is
+ *  freed as soon as no slot holds an epoch from before it was replaced (by the next
+ *  publish() or reclaim()). A version that doesn't compile is never published, the old
+ *  one stays. watch() reloads the file every time it's written (inotify on its directory,
+ *  so files replaced by rename() count too).
+ *
+ *  Source format, one formula per line (like calc_compile's, with signatures):
+ *      # comment
+ *      margin(x): x * 0.25
+ *      price(x, qty): (x + margin(x)) * qty
+ *
+ *  Usage Example:
+ *      CalcLive live;
+ *      live.load("rules.txt");
+ *      live.watch("rules.txt");
+ *      //every worker thread
+ *      CalcLive::Reader reader(live);
+ *      const CalcRegistry *reg = reader.lock();
+ *      if (reg != NULL) { res = reg->eval(reg->find("price"), args, err); }
+ *      reader.unlock();
+ */
+class CalcLive {
+    struct Version;
+public:
+    /**
+     * Reader Class
+     *
+     *  The slot of one reader thread, it can't be shared with other threads.
+     */
+    class Reader {
+    public:
+        /**
+         *  Reader Constructor
+         *
+         *  Takes a free slot (none if CALC_LIVE_READERS readers are alive already).
+         */
+        Reader(CalcLive &);
+        /**
+         * ~Reader Destructor
+         *
+         *  Unlocks and frees the slot.
+         */
+        ~Reader();
+        /**
+         * lock
+         *
+         *  Pins the current version until unlock(), never waits.
+         *
+         * @return  CalcRegistry*   The current version, NULL if nothing was published yet (or there's no slot).
+         */
+        const CalcRegistry *lock();
+        /**
+         * unlock
+         *
+         *  The version pinned by lock() may be freed from now on.
+         */
+        void unlock();
+        /**
+         * version
+         *
+         * @return  uint64_t        Version pinned by lock(), 0 none.
+         */
+        uint64_t version() const;
+    private:
+        Reader(const Reader &);
+        Reader &operator=(const Reader &);
+
+        CalcLive &mLive;
+        int mSlot;                  /* -1 if every slot was taken */
+        const Version *mPinned;
+    };
+    /**
+     *  CalcLive Constructor
+     *
+     *  Nothing published.
+     */
+    CalcLive();
+    /**
+     * ~CalcLive Destructor
+     *
+     *  Stops watching and frees every version (the Readers must be gone).
+     */
+    ~CalcLive();
+    /**
+     *  publish
+     *
+     *  Compiles a source and makes it the current version. The same source as the current
+     *  version is skipped.
+     *
+     * @param   source          The formulas (see the Source format).
+     *
+     * @return  true            Published (or unchanged).
+     * @return  false           Error (check get_error() and error_line()), the version in use stays.
+     */
+    bool publish(const string &);
+    /**
+     *  load
+     *
+     *  publish() of a file.
+     *
+     * @param   path            Source file.
+     *
+     * @return  true            Published (or unchanged).
+     * @return  false           Error (CE_LIB_IO if it can't be read).
+     */
+    bool load(const char *);
+    /**
+     *  watch
+     *
+     *  Starts a thread that load()s the file again every time it's written or replaced.
+     *
+     * @param   path            Source file.
+     *
+     * @return  true            Watching.
+     * @return  false           Can't watch it (CE_LIB_IO), or already watching.
+     */
+    bool watch(const char *);
+    /**
+     *  unwatch
+     *
+     *  Stops the watch() thread.
+     */
+    void unwatch();
+    /**
+     *  reclaim
+     *
+     *  Frees the old versions no reader is using anymore (publish() does it too).
+     */
+    void reclaim();
+    /**
+     * stats
+     *
+     * @return  CalcLiveStats   The counters.
+     */
+    CalcLiveStats stats();
+    bool error();
+    string get_error();
+    enum FunkiiCalcErrors_t get_error_code();
+    /**
+     * error_line
+     *
+     * @return  int             Source line of the last Error, 0 if it isn't one line's (i.e: CE_REG_CYCLE).
+     */
+    int error_line();
+private:
+    CalcLive(const CalcLive &);
+    CalcLive &operator=(const CalcLive &);
+
+    /* One published source */
+    struct Version {
+        CalcRegistry reg;
+        uint64_t version;
+        uint64_t hash;              /* CalcLibrary::hash() of the source */
+    };
+    /* The epoch a reader is reading at (0 idle), a cache line each */
+    struct Slot {
+        volatile uint64_t epoch;
+        volatile int taken;
+        char pad[64 - sizeof(uint64_t) - sizeof(int)];
+    };
+    /**
+     * reclaim_locked
+     *
+     *  reclaim() with mWriter held.
+     */
+    void reclaim_locked();
+    /**
+     * watcher
+     *
+     *  The watch() thread.
+     */
+    static void *watcher(void *);
+
+    Version *volatile mCurrent;     /* What lock() gets */
+    volatile uint64_t mEpoch;       /* Bumped after every swap, starts at 1 */
+    Slot mSlots[CALC_LIVE_READERS];
+    vector<pair<Version *, uint64_t> > mRetired;    /* Old versions and the epoch they were replaced at */
+    pthread_mutex_t mWriter;        /* publish(), reclaim() and the counters, never the readers */
+    CalcLiveStats mStats;
+    enum FunkiiCalcErrors_t mError;
+    int mLine;
+    string mPath;                   /* Watched file */
+    pthread_t mWatcher;
+    bool mWatching;
+    int mNotify;                    /* inotify descriptor watching mPath's directory */
+    int mStop[2];                   /* Pipe that wakes the watcher up to quit */
+};
+
+inline CalcLive::Reader::Reader(CalcLive &live) : mLive(live), mSlot(-1), mPinned(NULL) {
+    for (int s = 0; s < CALC_LIVE_READERS; s++) {
+        if (__sync_bool_compare_and_swap(&mLive.mSlots[s].taken, 0, 1)) { mSlot = s; break; }
+    }
+}
+inline CalcLive::Reader::~Reader() {
+    if (mSlot < 0) { return; }
+    unlock();
+    __sync_lock_release(&mLive.mSlots[mSlot].taken);
+}
+inline const CalcRegistry *CalcLive::Reader::lock() {
+    if (mSlot < 0) { return NULL; }
+    //publish() swaps the pointer before it bumps the epoch: seeing this epoch in the slot
+    //it knows this reader got the new version or is holding one from before the bump
+    __atomic_store_n(&mLive.mSlots[mSlot].epoch, __atomic_load_n(&mLive.mEpoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    mPinned = __atomic_load_n(&mLive.mCurrent, __ATOMIC_SEQ_CST);
+    return (mPinned == NULL ? NULL : &mPinned->reg);
+}
+inline void CalcLive::Reader::unlock() {
+    if (mSlot < 0) { return; }
+    mPinned = NULL;
+    __atomic_store_n(&mLive.mSlots[mSlot].epoch, (uint64_t)0, __ATOMIC_RELEASE);
+}
+inline uint64_t CalcLive::Reader::version() const { return (mPinned == NULL ? 0 : mPinned->version); }
+
+inline CalcLive::CalcLive() : mCurrent(NULL), mEpoch(1), mError(CE_NADA), mLine(0), mWatching(false), mNotify(-1) {
+    memset(mSlots, 0, sizeof(mSlots));
+    memset(&mStats, 0, sizeof(mStats));
+    pthread_mutex_init(&mWriter, NULL);
+    mStop[0] = mStop[1] = -1;
+}
+inline CalcLive::~CalcLive() {
+    unwatch();
+    for (size_t i = 0; i < mRetired.size(); i++) { delete mRetired[i].first; }
+    delete mCurrent;
+    pthread_mutex_destroy(&mWriter);
+}
+inline bool CalcLive::publish(const string &source) {
+    C_DBG_START;
+    uint64_t h = CalcLibrary::hash(source.data(), source.length());
+    pthread_mutex_lock(&mWriter);
+    bool same = (mCurrent != NULL && mCurrent->hash == h);
+    if (same) { mStats.unchanged++; mError = CE_NADA; mLine = 0; }
+    pthread_mutex_unlock(&mWriter);
+    if (same) { C_DBG_END; return true; }
+    //compiled with no lock at all, the readers go on with the current version
+    Version *v = new Version;
+    v->hash = h;
+    enum FunkiiCalcErrors_t err = CE_NADA;
+    int line = 0, n = 0;
+    string text;
+    stringstream lines(source);
+    while (err == CE_NADA && getline(lines, text)) {
+        n++;
+        if (!text.empty() && text.at(text.length() - 1) == '\r') { text.erase(text.length() - 1); }
+        size_t b = text.find_first_not_of(" \t");
+        if (b == string::npos || text.at(b) == '#') { continue; }
+        size_t colon = text.find(':');
+        if (colon == string::npos) { err = CE_SYNTAX; line = n; break; }
+        if (!v->reg.add(text.substr(b, colon - b), text.substr(colon + 1))) { err = v->reg.get_error_code(); line = n; }
+    }
+    if (err == CE_NADA && !v->reg.seal()) { err = v->reg.get_error_code(); }
+    pthread_mutex_lock(&mWriter);
+    mError = err; mLine = line;
+    if (err != CE_NADA) {
+        mStats.failed++;
+        pthread_mutex_unlock(&mWriter);
+        delete v;
+        C_DBG_END;
+        return false;
+    }
+    v->version = ++mStats.published;
+    Version *old = __atomic_exchange_n(&mCurrent, v, __ATOMIC_SEQ_CST);
+    uint64_t epoch = __atomic_add_fetch(&mEpoch, 1, __ATOMIC_SEQ_CST);
+    if (old != NULL) { mRetired.push_back(make_pair(old, epoch)); }
+    reclaim_locked();
+    pthread_mutex_unlock(&mWriter);
+    C_DBG_MSG("published version %llu :: %u formulas",(unsigned long long)v->version,v->reg.size());
+    C_DBG_END;
+    return true;
+}
+inline bool CalcLive::load(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        pthread_mutex_lock(&mWriter);
+        mError = CE_LIB_IO; mLine = 0; mStats.failed++;
+        pthread_mutex_unlock(&mWriter);
+        return false;
+    }
+    string source;
+    char buf[4096];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0) { source.append(buf, got); }
+    fclose(f);
+    return publish(source);
+}
+inline void CalcLive::reclaim() {
+    pthread_mutex_lock(&mWriter);
+    reclaim_locked();
+    pthread_mutex_unlock(&mWriter);
+}
+inline void CalcLive::reclaim_locked() {
+    if (mRetired.empty()) { return; }
+    //a reader at an epoch from before a version was replaced may still hold it
+    uint64_t oldest = 0;
+    for (int s = 0; s < CALC_LIVE_READERS; s++) {
+        uint64_t e = __atomic_load_n(&mSlots[s].epoch, __ATOMIC_SEQ_CST);
+        if (e != 0 && (oldest == 0 || e < oldest)) { oldest = e; }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < mRetired.size(); i++) {
+        if (oldest == 0 || oldest >= mRetired[i].second) { delete mRetired[i].first; mStats.reclaimed++; }
+        else { mRetired[kept++] = mRetired[i]; }
+    }
+    mRetired.resize(kept);
+}
+inline CalcLiveStats CalcLive::stats() {
+    pthread_mutex_lock(&mWriter);
+    CalcLiveStats s = mStats;
+    s.version = (mCurrent == NULL ? 0 : mCurrent->version);
+    s.formulas = (mCurrent == NULL ? 0 : mCurrent->reg.size());
+    s.retired = mRetired.size();
+    pthread_mutex_unlock(&mWriter);
+    s.readers = 0;
+    for (int s2 = 0; s2 < CALC_LIVE_READERS; s2++) { s.readers += (mSlots[s2].taken != 0); }
+    return s;
+}
+inline bool CalcLive::error() { return (get_error_code() != CE_NADA); }
+inline string CalcLive::get_error() { return string(Calc::get_error_c_str(get_error_code())); }
+inline enum FunkiiCalcErrors_t CalcLive::get_error_code() {
+    pthread_mutex_lock(&mWriter);
+    enum FunkiiCalcErrors_t e = mError;
+    pthread_mutex_unlock(&mWriter);
+    return e;
+}
+inline int CalcLive::error_line() {
+    pthread_mutex_lock(&mWriter);
+    int line = mLine;
+    pthread_mutex_unlock(&mWriter);
+    return line;
+}
+#ifdef __linux__
+inline bool CalcLive::watch(const char *path) {
+    if (mWatching) { return false; }
+    mPath = path;
+    //the directory: editors and deploys write a new file and rename() it over the old one.
+    //Set up here rather than in the thread so nothing written after watch() returns is missed
+    string dir = ".";
+    size_t slash = mPath.rfind('/');
+    if (slash != string::npos) { dir = (slash == 0 ? "/" : mPath.substr(0, slash)); }
+    mNotify = inotify_init();
+    if (mNotify < 0 || inotify_add_watch(mNotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        if (mNotify >= 0) { close(mNotify); mNotify = -1; }
+        mError = CE_LIB_IO;
+        return false;
+    }
+    if (pipe(mStop) != 0) {
+        close(mNotify); mNotify = -1; mStop[0] = mStop[1] = -1;
+        mError = CE_LIB_IO;
+        return false;
+    }
+    if (pthread_create(&mWatcher, NULL, watcher, this) != 0) {
+        close(mNotify); mNotify = -1;
+        close(mStop[0]); close(mStop[1]); mStop[0] = mStop[1] = -1;
+        mError = CE_LIB_IO;
+        return false;
+    }
+    mWatching = true;
+    return true;
+}
+inline void CalcLive::unwatch() {
+    if (!mWatching) { return; }
+    char c = 0;
+    if (write(mStop[1], &c, 1) < 0) { }
+    pthread_join(mWatcher, NULL);
+    close(mNotify); mNotify = -1;
+    close(mStop[0]); close(mStop[1]); mStop[0] = mStop[1] = -1;
+    mWatching = false;
+}
+inline void *CalcLive::watcher(void *arg) {
+    CalcLive *live = (CalcLive *)arg;
+    string name = live->mPath;
+    size_t slash = name.rfind('/');
+    if (slash != string::npos) { name = name.substr(slash + 1); }
+    int fd = live->mNotify;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        struct pollfd fds[2];
+        fds[0].fd = fd; fds[0].events = POLLIN;
+        fds[1].fd = live->mStop[0]; fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0) { if (errno == EINTR) { continue; } break; }
+        if (fds[1].revents != 0) { break; }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) { continue; }
+        bool changed = false;
+        for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->len > 0 && name == ev->name) { changed = true; }
+        }
+        if (changed) { live->load(live->mPath.c_str()); }
+        live->reclaim();
+    }
+    return NULL;
+}
+#else
+inline bool CalcLive::watch(const char *) { mError = CE_LIB_IO; return false; }
+inline void CalcLive::unwatch() { }
+inline void *CalcLive::watcher(void *) { return NULL; }
+#endif
+#endif
@@ -0,0 +1,399 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_PARALLEL_H_
+#define _FUNKII_CALC_PARALLEL_H_
+
+/* INCLUDES! */
+#include "calc_program.h"
+#include <deque>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/* How long a task should take (ns), the chunk sizes are picked from the measured cost per row */
+#define CALC_POOL_TASK_NS   200000
+/* At least this many tasks per thread, so the ones done first can steal from the rest */
+#define CALC_POOL_SPLIT     4
+
+/**
+ * CalcPool Class
+ *
+ *  A pool of threads that evaluates compiled formulas (CalcCode, so the programs are
+ *  shared and never copied): the rows of a batch, several formulas over the same rows,
+ *  or a list of independent formulas.
+ *  Every job is cut in tasks, the size of a task is picked from how long the first
+ *  CALC_BATCH_BLOCK rows (or the first formulas) took so a task lasts about
+ *  CALC_POOL_TASK_NS. The tasks are dealt to the deques of the threads, each one takes
+ *  from the back of its own and steals from the front of the others when it runs out.
+ *  The thread that called eval() works too, so a pool of 1 has no threads at all.
+ *  Every task writes its own rows of the output and the rows of a task are a whole
+ *  number of batch() blocks, the results are the same whatever thread ran them.
+ *  Every thread keeps its own evaluation stacks. eval() may be called from many threads
+ *  at once.
+ *
+ *  Usage Example:
+ *      CalcProgram prog("sqrt(x^2 + y^2)");
+ *      const double *cols[2] = { xs, ys };
+ *      CalcPool pool;
+ *      pool.eval(prog.code(), cols, rows, out, errs);
+ */
+class CalcPool {
+public:
+    /**
+     *  CalcPool Constructor
+     *
+     *  One thread per online CPU (counting the caller).
+     */
+    CalcPool();
+    /**
+     *  CalcPool Constructor
+     *
+     * @param   threads         Number of threads, counting the one that calls eval() (1 runs everything there).
+     */
+    CalcPool(int);
+    /**
+     * ~CalcPool Destructor
+     *
+     *  Waits for the threads to finish.
+     */
+    ~CalcPool();
+    /**
+     * threads
+     *
+     * @return  int             Number of threads, counting the caller.
+     */
+    int threads() const;
+    /**
+     * eval
+     *
+     *  CalcProgram::batch() of many rows, in parallel.
+     *
+     * @param   code            Program to run.
+     * @param   vars            Column of every variable slot (rows values each).
+     * @param   rows            Number of rows.
+     * @param   out             Result of every row (0 on Error).
+     * @param   errs            FunkiiCalcErrors_t of every row.
+     */
+    template <typename T>
+    void eval(const CalcCode &, const T *const *, size_t, T *, uint8_t *);
+    /**
+     * eval overload function
+     *
+     *  Several formulas over the same rows, all of their tasks go in at once.
+     *
+     * @param   codes           Programs to run.
+     * @param   ncodes          Number of programs.
+     * @param   vars            Columns of every program (indexed by its variable slots).
+     * @param   rows            Number of rows.
+     * @param   out             Results of every program.
+     * @param   errs            FunkiiCalcErrors_t of every program and row.
+     */
+    template <typename T>
+    void eval(const CalcCode *, size_t, const T *const *const *, size_t, T *const *, uint8_t *const *);
+    /**
+     * eval overload function
+     *
+     *  A list of independent formulas, each one evaluated once with CalcProgram::run().
+     *
+     * @param   codes           Programs to run.
+     * @param   n               Number of programs.
+     * @param   vars            Variables of every program.
+     * @param   out             Result of every program (0 on Error).
+     * @param   errs            FunkiiCalcErrors_t of every program.
+     */
+    void eval(const CalcCode *, size_t, const long double *const *, long double *, uint8_t *);
+private:
+    struct Job;
+    struct Task {
+        Job *job;
+        size_t item;                /* Program */
+        size_t from, to;            /* Rows (or programs of a list) */
+    };
+    struct Worker {
+        CalcPool *pool;
+        int self;                   /* Index in mWorkers */
+        pthread_mutex_t lock;
+        deque<Task> tasks;          /* Own tasks at the back, stolen from the front */
+        vector<double> stk_d;       /* Evaluation stacks */
+        vector<float> stk_f;
+        vector<const double *> cols_d;  /* Columns of a task (moved to its first row) */
+        vector<const float *> cols_f;
+    };
+    struct Job {
+        void (*run)(const Task &, Worker &);
+        const CalcCode *codes;
+        const void *const *const *vars;
+        void *const *out;
+        uint8_t *const *errs;
+        volatile long pending;      /* Tasks not done yet */
+    };
+    int mThreads;                   /* Counting the caller */
+    vector<Worker *> mWorkers;      /* One deque per thread, [0] is only stolen from */
+    vector<pthread_t> mPool;
+    pthread_mutex_t mLock;
+    pthread_cond_t mWork;           /* There are tasks (or mQuit) */
+    pthread_cond_t mDone;           /* A job finished */
+    volatile long mQueued;          /* Tasks in the deques */
+    volatile size_t mNext;          /* Deque the next job starts dealing at */
+    bool mQuit;
+
+    void start(int);
+    /**
+     * take
+     *
+     *  Pops a task from the back of the deque of self, or steals one from the front of another.
+     *
+     * @param   self            Deque of the thread (-1 for a caller).
+     *
+     * @return  false           Every deque is empty.
+     */
+    bool take(int, Task &);
+    /**
+     * run
+     *
+     *  Deals the tasks of a job (one per chunk of each item) and works until they're all done.
+     *
+     * @param   job             The job, pending is set here.
+     * @param   items           Number of programs.
+     * @param   size            Rows (or programs) per item.
+     * @param   from            First row, the rows before it are done.
+     * @param   chunk           Rows per task.
+     * @param   scratch         Worker state of the caller.
+     */
+    void run(Job &, size_t, size_t, size_t, size_t, Worker &);
+    void finish(Job &);
+    static void *loop(void *);
+    /**
+     * chunk
+     *
+     *  Rows per task for a cost per row, a whole number of batch() blocks.
+     */
+    size_t chunk(uint64_t, size_t, size_t);
+    static uint64_t now();
+    template <typename T>
+    static void rows(const Task &, Worker &);
+    static void list(const Task &, Worker &);
+    static vector<double> &stack(Worker &w, const double *) { return w.stk_d; }
+    static vector<float> &stack(Worker &w, const float *) { return w.stk_f; }
+    static vector<const double *> &columns(Worker &w, const double *) { return w.cols_d; }
+    static vector<const float *> &columns(Worker &w, const float *) { return w.cols_f; }
+};
+inline CalcPool::CalcPool() { start((int)sysconf(_SC_NPROCESSORS_ONLN)); }
+inline CalcPool::CalcPool(int threads) { start(threads); }
+inline void CalcPool::start(int threads) {
+    mThreads = (threads < 1 ? 1 : threads);
+    mQueued = 0; mNext = 0; mQuit = false;
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mWork, NULL);
+    pthread_cond_init(&mDone, NULL);
+    for (int i = 0; i < mThreads; i++) {
+        mWorkers.push_back(new Worker);
+        mWorkers.back()->pool = this;
+        mWorkers.back()->self = i;
+        pthread_mutex_init(&mWorkers.back()->lock, NULL);
+    }
+    mPool.resize(mThreads - 1);
+    for (int i = 1; i < mThreads; i++) { pthread_create(&mPool[i - 1], NULL, loop, mWorkers[i]); }
+}
+inline CalcPool::~CalcPool() {
+    pthread_mutex_lock(&mLock);
+    mQuit = true;
+    pthread_cond_broadcast(&mWork);
+    pthread_mutex_unlock(&mLock);
+    for (size_t i = 0; i < mPool.size(); i++) { pthread_join(mPool[i], NULL); }
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        pthread_mutex_destroy(&mWorkers[i]->lock);
+        delete mWorkers[i];
+    }
+    pthread_cond_destroy(&mDone);
+    pthread_cond_destroy(&mWork);
+    pthread_mutex_destroy(&mLock);
+}
+inline int CalcPool::threads() const { return mThreads; }
+inline uint64_t CalcPool::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+inline size_t CalcPool::chunk(uint64_t ns, size_t done, size_t total) {
+    const size_t B = CALC_BATCH_BLOCK;
+    size_t n = (size_t)(CALC_POOL_TASK_NS / (ns / (double)(done > 0 ? done : 1) + 1));
+    //but enough tasks for every thread to have a few
+    size_t most = (total / ((size_t)mThreads * CALC_POOL_SPLIT) + B - 1) / B * B;
+    if (n > most) { n = most; }
+    n = n / B * B;
+    return (n < B ? B : n);
+}
+inline bool CalcPool::take(int self, Task &t) {
+    if (self >= 0) {
+        Worker &w = *mWorkers[self];
+        pthread_mutex_lock(&w.lock);
+        bool got = !w.tasks.empty();
+        if (got) { t = w.tasks.back(); w.tasks.pop_back(); }
+        pthread_mutex_unlock(&w.lock);
+        if (got) { __sync_sub_and_fetch(&mQueued, 1); return true; }
+    }
+    for (int i = 1; i <= mThreads; i++) {
+        int v = (self + i + mThreads) % mThreads;
+        if (v == self) { continue; }
+        Worker &w = *mWorkers[v];
+        pthread_mutex_lock(&w.lock);
+        bool got = !w.tasks.empty();
+        if (got) { t = w.tasks.front(); w.tasks.pop_front(); }
+        pthread_mutex_unlock(&w.lock);
+        if (got) { __sync_sub_and_fetch(&mQueued, 1); return true; }
+    }
+    return false;
+}
+inline void CalcPool::finish(Job &job) {
+    if (__sync_sub_and_fetch(&job.pending, 1) == 0) {
+        pthread_mutex_lock(&mLock);
+        pthread_cond_broadcast(&mDone);
+        pthread_mutex_unlock(&mLock);
+    }
+}
+inline void *CalcPool::loop(void *arg) {
+    Worker &w = *(Worker *)arg;
+    CalcPool *pool = w.pool;
+    Task t;
+    while (true) {
+        if (pool->take(w.self, t)) {
+            t.job->run(t, w);
+            pool->finish(*t.job);
+            continue;
+        }
+        pthread_mutex_lock(&pool->mLock);
+        //mQueued is raised outside mLock (the broadcast after it isn't)
+        while (__atomic_load_n(&pool->mQueued, __ATOMIC_ACQUIRE) == 0 && !pool->mQuit) { pthread_cond_wait(&pool->mWork, &pool->mLock); }
+        bool quit = (__atomic_load_n(&pool->mQueued, __ATOMIC_ACQUIRE) == 0 && pool->mQuit);
+        pthread_mutex_unlock(&pool->mLock);
+        if (quit) { return NULL; }
+    }
+}
+inline void CalcPool::run(Job &job, size_t items, size_t size, size_t from, size_t chunk, Worker &scratch) {
+    vector<Task> tasks;
+    for (size_t i = 0; i < items; i++) {
+        for (size_t r = (i == 0 ? from : 0); r < size; r += chunk) {
+            Task t;
+            t.job = &job; t.item = i; t.from = r; t.to = (size - r < chunk ? size : r + chunk);
+            tasks.push_back(t);
+        }
+    }
+    job.pending = (long)tasks.size();
+    if (tasks.empty()) { return; }
+    //dealt backwards, so each thread starts with the first rows of its share
+    size_t start = __sync_fetch_and_add(&mNext, 1) % (size_t)mThreads;
+    __sync_add_and_fetch(&mQueued, (long)tasks.size());
+    for (size_t k = tasks.size(); k-- > 0; ) {
+        Worker &w = *mWorkers[(start + k) % (size_t)mThreads];
+        pthread_mutex_lock(&w.lock);
+        w.tasks.push_back(tasks[k]);
+        pthread_mutex_unlock(&w.lock);
+    }
+    pthread_mutex_lock(&mLock);
+    pthread_cond_broadcast(&mWork);
+    pthread_mutex_unlock(&mLock);
+    //help until it's done, from any deque (acquire: the last finish() published the results)
+    Task t;
+    while (__atomic_load_n(&job.pending, __ATOMIC_ACQUIRE) > 0) {
+        if (take(-1, t)) {
+            t.job->run(t, scratch);
+            finish(*t.job);
+            continue;
+        }
+        pthread_mutex_lock(&mLock);
+        while (__atomic_load_n(&job.pending, __ATOMIC_ACQUIRE) > 0 && __atomic_load_n(&mQueued, __ATOMIC_ACQUIRE) == 0) {
+            pthread_cond_wait(&mDone, &mLock);
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+}
+template <typename T>
+void CalcPool::rows(const Task &t, Worker &w) {
+    const CalcCode &code = t.job->codes[t.item];
+    const T *const *vars = (const T *const *)t.job->vars[t.item];
+    vector<const T *> &cols = columns(w, (const T *)NULL);
+    cols.resize(code.nvars + 1);
+    for (uint32_t s = 0; s < code.nvars; s++) { cols[s] = vars[s] + t.from; }
+    CalcProgram::batch(code, &cols[0], t.to - t.from, (T *)t.job->out[t.item] + t.from, t.job->errs[t.item] + t.from,
+                       stack(w, (const T *)NULL));
+}
+inline void CalcPool::list(const Task &t, Worker &) {
+    const long double *const *vars = (const long double *const *)t.job->vars[0];
+    long double *out = (long double *)t.job->out[0];
+    for (size_t i = t.from; i < t.to; i++) {
+        enum FunkiiCalcErrors_t err;
+        out[i] = CalcProgram::run(t.job->codes[i], vars[i], err);
+        t.job->errs[0][i] = (uint8_t)err;
+    }
+}
+template <typename T>
+void CalcPool::eval(const CalcCode &code, const T *const *vars, size_t rows, T *out, uint8_t *errs) {
+    T *outs[1] = { out };
+    uint8_t *errss[1] = { errs };
+    const T *const *varss[1] = { vars };
+    eval(&code, 1, varss, rows, outs, errss);
+}
+template <typename T>
+void CalcPool::eval(const CalcCode *codes, size_t ncodes, const T *const *const *vars, size_t nrows, T *const *out, uint8_t *const *errs) {
+    if (ncodes == 0 || nrows == 0) { return; }
+    Worker scratch;
+    Job job;
+    job.run = &CalcPool::rows<T>; job.codes = codes; job.out = (void *const *)out; job.errs = errs; job.pending = 0;
+    job.vars = (const void *const *const *)vars;
+    //the first block of the first program, timed
+    Task first;
+    first.job = &job; first.item = 0; first.from = 0;
+    first.to = (nrows < CALC_BATCH_BLOCK ? nrows : CALC_BATCH_BLOCK);
+    uint64_t t = now();
+    rows<T>(first, scratch);
+    t = now() - t;
+    run(job, ncodes, nrows, first.to, chunk(t, first.to, nrows), scratch);
+}
+inline void CalcPool::eval(const CalcCode *codes, size_t n, const long double *const *vars, long double *out, uint8_t *errs) {
+    if (n == 0) { return; }
+    Worker scratch;
+    Job job;
+    const void *const *v[1] = { (const void *const *)vars };
+    void *o[1] = { out };
+    uint8_t *e[1] = { errs };
+    job.run = &CalcPool::list; job.codes = codes; job.vars = v; job.out = o; job.errs = e; job.pending = 0;
+    //the first few, timed
+    Task first;
+    first.job = &job; first.item = 0; first.from = 0; first.to = (n < 16 ? n : 16);
+    uint64_t t = now();
+    list(first, scratch);
+    t = now() - t;
+    size_t per = (size_t)(CALC_POOL_TASK_NS / (t / (double)first.to + 1));
+    size_t most = n / ((size_t)mThreads * CALC_POOL_SPLIT) + 1;
+    run(job, 1, n, first.to, (per < 1 ? 1 : (per > most ? most : per)), scratch);
+}
+#endif
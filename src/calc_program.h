@@ -0,0 +1,1967 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_PROGRAM_H_
+#define _FUNKII_CALC_PROGRAM_H_
+
+/* INCLUDES! */
+#include "calc.h"
+#include "calc_simd.h"
+#include <algorithm>
+#include <map>
+#include <stdint.h>
+#include <string.h>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define CALC_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CALC_RDTSC
+#else
+#include <time.h>
+#endif
+
+/* Evaluation stack kept on the C stack, deeper programs allocate one */
+#define CALC_PROGRAM_STACK  64
+/* Rows evaluated together by CalcProgram::batch() */
+#define CALC_BATCH_BLOCK    256
+/* CalcOp flags */
+#define CALC_OP_FOLDED      1   //CO_CONST computed while compiling (i.e: 2*pi)
+
+/**
+ *  Opcodes of a compiled formula
+ *
+ *  A program is a flat array of CalcOp in postfix order, every opcode pops its
+ *  operands from the evaluation stack and pushes its result.
+ *  The lazy operators jump forward over the operands they don't need:
+ *      if(c, a, b)     c CO_JZ a CO_JMP b CO_IF
+ *      a && b          a CO_JF b CO_AND
+ *      a || b          a CO_JT b CO_OR
+ *  New opcodes are only ever appended (the values are stored in formula libraries).
+ */
+enum FunkiiCalcOpcodes_t {
+    CO_CONST    =   0,  //push consts[arg]
+    CO_VAR      =   1,  //push vars[arg]
+    CO_NEG      =   2,  //-a
+    CO_ADD      =   3,  //a + b
+    CO_SUB      =   4,  //a - b
+    CO_MUL      =   5,  //a * b
+    CO_DIV      =   6,  //a / b
+    CO_MOD      =   7,  //a % b
+    CO_POW      =   8,  //a ^ b
+    CO_SHL      =   9,  //a << b
+    CO_SHR      =   10, //a >> b
+    CO_LT       =   11, //a < b
+    CO_GT       =   12, //a > b
+    CO_EQ       =   13, //a = b, a == b
+    CO_NE       =   14, //a <> b
+    CO_LE       =   15, //a <= b
+    CO_GE       =   16, //a >= b
+    CO_AND      =   17, //comparison chains: a != 0 and b != 0
+    CO_FUNC     =   18, //func_array[arg - 1](a)
+    CO_CALL     =   19, //calls[arg](argc operands), see CalcRegistry
+    CO_AGG      =   20, //agg_array[arg - 1](argc operands), see Calc::apply_aggregate()
+    CO_NOT      =   21, //!a
+    CO_OR       =   22, //a != 0 or b != 0 (the end of a || b)
+    CO_JZ       =   23, //if(): pops the condition, or leaves it as a placeholder and skips arg instructions (the then) if it's 0
+    CO_JMP      =   24, //if(): skips arg instructions (the else and its CO_IF)
+    CO_IF       =   25, //if(): the else replaces the placeholder
+    CO_JF       =   26, //a && b: if a is 0 leaves 0 and skips arg instructions (b and its CO_AND)
+    CO_JT       =   27, //a || b: if a isn't 0 leaves 1 and skips arg instructions (b and its CO_OR)
+    CO_LOOKUP   =   28, //lookup(tables[arg], a), see CalcTable
+    CO_INTERP   =   29, //interp(tables[arg], a)
+    CO_STEP     =   30, //step(tables[arg], a)
+
+    CO_LAST
+};
+/**
+ *  CalcOp
+ *
+ *  One instruction of a compiled formula (8 bytes, no pointers so it can be mmap'ed).
+ */
+struct CalcOp {
+    uint8_t code;                   /* FunkiiCalcOpcodes_t */
+    uint8_t argc;                   /* Number of operands of CO_CALL and CO_AGG */
+    uint16_t flags;                 /* CALC_OP_* (informative, never changes the result) */
+    uint32_t arg;                   /* Constant, Variable slot, Function, Call, Aggregate or Table number, or instructions skipped */
+};
+/**
+ *  CalcCode
+ *
+ *  Non owning view of a compiled formula, it points either into a CalcProgram
+ *  or straight into a mapped formula library (see CalcLibrary).
+ *  It is only read while evaluating, so the same CalcCode can be evaluated
+ *  from many threads at once.
+ */
+struct CalcCode {
+    const CalcOp *ops;              /* Instructions */
+    const double *consts;           /* Constant Pool */
+    const CalcCode *calls;          /* Formulas CO_CALL can call (NULL if none) */
+    const CalcTable *const *tables; /* Tables of CO_LOOKUP, CO_INTERP and CO_STEP (NULL if none) */
+    uint32_t nops;                  /* Number of Instructions */
+    uint32_t nconsts;               /* Number of Constants */
+    uint32_t ncalls;                /* Number of Formulas in calls */
+    uint32_t ntables;               /* Number of Tables in tables */
+    uint32_t nvars;                 /* Number of Variable slots */
+    uint32_t stack;                 /* Max depth of the evaluation stack */
+    uint32_t math;                  /* FunkiiCalcMathTiers_t of batch evaluation */
+    /**
+     * eval
+     *
+     *  Evaluates the formula.
+     *
+     * @param   vars            Value of every variable slot (may be NULL if nvars is 0).
+     * @param   err             set to CE_NADA or the Error.
+     *
+     * @return  (long double)   Result of the formula, 0 on Error.
+     */
+    long double eval(const long double *, enum FunkiiCalcErrors_t &) const;
+};
+/**
+ *  CalcProfile
+ *
+ *  How many times every instruction of one formula ran and the cycles (TSC ticks, or
+ *  nanoseconds where there is no TSC) spent in it, filled by the profiling
+ *  CalcProgram::run() over as many evaluations as you want.
+ *  Timing every instruction costs a few dozen cycles each, compare the nodes
+ *  against each other, not against the plain run().
+ *
+ *  Usage Example:
+ *      CalcProgram prog("sqrt(x^2 + y^2) > 2*pi");
+ *      CalcProfile prof;
+ *      for (...) { CalcProgram::run(prog.code(), vars, err, prof); }
+ *      cout << prof.report(prog.code(), prog.symbols());
+ */
+struct CalcProfile {
+    vector<uint64_t> count;         /* Times every instruction ran */
+    vector<uint64_t> cycles;        /* Cycles spent in every instruction */
+    uint64_t runs;                  /* Evaluations profiled */
+
+    CalcProfile() : runs(0) { }
+    void reset() { count.clear(); cycles.clear(); runs = 0; }
+    /**
+     * report
+     *
+     *  One line per node: its own cycles, the cycles of the whole sub expression
+     *  under it and how many times it ran, sorted by cost.
+     *
+     * @param   code            Program that was profiled.
+     * @param   names           Variable names, indexed by slot (may be empty).
+     *
+     * @return  string          The table.
+     */
+    string report(const CalcCode &, const vector<string> &) const;
+    /**
+     * ticks
+     *
+     * @return  uint64_t        Current cycle counter.
+     */
+    static uint64_t ticks();
+};
+/**
+ * CalcProgram Class
+ *
+ *  Compiles a formula (same syntax as Calc, including the 'a=1,b=2;' vars prefix)
+ *  into a flat postfix program with a constant pool and a symbol table, so it can be
+ *  evaluated many times without parsing it again.
+ *  Constant sub expressions are folded while compiling, any identifier that is not
+ *  a function, 'e' or 'pi' becomes a variable slot (Calc evaluates those to 0).
+ *  Aggregates (sum(x, y, 2)...) take their items from the stack, one CO_AGG each, and
+ *  the table functions (interp(rates, x)...) take x, the table is picked when compiling.
+ *  if(c, a, b), && and || only evaluate what they need (see FunkiiCalcOpcodes_t), batch()
+ *  runs both ways of the blocks whose rows don't agree and blends the results.
+ *
+ *  Calc::calculate() doesn't group operators the usual way: after the first operand of a
+ *  '/', '%' or '^' it takes the rest of the chain as the right operand, and it only reads
+ *  one sign. A program never gives another result than Calc, so compile() fails with
+ *  CE_SYN_GROUP on every formula where the two could part (add the parentheses):
+ *      formula         Calc                usual
+ *      100/10*2        100/(10*2) = 5      (100/10)*2 = 20
+ *      2^2*3           2^(2*3) = 64        (2^2)*3 = 12
+ *      10/5/2          10/(5/2) = 4        (10/5)/2 = 1
+ *      2*sum(1,2)^2    (2*3)^2 = 36        2*(3^2) = 18
+ *  Between two '+'/'-' the operators have to go up: '*' then '/' or '%' then '^' then
+ *  '<<' or '>>', only '*' and '^' twice in a row. A function, a group or a signed operand
+ *  can only be the first operand, or the second when there are no more. The check is
+ *  made on the text, so a variable counts as the number Calc writes in its place.
+ *
+ *  Usage Example:
+ *      CalcProgram prog("x^2 + y");
+ *      long double vars[2];
+ *      vars[prog.slot("x")] = 3; vars[prog.slot("y")] = 1;
+ *      cout << prog.eval(vars);
+ *
+ *  Output:
+ *      10
+ */
+class CalcProgram {
+public:
+    /**
+     *  CalcProgram Constructor
+     *
+     *  Empty program (evaluates to 0)
+     */
+    CalcProgram();
+    /**
+     *  CalcProgram Constructor
+     *
+     *  Will call CalcProgram::compile with the input string
+     *
+     * @param   string     string containing the raw formula.
+     */
+    CalcProgram(string);
+    /**
+     *  compile
+     *
+     *  Compiles a new formula, sets the error on failure.
+     *
+     * @param   formula         string containing the raw formula.
+     *
+     * @return  true            Compiled.
+     * @return  false           Error (check get_error()).
+     */
+    bool compile(string);
+    /**
+     *  compile overload function
+     *
+     *  Compiles the body of a named formula (see CalcRegistry): the parameters are the
+     *  variable slots 0..n-1, commas separate call arguments and any other name is a call
+     *  to another formula ('rate' or 'margin(x)'), left unresolved until link().
+     *
+     * @param   formula         string containing the raw formula.
+     * @param   params          Parameter names (lowercase).
+     *
+     * @return  true            Compiled.
+     * @return  false           Error (check get_error()).
+     */
+    bool compile(string, const vector<string> &);
+    /**
+     *  bind
+     *
+     *  Binds an array to a name for the aggregates of the next compile() (see Calc::bind()).
+     *  The values are compiled into the program as constants, an aggregate of nothing but
+     *  constants is computed right there, otherwise it can't have more than 255 items.
+     *
+     * @param   name            Array name (not case sensitive).
+     * @param   values          The values (copied).
+     * @param   n               Number of values, 0 removes it.
+     */
+    void bind(string, const long double *, size_t);
+    /**
+     * table
+     *
+     *  Registers a table for the table functions of the next compile() (see Calc::table()).
+     *  The program keeps a pointer to it, it has to outlive the program. A table function of a
+     *  constant is computed right there.
+     *
+     * @param   name            Table name (not case sensitive).
+     * @param   table           The table, NULL removes it.
+     */
+    void table(string, const CalcTable *);
+    /**
+     * calls
+     *
+     * @return  vector<string>  Names of the formulas called, indexed by the CO_CALL argument.
+     */
+    const vector<string> &calls() const;
+    /**
+     * link
+     *
+     *  Resolves the calls: every CO_CALL argument i becomes target[i].
+     *
+     * @param   target          Formula number of every entry of calls().
+     */
+    void link(const vector<uint32_t> &);
+    /**
+     * error
+     *
+     * @return  true    the formula didn't compile :(
+     * @return  false   there was NO error!!
+     */
+    bool error();
+    /**
+     * get_error
+     *
+     * @return  string  the error message
+     */
+    string get_error();
+    /**
+     * get_error_code
+     *
+     * @return  enum FunkiiCalcErrors_t
+     */
+    enum FunkiiCalcErrors_t get_error_code();
+    /**
+     * slot
+     *
+     *  Returns the variable slot of a (lowercase) variable name.
+     *
+     * @param   string          Variable name.
+     *
+     * @return  int             Slot number, -1 if the formula doesn't use it.
+     */
+    int slot(string);
+    /**
+     * symbols
+     *
+     * @return  vector<string>  Variable names, indexed by slot.
+     */
+    const vector<string> &symbols() const;
+    /**
+     * math
+     *
+     *  Accuracy of the functions when evaluating many rows at once (see CalcSimd),
+     *  calc_math_accurate by default. It stays set when compiling another formula.
+     *
+     * @param   tier            calc_math_accurate or calc_math_fast.
+     */
+    void math(enum FunkiiCalcMathTiers_t);
+    /**
+     * limits
+     *
+     *  Limits of the formulas compiled from now on (CalcLimits() by default), the bound
+     *  arrays count as nodes too. A program runs every instruction once at most, so the
+     *  steps don't apply.
+     *
+     * @param   lim             The limits.
+     */
+    void limits(const CalcLimits &);
+    /**
+     * code
+     *
+     * @return  CalcCode        View of the compiled program (valid while this program lives and isn't recompiled).
+     */
+    CalcCode code() const;
+    /**
+     * eval
+     *
+     *  Evaluates a program without variables (they are all 0).
+     *
+     * @return  (long double)   Result, 0 on Error (check error()).
+     */
+    long double eval();
+    /**
+     * eval overload function
+     *
+     * @param   vars            Value of every variable slot.
+     *
+     * @return  (long double)   Result, 0 on Error (check error()).
+     */
+    long double eval(const long double *);
+    /**
+     * eval overload function
+     *
+     *  Does not touch the program, safe to call from many threads.
+     *
+     * @param   vars            Value of every variable slot.
+     * @param   err             set to CE_NADA or the Error.
+     *
+     * @return  (long double)   Result, 0 on Error.
+     */
+    long double eval(const long double *, enum FunkiiCalcErrors_t &) const;
+    /**
+     * eval overload function
+     *
+     *  Evaluates many rows at once, see batch().
+     *
+     * @param   vars            Column of every variable slot (rows values each).
+     * @param   rows            Number of rows.
+     * @param   out             Result of every row (0 on Error).
+     * @param   errs            FunkiiCalcErrors_t of every row.
+     */
+    void eval(const double *const *, size_t, double *, uint8_t *) const;
+    /**
+     * eval overload function
+     *
+     *  Evaluates many rows at once in float, see batch().
+     *
+     * @param   vars            Column of every variable slot (rows values each).
+     * @param   rows            Number of rows.
+     * @param   out             Result of every row (0 on Error).
+     * @param   errs            FunkiiCalcErrors_t of every row.
+     */
+    void eval(const float *const *, size_t, float *, uint8_t *) const;
+    /**
+     * run
+     *
+     *  The evaluation loop shared by every CalcCode.
+     *
+     * @param   code            Program to run.
+     * @param   vars            Value of every variable slot.
+     * @param   err             set to CE_NADA or the Error.
+     *
+     * @return  (long double)   Result, 0 on Error.
+     */
+    static long double run(const CalcCode &, const long double *, enum FunkiiCalcErrors_t &);
+    /**
+     * run overload function
+     *
+     *  Same as run() but adds the count and cycles of every instruction to a profile.
+     *
+     * @param   code            Program to run.
+     * @param   vars            Value of every variable slot.
+     * @param   err             set to CE_NADA or the Error.
+     * @param   prof            Profile of code.
+     *
+     * @return  (long double)   Result, 0 on Error.
+     */
+    static long double run(const CalcCode &, const long double *, enum FunkiiCalcErrors_t &, CalcProfile &);
+    /**
+     * run overload function
+     *
+     *  Same as run() with a choice of error detection (see Calc::error_mode()):
+     *  calc_err_fenv tests the FP exception flags once, at the end.
+     *
+     * @param   code            Program to run.
+     * @param   vars            Value of every variable slot.
+     * @param   err             set to CE_NADA or the Error.
+     * @param   mode            calc_err_errno or calc_err_fenv.
+     *
+     * @return  (long double)   Result, 0 on Error.
+     */
+    static long double run(const CalcCode &, const long double *, enum FunkiiCalcErrors_t &, enum FunkiiCalcErrorModes_t);
+    /**
+     * batch
+     *
+     *  Evaluates many rows, CALC_BATCH_BLOCK at a time: every instruction runs over the
+     *  whole block (in T, double or float) in plain loops the compiler can vectorize
+     *  (float fits twice the lanes of double in a SIMD register) and the functions run
+     *  in the CalcSimd kernels (code.math picks their accuracy). The errors are found
+     *  once per block from the FP exception flags, the lanes CalcSimd found out of a domain
+     *  and a NaN/Inf check of the results. Only the rows of a block that raised something
+     *  are evaluated again, one by one with run() in calc_err_fenv mode, to get their exact
+     *  Error (plus CE_ERANGE for results that don't fit a T). Build with -fno-math-errno so
+     *  the remaining libm loops don't have to set errno.
+     *
+     * @param   code            Program to run.
+     * @param   vars            Column of every variable slot (rows values each).
+     * @param   rows            Number of rows.
+     * @param   out             Result of every row (0 on Error).
+     * @param   errs            FunkiiCalcErrors_t of every row.
+     */
+    template <typename T>
+    static void batch(const CalcCode &, const T *const *, size_t, T *, uint8_t *);
+    /**
+     * batch overload function
+     *
+     *  Same thing with the evaluation stack kept by the caller (i.e: one per thread, see
+     *  CalcPool), so it's only allocated the first time.
+     *
+     * @param   stk             Evaluation stack, grown as needed.
+     */
+    template <typename T>
+    static void batch(const CalcCode &, const T *const *, size_t, T *, uint8_t *, vector<T> &);
+    /**
+     * explain
+     *
+     *  Dumps the compiled formula as a tree: operators, func_array calls, constants
+     *  (the ones folded while compiling are marked) and variable slots.
+     *
+     *  Output of explain() for 'sqrt(x^2 + y^2) > 2*pi':
+     *      [ 9] >
+     *      [ 7]   sqrt                             func_array[1]
+     *      [ 6]     +
+     *      [ 2]       ^
+     *      [ 0]         x                          var slot 0
+     *      [ 1]         2                          const #0
+     *      ...
+     *      [ 8]   6.28318530717959                 const #1 folded
+     *      10 ops, 2 consts, 2 vars (x, y), stack 3
+     *
+     * @return  string          The tree, one node per line with its instruction number (or the compile Error).
+     */
+    string explain() const;
+    /**
+     * explain overload function
+     *
+     * @param   code            Program to dump (i.e: from a CalcLibrary).
+     * @param   names           Variable names, indexed by slot (may be empty).
+     *
+     * @return  string          The tree, one node per line with its instruction number.
+     */
+    static string explain(const CalcCode &, const vector<string> &);
+    /**
+     * describe
+     *
+     *  Rebuilds the tree of a program from its instructions.
+     *
+     * @param   code            Program.
+     * @param   names           Variable names, indexed by slot (may be empty).
+     * @param   label           Set to the label of every instruction ('+', 'sqrt', 'x'...).
+     * @param   text            Set to the sub expression every instruction computes.
+     * @param   first           Set to the first instruction of the sub expression of every instruction.
+     *
+     * @return  false           The program is broken (see verify()).
+     */
+    static bool describe(const CalcCode &, const vector<string> &, vector<string> &, vector<string> &, vector<uint32_t> &);
+    /**
+     * verify
+     *
+     *  Checks that a program (i.e. coming from a file) is well formed:
+     *  valid opcodes and arguments, and a stack that never under/overflows.
+     *  Jumps only go forward, to where the stack is as deep as it is after the jump.
+     *
+     * @param   code            Program to check.
+     *
+     * @return  true            It can be evaluated safely.
+     */
+    static bool verify(const CalcCode &);
+    /**
+     * func
+     *
+     *  Checks if a name is one of the built in functions (Calc::func_array).
+     *
+     * @param   name            Lowercase name.
+     *
+     * @return  int             Function number (CO_FUNC argument), 0 if it isn't one.
+     */
+    static int func(string);
+    /**
+     * aggregate
+     *
+     *  Checks if a name is one of the aggregate functions (Calc::agg_array).
+     *
+     * @param   name            Lowercase name.
+     *
+     * @return  int             Aggregate number (CO_AGG argument), 0 if it isn't one.
+     */
+    static int aggregate(string);
+    /**
+     * table_func
+     *
+     *  Checks if a name is one of the table functions (Calc::tab_array).
+     *
+     * @param   name            Lowercase name.
+     *
+     * @return  int             FunkiiCalcTableFuncs_t (CO_LOOKUP + it - 1 is the opcode), 0 if it isn't one.
+     */
+    static int table_func(string);
+    /**
+     * apply
+     *
+     *  Applies one opcode to its operands (b is ignored by the unary ones).
+     *
+     * @return  (long double)   Result of the operation.
+     */
+    static long double apply(int, uint32_t, long double, long double, enum FunkiiCalcErrors_t &);
+private:
+    struct Node {
+        int code;                   /* FunkiiCalcOpcodes_t */
+        uint32_t arg;               /* Variable slot, Function or Table number */
+        int a, b;                   /* Operands (node index, -1 if none), CO_CALL/CO_AGG: a is the first mArgs */
+        int argc;                   /* CO_CALL/CO_AGG: Number of operands */
+        long double value;          /* CO_CONST value */
+        uint16_t flags;             /* CalcOp flags */
+    };
+    /**
+     *  Term
+     *
+     *  The operands and operators of one term (what's between the + and -), in the order
+     *  they were read: enough to tell if Calc::calculate() groups it the same way (see grouping()).
+     *  Operands: 0 number or variable, 1 group (parentheses, aggregate, table function, if(), !),
+     *  2 function call, 3 literal with a signed exponent (1e-5), 4 anything Calc never gets right
+     *  (+2, -pi, -abs(x)), 5 e or a literal with an exponent (3e2), 6 pi.
+     */
+    struct Term {
+        int atoms;                  /* Operands read */
+        int kind[2];                /* Of the first two operands */
+        bool rest;                  /* An operand after the second one isn't a number, variable, e or pi */
+        bool lone;                  /* A literal with a signed exponent */
+        int oper;                   /* Last operator: 1 *, 2 / %, 3 ^, 4 << >> */
+        bool bad;                   /* Calc groups it its own way, wherever it is */
+        Term() : atoms(0), rest(false), lone(false), oper(0), bad(false) { kind[0] = 0; kind[1] = 0; }
+    };
+    enum FunkiiCalcErrors_t mError; /* Compile Error. */
+    vector<CalcOp> mOps;            /* Instructions. */
+    vector<double> mConsts;         /* Constant Pool. */
+    vector<string> mSymbols;        /* Variable names, indexed by slot. */
+    vector<string> mCalls;          /* Called formulas, indexed by CO_CALL argument. */
+    uint32_t mStack;                /* Max depth of the evaluation stack. */
+    enum FunkiiCalcMathTiers_t mMath;   /* Accuracy of batch evaluation. */
+    CalcLimits mLimits;             /* What a formula may cost to compile. */
+    map<string, vector<long double> > mArrays;  /* Arrays bound with bind(). */
+    map<string, const CalcTable *> mTables;     /* Tables registered with table(). */
+    vector<const CalcTable *> mTabs;            /* Tables used by the program, indexed by the table function argument. */
+            /* Compiler Vars, only used while compiling */
+    Calc *mCalc;                    /* Used for syntax() and the bin/oct/hex conversions */
+    string mSrc;                    /* Sanity Checked Formula being compiled. */
+    size_t mPos;                    /* Parse position in mSrc. */
+    vector<Node> mNodes;            /* Parsed tree. */
+    vector<int> mArgs;              /* Operands of the CO_CALL nodes. */
+    const vector<string> *mParams;  /* Parameters of a named formula (NULL for a plain formula). */
+    Term *mTerm;                    /* Term being parsed. */
+    int mKind;                      /* Operand parse_unary() just read (see Term). */
+
+    /**
+     * node
+     *
+     *  Adds a node to the tree, folding it if all of its operands are constants.
+     *
+     * @return  int     Index of the node.
+     */
+    int node(int, int, int, uint32_t);
+    /**
+     * constant
+     *
+     * @return  int     Index of a new CO_CONST node.
+     */
+    int constant(long double);
+    /**
+     * parse_*
+     *
+     *  Recursive descent parser, the levels of Calc::calculate():
+     *  || < && < comparisons < (+ -) < (*) < (/ %) < (^) < (<< >>) < unary minus and ! < atoms
+     *  all of them left associative except ^ (2^3^2 is 2^9). parse_sum() checks every
+     *  term with grouping(), where Calc groups differently it's CE_SYN_GROUP.
+     *
+     * @return  int     Index of the parsed node, -1 on Error (mError is set).
+     */
+    int parse_or();
+    int parse_and();
+    int parse_cmp();
+    int parse_sum();
+    int parse_prod();
+    int parse_quot();
+    int parse_pow();
+    int parse_shift();
+    int parse_unary();
+    int parse_atom();
+    /**
+     * operand
+     *
+     *  Adds the operand parse_unary() just read (mKind) to mTerm.
+     */
+    void operand();
+    /**
+     * oper
+     *
+     *  Adds an operator to mTerm.
+     *
+     * @param   level           1 *, 2 / %, 3 ^, 4 << >>
+     */
+    void oper(int);
+    /**
+     * grouping
+     *
+     *  Whether Calc::calculate() groups a term like this grammar does. It takes the first
+     *  operand of an expression on its own and the rest of the chain as the right operand,
+     *  and a group or a function call in the middle of a term breaks it up:
+     *      100/10*2 is 100/(10*2), 2^2*3 is 2^(2*3), 2*(3)^2 is (2*3)^2, 1+2*(3) is 3, 2*abs(3) is 2
+     *  So the operators of a term have to go up (* < / % < ^ < << >>, only * and ^ can repeat),
+     *  only the first term may have a group (not a function) as its second operand, and past
+     *  that the operands of a term are numbers or variables, except the first one of the
+     *  first and the last term. Sets mError to CE_SYN_GROUP if it doesn't.
+     *
+     * @param   t               The term.
+     * @param   index           Which term of the expression it is (0 the first).
+     * @param   last            It's the last one.
+     *
+     * @return  false   Calc groups it another way.
+     */
+    bool grouping(const Term &, int, bool);
+    /**
+     * parse_list
+     *
+     *  Parses the items of an aggregate call, up to its closing parenthesis.
+     *
+     * @param   agg             Aggregate number.
+     *
+     * @return  int     Index of the CO_AGG node (or its folded constant), -1 on Error.
+     */
+    int parse_list(int);
+    /**
+     * parse_table
+     *
+     *  Parses the table and the x of a table function, up to its closing parenthesis.
+     *
+     * @param   fn              FunkiiCalcTableFuncs_t.
+     *
+     * @return  int     Index of the node (or its folded constant), -1 on Error.
+     */
+    int parse_table(int);
+    /**
+     * call
+     *
+     *  Adds a CO_CALL node (the arguments are the last argc entries of mArgs).
+     *
+     * @param   string          Name of the formula.
+     * @param   argc            Number of arguments.
+     *
+     * @return  int     Index of the node.
+     */
+    int call(string, int);
+    /**
+     * lazy
+     *
+     *  Adds an if(c, a, b) (CO_IF, the operands go in mArgs), a && b (CO_JF) or a || b (CO_JT)
+     *  node. A constant condition picks the operand right here.
+     *
+     * @param   code            CO_IF, CO_JF or CO_JT.
+     * @param   c               Condition (the left operand of && and ||).
+     * @param   a               Then (the right operand of && and ||).
+     * @param   b               Else (-1 for && and ||).
+     *
+     * @return  int     Index of the node.
+     */
+    int lazy(int, int, int, int);
+    /**
+     * leaf
+     *
+     *  Turns a word (number, constant or variable name) into a node.
+     *
+     * @param   string          The word.
+     *
+     * @return  int     Index of the node.
+     */
+    int leaf(string);
+    /**
+     * emit
+     *
+     *  Appends the postfix code of a node to mOps.
+     *
+     * @param   n               Node to emit.
+     * @param   depth           Current stack depth.
+     * @param   consts          Constant Pool index (value bits -> index).
+     */
+    void emit(int, uint32_t &, map<uint64_t, uint32_t> &);
+    /**
+     * pool
+     *
+     *  Index of a value in the Constant Pool, added if it isn't there yet.
+     *
+     * @param   v               Value.
+     * @param   consts          Constant Pool index (value bits -> index).
+     *
+     * @return  uint32_t        Index in mConsts.
+     */
+    uint32_t pool(double, map<uint64_t, uint32_t> &);
+    /**
+     * step
+     *
+     *  Runs one instruction (the body of the run() loops), fenv skips the errno checks.
+     *
+     * @return  uint32_t        Instructions to skip (a jump was taken), usually 0.
+     */
+    static uint32_t step(const CalcCode &, const CalcOp &, long double *, int &, const long double *, enum FunkiiCalcErrors_t &, bool);
+    /**
+     * exec
+     *
+     *  The run() loop, without resetting errno or the FP flags.
+     */
+    static long double exec(const CalcCode &, const long double *, enum FunkiiCalcErrors_t &, bool);
+    /**
+     * block
+     *
+     *  Runs a program over one block of batch() rows.
+     *
+     * @param   stk             code.stack x CALC_BATCH_BLOCK values.
+     * @param   lane            Error of the rows CalcSimd found out of a domain, or CE_EPIC for the rows that
+     *                          raised a FP flag in a branch only some rows took (CE_NADA for the rest).
+     *
+     * @return  false           Some row failed without raising a FP flag (i.e: fact(0.5)), check them all.
+     */
+    template <typename T>
+    static bool block(const CalcCode &, const T *const *, size_t, size_t, T *, T *, uint8_t *);
+    /**
+     *  Lanes
+     *
+     *  A lazy operator block() runs both ways: the rows that take each one and the FP flags
+     *  raised before it (the ones raised inside are only blamed on the rows that took it and
+     *  had a NaN or Inf on the way).
+     */
+    struct Lanes {
+        uint32_t jmp;               /* CO_JMP of an if() (0 for && and ||) */
+        uint32_t end;               /* Its CO_IF, CO_AND or CO_OR */
+        bool other;                 /* Past the CO_JMP: running the else */
+        fexcept_t flags;            /* FP flags raised before it */
+        uint8_t on[CALC_BATCH_BLOCK];   /* Rows that go on to the next instruction (the then, b) */
+        uint8_t off[CALC_BATCH_BLOCK];  /* Rows that jump (the else) */
+    };
+};
+inline CalcProgram::CalcProgram() : mMath(calc_math_accurate), mParams(NULL) { compile("0"); }
+inline CalcProgram::CalcProgram(string formula) : mMath(calc_math_accurate), mParams(NULL) { compile(formula); }
+inline bool CalcProgram::compile(string formula, const vector<string> &params) {
+    mParams = &params;
+    bool ret = compile(formula);
+    mParams = NULL;
+    return ret;
+}
+inline bool CalcProgram::compile(string formula) {
+    C_DBG_START;
+    mError = CE_NADA; mOps.clear(); mConsts.clear(); mSymbols.clear(); mCalls.clear(); mTabs.clear(); mStack = 0;
+    mNodes.clear(); mArgs.clear(); mSrc.clear(); mPos = 0; mTerm = NULL; mKind = 0;
+    if (mParams != NULL) { mSymbols = *mParams; }
+    Calc calc;
+    mCalc = &calc;
+    calc.limits(mLimits);
+    if (!calc.syntax(formula, (mParams != NULL))) { mError = calc.mError; }
+    else if (calc.mError != CE_NADA) { mError = calc.mError; }
+    else {
+        mSrc = calc.mFormula;
+        errno = 0;
+        int root = parse_or();
+        if (mError == CE_NADA && mPos != mSrc.length()) {
+            mError = (mSrc.at(mPos) == ')' ? CE_SYN_PAR : CE_SYNTAX);
+        }
+        if (mError == CE_NADA && mLimits.nodes > 0 && mNodes.size() > mLimits.nodes) { mError = CE_LIM_NODES; }
+        if (mError == CE_NADA) {
+            uint32_t depth = 0;
+            map<uint64_t, uint32_t> consts;
+            emit(root, depth, consts);
+        }
+    }
+    if (mError != CE_NADA) { mOps.clear(); mConsts.clear(); mSymbols.clear(); mCalls.clear(); mTabs.clear(); mStack = 0; }
+    mNodes.clear(); mArgs.clear(); mSrc.clear(); mCalc = NULL;
+    C_DBG_MSG("compiled '%s' :: %d ops, %d consts, %d vars",formula.c_str(),(int)mOps.size(),(int)mConsts.size(),(int)mSymbols.size());
+    C_DBG_END;
+    return (mError == CE_NADA);
+}
+inline bool CalcProgram::error() { return (mError != CE_NADA); }
+inline string CalcProgram::get_error() { return string(Calc::get_error_c_str(mError)); }
+inline enum FunkiiCalcErrors_t CalcProgram::get_error_code() { return mError; }
+inline int CalcProgram::slot(string name) {
+    for (int i = 0; i < (int)mSymbols.size(); i++) {
+        if (mSymbols[i] == name) { return i; }
+    }
+    return -1;
+}
+inline const vector<string> &CalcProgram::symbols() const { return mSymbols; }
+inline const vector<string> &CalcProgram::calls() const { return mCalls; }
+inline void CalcProgram::bind(string name, const long double *values, size_t n) {
+    for (size_t i = 0; i < name.length(); i++) {
+        if (name.at(i) >= 'A' && name.at(i) <= 'Z') { name.at(i) = (char)(name.at(i) + 32); }
+    }
+    if (n == 0) { mArrays.erase(name); }
+    else { mArrays[name].assign(values, values + n); }
+}
+inline void CalcProgram::table(string name, const CalcTable *table) {
+    for (size_t i = 0; i < name.length(); i++) {
+        if (name.at(i) >= 'A' && name.at(i) <= 'Z') { name.at(i) = (char)(name.at(i) + 32); }
+    }
+    if (table == NULL) { mTables.erase(name); }
+    else { mTables[name] = table; }
+}
+inline void CalcProgram::link(const vector<uint32_t> &target) {
+    for (size_t i = 0; i < mOps.size(); i++) {
+        if (mOps[i].code == CO_CALL) { mOps[i].arg = target[mOps[i].arg]; }
+    }
+}
+inline CalcCode CalcProgram::code() const {
+    CalcCode c;
+    c.ops = (mOps.empty() ? NULL : &mOps[0]);
+    c.consts = (mConsts.empty() ? NULL : &mConsts[0]);
+    c.calls = NULL;
+    c.tables = (mTabs.empty() ? NULL : &mTabs[0]);
+    c.nops = (uint32_t)mOps.size();
+    c.nconsts = (uint32_t)mConsts.size();
+    c.ncalls = 0;
+    c.ntables = (uint32_t)mTabs.size();
+    c.nvars = (uint32_t)mSymbols.size();
+    c.stack = mStack;
+    c.math = (uint32_t)mMath;
+    return c;
+}
+inline void CalcProgram::math(enum FunkiiCalcMathTiers_t tier) { mMath = tier; }
+inline void CalcProgram::limits(const CalcLimits &lim) { mLimits = lim; }
+inline long double CalcProgram::eval() {
+    vector<long double> vars(mSymbols.size(), 0);
+    return eval(vars.empty() ? NULL : &vars[0]);
+}
+inline long double CalcProgram::eval(const long double *vars) {
+    if (mError != CE_NADA) { return 0; }
+    enum FunkiiCalcErrors_t err;
+    long double res = run(code(), vars, err);
+    if (err != CE_NADA) { mError = err; }
+    return res;
+}
+inline long double CalcProgram::eval(const long double *vars, enum FunkiiCalcErrors_t &err) const {
+    if (mError != CE_NADA) { err = mError; return 0; }
+    return run(code(), vars, err);
+}
+inline long double CalcCode::eval(const long double *vars, enum FunkiiCalcErrors_t &err) const {
+    return CalcProgram::run(*this, vars, err);
+}
+inline int CalcProgram::func(string name) {
+    Calc calc;
+    return calc.isFunc(name);
+}
+inline int CalcProgram::aggregate(string name) {
+    Calc calc;
+    return calc.isAgg(name);
+}
+inline int CalcProgram::table_func(string name) {
+    Calc calc;
+    return calc.isTab(name);
+}
+inline long double CalcProgram::apply(int code, uint32_t arg, long double a, long double b, enum FunkiiCalcErrors_t &err) {
+    switch (code) {
+        case CO_NEG: return -a;
+        case CO_ADD: return a + b;
+        case CO_SUB: return a - b;
+        case CO_MUL: return a * b;
+        case CO_DIV: return Calc::apply_oper('/', a, b, err);
+        case CO_MOD: return Calc::apply_oper('%', a, b, err);
+        case CO_POW: return Calc::apply_oper('^', a, b, err);
+        case CO_SHL: return Calc::apply_oper('<', a, b, err);
+        case CO_SHR: return Calc::apply_oper('>', a, b, err);
+        case CO_LT: return (a < b ? 1 : 0);
+        case CO_GT: return (a > b ? 1 : 0);
+        case CO_EQ: return (a == b ? 1 : 0);
+        case CO_NE: return (a != b ? 1 : 0);
+        case CO_LE: return (a <= b ? 1 : 0);
+        case CO_GE: return (a >= b ? 1 : 0);
+        case CO_AND: return ((a != 0 && b != 0) ? 1 : 0);
+        case CO_OR: return ((a != 0 || b != 0) ? 1 : 0);
+        case CO_NOT: return (a == 0 ? 1 : 0);
+        case CO_FUNC: return Calc::apply_func((int)arg, a, err);
+        default: err = CE_EPIC; return 0;
+    }
+}
+inline uint32_t CalcProgram::step(const CalcCode &code, const CalcOp &op, long double *stk, int &sp, const long double *vars, enum FunkiiCalcErrors_t &err, bool fenv) {
+    switch (op.code) {
+        case CO_CONST: stk[++sp] = code.consts[op.arg]; break;
+        case CO_VAR: stk[++sp] = vars[op.arg]; break;
+        case CO_ADD: sp--; stk[sp] += stk[sp + 1]; break;
+        case CO_SUB: sp--; stk[sp] -= stk[sp + 1]; break;
+        case CO_MUL: sp--; stk[sp] *= stk[sp + 1]; break;
+        case CO_FUNC:
+            if (fenv) { stk[sp] = Calc::eval_func((int)op.arg, stk[sp], err); break; }
+            stk[sp] = apply(op.code, op.arg, stk[sp], 0, err);
+            break;
+        case CO_NEG: stk[sp] = -stk[sp]; break;
+        case CO_NOT: stk[sp] = (stk[sp] == 0 ? 1 : 0); break;
+        case CO_JZ:
+            if (stk[sp] == 0) { return op.arg; }
+            sp--;
+            break;
+        case CO_JMP: return op.arg;
+        case CO_IF: sp--; stk[sp] = stk[sp + 1]; break;
+        case CO_JF:
+            if (stk[sp] == 0) { stk[sp] = 0; return op.arg; }
+            break;
+        case CO_JT:
+            if (stk[sp] != 0) { stk[sp] = 1; return op.arg; }
+            break;
+        case CO_CALL: {
+                //the arguments are already in order on the stack, they are the vars of the callee
+                sp -= op.argc;
+                long double r = exec(code.calls[op.arg], stk + sp + 1, err, fenv);
+                stk[++sp] = r;
+            } break;
+        case CO_AGG:
+            sp -= op.argc - 1;
+            stk[sp] = Calc::apply_aggregate((int)op.arg, stk + sp, op.argc, err);
+            break;
+        case CO_LOOKUP:
+        case CO_INTERP:
+        case CO_STEP: stk[sp] = code.tables[op.arg]->apply(op.code - CO_LOOKUP + 1, stk[sp], err); break;
+        default: sp--; stk[sp] = apply(op.code, op.arg, stk[sp], stk[sp + 1], err); break;
+    }
+    return 0;
+}
+inline long double CalcProgram::exec(const CalcCode &code, const long double *vars, enum FunkiiCalcErrors_t &err, bool fenv) {
+    long double local[CALC_PROGRAM_STACK], *stk = local;
+    vector<long double> big;
+    if (code.stack > CALC_PROGRAM_STACK) { big.resize(code.stack); stk = &big[0]; }
+    int sp = -1;
+    for (uint32_t pc = 0; pc < code.nops; pc++) {
+        pc += step(code, code.ops[pc], stk, sp, vars, err, fenv);
+        if (err != CE_NADA) { return 0; }
+    }
+    return (sp < 0 ? 0 : stk[sp]);
+}
+inline long double CalcProgram::run(const CalcCode &code, const long double *vars, enum FunkiiCalcErrors_t &err) {
+    err = CE_NADA; errno = 0;
+    return exec(code, vars, err, false);
+}
+inline long double CalcProgram::run(const CalcCode &code, const long double *vars, enum FunkiiCalcErrors_t &err, enum FunkiiCalcErrorModes_t mode) {
+    if (mode != calc_err_fenv) { return run(code, vars, err); }
+    err = CE_NADA;
+    Calc::fenv_clear();
+    long double res = exec(code, vars, err, true);
+    if (err == CE_NADA) { err = Calc::fenv_error(); }
+    return (err == CE_NADA ? res : 0);
+}
+inline long double CalcProgram::run(const CalcCode &code, const long double *vars, enum FunkiiCalcErrors_t &err, CalcProfile &prof) {
+    long double local[CALC_PROGRAM_STACK], *stk = local;
+    vector<long double> big;
+    if (code.stack > CALC_PROGRAM_STACK) { big.resize(code.stack); stk = &big[0]; }
+    if (prof.count.size() != code.nops) { prof.count.assign(code.nops, 0); prof.cycles.assign(code.nops, 0); }
+    prof.runs++;
+    int sp = -1;
+    err = CE_NADA; errno = 0;
+    for (uint32_t pc = 0; pc < code.nops; pc++) {
+        uint64_t t = CalcProfile::ticks();
+        uint32_t skip = step(code, code.ops[pc], stk, sp, vars, err, false);
+        prof.cycles[pc] += CalcProfile::ticks() - t;
+        prof.count[pc]++;
+        pc += skip;
+        if (err != CE_NADA) { return 0; }
+    }
+    return (sp < 0 ? 0 : stk[sp]);
+}
+inline void CalcProgram::eval(const double *const *vars, size_t rows, double *out, uint8_t *errs) const {
+    if (mError != CE_NADA) {
+        for (size_t i = 0; i < rows; i++) { out[i] = 0; errs[i] = (uint8_t)mError; }
+        return;
+    }
+    batch(code(), vars, rows, out, errs);
+}
+inline void CalcProgram::eval(const float *const *vars, size_t rows, float *out, uint8_t *errs) const {
+    if (mError != CE_NADA) {
+        for (size_t i = 0; i < rows; i++) { out[i] = 0; errs[i] = (uint8_t)mError; }
+        return;
+    }
+    batch(code(), vars, rows, out, errs);
+}
+template <typename T>
+void CalcProgram::batch(const CalcCode &code, const T *const *vars, size_t rows, T *out, uint8_t *errs) {
+    vector<T> stk;
+    batch(code, vars, rows, out, errs, stk);
+}
+template <typename T>
+void CalcProgram::batch(const CalcCode &code, const T *const *vars, size_t rows, T *out, uint8_t *errs, vector<T> &stk) {
+    size_t need = (size_t)(code.stack > 0 ? code.stack : 1) * CALC_BATCH_BLOCK;
+    if (stk.size() < need) { stk.resize(need); }
+    vector<long double> row(code.nvars + 1);
+    uint8_t lane[CALC_BATCH_BLOCK];
+    for (size_t from = 0; from < rows; from += CALC_BATCH_BLOCK) {
+        size_t n = (rows - from < CALC_BATCH_BLOCK ? rows - from : CALC_BATCH_BLOCK);
+        T *res = out + from;
+        memset(lane, CE_NADA, n);
+        Calc::fenv_clear();
+        bool all = !block(code, vars, from, n, &stk[0], res, lane) || (Calc::fenv_error() != CE_NADA);
+        for (size_t i = 0; i < n; i++) {
+            errs[from + i] = CE_NADA;
+            if (!all && lane[i] == CE_NADA && isfinite(res[i])) { continue; }
+            //something went wrong in this block, the scalar run tells which rows and why
+            for (uint32_t s = 0; s < code.nvars; s++) { row[s] = vars[s][from + i]; }
+            enum FunkiiCalcErrors_t err;
+            long double v = run(code, &row[0], err, calc_err_fenv);
+            if (err == CE_NADA && (lane[i] != CE_NADA || !isfinite(res[i]))) {
+                res[i] = (T)v;
+                if (isfinite(v) && !isfinite(res[i])) { err = CE_ERANGE; }
+            }
+            if (err != CE_NADA) { res[i] = 0; errs[from + i] = (uint8_t)err; }
+        }
+    }
+}
+template <typename T>
+bool CalcProgram::block(const CalcCode &code, const T *const *vars, size_t from, size_t n, T *stk, T *out, uint8_t *lane) {
+    const size_t B = CALC_BATCH_BLOCK;
+    const int FLAGS = FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW;
+    bool ok = true;
+    int sp = -1;
+    vector<Lanes> lazy;             /* Lazy operators running both ways, innermost last */
+    const uint8_t *on = NULL;       /* Rows taking the branch being run, NULL for all */
+    uint8_t bad[CALC_BATCH_BLOCK];  /* Rows that had a NaN or Inf in a branch they took */
+    for (uint32_t pc = 0; pc < code.nops; pc++) {
+        const CalcOp &op = code.ops[pc];
+        if (on != NULL) {
+            //a FP flag raised by a row always leaves a NaN or Inf behind, so these are the rows to blame
+            T *a = stk + (size_t)sp * B;
+            for (size_t i = 0; i < n; i++) { bad[i] |= (uint8_t)(on[i] & !isfinite(a[i])); }
+        }
+        if (op.code == CO_JZ || op.code == CO_JF || op.code == CO_JT) {
+            //if every row goes the same way it's a plain jump, else both ways are run for the rows taking them
+            T *a = stk + (size_t)sp * B;
+            Lanes l;
+            size_t go = 0, all = 0;
+            for (size_t i = 0; i < n; i++) {
+                bool act = (on == NULL || on[i]), t = (op.code == CO_JT ? a[i] == 0 : a[i] != 0);
+                l.on[i] = (uint8_t)(act && t); l.off[i] = (uint8_t)(act && !t);
+                go += l.on[i]; all += (act ? 1 : 0);
+            }
+            if (go == 0) {
+                if (op.code != CO_JZ) { for (size_t i = 0; i < n; i++) { a[i] = (op.code == CO_JF ? 0 : 1); } }
+                pc += op.arg;
+                continue;
+            }
+            if (op.code == CO_JZ) { sp--; }
+            if (go == all) { continue; }
+            l.jmp = (op.code == CO_JZ ? pc + op.arg : 0);
+            l.end = (op.code == CO_JZ ? l.jmp + code.ops[l.jmp].arg : pc + op.arg);
+            l.other = false;
+            fegetexceptflag(&l.flags, FLAGS);
+            Calc::fenv_clear();
+            if (lazy.empty()) { memset(bad, 0, n); }
+            lazy.push_back(l);
+            on = lazy.back().on;
+            continue;
+        }
+        if (op.code == CO_JMP && (lazy.empty() || lazy.back().jmp != pc)) { pc += op.arg; continue; }
+        if (op.code == CO_JMP || (!lazy.empty() && lazy.back().end == pc)) {
+            //the end of one way: its FP flags are only for the rows that took it
+            Lanes &l = lazy.back();
+            if (fetestexcept(FLAGS) != 0) {
+                for (size_t i = 0; i < n; i++) { if (on[i] && bad[i] && lane[i] == CE_NADA) { lane[i] = CE_EPIC; } }
+            }
+            if (op.code == CO_JMP) {
+                Calc::fenv_clear();
+                l.other = true;
+                on = l.off;
+                continue;
+            }
+            fesetexceptflag(&l.flags, FLAGS);
+            if (op.code == CO_IF) {
+                sp--;
+                T *a = stk + (size_t)sp * B, *b = a + B;
+                for (size_t i = 0; i < n; i++) { a[i] = (l.on[i] ? a[i] : b[i]); }
+            }
+            lazy.pop_back();
+            on = (lazy.empty() ? NULL : (lazy.back().other ? lazy.back().off : lazy.back().on));
+            if (op.code == CO_IF) { continue; }
+        }
+        else if (op.code == CO_IF) {
+            //every row took the else, it replaces the placeholder
+            sp--;
+            memcpy(stk + (size_t)sp * B, stk + (size_t)(sp + 1) * B, n * sizeof(T));
+            continue;
+        }
+        if (op.code == CO_CONST) {
+            T *a = stk + (size_t)(++sp) * B, v = (T)code.consts[op.arg];
+            for (size_t i = 0; i < n; i++) { a[i] = v; }
+            continue;
+        }
+        if (op.code == CO_VAR) { memcpy(stk + (size_t)(++sp) * B, vars[op.arg] + from, n * sizeof(T)); continue; }
+        if (op.code == CO_CALL) {
+            //one row at a time, the arguments are the vars of the callee
+            sp -= op.argc;
+            T *a = stk + (size_t)(sp + 1) * B;
+            long double args[256];
+            for (size_t i = 0; i < n; i++) {
+                for (int j = 0; j < op.argc; j++) { args[j] = a[j * B + i]; }
+                enum FunkiiCalcErrors_t err;
+                a[i] = (T)run(code.calls[op.arg], args, err);
+                if (err != CE_NADA && (on == NULL || on[i])) { ok = false; }
+            }
+            sp++;
+            continue;
+        }
+        if (op.code == CO_AGG) {
+            //one row at a time, the items are the argc columns
+            sp -= op.argc - 1;
+            T *a = stk + (size_t)sp * B, items[256];
+            for (size_t i = 0; i < n; i++) {
+                for (int j = 0; j < op.argc; j++) { items[j] = a[j * B + i]; }
+                enum FunkiiCalcErrors_t err = CE_NADA;
+                a[i] = BasicCalc<T>::apply_aggregate((int)op.arg, items, op.argc, err);
+                if (err != CE_NADA && (on == NULL || on[i])) { ok = false; }
+            }
+            continue;
+        }
+        if (op.code == CO_LOOKUP || op.code == CO_INTERP || op.code == CO_STEP) {
+            //the rows without a key are run() again, like the ones out of a domain
+            T *a = stk + (size_t)sp * B;
+            uint8_t marks[CALC_BATCH_BLOCK];
+            memset(marks, CE_NADA, n);
+            code.tables[op.arg]->apply(op.code - CO_LOOKUP + 1, a, n, a, marks);
+            for (size_t i = 0; i < n; i++) { if ((on == NULL || on[i]) && marks[i] != CE_NADA) { lane[i] = marks[i]; } }
+            continue;
+        }
+        if (op.code != CO_NEG && op.code != CO_NOT && op.code != CO_FUNC) { sp--; }
+        T *a = stk + (size_t)sp * B, *b = a + B;
+        switch (op.code) {
+            case CO_NEG: for (size_t i = 0; i < n; i++) { a[i] = -a[i]; } break;
+            case CO_NOT: for (size_t i = 0; i < n; i++) { a[i] = (a[i] == 0 ? 1 : 0); } break;
+            case CO_ADD: for (size_t i = 0; i < n; i++) { a[i] += b[i]; } break;
+            case CO_SUB: for (size_t i = 0; i < n; i++) { a[i] -= b[i]; } break;
+            case CO_MUL: for (size_t i = 0; i < n; i++) { a[i] *= b[i]; } break;
+            case CO_DIV: for (size_t i = 0; i < n; i++) { a[i] /= b[i]; } break;
+            case CO_MOD: for (size_t i = 0; i < n; i++) { a[i] = fmod(a[i], b[i]); } break;
+            case CO_POW: for (size_t i = 0; i < n; i++) { a[i] = pow(a[i], b[i]); } break;
+            case CO_LT: for (size_t i = 0; i < n; i++) { a[i] = (a[i] < b[i] ? 1 : 0); } break;
+            case CO_GT: for (size_t i = 0; i < n; i++) { a[i] = (a[i] > b[i] ? 1 : 0); } break;
+            case CO_EQ: for (size_t i = 0; i < n; i++) { a[i] = (a[i] == b[i] ? 1 : 0); } break;
+            case CO_NE: for (size_t i = 0; i < n; i++) { a[i] = (a[i] != b[i] ? 1 : 0); } break;
+            case CO_LE: for (size_t i = 0; i < n; i++) { a[i] = (a[i] <= b[i] ? 1 : 0); } break;
+            case CO_GE: for (size_t i = 0; i < n; i++) { a[i] = (a[i] >= b[i] ? 1 : 0); } break;
+            case CO_AND: for (size_t i = 0; i < n; i++) { a[i] = ((a[i] != 0 && b[i] != 0) ? 1 : 0); } break;
+            case CO_OR: for (size_t i = 0; i < n; i++) { a[i] = ((a[i] != 0 || b[i] != 0) ? 1 : 0); } break;
+            case CO_FUNC:
+                if (on != NULL) {
+                    //only the rows taking this branch can be out of the domain
+                    uint8_t marks[CALC_BATCH_BLOCK];
+                    memset(marks, CE_NADA, n);
+                    bool simd = CalcSimd::apply((int)op.arg, (enum FunkiiCalcMathTiers_t)code.math, a, n, marks);
+                    for (size_t i = 0; i < n; i++) { if (on[i] && marks[i] != CE_NADA) { lane[i] = marks[i]; } }
+                    if (simd) { break; }
+                }
+                else if (CalcSimd::apply((int)op.arg, (enum FunkiiCalcMathTiers_t)code.math, a, n, lane)) { break; }
+                switch (op.arg) {
+                    case 1: for (size_t i = 0; i < n; i++) { a[i] = sqrt(a[i]); } break;
+                    case 2: for (size_t i = 0; i < n; i++) { a[i] = floor(a[i]); } break;
+                    case 3: for (size_t i = 0; i < n; i++) { a[i] = ceil(a[i]); } break;
+                    case 4: for (size_t i = 0; i < n; i++) { a[i] = sin(a[i]); } break;
+                    case 5: for (size_t i = 0; i < n; i++) { a[i] = cos(a[i]); } break;
+                    case 6: for (size_t i = 0; i < n; i++) { a[i] = tan(a[i]); } break;
+                    case 7: for (size_t i = 0; i < n; i++) { a[i] = asin(a[i]); } break;
+                    case 8: for (size_t i = 0; i < n; i++) { a[i] = acos(a[i]); } break;
+                    case 9: for (size_t i = 0; i < n; i++) { a[i] = atan(a[i]); } break;
+                    case 10: for (size_t i = 0; i < n; i++) { a[i] = sinh(a[i]); } break;
+                    case 11: for (size_t i = 0; i < n; i++) { a[i] = cosh(a[i]); } break;
+                    case 12: for (size_t i = 0; i < n; i++) { a[i] = tanh(a[i]); } break;
+                    case 13: for (size_t i = 0; i < n; i++) { a[i] = log(a[i]); } break;
+                    case 14: for (size_t i = 0; i < n; i++) { a[i] = log10(a[i]); } break;
+                    case 15:
+                    case 16: for (size_t i = 0; i < n; i++) { a[i] = fabs(a[i]); } break;
+                    default:
+                        for (size_t i = 0; i < n; i++) {
+                            enum FunkiiCalcErrors_t err = CE_NADA;
+                            a[i] = BasicCalc<T>::eval_func((int)op.arg, a[i], err);
+                            if (err != CE_NADA && (on == NULL || on[i])) { ok = false; }
+                        }
+                }
+                break;
+            default:
+                //bitshifts, one row at a time
+                for (size_t i = 0; i < n; i++) {
+                    enum FunkiiCalcErrors_t err = CE_NADA;
+                    a[i] = (T)apply(op.code, op.arg, a[i], b[i], err);
+                    if (err != CE_NADA && (on == NULL || on[i])) { ok = false; }
+                }
+        }
+    }
+    if (sp < 0) { for (size_t i = 0; i < n; i++) { out[i] = 0; } }
+    else { memcpy(out, stk, n * sizeof(T)); }
+    return ok;
+}
+inline bool CalcProgram::verify(const CalcCode &code) {
+    int nfuncs = (int)(sizeof(Calc::func_array)/sizeof(char *)), naggs = (int)(sizeof(Calc::agg_array)/sizeof(char *));
+    uint32_t depth = 0;
+    if (code.nops > 0 && code.ops == NULL) { return false; }
+    vector<int64_t> want(code.nops + 1, -1);    /* Stack depth every jump lands with */
+    for (uint32_t pc = 0; pc < code.nops; pc++) {
+        const CalcOp &op = code.ops[pc];
+        if (want[pc] >= 0 && want[pc] != (int64_t)depth) { return false; }
+        switch (op.code) {
+            case CO_CONST: if (op.arg >= code.nconsts) { return false; } depth++; break;
+            case CO_VAR: if (op.arg >= code.nvars) { return false; } depth++; break;
+            case CO_FUNC: if (op.arg < 1 || (int)op.arg > nfuncs || depth < 1) { return false; } break;
+            case CO_LOOKUP:
+            case CO_INTERP:
+            case CO_STEP: if (code.tables == NULL || op.arg >= code.ntables || code.tables[op.arg] == NULL || depth < 1) { return false; } break;
+            case CO_NEG:
+            case CO_NOT: if (depth < 1) { return false; } break;
+            case CO_JZ:
+            case CO_JMP:
+            case CO_JF:
+            case CO_JT: {
+                    //and they land right after the instruction that closes them
+                    int closes = (op.code == CO_JZ ? CO_JMP : (op.code == CO_JMP ? CO_IF : (op.code == CO_JF ? CO_AND : CO_OR)));
+                    if (depth < 1 || op.arg < 1 || op.arg > code.nops - pc - 1 || code.ops[pc + op.arg].code != closes ||
+                        (want[pc + op.arg + 1] >= 0 && want[pc + op.arg + 1] != (int64_t)depth)) { return false; }
+                    want[pc + op.arg + 1] = depth;
+                    if (op.code == CO_JZ) { depth--; }
+                } break;
+            case CO_CALL:
+                if (code.calls == NULL || op.arg >= code.ncalls || depth < op.argc ||
+                    code.calls[op.arg].nvars != op.argc) { return false; }
+                depth = depth - op.argc + 1;
+                break;
+            case CO_AGG:
+                //dot (6) takes two halves, powmod (9) 3 values
+                if (op.arg < 1 || (int)op.arg > naggs || op.argc < 1 || depth < op.argc || (op.arg == 6 && (op.argc % 2) != 0) ||
+                    (op.arg == 9 && op.argc != 3)) { return false; }
+                depth = depth - op.argc + 1;
+                break;
+            default:
+                if (op.code >= CO_LAST || depth < 2) { return false; }
+                depth--;
+        }
+        if (depth > code.stack) { return false; }
+    }
+    if (want[code.nops] >= 0 && want[code.nops] != (int64_t)depth) { return false; }
+    return (code.nops == 0 || depth == 1);
+}
+inline int CalcProgram::node(int code, int a, int b, uint32_t arg) {
+    Node n;
+    n.code = code; n.arg = arg; n.a = a; n.b = b; n.argc = 0; n.value = 0; n.flags = 0;
+    //all operands are constants? then fold it... unless it errors, that's left for eval()
+    if (a >= 0 && mNodes[a].code == CO_CONST && (b < 0 || mNodes[b].code == CO_CONST)) {
+        enum FunkiiCalcErrors_t err = CE_NADA;
+        errno = 0;
+        Calc::fenv_clear();
+        long double v = apply(code, arg, mNodes[a].value, (b < 0 ? 0 : mNodes[b].value), err);
+        if (err == CE_NADA && errno == 0 && Calc::fenv_error() == CE_NADA) {
+            int c = constant(v);
+            mNodes[c].flags = CALC_OP_FOLDED;
+            return c;
+        }
+    }
+    mNodes.push_back(n);
+    return (int)mNodes.size() - 1;
+}
+inline int CalcProgram::constant(long double value) {
+    Node n;
+    n.code = CO_CONST; n.arg = 0; n.a = -1; n.b = -1; n.argc = 0; n.value = value; n.flags = 0;
+    mNodes.push_back(n);
+    return (int)mNodes.size() - 1;
+}
+inline int CalcProgram::parse_or() {
+    int l = parse_and();
+    while (mError == CE_NADA && (mPos + 1) < mSrc.length() && mSrc.at(mPos) == '|' && mSrc.at(mPos + 1) == '|') {
+        mPos += 2;
+        int r = parse_and();
+        if (mError != CE_NADA) { return -1; }
+        l = lazy(CO_JT, l, r, -1);
+    }
+    return (mError != CE_NADA ? -1 : l);
+}
+inline int CalcProgram::parse_and() {
+    int l = parse_cmp();
+    while (mError == CE_NADA && (mPos + 1) < mSrc.length() && mSrc.at(mPos) == '&' && mSrc.at(mPos + 1) == '&') {
+        mPos += 2;
+        int r = parse_cmp();
+        if (mError != CE_NADA) { return -1; }
+        l = lazy(CO_JF, l, r, -1);
+    }
+    return (mError != CE_NADA ? -1 : l);
+}
+inline int CalcProgram::parse_cmp() {
+    int l = parse_sum(), res = -1;
+    while (mError == CE_NADA && mPos < mSrc.length()) {
+        int code;
+        char c = mSrc.at(mPos), c1 = ((mPos + 1) < mSrc.length() ? mSrc.at(mPos + 1) : '\0');
+        if (c == '<') {
+            if (c1 == '>') { code = CO_NE; mPos++; }
+            else if (c1 == '=') { code = CO_LE; mPos++; }
+            else { code = CO_LT; }
+        }
+        else if (c == '>') {
+            if (c1 == '=') { code = CO_GE; mPos++; }
+            else { code = CO_GT; }
+        }
+        else if (c == '=') {
+            if (c1 == '=') { mPos++; }
+            code = CO_EQ;
+        }
+        else { break; }
+        mPos++;
+        int r = parse_sum();
+        if (mError != CE_NADA) { return -1; }
+        //a < b < c is evaluated as (a < b) and (b < c), same as Calc::checkandcompare()
+        int cmp = node(code, l, r, 0);
+        res = (res < 0 ? cmp : node(CO_AND, res, cmp, 0));
+        l = r;
+    }
+    if (mError != CE_NADA) { return -1; }
+    return (res < 0 ? l : res);
+}
+inline int CalcProgram::parse_sum() {
+    Term *outer = mTerm, t;
+    int terms = 0, first = -1;
+    mTerm = &t;
+    int l = parse_prod();
+    while (mError == CE_NADA && mPos < mSrc.length() && (mSrc.at(mPos) == '+' || mSrc.at(mPos) == '-')) {
+        int code = (mSrc.at(mPos) == '+' ? CO_ADD : CO_SUB);
+        mPos++;
+        if (!grouping(t, terms++, false)) { break; }
+        if (terms == 1 && t.atoms == 1) { first = t.kind[0]; }
+        t = Term();
+        int r = parse_prod();
+        if (mError != CE_NADA) { break; }
+        l = node(code, l, r, 0);
+    }
+    if (mError == CE_NADA && grouping(t, terms, true) && terms == 1 && first == 5 && t.atoms == 1 && (t.kind[0] == 0 || t.kind[0] == 5)) {
+        //e-1 and 3e2+1 pass Calc::IsValidNum(), strtod() makes them 0 and 300
+        mError = CE_SYN_GROUP;
+    }
+    mTerm = outer;
+    return (mError != CE_NADA ? -1 : l);
+}
+inline int CalcProgram::parse_prod() {
+    int l = parse_quot();
+    while (mError == CE_NADA && mPos < mSrc.length() && mSrc.at(mPos) == '*') {
+        oper(1);
+        mPos++;
+        int r = parse_quot();
+        if (mError != CE_NADA) { return -1; }
+        l = node(CO_MUL, l, r, 0);
+    }
+    return (mError != CE_NADA ? -1 : l);
+}
+inline int CalcProgram::parse_quot() {
+    int l = parse_pow();
+    while (mError == CE_NADA && mPos < mSrc.length() && (mSrc.at(mPos) == '/' || mSrc.at(mPos) == '%')) {
+        int code = (mSrc.at(mPos) == '/' ? CO_DIV : CO_MOD);
+        oper(2);
+        mPos++;
+        int r = parse_pow();
+        if (mError != CE_NADA) { return -1; }
+        l = node(code, l, r, 0);
+    }
+    return (mError != CE_NADA ? -1 : l);
+}
+inline int CalcProgram::parse_pow() {
+    int l = parse_shift();
+    if (mError == CE_NADA && mPos < mSrc.length() && mSrc.at(mPos) == '^') {
+        oper(3);
+        mPos++;
+        int r = parse_pow();
+        if (mError != CE_NADA) { return -1; }
+        l = node(CO_POW, l, r, 0);
+    }
+    return (mError != CE_NADA ? -1 : l);
+}
+inline int CalcProgram::parse_shift() {
+    int l = parse_unary();
+    if (mError == CE_NADA) { operand(); }
+    while (mError == CE_NADA && (mPos + 1) < mSrc.length() &&
+           ((mSrc.at(mPos) == '<' && mSrc.at(mPos + 1) == '<') || (mSrc.at(mPos) == '>' && mSrc.at(mPos + 1) == '>'))) {
+        int code = (mSrc.at(mPos) == '<' ? CO_SHL : CO_SHR);
+        oper(4);
+        mPos += 2;
+        int r = parse_unary();
+        if (mError != CE_NADA) { return -1; }
+        operand();
+        l = node(code, l, r, 0);
+    }
+    return (mError != CE_NADA ? -1 : l);
+}
+inline int CalcProgram::parse_unary() {
+    if (mPos < mSrc.length() && mSrc.at(mPos) == '-') {
+        mPos++;
+        bool twice = (mPos < mSrc.length() && mSrc.at(mPos) == '-');
+        int a = parse_unary();
+        if (mError != CE_NADA) { return -1; }
+        //Calc only gets one sign, of a number, a variable or a group
+        if (twice || mKind == 2 || mKind == 3 || mKind == 5 || mKind == 6) { mKind = 4; }
+        return node(CO_NEG, a, -1, 0);
+    }
+    if (mPos < mSrc.length() && mSrc.at(mPos) == '!') {
+        mPos++;
+        int a = parse_unary();
+        if (mError != CE_NADA) { return -1; }
+        //Calc puts (0) or (1) in its place (but it ends 1e-5 at the e)
+        mKind = (mKind == 3 ? 4 : 1);
+        return node(CO_NOT, a, -1, 0);
+    }
+    if (mPos < mSrc.length() && mSrc.at(mPos) == '+') {
+        mPos++;
+        int a = parse_unary();
+        mKind = 4;
+        return a;
+    }
+    return parse_atom();
+}
+inline void CalcProgram::operand() {
+    Term &t = *mTerm;
+    if (t.atoms < 2) { t.kind[t.atoms] = mKind; }
+    else if (mKind != 0 && mKind < 5) { t.rest = true; }
+    if (mKind == 3) { t.lone = true; }
+    if (mKind == 4) { t.bad = true; }
+    t.atoms++;
+}
+inline void CalcProgram::oper(int level) {
+    Term &t = *mTerm;
+    if (t.oper > level || (t.oper == level && level != 1 && level != 3)) { t.bad = true; }
+    t.oper = level;
+}
+inline bool CalcProgram::grouping(const Term &t, int index, bool last) {
+    bool ok = !t.bad && (!t.lone || (t.atoms == 1 && index == 0 && last));
+    if (ok && t.atoms > 1) {
+        bool plain0 = (t.kind[0] == 0 || t.kind[0] >= 5), plain1 = (t.kind[1] == 0 || t.kind[1] >= 5);
+        if (t.rest) { ok = false; }
+        else if (index == 0) { ok = (plain1 || (t.kind[1] == 1 && t.atoms == 2)); }
+        else if (last) { ok = plain1; }
+        else { ok = (plain0 && plain1); }
+    }
+    if (!ok) { mError = CE_SYN_GROUP; }
+    return ok;
+}
+inline int CalcProgram::parse_atom() {
+    if (mPos >= mSrc.length()) { mError = CE_SYNTAX; return -1; }
+    if (mSrc.at(mPos) == '(') {
+        mPos++;
+        int n = parse_or();
+        if (mError != CE_NADA) { return -1; }
+        if (mPos >= mSrc.length() || mSrc.at(mPos) != ')') { mError = CE_SYN_PAR; return -1; }
+        mPos++;
+        mKind = 1;
+        return n;
+    }
+    size_t start = mPos;
+    while (mPos < mSrc.length() &&
+           ((mSrc.at(mPos) >= '0' && mSrc.at(mPos) <= '9') || (mSrc.at(mPos) >= 'a' && mSrc.at(mPos) <= 'z') || mSrc.at(mPos) == '.')) {
+        mPos++;
+    }
+    if (mPos == start) { mError = CE_SYNTAX; return -1; }
+    mKind = 0;
+    //the sign of an exponent is part of the number: 1e-5 isn't 1e - 5 (but to Calc it is, unless it's all there is)
+    if (mPos + 1 < mSrc.length() && mSrc.at(mPos - 1) == 'e' && (mSrc.at(mPos) == '-' || mSrc.at(mPos) == '+') &&
+        mSrc.at(mPos + 1) >= '0' && mSrc.at(mPos + 1) <= '9' &&
+        mSrc.find_first_not_of("0123456789.", start) == mPos - 1 && mPos - 1 > start) {
+        mPos += 2;
+        while (mPos < mSrc.length() && mSrc.at(mPos) >= '0' && mSrc.at(mPos) <= '9') { mPos++; }
+        mKind = 3;
+    }
+    string word = mSrc.substr(start, mPos - start);
+    if (mKind == 0 && (word == "e" || (word.at(0) <= '9' && word.find('e') != string::npos))) { mKind = 5; }
+    else if (word == "pi") { mKind = 6; }
+    if (mPos < mSrc.length() && mSrc.at(mPos) == '(') {
+        int f = mCalc->isFunc(word), g = mCalc->isAgg(word), t = mCalc->isTab(word);
+        mPos++;
+        //Calc puts the value of these in their place, in parentheses
+        if (g > 0) { int n = parse_list(g); mKind = 1; return n; }
+        if (t > 0) { int n = parse_table(t); mKind = 1; return n; }
+        if (word == "if") {
+            //if(cond, then, else)
+            int args[3], argc = 0;
+            while (true) {
+                int a = parse_or();
+                if (mError != CE_NADA) { return -1; }
+                if (argc < 3) { args[argc] = a; }
+                argc++;
+                if (mPos < mSrc.length() && mSrc.at(mPos) == ',') { mPos++; continue; }
+                break;
+            }
+            if (mPos >= mSrc.length() || mSrc.at(mPos) != ')') { mError = CE_SYN_PAR; return -1; }
+            mPos++;
+            if (argc != 3) { mError = CE_SYNTAX; return -1; }
+            mKind = 1;
+            return lazy(CO_IF, args[0], args[1], args[2]);
+        }
+        if (f == 0) {
+            //a call to another formula: name(arg, arg, ...)
+            if (mParams == NULL) { mError = CE_SYNTAX; return -1; }
+            vector<int> args;
+            while (true) {
+                int a = parse_or();
+                if (mError != CE_NADA) { return -1; }
+                args.push_back(a);
+                if (mPos < mSrc.length() && mSrc.at(mPos) == ',') { mPos++; continue; }
+                break;
+            }
+            if (mPos >= mSrc.length() || mSrc.at(mPos) != ')') { mError = CE_SYN_PAR; return -1; }
+            mPos++;
+            if (args.size() > 255) { mError = CE_REG_ARGS; return -1; }
+            mArgs.insert(mArgs.end(), args.begin(), args.end());
+            mKind = 2;
+            return call(word, (int)args.size());
+        }
+        if (f >= 17 && f <= 19) {
+            //bin(), oct() and hex() of a literal (what syntax() makes of \b, \o and \x)
+            size_t end = mSrc.find(')', mPos);
+            string num = mSrc.substr(mPos, (end == string::npos ? string::npos : end - mPos));
+            if (end != string::npos && !num.empty() && num.find_first_not_of("0123456789abcdefghijklmnopqrstuvwxyz.") == string::npos) {
+                long double v = (f == 17 ? mCalc->bin2dec(num) : (f == 18 ? mCalc->oct2dec(num) : mCalc->hex2dec(num)));
+                if (mCalc->mError != CE_NADA) { mError = mCalc->mError; return -1; }
+                mPos = end + 1;
+                mKind = 2;
+                return constant(v);
+            }
+        }
+        int a = parse_or();
+        if (mError != CE_NADA) { return -1; }
+        if (mPos >= mSrc.length() || mSrc.at(mPos) != ')') { mError = CE_SYN_PAR; return -1; }
+        mPos++;
+        mKind = 2;
+        //bin(), oct() and hex() of an expression leave it as it is (like Calc does)
+        if (f >= 17 && f <= 19) { return a; }
+        return node(CO_FUNC, a, -1, (uint32_t)f);
+    }
+    return leaf(word);
+}
+inline int CalcProgram::parse_list(int agg) {
+    vector<int> items;
+    bool constants = true;
+    while (true) {
+        //a bound array is all of its values
+        size_t end = mPos;
+        while (end < mSrc.length() && ((mSrc.at(end) >= '0' && mSrc.at(end) <= '9') || (mSrc.at(end) >= 'a' && mSrc.at(end) <= 'z') || mSrc.at(end) == '.')) {
+            end++;
+        }
+        map<string, vector<long double> >::iterator it = mArrays.find(mSrc.substr(mPos, end - mPos));
+        if (it != mArrays.end() && end < mSrc.length() && (mSrc.at(end) == ',' || mSrc.at(end) == ')')) {
+            for (size_t i = 0; i < it->second.size(); i++) { items.push_back(constant(it->second[i])); }
+            mPos = end;
+        }
+        else {
+            int a = parse_or();
+            if (mError != CE_NADA) { return -1; }
+            items.push_back(a);
+            if (mNodes[a].code != CO_CONST) { constants = false; }
+        }
+        if (mPos < mSrc.length() && mSrc.at(mPos) == ',') { mPos++; continue; }
+        break;
+    }
+    if (mPos >= mSrc.length() || mSrc.at(mPos) != ')') { mError = CE_SYN_PAR; return -1; }
+    mPos++;
+    if ((agg == 6 && (items.size() % 2) != 0) || (agg == 9 && items.size() != 3)) { mError = CE_REG_ARGS; return -1; }
+    if (constants) {
+        //sum(1, 2, pi) or sum(prices): done once, here
+        vector<long double> v(items.size());
+        for (size_t i = 0; i < items.size(); i++) { v[i] = mNodes[items[i]].value; }
+        enum FunkiiCalcErrors_t err = CE_NADA;
+        Calc::fenv_clear();
+        long double r = Calc::apply_aggregate(agg, &v[0], v.size(), err);
+        if (err == CE_NADA && Calc::fenv_error() == CE_NADA) {
+            int c = constant(r);
+            mNodes[c].flags = CALC_OP_FOLDED;
+            return c;
+        }
+    }
+    if (items.size() > 255) { mError = CE_REG_ARGS; return -1; }
+    mArgs.insert(mArgs.end(), items.begin(), items.end());
+    Node n;
+    n.code = CO_AGG; n.arg = (uint32_t)agg; n.a = (int)mArgs.size() - (int)items.size(); n.b = -1; n.argc = (int)items.size(); n.value = 0; n.flags = 0;
+    mNodes.push_back(n);
+    return (int)mNodes.size() - 1;
+}
+inline int CalcProgram::parse_table(int fn) {
+    //the table is a name, x any formula
+    size_t end = mPos;
+    while (end < mSrc.length() && ((mSrc.at(end) >= '0' && mSrc.at(end) <= '9') || (mSrc.at(end) >= 'a' && mSrc.at(end) <= 'z'))) { end++; }
+    map<string, const CalcTable *>::iterator it = mTables.find(mSrc.substr(mPos, end - mPos));
+    if (end == mPos) { mError = CE_SYNTAX; return -1; }
+    if (it == mTables.end() || end >= mSrc.length() || (mSrc.at(end) != ',' && mSrc.at(end) != ')')) { mError = CE_REG_UNDEF; return -1; }
+    if (mSrc.at(end) == ')') { mError = CE_REG_ARGS; return -1; }
+    mPos = end + 1;
+    int a = parse_or();
+    if (mError != CE_NADA) { return -1; }
+    if (mPos < mSrc.length() && mSrc.at(mPos) == ',') { mError = CE_REG_ARGS; return -1; }
+    if (mPos >= mSrc.length() || mSrc.at(mPos) != ')') { mError = CE_SYN_PAR; return -1; }
+    mPos++;
+    if (mNodes[a].code == CO_CONST) {
+        //interp(rates, 2.5): done once, here
+        enum FunkiiCalcErrors_t err = CE_NADA;
+        long double r = it->second->apply(fn, mNodes[a].value, err);
+        if (err == CE_NADA) {
+            int c = constant(r);
+            mNodes[c].flags = CALC_OP_FOLDED;
+            return c;
+        }
+    }
+    uint32_t t = 0;
+    while (t < mTabs.size() && mTabs[t] != it->second) { t++; }
+    if (t == mTabs.size()) { mTabs.push_back(it->second); }
+    Node n;
+    n.code = CO_LOOKUP + fn - 1; n.arg = t; n.a = a; n.b = -1; n.argc = 0; n.value = 0; n.flags = 0;
+    mNodes.push_back(n);
+    return (int)mNodes.size() - 1;
+}
+inline int CalcProgram::call(string name, int argc) {
+    uint32_t c = 0;
+    while (c < mCalls.size() && mCalls[c] != name) { c++; }
+    if (c == mCalls.size()) { mCalls.push_back(name); }
+    Node n;
+    n.code = CO_CALL; n.arg = c; n.a = (int)mArgs.size() - argc; n.b = -1; n.argc = argc; n.value = 0; n.flags = 0;
+    mNodes.push_back(n);
+    return (int)mNodes.size() - 1;
+}
+inline int CalcProgram::lazy(int code, int c, int a, int b) {
+    if (mNodes[c].code == CO_CONST) {
+        bool t = (mNodes[c].value != 0);
+        if (code == CO_IF) { return (t ? a : b); }
+        //true && a, false || a: whether a isn't 0
+        if (t == (code == CO_JF)) { return node(CO_NE, a, constant(0), 0); }
+        int k = constant(t ? 1 : 0);
+        mNodes[k].flags = CALC_OP_FOLDED;
+        return k;
+    }
+    Node n;
+    n.code = code; n.arg = 0; n.a = c; n.b = a; n.argc = 0; n.value = 0; n.flags = 0;
+    if (code == CO_IF) {
+        mArgs.push_back(c); mArgs.push_back(a); mArgs.push_back(b);
+        n.a = (int)mArgs.size() - 3; n.b = -1; n.argc = 3;
+    }
+    mNodes.push_back(n);
+    return (int)mNodes.size() - 1;
+}
+inline int CalcProgram::leaf(string word) {
+    if (word.compare("e") == 0) { return constant(EXP); }
+    if (word.compare("pi") == 0) { return constant(PI); }
+    if (word.at(0) >= 'a' && word.at(0) <= 'z') {
+        int s = slot(word);
+        if (s < 0) {
+            //named formulas only have their parameters, anything else is a formula without parameters
+            if (mParams != NULL) { return call(word, 0); }
+            mSymbols.push_back(word); s = (int)mSymbols.size() - 1;
+        }
+        Node n;
+        n.code = CO_VAR; n.arg = (uint32_t)s; n.a = -1; n.b = -1; n.argc = 0; n.value = 0; n.flags = 0;
+        mNodes.push_back(n);
+        return (int)mNodes.size() - 1;
+    }
+    return constant(calc_strtonum(word.c_str(), (long double)0));
+}
+inline void CalcProgram::emit(int n, uint32_t &depth, map<uint64_t, uint32_t> &consts) {
+    const Node nd = mNodes[n];
+    CalcOp op;
+    op.code = (uint8_t)nd.code; op.argc = (uint8_t)nd.argc; op.flags = nd.flags; op.arg = nd.arg;
+    if (nd.code == CO_CONST) {
+        double v = (double)nd.value;
+        op.arg = pool(v, consts);
+        depth++;
+        if ((long double)v != nd.value && nd.value == floorl(nd.value) && fabsl(nd.value) < 18446744073709551616.0L) {
+            //an integer past 2^53 doesn't fit a double: both halves do, and run() adds them back in long double
+            mOps.push_back(op);
+            op.arg = pool((double)(nd.value - v), consts);
+            mOps.push_back(op);
+            if (++depth > mStack) { mStack = depth; }
+            depth--;
+            op.code = CO_ADD; op.arg = 0;
+        }
+    }
+    else if (nd.code == CO_VAR) { depth++; }
+    else if (nd.code == CO_CALL || nd.code == CO_AGG) {
+        for (int i = 0; i < nd.argc; i++) { emit(mArgs[nd.a + i], depth, consts); }
+        depth = depth - nd.argc + 1;
+    }
+    else if (nd.code == CO_IF) {
+        //c CO_JZ a CO_JMP b CO_IF, the jumps are filled once their targets are known
+        CalcOp jump = op;
+        emit(mArgs[nd.a], depth, consts);
+        size_t jz = mOps.size();
+        jump.code = CO_JZ; jump.argc = 0;
+        mOps.push_back(jump);
+        depth--;
+        emit(mArgs[nd.a + 1], depth, consts);
+        size_t jmp = mOps.size();
+        jump.code = CO_JMP;
+        mOps.push_back(jump);
+        emit(mArgs[nd.a + 2], depth, consts);
+        depth--;
+        mOps[jz].arg = (uint32_t)(jmp - jz);
+        mOps[jmp].arg = (uint32_t)(mOps.size() - jmp);
+        op.argc = 0;
+    }
+    else if (nd.code == CO_JF || nd.code == CO_JT) {
+        //a CO_JF b CO_AND, a CO_JT b CO_OR
+        emit(nd.a, depth, consts);
+        size_t j = mOps.size();
+        mOps.push_back(op);
+        emit(nd.b, depth, consts);
+        depth--;
+        mOps[j].arg = (uint32_t)(mOps.size() - j);
+        op.code = (uint8_t)(nd.code == CO_JF ? CO_AND : CO_OR);
+    }
+    else {
+        emit(nd.a, depth, consts);
+        if (nd.b >= 0) { emit(nd.b, depth, consts); depth--; }
+    }
+    if (depth > mStack) { mStack = depth; }
+    mOps.push_back(op);
+}
+inline uint32_t CalcProgram::pool(double v, map<uint64_t, uint32_t> &consts) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    map<uint64_t, uint32_t>::iterator it = consts.find(bits);
+    if (it != consts.end()) { return it->second; }
+    consts[bits] = (uint32_t)mConsts.size();
+    mConsts.push_back(v);
+    return (uint32_t)mConsts.size() - 1;
+}
+inline bool CalcProgram::describe(const CalcCode &code, const vector<string> &names, vector<string> &label, vector<string> &text, vector<uint32_t> &first) {
+    //precedence of every opcode, to only put the parentheses the parser needs
+    static const int prec[CO_LAST] = { 9, 9, 8, 3, 3, 4, 5, 5, 6, 7, 7, 2, 2, 2, 2, 2, 2, 1, 9, 9, 9, 8, 0, 9, 9, 9, 9, 9, 9, 9, 9 };
+    static const char *sym[CO_LAST] = { "", "", "-", "+", "-", "*", "/", "%", "^", "<<", ">>",
+                                        "<", ">", "=", "<>", "<=", ">=", "and", "", "", "",
+                                        "!", "||", "jz", "jmp", "if", "jf", "jt", "", "", "" };
+    int nfuncs = (int)(sizeof(Calc::func_array)/sizeof(char *)), naggs = (int)(sizeof(Calc::agg_array)/sizeof(char *));
+    label.assign(code.nops, ""); text.assign(code.nops, ""); first.assign(code.nops, 0);
+    vector<uint32_t> stack;         /* Instruction of every sub expression on the evaluation stack */
+    vector<uint32_t> conds;         /* Conditions of the if() being described */
+    char buf[64];
+    for (uint32_t pc = 0; pc < code.nops; pc++) {
+        const CalcOp &op = code.ops[pc];
+        if (op.code >= CO_LAST) { return false; }
+        first[pc] = pc;
+        switch (op.code) {
+            case CO_CONST:
+                if (op.arg >= code.nconsts) { return false; }
+                snprintf(buf, sizeof(buf), "%.15g", code.consts[op.arg]);
+                label[pc] = buf;
+                break;
+            case CO_VAR:
+                if (op.arg < names.size()) { label[pc] = names[op.arg]; }
+                else { snprintf(buf, sizeof(buf), "$%u", op.arg); label[pc] = buf; }
+                break;
+            case CO_CALL:
+            case CO_AGG: {
+                    if (stack.size() < op.argc || (op.code == CO_AGG && (op.arg < 1 || (int)op.arg > naggs))) { return false; }
+                    if (op.code == CO_AGG) { label[pc] = Calc::agg_array[op.arg - 1]; }
+                    else { snprintf(buf, sizeof(buf), "call#%u", op.arg); label[pc] = buf; }
+                    text[pc] = label[pc] + "(";
+                    size_t from = stack.size() - op.argc;
+                    for (size_t i = from; i < stack.size(); i++) { text[pc] += (i > from ? "," : "") + text[stack[i]]; }
+                    text[pc] += ")";
+                    if (op.argc > 0) { first[pc] = first[stack[from]]; }
+                    stack.resize(from);
+                } break;
+            case CO_JZ:
+            case CO_JMP:
+            case CO_JF:
+            case CO_JT:
+                //not sub expressions, the if() keeps its condition aside
+                if (stack.empty()) { return false; }
+                label[pc] = text[pc] = sym[op.code];
+                if (op.code == CO_JZ) { conds.push_back(stack.back()); stack.pop_back(); }
+                continue;
+            case CO_IF: {
+                    if (stack.size() < 2 || conds.empty()) { return false; }
+                    uint32_t b = stack.back(); stack.pop_back();
+                    uint32_t a = stack.back(); stack.pop_back();
+                    uint32_t c = conds.back(); conds.pop_back();
+                    label[pc] = sym[op.code];
+                    text[pc] = "if(" + text[c] + "," + text[a] + "," + text[b] + ")";
+                    first[pc] = first[c];
+                } break;
+            case CO_LOOKUP:
+            case CO_INTERP:
+            case CO_STEP:
+            case CO_FUNC:
+            case CO_NOT:
+            case CO_NEG: {
+                    if (stack.empty() || (op.code == CO_FUNC && (op.arg < 1 || (int)op.arg > nfuncs))) { return false; }
+                    uint32_t a = stack.back();
+                    stack.pop_back();
+                    if (op.code == CO_FUNC) {
+                        label[pc] = Calc::func_array[op.arg - 1];
+                        text[pc] = label[pc] + "(" + text[a] + ")";
+                    }
+                    else if (op.code >= CO_LOOKUP) {
+                        //the tables have no names here
+                        label[pc] = Calc::tab_array[op.code - CO_LOOKUP];
+                        snprintf(buf, sizeof(buf), "(table#%u,", op.arg);
+                        text[pc] = label[pc] + buf + text[a] + ")";
+                    }
+                    else {
+                        label[pc] = sym[op.code];
+                        text[pc] = (prec[code.ops[a].code] < 9 ? label[pc] + "(" + text[a] + ")" : label[pc] + text[a]);
+                    }
+                    first[pc] = first[a];
+                } break;
+            default: {
+                    if (stack.size() < 2) { return false; }
+                    uint32_t b = stack.back(); stack.pop_back();
+                    uint32_t a = stack.back(); stack.pop_back();
+                    int p = prec[op.code];
+                    label[pc] = sym[op.code];
+                    //the CO_AND of a && b (not of a comparison chain)
+                    if (op.code == CO_AND && first[b] > 0 && code.ops[first[b] - 1].code == CO_JF) { label[pc] = "&&"; }
+                    text[pc] = (prec[code.ops[a].code] < p ? "(" + text[a] + ")" : text[a]) + label[pc] +
+                               (prec[code.ops[b].code] <= p ? "(" + text[b] + ")" : text[b]);
+                    first[pc] = first[a];
+                } break;
+        }
+        if (text[pc].empty()) { text[pc] = label[pc]; }
+        stack.push_back(pc);
+    }
+    return (code.nops == 0 || stack.size() == 1);
+}
+inline string CalcProgram::explain() const {
+    if (mError != CE_NADA) { return string(Calc::get_error_c_str(mError)) + "\n"; }
+    return explain(code(), mSymbols);
+}
+inline string CalcProgram::explain(const CalcCode &code, const vector<string> &names) {
+    vector<string> label, text;
+    vector<uint32_t> first;
+    if (!describe(code, names, label, text, first)) { return "broken program\n"; }
+    string out;
+    char buf[128];
+    //depth first from the root (the last instruction), the operands of pc end right before it
+    vector<pair<uint32_t, int> > todo;
+    if (code.nops > 0) { todo.push_back(make_pair(code.nops - 1, 0)); }
+    while (!todo.empty()) {
+        uint32_t pc = todo.back().first;
+        int depth = todo.back().second;
+        todo.pop_back();
+        const CalcOp &op = code.ops[pc];
+        string detail;
+        switch (op.code) {
+            case CO_CONST: snprintf(buf, sizeof(buf), "const #%u%s", op.arg, (op.flags & CALC_OP_FOLDED) ? " folded" : ""); detail = buf; break;
+            case CO_VAR: snprintf(buf, sizeof(buf), "var slot %u", op.arg); detail = buf; break;
+            case CO_FUNC: snprintf(buf, sizeof(buf), "func_array[%u]", op.arg); detail = buf; break;
+            case CO_CALL: snprintf(buf, sizeof(buf), "calls[%u], %u args", op.arg, (unsigned)op.argc); detail = buf; break;
+            case CO_AGG: snprintf(buf, sizeof(buf), "agg_array[%u], %u items", op.arg, (unsigned)op.argc); detail = buf; break;
+            case CO_LOOKUP:
+            case CO_INTERP:
+            case CO_STEP: snprintf(buf, sizeof(buf), "tables[%u]", op.arg); detail = buf; break;
+            case CO_JZ:
+            case CO_JMP:
+            case CO_JF:
+            case CO_JT: snprintf(buf, sizeof(buf), "skip %u", op.arg); detail = buf; break;
+        }
+        string node = string(depth * 2, ' ') + label[pc];
+        snprintf(buf, sizeof(buf), "[%2u] %-34s %s", pc, node.c_str(), detail.c_str());
+        out += buf;
+        out.erase(out.find_last_not_of(' ') + 1);
+        out += "\n";
+        //operands, pushed backwards so the first one is printed first
+        for (int64_t c = (int64_t)pc - 1; c >= (int64_t)first[pc]; c = (int64_t)first[c] - 1) {
+            todo.push_back(make_pair((uint32_t)c, depth + 1));
+        }
+    }
+    snprintf(buf, sizeof(buf), "%u ops, %u consts, %u vars", code.nops, code.nconsts, code.nvars);
+    out += buf;
+    for (uint32_t i = 0; i < code.nvars && i < names.size(); i++) { out += (i == 0 ? " (" : ", ") + names[i]; }
+    if (code.nvars > 0 && !names.empty()) { out += ")"; }
+    snprintf(buf, sizeof(buf), ", stack %u\n", code.stack);
+    out += buf;
+    return out;
+}
+inline uint64_t CalcProfile::ticks() {
+#ifdef CALC_RDTSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+inline string CalcProfile::report(const CalcCode &code, const vector<string> &names) const {
+    vector<string> label, text;
+    vector<uint32_t> first;
+    if (count.size() != code.nops || !CalcProgram::describe(code, names, label, text, first)) { return "no profile\n"; }
+    uint64_t all = 0;
+    for (size_t i = 0; i < cycles.size(); i++) { all += cycles[i]; }
+    vector<pair<uint64_t, uint32_t> > order;
+    for (uint32_t pc = 0; pc < code.nops; pc++) { order.push_back(make_pair(cycles[pc], pc)); }
+    sort(order.rbegin(), order.rend());
+    string out;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%llu runs, %llu cycles (%.1f per run)\n  op       count        self  self%%       total  node\n",
+             (unsigned long long)runs, (unsigned long long)all, runs ? (double)all / runs : 0.0);
+    out += buf;
+    for (size_t i = 0; i < order.size(); i++) {
+        uint32_t pc = order[i].second;
+        uint64_t total = 0;
+        for (uint32_t c = first[pc]; c <= pc; c++) { total += cycles[c]; }
+        string node = text[pc];
+        if (node.length() > 48) { node = node.substr(0, 45) + "..."; }
+        snprintf(buf, sizeof(buf), "[%2u] %10llu %11llu %5.1f%% %11llu  %s\n", pc, (unsigned long long)count[pc],
+                 (unsigned long long)cycles[pc], all ? 100.0 * cycles[pc] / all : 0.0, (unsigned long long)total, node.c_str());
+        out += buf;
+    }
+    return out;
+}
+#endif
@@ -0,0 +1,146 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_PROTOCOL_H_
+#define _FUNKII_CALC_PROTOCOL_H_
+
+/* INCLUDES! */
+#include "calc_program.h"
+
+/**
+ *  Binary protocol of calc_server (tools/calc_server.cpp)
+ *
+ *  Local only (Unix domain socket), so every number is in the host byte order and
+ *  nothing is aligned: read the fields with memcpy.
+ *  Every message is a CalcMsgHeader followed by header.size bytes of payload.
+ *  Requests can be pipelined: send as many as you want without waiting, every
+ *  response carries the id of its request and they may come back in any order.
+ *
+ *  CALC_MSG_EVAL request:
+ *      uint32 nformulas, uint32 nvars, uint32 nrows
+ *      nformulas x (uint32 length, formula bytes)
+ *      nvars x (uint32 length, lowercase variable name bytes)
+ *      nrows x nvars double                    row major
+ *  CALC_MSG_EVAL response:
+ *      uint32 nformulas, uint32 nrows
+ *      nrows x nformulas double                results, row major (0 on Error)
+ *      nrows x nformulas uint8                 FunkiiCalcErrors_t of every result
+ *  Variables a formula uses that are not in the request are 0 (like Calc does).
+ *  A request whose response would be over CALC_MSG_MAX is answered with CE_MSG_SIZE.
+ *
+ *  CALC_MSG_STATS request: no payload.
+ *  CALC_MSG_STATS response: CalcServerStats.
+ *
+ *  A response with header.status != CE_NADA has no payload (the request was broken).
+ */
+#define CALC_MSG_EVAL       1
+#define CALC_MSG_STATS      2
+#define CALC_MSG_RESPONSE   0x8000      /* type of a response: request type | CALC_MSG_RESPONSE */
+#define CALC_MSG_MAX        (64 << 20)  /* max payload size, bigger messages close the connection */
+
+/**
+ *  CalcMsgHeader
+ *
+ *  16 bytes in front of every message.
+ */
+struct CalcMsgHeader {
+    uint32_t size;                  /* Payload bytes after the header */
+    uint32_t id;                    /* Chosen by the client, echoed in the response */
+    uint16_t type;                  /* CALC_MSG_* */
+    uint16_t status;                /* Response: CE_NADA or the FunkiiCalcErrors_t of the request */
+    uint32_t reserved;              /* 0 */
+};
+/**
+ *  CalcServerStats
+ *
+ *  Payload of the CALC_MSG_STATS response, latencies are from the moment a request is
+ *  queued until its response is ready, latency[i] counts the ones under 2^i microseconds.
+ */
+struct CalcServerStats {
+    uint64_t connections;           /* Open connections */
+    uint64_t requests;              /* Requests answered */
+    uint64_t rows;                  /* Rows evaluated */
+    uint64_t evals;                 /* Formulas evaluated (rows x formulas) */
+    uint64_t errors;                /* Results with an Error */
+    uint64_t cache_hits;            /* Formulas found compiled */
+    uint64_t cache_misses;          /* Formulas compiled */
+    uint64_t cache_size;            /* Compiled formulas cached */
+    uint64_t queue_depth;           /* Requests waiting for a worker right now */
+    uint64_t queue_max;             /* Max queue_depth seen */
+    uint64_t workers;               /* Worker threads */
+    uint64_t latency_total;         /* Sum of the latencies (microseconds) */
+    uint64_t latency_max;           /* Max latency (microseconds) */
+    uint64_t latency[32];           /* Latency histogram */
+};
+/**
+ *  CalcMsgWriter
+ *
+ *  Builds a message, the header size is filled by finish().
+ */
+struct CalcMsgWriter {
+    string buf;                     /* Header + payload */
+
+    CalcMsgWriter(uint16_t type, uint32_t id, uint16_t status) {
+        CalcMsgHeader h;
+        h.size = 0; h.id = id; h.type = type; h.status = status; h.reserved = 0;
+        buf.append((const char *)&h, sizeof(h));
+    }
+    void put32(uint32_t v) { buf.append((const char *)&v, sizeof(v)); }
+    void putd(double v) { buf.append((const char *)&v, sizeof(v)); }
+    void puts(const string &s) { put32((uint32_t)s.length()); buf.append(s); }
+    void put(const void *p, size_t n) { buf.append((const char *)p, n); }
+    const string &finish() {
+        uint32_t size = (uint32_t)(buf.length() - sizeof(CalcMsgHeader));
+        memcpy(&buf[0], &size, sizeof(size));
+        return buf;
+    }
+};
+/**
+ *  CalcMsgReader
+ *
+ *  Reads a payload, every get fails (returns false) past its end.
+ */
+struct CalcMsgReader {
+    const char *p;                  /* Read position */
+    const char *end;                /* End of the payload */
+
+    CalcMsgReader(const char *data, size_t size) : p(data), end(data + size) { }
+    bool get32(uint32_t &v) { if ((size_t)(end - p) < sizeof(v)) { return false; } memcpy(&v, p, sizeof(v)); p += sizeof(v); return true; }
+    bool getd(double &v) { if ((size_t)(end - p) < sizeof(v)) { return false; } memcpy(&v, p, sizeof(v)); p += sizeof(v); return true; }
+    bool gets(string &s) {
+        uint32_t n;
+        if (!get32(n) || (size_t)(end - p) < n) { return false; }
+        s.assign(p, n); p += n;
+        return true;
+    }
+    bool skip(size_t n, const char *&at) { if ((size_t)(end - p) < n) { return false; } at = p; p += n; return true; }
+    size_t left() const { return (size_t)(end - p); }
+};
+#endif
@@ -0,0 +1,302 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_REGISTRY_H_
+#define _FUNKII_CALC_REGISTRY_H_
+
+/* INCLUDES! */
+#include "calc_program.h"
+#include <set>
+
+/**
+ * CalcRegistry Class
+ *
+ *  A set of named formulas that can call each other, i.e: margin(x) inside price(x).
+ *  Every formula is compiled once when it's added (that's also when cycles are caught),
+ *  seal() resolves the calls to direct indexes, after that the formulas can be
+ *  evaluated (from many threads) but no more formulas can be added.
+ *  Unlike the 'a=1,b=2;' vars prefix nothing is inlined as text.
+ *
+ *  Usage Example:
+ *      CalcRegistry reg;
+ *      reg.add("margin(x)", "x * 0.25");
+ *      reg.add("price(x, qty)", "(x + margin(x)) * qty");
+ *      reg.seal();
+ *      long double args[2] = { 100, 3 };
+ *      cout << reg.eval(reg.find("price"), args);
+ *
+ *  Output:
+ *      375
+ */
+class CalcRegistry {
+public:
+    /**
+     *  CalcRegistry Constructor
+     *
+     *  Empty (unsealed) registry.
+     */
+    CalcRegistry();
+    /**
+     *  add
+     *
+     *  Compiles a named formula. It may call formulas that aren't added yet.
+     *
+     * @param   signature       Name and parameters: "price(x, qty)", or just "rate" without parameters
+     *                          (a parameter can't be a function, 'if', 'e' or 'pi': CE_SYNTAX).
+     * @param   body            The formula, it can only use its parameters and other formulas.
+     *
+     * @return  true            Added.
+     * @return  false           Error (check get_error()), i.e: CE_REG_CYCLE or CE_REG_DUP.
+     */
+    bool add(string, string);
+    /**
+     *  seal
+     *
+     *  Resolves every call, no more formulas can be added after this.
+     *
+     * @return  true            Sealed.
+     * @return  false           Error (CE_REG_UNDEF, CE_REG_ARGS), the registry stays unsealed.
+     */
+    bool seal();
+    /**
+     * sealed
+     *
+     * @return  true            seal() was successful.
+     */
+    bool sealed();
+    bool error();
+    string get_error();
+    enum FunkiiCalcErrors_t get_error_code();
+    /**
+     * size
+     *
+     * @return  uint32_t        Number of formulas.
+     */
+    uint32_t size() const;
+    /**
+     * find
+     *
+     * @param   name            Formula name.
+     *
+     * @return  int             Formula number, -1 if there's no such formula.
+     */
+    int find(string) const;
+    /**
+     * params
+     *
+     * @param   f               Formula number.
+     *
+     * @return  vector<string>  Parameter names (the order of the args of eval()).
+     */
+    const vector<string> &params(int) const;
+    /**
+     * code
+     *
+     * @param   f               Formula number.
+     *
+     * @return  CalcCode        Linked program (only after seal()).
+     */
+    CalcCode code(int) const;
+    /**
+     * eval
+     *
+     *  Evaluates a formula, sets the error of the registry.
+     *
+     * @param   f               Formula number.
+     * @param   args            Value of every parameter.
+     *
+     * @return  (long double)   Result, 0 on Error.
+     */
+    long double eval(int, const long double *);
+    /**
+     * eval overload function
+     *
+     *  Does not touch the registry, safe to call from many threads once sealed.
+     *
+     * @param   f               Formula number.
+     * @param   args            Value of every parameter.
+     * @param   err             set to CE_NADA or the Error.
+     *
+     * @return  (long double)   Result, 0 on Error.
+     */
+    long double eval(int, const long double *, enum FunkiiCalcErrors_t &) const;
+private:
+    enum FunkiiCalcErrors_t mError; /* Error of the last operation. */
+    bool mSealed;                   /* seal() was successful. */
+    vector<string> mNames;          /* Formula names. */
+    vector<vector<string> > mParams;/* Parameters of every formula. */
+    vector<CalcProgram> mProgs;     /* Compiled formulas. */
+    vector<CalcCode> mCodes;        /* Linked programs (after seal()). */
+    map<string, int> mIndex;        /* name -> Formula number. */
+
+    /**
+     * reaches
+     *
+     *  Depth first search of the calls of the added formulas.
+     *
+     * @param   from            Name of the formula to start from.
+     * @param   target          Name to look for.
+     * @param   seen            Names already visited.
+     *
+     * @return  true            target is called (directly or not) by from.
+     */
+    bool reaches(const string &, const string &, set<string> &);
+};
+inline CalcRegistry::CalcRegistry() : mError(CE_NADA), mSealed(false) { }
+inline bool CalcRegistry::add(string signature, string body) {
+    C_DBG_START;
+    mError = CE_NADA;
+    if (mSealed) { mError = CE_REG_SEALED; C_DBG_END; return false; }
+    //clean up the signature: lowercase and no spaces
+    string sig;
+    for (size_t i = 0; i < signature.length(); i++) {
+        char c = signature.at(i);
+        if (c == ' ' || c == '\t') { continue; }
+        if (c >= 'A' && c <= 'Z') { c = (char)(c + 32); }
+        sig.push_back(c);
+    }
+    string name;
+    vector<string> params;
+    size_t p = sig.find('(');
+    name = sig.substr(0, p);
+    if (p != string::npos) {
+        if (sig.at(sig.length() - 1) != ')') { mError = CE_SYN_PAR; C_DBG_END; return false; }
+        string list = sig.substr(p + 1, sig.length() - p - 2);
+        size_t b = 0;
+        while (!list.empty() && b <= list.length()) {
+            size_t e = list.find(',', b);
+            if (e == string::npos) { e = list.length(); }
+            params.push_back(list.substr(b, e - b));
+            b = e + 1;
+        }
+    }
+    //names are what the parser reads as a word: [a-z][a-z0-9]*
+    for (size_t i = 0; i <= params.size(); i++) {
+        const string &w = (i == params.size() ? name : params[i]);
+        if (w.empty() || !(w.at(0) >= 'a' && w.at(0) <= 'z') ||
+            w.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789") != string::npos) {
+            mError = CE_SYNTAX; C_DBG_END; return false;
+        }
+        for (size_t j = 0; j < i && i < params.size(); j++) {
+            if (params[j] == w) { mError = CE_SYNTAX; C_DBG_END; return false; }
+        }
+        //the parser reads these before it looks for a parameter or a formula (f(e) would be f(2.718...))
+        if (CalcProgram::func(w) > 0 || CalcProgram::aggregate(w) > 0 || CalcProgram::table_func(w) > 0 || w == "if" || w == "e" || w == "pi") {
+            mError = (i == params.size() ? CE_REG_DUP : CE_SYNTAX); C_DBG_END; return false;
+        }
+    }
+    if (mIndex.count(name) > 0) { mError = CE_REG_DUP; C_DBG_END; return false; }
+    CalcProgram prog;
+    if (!prog.compile(body, params)) { mError = prog.get_error_code(); C_DBG_END; return false; }
+    //would it close a cycle? (the formulas it calls can't reach it)
+    const vector<string> &calls = prog.calls();
+    for (size_t i = 0; i < calls.size(); i++) {
+        set<string> seen;
+        if (calls[i] == name || reaches(calls[i], name, seen)) {
+            C_DBG_MSG("'%s' :: cycle through '%s'",name.c_str(),calls[i].c_str());
+            mError = CE_REG_CYCLE; C_DBG_END; return false;
+        }
+    }
+    mIndex[name] = (int)mNames.size();
+    mNames.push_back(name);
+    mParams.push_back(params);
+    mProgs.push_back(prog);
+    C_DBG_END;
+    return true;
+}
+inline bool CalcRegistry::reaches(const string &from, const string &target, set<string> &seen) {
+    if (!seen.insert(from).second) { return false; }
+    map<string, int>::iterator it = mIndex.find(from);
+    if (it == mIndex.end()) { return false; }
+    const vector<string> &calls = mProgs[it->second].calls();
+    for (size_t i = 0; i < calls.size(); i++) {
+        if (calls[i] == target || reaches(calls[i], target, seen)) { return true; }
+    }
+    return false;
+}
+inline bool CalcRegistry::seal() {
+    C_DBG_START;
+    mError = CE_NADA;
+    if (mSealed) { C_DBG_END; return true; }
+    //resolve and check everything before touching the programs
+    vector<vector<uint32_t> > targets(mProgs.size());
+    for (size_t f = 0; f < mProgs.size(); f++) {
+        const vector<string> &calls = mProgs[f].calls();
+        for (size_t i = 0; i < calls.size(); i++) {
+            map<string, int>::iterator it = mIndex.find(calls[i]);
+            if (it == mIndex.end()) {
+                C_DBG_MSG("'%s' :: undefined '%s'",mNames[f].c_str(),calls[i].c_str());
+                mError = CE_REG_UNDEF; C_DBG_END; return false;
+            }
+            targets[f].push_back((uint32_t)it->second);
+        }
+        CalcCode c = mProgs[f].code();
+        for (uint32_t pc = 0; pc < c.nops; pc++) {
+            if (c.ops[pc].code == CO_CALL && mParams[targets[f][c.ops[pc].arg]].size() != c.ops[pc].argc) {
+                mError = CE_REG_ARGS; C_DBG_END; return false;
+            }
+        }
+    }
+    mCodes.resize(mProgs.size());
+    for (size_t f = 0; f < mProgs.size(); f++) {
+        mProgs[f].link(targets[f]);
+        mCodes[f] = mProgs[f].code();
+    }
+    for (size_t f = 0; f < mCodes.size(); f++) {
+        mCodes[f].calls = &mCodes[0];
+        mCodes[f].ncalls = (uint32_t)mCodes.size();
+    }
+    mSealed = true;
+    C_DBG_END;
+    return true;
+}
+inline bool CalcRegistry::sealed() { return mSealed; }
+inline bool CalcRegistry::error() { return (mError != CE_NADA); }
+inline string CalcRegistry::get_error() { return string(Calc::get_error_c_str(mError)); }
+inline enum FunkiiCalcErrors_t CalcRegistry::get_error_code() { return mError; }
+inline uint32_t CalcRegistry::size() const { return (uint32_t)mNames.size(); }
+inline int CalcRegistry::find(string name) const {
+    for (size_t i = 0; i < name.length(); i++) {
+        if (name.at(i) >= 'A' && name.at(i) <= 'Z') { name.at(i) = (char)(name.at(i) + 32); }
+    }
+    map<string, int>::const_iterator it = mIndex.find(name);
+    return (it == mIndex.end() ? -1 : it->second);
+}
+inline const vector<string> &CalcRegistry::params(int f) const { return mParams[f]; }
+inline CalcCode CalcRegistry::code(int f) const { return mCodes[f]; }
+inline long double CalcRegistry::eval(int f, const long double *args) {
+    return eval(f, args, mError);
+}
+inline long double CalcRegistry::eval(int f, const long double *args, enum FunkiiCalcErrors_t &err) const {
+    if (!mSealed) { err = CE_REG_SEALED; return 0; }
+    if (f < 0 || f >= (int)mCodes.size()) { err = CE_REG_UNDEF; return 0; }
+    return CalcProgram::run(mCodes[f], args, err);
+}
+#endif
@@ -0,0 +1,338 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_RULES_H_
+#define _FUNKII_CALC_RULES_H_
+
+/* INCLUDES! */
+#include "calc_program.h"
+#include <algorithm>
+
+/**
+ * CalcRuleSet Class
+ *
+ *  Evaluates thousands of rules (comparison formulas) against one record at a time.
+ *  Rules that compare an expression against a constant, i.e: 'x * 1.2 > 300' or
+ *  '10 <= x * 1.2', are grouped by that expression: it is computed once per record and
+ *  the thresholds are matched with a binary search over the sorted constants.
+ *  Every other rule (comparison chains, both sides variable...) is evaluated on its own
+ *  and fires if its result is not 0.
+ *
+ *  Usage Example:
+ *      CalcRuleSet rules;
+ *      rules.add("temp > 30"); rules.add("temp > 40"); rules.add("temp*1.8+32 < 50");
+ *      rules.seal();
+ *      long double record[1];
+ *      record[rules.slot("temp")] = 35;
+ *      uint64_t fired[1];
+ *      rules.eval(record, fired);     //fired[0] == 1 (only the first rule)
+ */
+class CalcRuleSet {
+public:
+    /**
+     *  CalcRuleSet Constructor
+     *
+     *  Empty (unsealed) rule set.
+     */
+    CalcRuleSet();
+    /**
+     *  add
+     *
+     *  Compiles a rule.
+     *
+     * @param   rule            string containing the raw formula.
+     *
+     * @return  int             Rule number (its bit in eval()), -1 on Error (check get_error()).
+     */
+    int add(string);
+    /**
+     *  seal
+     *
+     *  Builds the index, no more rules can be added after this.
+     *
+     * @return  true            Sealed.
+     */
+    bool seal();
+    bool error();
+    string get_error();
+    enum FunkiiCalcErrors_t get_error_code();
+    /**
+     * size
+     *
+     * @return  uint32_t        Number of rules.
+     */
+    uint32_t size();
+    /**
+     * groups
+     *
+     * @return  uint32_t        Number of distinct expressions compared against constants.
+     */
+    uint32_t groups();
+    /**
+     * slot
+     *
+     * @param   string          Variable name.
+     *
+     * @return  int             Slot of the variable in the record, -1 if no rule uses it.
+     */
+    int slot(string);
+    /**
+     * symbols
+     *
+     * @return  vector<string>  Variable names, indexed by record slot.
+     */
+    const vector<string> &symbols() const;
+    /**
+     * eval
+     *
+     *  Evaluates every rule against a record (safe from many threads once sealed).
+     *
+     * @param   record          Value of every variable slot.
+     * @param   fired           Bitset of (size() + 63) / 64 words, bit n is set if rule n fired.
+     * @param   errors          Bitset like fired for the rules that failed to evaluate (may be NULL).
+     *
+     * @return  uint32_t        Number of rules that fired.
+     */
+    uint32_t eval(const long double *, uint64_t *, uint64_t *) const;
+    /**
+     * eval overload function
+     *
+     * @param   record          Value of every variable slot.
+     * @param   fired           Bitset of (size() + 63) / 64 words, bit n is set if rule n fired.
+     *
+     * @return  uint32_t        Number of rules that fired.
+     */
+    uint32_t eval(const long double *, uint64_t *) const;
+private:
+    struct Bound {
+        double value;               /* Threshold. */
+        uint32_t rule;              /* Rule number. */
+        bool operator<(const Bound &b) const { return value < b.value; }
+    };
+    struct Prog {
+        vector<CalcOp> ops;         /* Instructions, variables remapped to record slots. */
+        vector<double> consts;      /* Constant Pool. */
+        uint32_t stack;             /* Max depth of the evaluation stack. */
+    };
+    struct Group {
+        Prog lhs;                   /* The shared expression. */
+        vector<Bound> cmp[6];       /* Sorted thresholds, by comparison: expr <, >, =, <>, <=, >= threshold */
+    };
+    enum FunkiiCalcErrors_t mError; /* Error of the last operation. */
+    bool mSealed;                   /* seal() was successful. */
+    uint32_t mRules;                /* Number of rules. */
+    vector<string> mSymbols;        /* Record layout. */
+    vector<Group> mGroups;          /* Rules against constants. */
+    map<string, uint32_t> mGroupIndex;  /* expression key -> group. */
+    vector<Prog> mOthers;           /* Every other rule... */
+    vector<uint32_t> mOtherRules;   /* ...and its rule number. */
+
+    /**
+     * code
+     *
+     * @return  CalcCode        View of a Prog.
+     */
+    CalcCode code(const Prog &) const;
+    /**
+     * fire
+     *
+     *  Sets the bits of a range of sorted thresholds.
+     *
+     * @return  uint32_t        Number of rules in the range.
+     */
+    static uint32_t fire(const vector<Bound> &, size_t, size_t, uint64_t *);
+};
+inline CalcRuleSet::CalcRuleSet() : mError(CE_NADA), mSealed(false), mRules(0) { }
+inline int CalcRuleSet::add(string rule) {
+    C_DBG_START;
+    mError = CE_NADA;
+    if (mSealed) { mError = CE_REG_SEALED; C_DBG_END; return -1; }
+    CalcProgram prog;
+    if (!prog.compile(rule)) { mError = prog.get_error_code(); C_DBG_END; return -1; }
+    CalcCode c = prog.code();
+    //record layout: every variable name gets one slot for the whole set
+    vector<uint32_t> remap;
+    for (size_t i = 0; i < prog.symbols().size(); i++) {
+        int s = slot(prog.symbols()[i]);
+        if (s < 0) { mSymbols.push_back(prog.symbols()[i]); s = (int)mSymbols.size() - 1; }
+        remap.push_back((uint32_t)s);
+    }
+    Prog p;
+    p.ops.assign(c.ops, c.ops + c.nops);
+    p.consts.assign(c.consts, c.consts + c.nconsts);
+    p.stack = c.stack;
+    for (size_t i = 0; i < p.ops.size(); i++) {
+        if (p.ops[i].code == CO_VAR) { p.ops[i].arg = remap[p.ops[i].arg]; }
+    }
+    uint32_t id = mRules++;
+    //is it 'expression <op> constant' or 'constant <op> expression'?
+    uint32_t n = c.nops;
+    int cmp = -1;
+    bool flip = false;
+    if (n >= 3 && c.ops[n - 1].code >= CO_LT && c.ops[n - 1].code <= CO_GE) {
+        if (c.ops[n - 2].code == CO_CONST) { cmp = c.ops[n - 1].code - CO_LT; }
+        else if (c.ops[0].code == CO_CONST) { cmp = c.ops[n - 1].code - CO_LT; flip = true; }
+    }
+    Prog lhs;
+    if (cmp >= 0) {
+        lhs.ops.assign(p.ops.begin() + (flip ? 1 : 0), p.ops.begin() + (flip ? n - 1 : n - 2));
+        lhs.consts = p.consts;
+        lhs.stack = p.stack;
+        //the constant has to be a whole operand ('2*x > y' starts with one too)
+        if (!CalcProgram::verify(code(lhs))) { cmp = -1; }
+    }
+    if (cmp < 0) {
+        mOthers.push_back(p);
+        mOtherRules.push_back(id);
+        C_DBG_MSG("rule %u :: '%s' not indexed",id,rule.c_str());
+        C_DBG_END;
+        return (int)id;
+    }
+    Bound b;
+    b.rule = id;
+    b.value = c.consts[c.ops[flip ? 0 : n - 2].arg];
+    if (flip) {
+        //10 < x is x > 10
+        const int flipped[6] = { 1, 0, 2, 3, 5, 4 };
+        cmp = flipped[cmp];
+    }
+    //group key: the instructions of the expression with the constants by value
+    string key;
+    for (size_t i = 0; i < lhs.ops.size(); i++) {
+        CalcOp op = lhs.ops[i];
+        key.append((const char *)&op.code, 1);
+        key.append((const char *)&op.argc, 1);
+        if (op.code == CO_CONST) { key.append((const char *)&lhs.consts[op.arg], sizeof(double)); }
+        else { key.append((const char *)&op.arg, sizeof(op.arg)); }
+    }
+    map<string, uint32_t>::iterator it = mGroupIndex.find(key);
+    uint32_t g;
+    if (it == mGroupIndex.end()) {
+        g = (uint32_t)mGroups.size();
+        mGroups.push_back(Group());
+        mGroups.back().lhs = lhs;
+        mGroupIndex[key] = g;
+    }
+    else { g = it->second; }
+    mGroups[g].cmp[cmp].push_back(b);
+    C_DBG_MSG("rule %u :: '%s' group %u",id,rule.c_str(),g);
+    C_DBG_END;
+    return (int)id;
+}
+inline bool CalcRuleSet::seal() {
+    mError = CE_NADA;
+    for (size_t g = 0; g < mGroups.size(); g++) {
+        for (int c = 0; c < 6; c++) { stable_sort(mGroups[g].cmp[c].begin(), mGroups[g].cmp[c].end()); }
+    }
+    mGroupIndex.clear();
+    mSealed = true;
+    return true;
+}
+inline bool CalcRuleSet::error() { return (mError != CE_NADA); }
+inline string CalcRuleSet::get_error() { return string(Calc::get_error_c_str(mError)); }
+inline enum FunkiiCalcErrors_t CalcRuleSet::get_error_code() { return mError; }
+inline uint32_t CalcRuleSet::size() { return mRules; }
+inline uint32_t CalcRuleSet::groups() { return (uint32_t)mGroups.size(); }
+inline int CalcRuleSet::slot(string name) {
+    for (int i = 0; i < (int)mSymbols.size(); i++) {
+        if (mSymbols[i] == name) { return i; }
+    }
+    return -1;
+}
+inline const vector<string> &CalcRuleSet::symbols() const { return mSymbols; }
+inline CalcCode CalcRuleSet::code(const Prog &p) const {
+    CalcCode c;
+    c.ops = (p.ops.empty() ? NULL : &p.ops[0]);
+    c.consts = (p.consts.empty() ? NULL : &p.consts[0]);
+    c.calls = NULL;
+    c.tables = NULL;
+    c.nops = (uint32_t)p.ops.size();
+    c.nconsts = (uint32_t)p.consts.size();
+    c.ncalls = 0;
+    c.ntables = 0;
+    c.nvars = (uint32_t)mSymbols.size();
+    c.stack = p.stack;
+    c.math = calc_math_accurate;
+    return c;
+}
+inline uint32_t CalcRuleSet::fire(const vector<Bound> &b, size_t from, size_t to, uint64_t *fired) {
+    for (size_t i = from; i < to; i++) { fired[b[i].rule >> 6] |= ((uint64_t)1 << (b[i].rule & 63)); }
+    return (uint32_t)(to - from);
+}
+inline uint32_t CalcRuleSet::eval(const long double *record, uint64_t *fired) const { return eval(record, fired, NULL); }
+inline uint32_t CalcRuleSet::eval(const long double *record, uint64_t *fired, uint64_t *errors) const {
+    uint32_t words = (mRules + 63) / 64, count = 0;
+    for (uint32_t w = 0; w < words; w++) { fired[w] = 0; if (errors != NULL) { errors[w] = 0; } }
+    if (!mSealed) { return 0; }
+    for (size_t g = 0; g < mGroups.size(); g++) {
+        const Group &grp = mGroups[g];
+        enum FunkiiCalcErrors_t err;
+        long double v = CalcProgram::run(code(grp.lhs), record, err);
+        if (err != CE_NADA) {
+            if (errors != NULL) {
+                for (int c = 0; c < 6; c++) { fire(grp.cmp[c], 0, grp.cmp[c].size(), errors); }
+            }
+            continue;
+        }
+        if (v != v) {
+            //NaN: only <> is true
+            count += fire(grp.cmp[3], 0, grp.cmp[3].size(), fired);
+            continue;
+        }
+        for (int c = 0; c < 6; c++) {
+            const vector<Bound> &b = grp.cmp[c];
+            if (b.empty()) { continue; }
+            //first threshold >= v and first threshold > v
+            size_t lo = 0, hi = b.size();
+            while (lo < hi) { size_t m = (lo + hi) / 2; if (b[m].value < v) { lo = m + 1; } else { hi = m; } }
+            size_t ge = lo;
+            hi = b.size();
+            while (lo < hi) { size_t m = (lo + hi) / 2; if (b[m].value <= v) { lo = m + 1; } else { hi = m; } }
+            size_t gt = lo;
+            switch (c) {
+                case 0: count += fire(b, gt, b.size(), fired); break;      // v <  t
+                case 1: count += fire(b, 0, ge, fired); break;             // v >  t
+                case 2: count += fire(b, ge, gt, fired); break;            // v == t
+                case 3: count += fire(b, 0, ge, fired) + fire(b, gt, b.size(), fired); break;  // v <> t
+                case 4: count += fire(b, ge, b.size(), fired); break;      // v <= t
+                case 5: count += fire(b, 0, gt, fired); break;             // v >= t
+            }
+        }
+    }
+    for (size_t r = 0; r < mOthers.size(); r++) {
+        enum FunkiiCalcErrors_t err;
+        long double v = CalcProgram::run(code(mOthers[r]), record, err);
+        uint32_t id = mOtherRules[r];
+        if (err != CE_NADA) { if (errors != NULL) { errors[id >> 6] |= ((uint64_t)1 << (id & 63)); } }
+        else if (v != 0) { fired[id >> 6] |= ((uint64_t)1 << (id & 63)); count++; }
+    }
+    return count;
+}
+#endif
@@ -0,0 +1,471 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_SHARD_H_
+#define _FUNKII_CALC_SHARD_H_
+
+/* INCLUDES! */
+#include "calc_program.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CALC_SHARD_MAGIC    "FKCALCSH"
+#define CALC_SHARD_VERSION  1
+/* At least this many tasks per process, so a slow (or restarted) one doesn't hold up the end */
+#define CALC_SHARD_SPLIT    8
+/* Times a task may take its worker down before its rows get CE_SHARD_CRASH */
+#define CALC_SHARD_TRIES    3
+
+/**
+ *  Shard result file layout
+ *
+ *  Written in place by the workers through a shared mapping, offsets from the start of
+ *  the file, the sections are 64 byte aligned:
+ *
+ *      CalcShardHeader
+ *      T               results[formulas][rows]     float or double (value_size)
+ *      uint8_t         errors[formulas][rows]      FunkiiCalcErrors_t of every result
+ */
+struct CalcShardHeader {
+    char magic[8];                  /* CALC_SHARD_MAGIC */
+    uint32_t version;               /* CALC_SHARD_VERSION */
+    uint32_t value_size;            /* sizeof(float) or sizeof(double) */
+    uint64_t formulas;              /* Number of formulas */
+    uint64_t rows;                  /* Rows of every formula */
+    uint64_t results, errors;       /* Section offsets */
+    uint64_t size;                  /* Size of the whole file */
+    uint64_t failed;                /* Rows that got CE_SHARD_CRASH */
+};
+/**
+ *  CalcShardStats
+ *
+ *  What the last CalcShard::run() did.
+ */
+struct CalcShardStats {
+    int processes;                  /* Workers running at once */
+    uint64_t tasks;                 /* Formulas times chunks of rows */
+    uint64_t rows_per_task;
+    uint64_t forks;                 /* Workers started, restarts included */
+    uint64_t restarts;              /* Workers started again after one died */
+    uint64_t failed;                /* Tasks given up after CALC_SHARD_TRIES */
+    double seconds;                 /* Wall time of run() */
+};
+/**
+ * CalcShard Class
+ *
+ *  Evaluates compiled formulas over many rows with a pool of worker processes, so a
+ *  formula (or a row) that takes its process down doesn't take the job with it.
+ *  The rows are cut in tasks (a chunk of rows of one formula, a whole number of batch()
+ *  blocks) and the tasks are handed out through a queue in shared memory: a counter
+ *  the workers fetch and add, and the state of every task they claim with a CAS.
+ *  The workers are fork()ed from the caller, so the programs and the input columns are
+ *  shared copy on write and never serialized, and they write the results straight into
+ *  a shared mapping of the output file (or of anonymous memory): nothing goes through
+ *  pipes. The caller only supervises: each worker holds the write end of a pipe, its EOF
+ *  means the worker is gone; if it died, the tasks it held go back in the queue and a
+ *  new worker takes its place. A task that took down CALC_SHARD_TRIES workers is given
+ *  up, its rows get CE_SHARD_CRASH and the run goes on.
+ *  Linux and other POSIX systems with fork(), one host.
+ *
+ *  Usage Example:
+ *      CalcProgram prog("sqrt(x^2 + y^2)");
+ *      CalcCode code = prog.code();
+ *      const double *cols[2] = { xs, ys };
+ *      const double *const *vars[1] = { cols };
+ *      CalcShard shard(8);
+ *      if (!shard.run(&code, 1, vars, rows, "out.fcs")) { cout << shard.get_error(); }
+ *      double *out = shard.results<double>(0);
+ */
+class CalcShard {
+public:
+    /**
+     *  CalcShard Constructor
+     *
+     *  One worker per online CPU.
+     */
+    CalcShard();
+    /**
+     *  CalcShard Constructor
+     *
+     * @param   processes       Number of worker processes.
+     */
+    CalcShard(int);
+    /**
+     * ~CalcShard Destructor
+     *
+     *  Unmaps the results (the file stays).
+     */
+    ~CalcShard();
+    /**
+     * processes
+     *
+     * @return  int             Number of worker processes.
+     */
+    int processes() const;
+    /**
+     * run
+     *
+     *  Evaluates every formula over every row, in the worker processes, and waits for them.
+     *  The results stay mapped until the next run() or close().
+     *
+     * @param   codes           Programs to run.
+     * @param   ncodes          Number of programs.
+     * @param   vars            Columns of every program (indexed by its variable slots).
+     * @param   rows            Number of rows.
+     * @param   path            Output file, created (or truncated) with the CalcShardHeader layout.
+     *
+     * @return  false           The output couldn't be created or no worker could be started
+     *                          (CE_LIB_IO). Rows given up on don't count, see stats().failed.
+     */
+    template <typename T>
+    bool run(const CalcCode *, size_t, const T *const *const *, size_t, const char *);
+    /**
+     * run overload function
+     *
+     *  The same, the results go to anonymous shared memory.
+     */
+    template <typename T>
+    bool run(const CalcCode *, size_t, const T *const *const *, size_t);
+    /**
+     * results
+     *
+     * @param   formula         Index of the program in run().
+     *
+     * @return  T*              Its rows, NULL if there's no such formula or T isn't the type of the run.
+     */
+    template <typename T>
+    T *results(size_t);
+    /**
+     * errors
+     *
+     * @param   formula         Index of the program in run().
+     *
+     * @return  uint8_t*        FunkiiCalcErrors_t of its rows, NULL if there's no such formula.
+     */
+    uint8_t *errors(size_t);
+    /**
+     * header
+     *
+     * @return  const CalcShardHeader*  Of the mapped results, NULL before run().
+     */
+    const CalcShardHeader *header() const;
+    /**
+     * close
+     *
+     *  Unmaps the results.
+     */
+    void close();
+    /**
+     * stats
+     *
+     * @return  CalcShardStats  Of the last run().
+     */
+    CalcShardStats stats() const;
+    /**
+     * error
+     *
+     * @return  true            The last run() failed.
+     */
+    bool error();
+    /**
+     * get_error
+     *
+     * @return  string          Error message.
+     */
+    string get_error();
+    /**
+     * get_error_code
+     *
+     * @return  FunkiiCalcErrors_t  Error code.
+     */
+    enum FunkiiCalcErrors_t get_error_code();
+private:
+    /* Task states, a claimed task holds TASK_RUNNING + the slot of its worker */
+    enum { TASK_TODO = 0, TASK_DONE = 1, TASK_FAILED = 2, TASK_RUNNING = 3 };
+    struct Queue {
+        volatile uint64_t next;     /* First task never handed out */
+        volatile uint32_t state[1]; /* One per task */
+    };
+    int mProcs;
+    enum FunkiiCalcErrors_t mError;
+    CalcShardStats mStats;
+    CalcShardHeader *mHeader;       /* Start of the mapped results */
+    Queue *mQueue;
+    size_t mQueueSize;
+    //the job of run(), the workers inherit it
+    const CalcCode *mCodes;
+    const void *const *const *mVars;
+    uint64_t mChunk, mTasks;
+
+    /**
+     * map
+     *
+     *  Creates and maps the results (and the queue) for a run.
+     */
+    bool map(const char *, uint64_t, uint64_t, uint32_t);
+    /**
+     * supervise
+     *
+     *  Starts the workers, restarts the ones that die and waits for the tasks to be done.
+     *
+     * @param   work            What a worker runs, in the child.
+     */
+    bool supervise(void (*)(CalcShard &, uint32_t));
+    /**
+     * spawn
+     *
+     *  Forks the worker of a slot.
+     *
+     * @return  int             Read end of its pipe, -1 if fork() failed.
+     */
+    int spawn(void (*)(CalcShard &, uint32_t), uint32_t, pid_t &, const vector<int> &);
+    /**
+     * worker
+     *
+     *  Claims tasks and evaluates them until there are none left.
+     */
+    template <typename T>
+    static void worker(CalcShard &, uint32_t);
+    /**
+     * give_up
+     *
+     *  Fills the rows of a task with CE_SHARD_CRASH.
+     */
+    void give_up(uint64_t);
+    bool claim(uint64_t, uint32_t);
+};
+inline CalcShard::CalcShard() : mProcs((int)sysconf(_SC_NPROCESSORS_ONLN)), mError(CE_NADA), mHeader(NULL), mQueue(NULL),
+                                mQueueSize(0), mCodes(NULL), mVars(NULL), mChunk(0), mTasks(0) {
+    if (mProcs < 1) { mProcs = 1; }
+    memset(&mStats, 0, sizeof(mStats));
+}
+inline CalcShard::CalcShard(int processes) : mProcs(processes < 1 ? 1 : processes), mError(CE_NADA), mHeader(NULL),
+                                             mQueue(NULL), mQueueSize(0), mCodes(NULL), mVars(NULL), mChunk(0), mTasks(0) {
+    memset(&mStats, 0, sizeof(mStats));
+}
+inline CalcShard::~CalcShard() { close(); }
+inline int CalcShard::processes() const { return mProcs; }
+inline const CalcShardHeader *CalcShard::header() const { return mHeader; }
+inline CalcShardStats CalcShard::stats() const { return mStats; }
+inline bool CalcShard::error() { return (mError != CE_NADA); }
+inline string CalcShard::get_error() { return string(Calc::get_error_c_str(mError)); }
+inline enum FunkiiCalcErrors_t CalcShard::get_error_code() { return mError; }
+inline void CalcShard::close() {
+    if (mHeader != NULL) { munmap(mHeader, (size_t)mHeader->size); }
+    if (mQueue != NULL) { munmap(mQueue, mQueueSize); }
+    mHeader = NULL; mQueue = NULL; mQueueSize = 0;
+}
+template <typename T>
+T *CalcShard::results(size_t formula) {
+    if (mHeader == NULL || mHeader->value_size != sizeof(T) || formula >= mHeader->formulas) { return NULL; }
+    return (T *)((char *)mHeader + mHeader->results) + formula * mHeader->rows;
+}
+inline uint8_t *CalcShard::errors(size_t formula) {
+    if (mHeader == NULL || formula >= mHeader->formulas) { return NULL; }
+    return (uint8_t *)mHeader + mHeader->errors + formula * mHeader->rows;
+}
+inline bool CalcShard::map(const char *path, uint64_t formulas, uint64_t rows, uint32_t value_size) {
+    uint64_t results = (sizeof(CalcShardHeader) + 63) / 64 * 64;
+    uint64_t errors = (results + formulas * rows * value_size + 63) / 64 * 64;
+    uint64_t size = errors + formulas * rows;
+    void *p;
+    if (path != NULL) {
+        int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) { return false; }
+        if (ftruncate(fd, (off_t)size) != 0) { ::close(fd); return false; }
+        p = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+    } else {
+        p = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    }
+    if (p == MAP_FAILED) { return false; }
+    mHeader = (CalcShardHeader *)p;
+    memset(mHeader, 0, sizeof(CalcShardHeader));
+    memcpy(mHeader->magic, CALC_SHARD_MAGIC, 8);
+    mHeader->version = CALC_SHARD_VERSION;
+    mHeader->value_size = value_size;
+    mHeader->formulas = formulas; mHeader->rows = rows;
+    mHeader->results = results; mHeader->errors = errors; mHeader->size = size;
+    mQueueSize = sizeof(Queue) + (size_t)mTasks * sizeof(uint32_t);
+    p = mmap(NULL, mQueueSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) { mQueueSize = 0; return false; }
+    mQueue = (Queue *)p;        //zero filled: every task TASK_TODO
+    return true;
+}
+template <typename T>
+bool CalcShard::run(const CalcCode *codes, size_t ncodes, const T *const *const *vars, size_t rows) {
+    return run(codes, ncodes, vars, rows, (const char *)NULL);
+}
+template <typename T>
+bool CalcShard::run(const CalcCode *codes, size_t ncodes, const T *const *const *vars, size_t rows, const char *path) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    close();
+    mError = CE_NADA;
+    memset(&mStats, 0, sizeof(mStats));
+    mStats.processes = mProcs;
+    //tasks of whole blocks, CALC_SHARD_SPLIT of them per worker and formula at least
+    const uint64_t B = CALC_BATCH_BLOCK;
+    mChunk = ((uint64_t)rows / ((uint64_t)mProcs * CALC_SHARD_SPLIT) + B - 1) / B * B;
+    if (mChunk < B) { mChunk = B; }
+    mTasks = (ncodes == 0 ? 0 : ((uint64_t)rows + mChunk - 1) / mChunk * ncodes);
+    mCodes = codes; mVars = (const void *const *const *)vars;
+    mStats.tasks = mTasks; mStats.rows_per_task = mChunk;
+    if (!map(path, ncodes, rows, sizeof(T))) { close(); mError = CE_LIB_IO; return false; }
+    bool ok = (mTasks == 0 || supervise(&CalcShard::worker<T>));
+    munmap(mQueue, mQueueSize);
+    mQueue = NULL; mQueueSize = 0;
+    if (!ok) { mError = CE_LIB_IO; }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    mStats.seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return ok;
+}
+inline bool CalcShard::claim(uint64_t task, uint32_t slot) {
+    return __sync_bool_compare_and_swap(&mQueue->state[task], (uint32_t)TASK_TODO, (uint32_t)TASK_RUNNING + slot);
+}
+template <typename T>
+void CalcShard::worker(CalcShard &shard, uint32_t slot) {
+    uint64_t formulas = shard.mHeader->formulas, rows = shard.mHeader->rows;
+    T *results = (T *)((char *)shard.mHeader + shard.mHeader->results);
+    uint8_t *errors = (uint8_t *)shard.mHeader + shard.mHeader->errors;
+    vector<T> stk;
+    vector<const T *> cols;
+    while (true) {
+        uint64_t t = __sync_fetch_and_add(&shard.mQueue->next, 1);
+        if (t >= shard.mTasks) {
+            //the queue's run out, but tasks of a worker that died may be back
+            for (t = 0; t < shard.mTasks; t++) {
+                if (shard.mQueue->state[t] == TASK_TODO && shard.claim(t, slot)) { break; }
+            }
+            if (t == shard.mTasks) { return; }
+        } else if (!shard.claim(t, slot)) {
+            continue;
+        }
+        //the formulas of a chunk one after the other, they read the same rows
+        uint64_t f = t % formulas, from = t / formulas * shard.mChunk;
+        uint64_t n = (rows - from < shard.mChunk ? rows - from : shard.mChunk);
+        const CalcCode &code = shard.mCodes[f];
+        const T *const *vars = (const T *const *)shard.mVars[f];
+        cols.resize(code.nvars + 1);
+        for (uint32_t s = 0; s < code.nvars; s++) { cols[s] = vars[s] + from; }
+        CalcProgram::batch(code, &cols[0], (size_t)n, results + f * rows + from, errors + f * rows + from, stk);
+        __sync_synchronize();
+        shard.mQueue->state[t] = TASK_DONE;
+    }
+}
+inline void CalcShard::give_up(uint64_t t) {
+    uint64_t formulas = mHeader->formulas, rows = mHeader->rows;
+    uint64_t f = t % formulas, from = t / formulas * mChunk;
+    uint64_t n = (rows - from < mChunk ? rows - from : mChunk);
+    memset((char *)mHeader + mHeader->results + (f * rows + from) * mHeader->value_size, 0, (size_t)(n * mHeader->value_size));
+    memset((uint8_t *)mHeader + mHeader->errors + f * rows + from, CE_SHARD_CRASH, (size_t)n);
+    mHeader->failed += n;
+    mQueue->state[t] = TASK_FAILED;
+    mStats.failed++;
+}
+inline int CalcShard::spawn(void (*work)(CalcShard &, uint32_t), uint32_t slot, pid_t &pid, const vector<int> &fds) {
+    int p[2];
+    if (pipe(p) != 0) { return -1; }
+    pid = fork();
+    if (pid < 0) { ::close(p[0]); ::close(p[1]); return -1; }
+    if (pid == 0) {
+        //the write end stays open until the worker is gone, whichever way it goes
+        ::close(p[0]);
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i] >= 0) { ::close(fds[i]); }
+        }
+        work(*this, slot);
+        _exit(0);
+    }
+    ::close(p[1]);
+    mStats.forks++;
+    return p[0];
+}
+inline bool CalcShard::supervise(void (*work)(CalcShard &, uint32_t)) {
+    vector<int> fds(mProcs, -1);
+    vector<pid_t> pids(mProcs, 0);
+    vector<uint8_t> tries((size_t)mTasks, 0);
+    int alive = 0, blameless = 0;
+    for (int s = 0; s < mProcs; s++) {
+        fds[s] = spawn(work, (uint32_t)s, pids[s], fds);
+        if (fds[s] >= 0) { alive++; }
+    }
+    vector<struct pollfd> pfds(mProcs);
+    while (alive > 0) {
+        for (int s = 0; s < mProcs; s++) { pfds[s].fd = fds[s]; pfds[s].events = POLLIN; pfds[s].revents = 0; }
+        if (poll(&pfds[0], (nfds_t)mProcs, -1) < 0) {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+        for (int s = 0; s < mProcs; s++) {
+            if (fds[s] < 0 || pfds[s].revents == 0) { continue; }
+            char c;
+            if (read(fds[s], &c, 1) > 0) { continue; }
+            ::close(fds[s]);
+            fds[s] = -1;
+            alive--;
+            int status = 0;
+            while (waitpid(pids[s], &status, 0) < 0 && errno == EINTR) { }
+            bool died = !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+            //what it held goes back in the queue, or is given up on
+            bool held = false;
+            for (uint64_t t = 0; t < mTasks; t++) {
+                if (mQueue->state[t] != TASK_RUNNING + (uint32_t)s) { continue; }
+                held = true;
+                if (died && ++tries[t] >= CALC_SHARD_TRIES) { give_up(t); }
+                else { mQueue->state[t] = TASK_TODO; }
+            }
+            //dying with no task held is the worker itself, not the rows: don't loop on it forever
+            if (died && !held && ++blameless > CALC_SHARD_TRIES * mProcs) { continue; }
+            bool todo = (mQueue->next < mTasks);
+            for (uint64_t t = 0; t < mTasks && !todo; t++) { todo = (mQueue->state[t] == TASK_TODO); }
+            if (!todo) { continue; }
+            fds[s] = spawn(work, (uint32_t)s, pids[s], fds);
+            if (fds[s] >= 0) {
+                alive++;
+                if (died) { mStats.restarts++; }
+            }
+        }
+    }
+    for (int s = 0; s < mProcs; s++) {
+        if (fds[s] >= 0) { ::close(fds[s]); kill(pids[s], SIGKILL); waitpid(pids[s], NULL, 0); }
+    }
+    for (uint64_t t = 0; t < mTasks; t++) {
+        if (mQueue->state[t] != TASK_DONE && mQueue->state[t] != TASK_FAILED) { return false; }
+    }
+    return true;
+}
+#endif
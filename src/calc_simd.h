@@ -0,0 +1,703 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_SIMD_H_
+#define _FUNKII_CALC_SIMD_H_
+
+/* INCLUDES! */
+#include "calc.h"
+#include <stdint.h>
+
+/**
+ *  FunkiiCalcMathTiers_t
+ *
+ *  Accuracy of the functions in batch evaluation (CalcProgram::math()).
+ */
+enum FunkiiCalcMathTiers_t {
+    calc_math_accurate  =   0,  //<= 1 ulp (libm where the kernels can't promise it)
+    calc_math_fast      =   1   //a few ulp, every function in SIMD
+};
+/* Worst error of the kernels of each tier, in ulp of the result (tools/calc_simd_check fails past them) */
+#define CALC_SIMD_ULP_ACCURATE  0.80
+#define CALC_SIMD_ULP_FAST      4.2
+
+//GCC/Clang vector extensions, anything else evaluates with libm
+#if defined(__GNUC__) && !defined(CALC_NO_SIMD)
+    #define CALC_SIMD
+    #define CALC_SIMD_INLINE    inline __attribute__((always_inline))
+    #if defined(__x86_64__) || defined(__i386__)
+        #define CALC_SIMD_X86
+    #endif
+#endif
+
+/**
+ * CalcSimd Class
+ *
+ *  Vectorized func_array functions for CalcProgram::batch(): sin, cos, tan, asin, acos,
+ *  atan, sinh, cosh, tanh, ln and log over a whole block, in double or float.
+ *  The kernels are written once with vector extensions and built for SSE2 (16 byte
+ *  vectors), AVX2+FMA (32) and AVX-512 (64), the widest the CPU has is picked at runtime.
+ *  sqrt is left to libm, it already is one instruction.
+ *
+ *  calc_math_accurate (CALC_SIMD_ULP_ACCURATE)
+ *      double: sin, cos, ln and log in SIMD (worst error measured against long double
+ *      over 2M random arguments per function and range: 0.70 ulp), the rest with libm
+ *      (their kernels measured 1.5 to 2.5 ulp).
+ *      float: every function in SIMD, computed in double and rounded (0.50 ulp).
+ *  calc_math_fast (CALC_SIMD_ULP_FAST)
+ *      Every function in SIMD with shorter polynomials, float math for float.
+ *      Worst error measured: 3.3 ulp (double tanh), 3.0 ulp (float tan).
+ *  tools/calc_simd_check measures them again, on every instruction set the CPU has.
+ *
+ *  Arguments outside the domain (ln, log of a negative, asin, acos of |x| > 1) are
+ *  NaN and their lane is marked CE_EDOM, without raising FP exceptions, so one bad row
+ *  doesn't make the whole block be evaluated again. sin, cos and tan of huge arguments
+ *  (where a short argument reduction isn't exact) go to libm, one lane at a time.
+ */
+class CalcSimd {
+public:
+    /**
+     * apply
+     *
+     *  Evaluates a function over an array, in place.
+     *
+     * @param   func            Function number (Calc::func_array).
+     * @param   tier            calc_math_accurate or calc_math_fast.
+     * @param   a               Arguments, results on return.
+     * @param   n               Number of values.
+     * @param   lane            Set to CE_EDOM for the values out of the domain (others untouched).
+     *
+     * @return  true            Done.
+     * @return  false           Function without a kernel, a untouched.
+     */
+    static bool apply(int, enum FunkiiCalcMathTiers_t, double *, size_t, uint8_t *);
+    /**
+     * apply overload function
+     *
+     *  Same thing in float.
+     */
+    static bool apply(int, enum FunkiiCalcMathTiers_t, float *, size_t, uint8_t *);
+    /**
+     * apply overload function
+     *
+     *  Same thing with the kernels built for a given instruction set, so every one of them
+     *  can be checked on a single CPU (tools/calc_simd_check).
+     *
+     * @param   level           Instruction set, see level().
+     *
+     * @return  false           Also if the CPU doesn't have that instruction set.
+     */
+    static bool apply(int, enum FunkiiCalcMathTiers_t, double *, size_t, uint8_t *, int);
+    static bool apply(int, enum FunkiiCalcMathTiers_t, float *, size_t, uint8_t *, int);
+    /**
+     * isa
+     *
+     * @return  const char*     Instruction set apply() runs with: "avx512", "avx2", "sse2" (or
+     *                          "simd" off x86) or "libm" without vector extensions.
+     */
+    static const char *isa();
+    /**
+     * isa overload function
+     *
+     * @param   level           Instruction set, see level().
+     */
+    static const char *isa(int);
+    /**
+     * level
+     *
+     * @return  int             Widest instruction set of the CPU, the one apply() runs with:
+     *                          3 AVX-512, 2 AVX2+FMA, 1 SSE2 (or any vector extensions off x86), 0 libm.
+     */
+    static int level();
+private:
+#ifdef CALC_SIMD
+    static bool apply_simd(int, int, double *, size_t, uint8_t *);
+    static bool apply_simd(int, int, float *, size_t, uint8_t *);
+    #ifdef CALC_SIMD_X86
+    __attribute__((target("avx2,fma"))) static bool apply_avx2(int, int, double *, size_t, uint8_t *);
+    __attribute__((target("avx2,fma"))) static bool apply_avx2(int, int, float *, size_t, uint8_t *);
+    __attribute__((target("avx512f"))) static bool apply_avx512(int, int, double *, size_t, uint8_t *);
+    __attribute__((target("avx512f"))) static bool apply_avx512(int, int, float *, size_t, uint8_t *);
+    #endif
+#endif
+};
+
+#ifdef CALC_SIMD
+/**
+ *  CalcSimdLanes
+ *
+ *  The kernels, for L lanes of T. Vectors only go by reference so nothing depends
+ *  on the vector ABI of the instruction set the caller was built with.
+ */
+template <typename T, int L>
+struct CalcSimdLanes {
+    typedef T V __attribute__((vector_size(L * sizeof(T))));
+    typedef decltype(V() < V()) I;  //lane masks and bits (int64_t or int32_t lanes)
+    static const bool DBL = (sizeof(T) == 8);
+    static const int MANT = (DBL ? 52 : 23), BIAS = (DBL ? 1023 : 127), EXPS = (DBL ? 2047 : 255);
+
+    /* 1/k! */
+    static CALC_SIMD_INLINE T fact(int k) {
+        static const double f[] = { 1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040, 1.0/40320,
+                                    1.0/362880, 1.0/3628800, 1.0/39916800, 1.0/479001600, 1.0/6227020800.0,
+                                    1.0/87178291200.0, 1.0/1307674368000.0, 1.0/20922789888000.0,
+                                    1.0/355687428096000.0, 1.0/6402373705728000.0, 1.0/121645100408832000.0 };
+        return (T)f[k];
+    }
+    static CALC_SIMD_INLINE void set(V &v, T s) { for (int j = 0; j < L; j++) { v[j] = s; } }
+    /* Square root (sqrtpd/sqrtps: the lanes are never negative here) */
+    static CALC_SIMD_INLINE void sqrt(const V &x, V &out) {
+        for (int j = 0; j < L; j++) { out[j] = (DBL ? __builtin_sqrt(x[j]) : __builtin_sqrtf(x[j])); }
+    }
+    static CALC_SIMD_INLINE void set(I &v, int64_t s) { for (int j = 0; j < L; j++) { v[j] = s; } }
+    /* Lanes of m: a, others: b */
+    static CALC_SIMD_INLINE void pick(const I &m, const V &a, const V &b, V &out) { out = (V)((m & (I)a) | (~m & (I)b)); }
+    static CALC_SIMD_INLINE void pick(const I &m, T a, const V &b, V &out) { V va; set(va, a); pick(m, va, b, out); }
+    static CALC_SIMD_INLINE void fabs(const V &x, V &out) { I s; set(s, (int64_t)1 << (sizeof(T) * 8 - 1)); out = (V)((I)x & ~s); }
+    /* |a| with the sign of b */
+    static CALC_SIMD_INLINE void sign(const V &a, const V &b, V &out) {
+        I s; set(s, (int64_t)1 << (sizeof(T) * 8 - 1));
+        out = (V)(((I)a & ~s) | ((I)b & s));
+    }
+    /* Nearest integer (k, |x| < 2^(MANT-1)) and its bits as an integer (ki) */
+    static CALC_SIMD_INLINE void rint(const V &x, V &k, I &ki) {
+        V m; set(m, (T)(DBL ? 6755399441055744.0 : 12582912.0));    //1.5 * 2^MANT
+        V t = x + m;
+        k = t - m;
+        ki = (I)t - (I)m;
+    }
+    /* Small integers (|i| < 2^(MANT-1)) to T, without the (scalar on AVX2) int64 conversion */
+    static CALC_SIMD_INLINE void to_real(const I &i, V &out) {
+        V m; set(m, (T)(DBL ? 6755399441055744.0 : 12582912.0));
+        out = (V)(i + (I)m) - m;
+    }
+    /* x * 2^k (x * 2^(k/2) * 2^(k - k/2), so it can overflow or underflow in one rounding) */
+    static CALC_SIMD_INLINE void scale(const V &x, const I &k, V &out) {
+        I k1 = k >> 1, k2 = k - k1;
+        out = x * (V)((k1 + BIAS) << MANT) * (V)((k2 + BIAS) << MANT);
+    }
+    /* x = k ln2 + r + dr, |r| <= ln2/2, dr the rounding error of r */
+    static CALC_SIMD_INLINE void reduce_ln2(const V &x, V &r, V &dr, I &ki) {
+        V k, c; set(c, (T)1.44269504088896338700);
+        rint(x * c, k, ki);
+        set(c, (T)(DBL ? 6.93147180369123816490e-01 : 6.9314575195e-01));
+        V hi = x - k * c;
+        set(c, (T)(DBL ? 1.90821492927058770002e-10 : 1.4286067653e-06));
+        V lo = k * c;
+        r = hi - lo;
+        dr = (hi - r) - lo;
+    }
+    /* e^r - 1 = r + r^2 (1/2! + r/3! + ... + r^(deg-2)/deg!) */
+    static CALC_SIMD_INLINE void taylor_m1(const V &r, int deg, V &out) {
+        V q; set(q, fact(deg));
+        for (int k = deg - 1; k >= 2; k--) { q = q * r + fact(k); }
+        out = r + r * r * q;
+    }
+    /* e^x 2^e2 (e2 small, in the same rounding as e^x) */
+    static CALC_SIMD_INLINE void exp(const V &x, bool acc, int e2, V &out) {
+        V xc, c, r, dr, q; I ki, ke;
+        set(c, (T)(DBL ? 1100 : 110)); pick(x > c, c, x, xc);
+        set(c, (T)(DBL ? -1100 : -110)); pick(xc < c, c, xc, xc);
+        reduce_ln2(xc, r, dr, ki);
+        taylor_m1(r, (DBL ? (acc ? 13 : 12) : 7), q);
+        set(c, (T)1);
+        set(ke, e2);
+        scale(c + (q + dr), ki + ke, out);
+    }
+    static CALC_SIMD_INLINE void exp(const V &x, bool acc, V &out) { exp(x, acc, 0, out); }
+    /* e^x - 1, |x| <= 64: straight from the series up to 0.7, else 2^k (e^r - 1) + 2^k - 1 */
+    static CALC_SIMD_INLINE void expm1(const V &x, bool acc, V &out) {
+        V r, dr, q, s, one, ax, near; I ki;
+        reduce_ln2(x, r, dr, ki);
+        taylor_m1(r, (DBL ? (acc ? 13 : 12) : 7), q);
+        q = q + dr;
+        set(one, (T)1);
+        scale(one, ki, s);
+        out = s * q + (s - one);
+        taylor_m1(x, (DBL ? 16 : 9), near);
+        fabs(x, ax);
+        set(one, (T)0.7);
+        pick(ax < one, near, out, out);
+    }
+    /* ln(x) = k ln2 + f - hfsq + s (hfsq + R), x = 2^k (1 + f), s = f / (2 + f) (fdlibm) */
+    static CALC_SIMD_INLINE void log_parts(const V &x, bool acc, V &k, V &f, V &hfsq, V &t) {
+        V c; I ib, mask;
+        set(c, (T)(DBL ? 2.2250738585072014e-308 : 1.17549435e-38));
+        I tiny = x < c;
+        set(c, (T)(DBL ? 18014398509481984.0 : 33554432.0));   //2^54 and 2^25
+        V xs; pick(tiny, x * c, x, xs);
+        I b = (I)xs;
+        set(mask, EXPS); ib = (b >> MANT) & mask;
+        set(mask, ((int64_t)1 << MANT) - 1);
+        I bias; set(bias, (int64_t)BIAS << MANT);
+        V m = (V)((b & mask) | bias);
+        set(c, (T)1.41421356237309504880);
+        I big = m > c;
+        set(c, (T)0.5); pick(big, m * c, m, m);
+        I adj; set(adj, (DBL ? 54 : 25));
+        ib = ib - BIAS - big - (tiny & adj);
+        to_real(ib, k);
+        set(c, (T)1);
+        f = m - c;
+        set(c, (T)0.5);
+        hfsq = c * f * f;
+        set(c, (T)2);
+        V s = f / (c + f), z = s * s, R;
+        static const double lg[] = { 2.0/3, 2.0/5, 2.0/7, 2.0/9, 2.0/11, 2.0/13, 2.0/15, 2.0/17, 2.0/19, 2.0/21 };
+        int deg = (DBL ? (acc ? 9 : 8) : 3);
+        set(R, (T)lg[deg]);
+        for (int j = deg - 1; j >= 0; j--) { R = R * z + (T)lg[j]; }
+        R = R * z;
+        t = s * (hfsq + R);
+    }
+    /* ln(0) = -inf, ln(inf) = inf, ln(NaN) = NaN */
+    static CALC_SIMD_INLINE void log_special(const V &x, V &out) {
+        V inf; set(inf, (T)HUGE_VAL);
+        V zero = x - x;
+        pick(x == inf, inf, out, out);
+        pick(x == zero, -inf, out, out);
+        pick(x != x, x, out, out);
+    }
+    static CALC_SIMD_INLINE void ln(const V &x, bool acc, V &out) {
+        V k, f, hfsq, t, c;
+        log_parts(x, acc, k, f, hfsq, t);
+        set(c, (T)(DBL ? 1.90821492927058770002e-10 : 9.0580006145e-06));
+        V lo = k * c;
+        set(c, (T)(DBL ? 6.93147180369123816490e-01 : 6.9313812256e-01));
+        if (!DBL || !acc) { out = k * c - ((hfsq - (t + lo)) - f); }
+        else {
+            //f - hfsq and k ln2 + (f - hfsq) with their rounding errors, and the one of hfsq (f split in halves)
+            V hi = k * c, sp, fh, fl, hl, s1, e1, s2, e2;
+            set(c, (T)134217729.0); sp = f * c;
+            fh = sp - (sp - f); fl = f - fh;
+            set(c, (T)0.5);
+            hl = ((c * fh * fh - hfsq) + fh * fl) + c * fl * fl;
+            s1 = f - hfsq; e1 = (f - s1) - hfsq;
+            s2 = hi + s1; e2 = (hi - s2) + s1;
+            out = s2 + (e2 + ((e1 - hl) + (t + lo)));
+        }
+        log_special(x, out);
+    }
+    static CALC_SIMD_INLINE void log10(const V &x, bool acc, V &out) {
+        V k, f, hfsq, t, c;
+        log_parts(x, acc, k, f, hfsq, t);
+        if (!DBL || !acc) {
+            set(c, (T)0.69314718055994530942);
+            out = k * c + (f - hfsq + t);
+            set(c, (T)0.43429448190325182765);
+            out = out * c;
+        }
+        else {
+            //the high part exact in the products (fdlibm's e_log10.c)
+            I m; set(m, ~(int64_t)0xffffffff);
+            V hi = (V)((I)(f - hfsq) & m);
+            V lo = (f - hi) - hfsq + t;
+            V ivhi, ivlo, l2hi, l2lo;
+            set(ivhi, (T)4.34294481878168880939e-01); set(ivlo, (T)2.50829467116452752298e-11);
+            set(l2hi, (T)3.01029995663611771306e-01); set(l2lo, (T)3.69423907715893078616e-13);
+            V vhi = hi * ivhi, y = k * l2hi;
+            V vlo = k * l2lo + (lo + hi) * ivlo + lo * ivhi;
+            V w = y + vhi;
+            vlo = vlo + ((y - w) + vhi);
+            out = vlo + w;
+        }
+        log_special(x, out);
+    }
+    /* sin (q = 0) or cos (q = 1) of x = n pi/2 + r + y, |r| <= pi/4 (fdlibm's __kernel_sin and __kernel_cos) */
+    static CALC_SIMD_INLINE void sincos(const V &x, int q, bool acc, V &out) {
+        V n, c, r, y; I ni;
+        set(c, (T)0.63661977236758134308);
+        rint(x * c, n, ni);
+        if (DBL) {
+            //pi/2 in 33 bit pieces (fdlibm's pio2_1, pio2_2 and their tails): exact products for |n| < 2^20
+            V t, w;
+            set(c, (T)1.57079632673412561417e+00); t = x - n * c;
+            set(c, (T)6.07710050630396597660e-11); w = n * c;
+            r = t - w;
+            set(c, (T)2.02226624879595063154e-21); w = n * c - ((t - r) - w);
+            y = r - w;
+            y = (r - y) - w;
+            r = r - w;
+        }
+        else {
+            //pi/2 in 12 bit pieces: exact products for |n| < 2^12
+            set(c, (T)1.5703125); r = x - n * c;
+            set(c, (T)4.837512969970703e-4); r = r - n * c;
+            set(c, (T)7.549533620476723e-08); r = r - n * c;
+            set(c, (T)2.5633440682570896e-12); r = r - n * c;
+            y = r - r;
+        }
+        V z = r * r, zl = z - z, s, k, one, h;
+        int ds = (DBL ? (acc ? 8 : 7) : 4), dc = (DBL ? (acc ? 8 : 7) : 4);
+        set(one, (T)1); set(h, (T)0.5);
+        if (DBL && acc) {
+            //the rounding error of r^2 (r split in halves), r^3/6 and r^2/2 are too big to lose it
+            V sp, rh, rl;
+            set(c, (T)134217729.0); sp = r * c;
+            rh = sp - (sp - r); rl = r - rh;
+            zl = ((rh * rh - z) + (rh + rh) * rl) + rl * rl;
+        }
+        //sin r = r + r^3 S(r^2), plus y cos r
+        set(s, fact(2 * ds + 1) * ((ds & 1) ? -1 : 1));
+        for (int j = ds - 1; j >= 2; j--) { s = s * z + fact(2 * j + 1) * ((j & 1) ? -1 : 1); }
+        V v = z * r, s1; set(s1, -fact(3));
+        s = r - (((z * (h * y - v * s) - y) - zl * r * s1) - v * s1);
+        //cos r = 1 - r^2/2 + r^4 C(r^2) (1 - r^2/2 with its rounding error added back), minus y sin r
+        set(k, fact(2 * dc + 2) * ((dc & 1) ? 1 : -1));
+        for (int j = dc - 1; j >= 1; j--) { k = k * z + fact(2 * j + 2) * ((j & 1) ? 1 : -1); }
+        V hz = h * z, w = one - hz;
+        k = w + ((((one - w) - hz) - h * zl) + (z * z * k - r * y));
+        //quadrants
+        I bit; set(bit, 1);
+        ni = ni + q;
+        pick((ni & bit) != 0, k, s, out);
+        I sgn = ((ni >> 1) & bit) << (sizeof(T) * 8 - 1);
+        out = (V)((I)out ^ sgn);
+    }
+    static CALC_SIMD_INLINE void tan(const V &x, bool acc, V &out) {
+        V s, k;
+        sincos(x, 0, acc, s);
+        sincos(x, 1, acc, k);
+        out = s / k;
+    }
+    /* atan(x) = atan(c) + atan((t - c) / (1 + t c)), c = 0, 1/4, 1/2, 3/4 or 1 just below t = |x| (or 1/|x|) */
+    static CALC_SIMD_INLINE void atan(const V &x, bool acc, V &out) {
+        V ax, one, t, c, k, r; I ki;
+        fabs(x, ax);
+        set(one, (T)1);
+        I inv = ax > one;
+        V den; pick(inv, ax, one, den);
+        V num; pick(inv, one, ax, num);
+        t = num / den;
+        //floor(4t): no cancellation between atan(c) and the rest
+        set(c, (T)4); rint(t * c - (T)0.5, k, ki);
+        set(c, (T)0.25); c = k * c;
+        V u = (t - c) / (one + t * c), z = u * u, p, hi, lo;
+        int deg = (DBL ? (acc ? 13 : 12) : 6);
+        set(p, (T)(((deg & 1) ? -1.0 : 1.0) / (2 * deg + 1)));
+        for (int j = deg - 1; j >= 1; j--) { p = p * z + (T)(((j & 1) ? -1.0 : 1.0) / (2 * j + 1)); }
+        p = u + u * z * p;
+        //atan(c) in two parts
+        set(hi, (T)0); set(lo, (T)0);
+        pick(ki == 1, (T)0.24497866312686414, hi, hi); pick(ki == 1, (T)1.0698755618734451e-17, lo, lo);
+        pick(ki == 2, (T)0.4636476090008061, hi, hi);  pick(ki == 2, (T)2.2698777452961687e-17, lo, lo);
+        pick(ki == 3, (T)0.6435011087932844, hi, hi);  pick(ki == 3, (T)1.5834785051444286e-17, lo, lo);
+        pick(ki == 4, (T)0.7853981633974483, hi, hi);  pick(ki == 4, (T)3.061616997868383e-17, lo, lo);
+        r = hi + (p + lo);
+        set(hi, (T)1.5707963267948966); set(lo, (T)6.123233995736766e-17);
+        pick(inv, (hi - r) + lo, r, r);
+        pick(x != x, x, r, r);
+        sign(r, x, out);
+    }
+    /* asin(x) = atan(x / sqrt(1 - x^2)) */
+    static CALC_SIMD_INLINE void asin(const V &x, bool acc, V &out) {
+        V one, ax, d; set(one, (T)1);
+        fabs(x, ax);
+        sqrt((one - ax) * (one + ax), d);
+        I edge = (d == (x - x));
+        pick(edge, one, d, d);
+        atan(x / d, acc, out);
+        V h; set(h, (T)1.57079632679489661923);
+        sign(h, x, h);
+        pick(edge, h, out, out);
+    }
+    /* acos(x) = 2 atan(sqrt((1 - x) / (1 + x))) */
+    static CALC_SIMD_INLINE void acos(const V &x, bool acc, V &out) {
+        V one, d; set(one, (T)1);
+        d = one + x;
+        I edge = (d == (x - x));
+        pick(edge, one, d, d);
+        sqrt((one - x) / d, d);
+        atan(d, acc, out);
+        out = out + out;
+        pick(edge, (T)3.14159265358979323846, out, out);
+    }
+    /* sinh, cosh and tanh from e^x and e^x - 1 (fdlibm's e_sinh.c, e_cosh.c and s_tanh.c) */
+    static CALC_SIMD_INLINE void sinh(const V &x, bool acc, V &out) {
+        V ax, h, one, c, xc, t, e, small, mid;
+        fabs(x, ax);
+        set(h, (T)0.5); sign(h, x, h);
+        set(one, (T)1);
+        set(c, (T)(DBL ? 22 : 9)); pick(ax > c, c, ax, xc);
+        expm1(xc, acc, t);
+        small = h * (t + t - t * t / (t + one));
+        mid = h * (t + t / (t + one));
+        //e^|x| / 2 in one go, e^|x| overflows before sinh does
+        exp(ax, acc, -1, e);
+        sign(e, x, e);
+        pick(ax < one, small, mid, out);
+        set(c, (T)(DBL ? 22 : 9)); pick(ax >= c, e, out, out);
+        pick(x != x, x, out, out);
+    }
+    static CALC_SIMD_INLINE void cosh(const V &x, bool acc, V &out) {
+        V ax, one, h, c, xc, t, w, near, mid, far;
+        fabs(x, ax);
+        set(one, (T)1); set(h, (T)0.5);
+        set(c, (T)(DBL ? 22 : 9)); pick(ax > c, c, ax, xc);
+        expm1(xc, acc, t);
+        w = one + t;
+        near = one + (t * t) / (w + w);
+        exp(xc, acc, t);
+        mid = h * t + h / t;
+        exp(ax, acc, -1, far);
+        set(c, (T)0.34657359027997265471); pick(ax < c, near, mid, out);
+        set(c, (T)(DBL ? 22 : 9)); pick(ax >= c, far, out, out);
+        pick(x != x, x, out, out);
+    }
+    static CALC_SIMD_INLINE void tanh(const V &x, bool acc, V &out) {
+        V ax, one, two, c, xc, t, big, small;
+        fabs(x, ax);
+        set(one, (T)1); set(two, (T)2);
+        set(c, (T)(DBL ? 22 : 9)); pick(ax > c, c, ax, xc);
+        expm1(two * xc, acc, t);
+        big = one - two / (t + two);
+        expm1(-two * xc, acc, t);
+        small = -t / (t + two);
+        pick(ax < one, small, big, out);
+        pick(ax >= c, one, out, out);
+        pick(x != x, x, out, out);
+        sign(out, x, out);
+    }
+    /**
+     * eval
+     *
+     *  One function over a vector: slow marks the lanes the kernel can't do (libm).
+     */
+    static CALC_SIMD_INLINE void eval(int func, bool acc, const V &x, V &y, I &slow) {
+        V ax, c; fabs(x, ax);
+        slow = (ax != ax);
+        y = x;
+        switch (func) {
+            case 4:
+            case 5:
+            case 6:
+                //past 2^16 (2^13 in float) the reduction by pi/2 may lose bits
+                set(c, (T)(DBL ? 65536 : 8192));
+                slow = slow | (ax > c);
+                if (func == 6) { tan(x, acc, y); }
+                else { sincos(x, func - 4, acc, y); }
+                break;
+            case 7: asin(x, acc, y); break;
+            case 8: acos(x, acc, y); break;
+            case 9: atan(x, acc, y); break;
+            case 10: sinh(x, acc, y); break;
+            case 11: cosh(x, acc, y); break;
+            case 12: tanh(x, acc, y); break;
+            case 13: ln(x, acc, y); break;
+            case 14: log10(x, acc, y); break;
+        }
+    }
+    /* Lanes out of the domain */
+    static CALC_SIMD_INLINE void domain(int func, const V &x, I &dom) {
+        V z = x - x, zero, ax, one;
+        set(zero, (T)0); set(one, (T)1);
+        fabs(x, ax);
+        switch (func) {
+            case 13:
+            case 14: dom = (x < zero); break;
+            case 7:
+            case 8: dom = (ax > one); break;
+            default: dom = (z != z); break;
+        }
+    }
+    /* One lane with libm, in double so float gets it rounded once */
+    static CALC_SIMD_INLINE T libm(int func, T x) {
+        double d = x;
+        switch (func) {
+            case 4: return (T)std::sin(d);
+            case 5: return (T)std::cos(d);
+            case 6: return (T)std::tan(d);
+            case 7: return (T)std::asin(d);
+            case 8: return (T)std::acos(d);
+            case 9: return (T)std::atan(d);
+            case 10: return (T)std::sinh(d);
+            case 11: return (T)std::cosh(d);
+            case 12: return (T)std::tanh(d);
+            case 13: return (T)std::log(d);
+            case 14: return (T)std::log10(d);
+        }
+        return x;
+    }
+    /* float: calc_math_accurate in double, then rounded (two halves, each as wide as V) */
+    static CALC_SIMD_INLINE void eval_accurate(int func, const V &x, V &y, I &slow, const float *) {
+        typedef CalcSimdLanes<double, L / 2> D;
+        typename D::V lo = {}, hi = {}, ylo, yhi;
+        typename D::I slo, shi;
+        for (int j = 0; j < L / 2; j++) { lo[j] = x[j]; hi[j] = x[j + L / 2]; }
+        D::eval(func, false, lo, ylo, slo);
+        D::eval(func, false, hi, yhi, shi);
+        for (int j = 0; j < L / 2; j++) {
+            y[j] = (T)ylo[j]; y[j + L / 2] = (T)yhi[j];
+            slow[j] = (int32_t)slo[j]; slow[j + L / 2] = (int32_t)shi[j];
+        }
+    }
+    static CALC_SIMD_INLINE void eval_accurate(int func, const V &x, V &y, I &slow, const double *) { eval(func, true, x, y, slow); }
+    /**
+     * run
+     *
+     *  The chunk loop for one function (a constant, so eval() and domain() fold down
+     *  to its kernel).
+     */
+    template <int F>
+    static CALC_SIMD_INLINE void run(int tier, T *a, size_t n, uint8_t *lane) {
+        V safe, nan; I none = {};
+        set(safe, (T)0.5);
+        set(nan, (T)NAN);
+        for (size_t i = 0; i < n; i += L) {
+            size_t m = (n - i < (size_t)L ? n - i : (size_t)L);
+            V x, y, in; I dom, slow, odd;
+            if (m == (size_t)L) { memcpy(&x, a + i, sizeof(V)); }
+            else { x = safe; for (size_t j = 0; j < m; j++) { x[j] = a[i + j]; } }
+            domain(F, x, dom);
+            //0.5 is in the domain of every function: no exceptions for the bad lanes
+            pick(dom, safe, x, in);
+            if (tier == calc_math_fast) { eval(F, false, in, y, slow); }
+            else { eval_accurate(F, in, y, slow, (const T *)NULL); }
+            pick(dom, nan, y, y);
+            odd = dom | slow;
+            if (memcmp(&odd, &none, sizeof(I)) != 0) {
+                for (size_t j = 0; j < m; j++) {
+                    if (odd[j] == 0) { continue; }
+                    if (dom[j] != 0) { lane[i + j] = CE_EDOM; }
+                    else { y[j] = libm(F, x[j]); }
+                }
+            }
+            if (m == (size_t)L) { memcpy(a + i, &y, sizeof(V)); }
+            else { for (size_t j = 0; j < m; j++) { a[i + j] = y[j]; } }
+        }
+    }
+    /**
+     * apply
+     *
+     *  CalcSimd::apply() for this vector size.
+     *
+     * @return  false           No kernel for func.
+     */
+    static CALC_SIMD_INLINE bool apply(int func, int tier, T *a, size_t n, uint8_t *lane) {
+        switch (func) {
+            case 4: run<4>(tier, a, n, lane); break;
+            case 5: run<5>(tier, a, n, lane); break;
+            case 6: run<6>(tier, a, n, lane); break;
+            case 7: run<7>(tier, a, n, lane); break;
+            case 8: run<8>(tier, a, n, lane); break;
+            case 9: run<9>(tier, a, n, lane); break;
+            case 10: run<10>(tier, a, n, lane); break;
+            case 11: run<11>(tier, a, n, lane); break;
+            case 12: run<12>(tier, a, n, lane); break;
+            case 13: run<13>(tier, a, n, lane); break;
+            case 14: run<14>(tier, a, n, lane); break;
+            default: return false;
+        }
+        return true;
+    }
+};
+#endif
+
+inline bool CalcSimd::apply(int func, enum FunkiiCalcMathTiers_t tier, double *a, size_t n, uint8_t *lane) {
+    return apply(func, tier, a, n, lane, level());
+}
+inline bool CalcSimd::apply(int func, enum FunkiiCalcMathTiers_t tier, float *a, size_t n, uint8_t *lane) {
+    return apply(func, tier, a, n, lane, level());
+}
+inline bool CalcSimd::apply(int func, enum FunkiiCalcMathTiers_t tier, double *a, size_t n, uint8_t *lane, int isa) {
+    //calc_math_accurate: only the kernels within CALC_SIMD_ULP_ACCURATE
+    if (tier == calc_math_accurate && func != 4 && func != 5 && func != 13 && func != 14) { return false; }
+    if (isa > level()) { return false; }
+#ifdef CALC_SIMD
+    switch (isa) {
+    #ifdef CALC_SIMD_X86
+        case 3: return apply_avx512(func, tier, a, n, lane);
+        case 2: return apply_avx2(func, tier, a, n, lane);
+    #endif
+        case 1: return apply_simd(func, tier, a, n, lane);
+    }
+#endif
+    return false;
+}
+inline bool CalcSimd::apply(int func, enum FunkiiCalcMathTiers_t tier, float *a, size_t n, uint8_t *lane, int isa) {
+    if (isa > level()) { return false; }
+#ifdef CALC_SIMD
+    switch (isa) {
+    #ifdef CALC_SIMD_X86
+        case 3: return apply_avx512(func, tier, a, n, lane);
+        case 2: return apply_avx2(func, tier, a, n, lane);
+    #endif
+        case 1: return apply_simd(func, tier, a, n, lane);
+    }
+#endif
+    return false;
+}
+inline const char *CalcSimd::isa() { return isa(level()); }
+inline const char *CalcSimd::isa(int level) {
+    switch (level) {
+        case 3: return "avx512";
+        case 2: return "avx2";
+#ifdef CALC_SIMD_X86
+        case 1: return "sse2";
+#else
+        case 1: return "simd";
+#endif
+    }
+    return "libm";
+}
+inline int CalcSimd::level() {
+#ifdef CALC_SIMD_X86
+    static const int l = (__builtin_cpu_supports("avx512f") ? 3 :
+                         ((__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? 2 : 1));
+    return l;
+#elif defined(CALC_SIMD)
+    return 1;
+#else
+    return 0;
+#endif
+}
+#ifdef CALC_SIMD
+inline bool CalcSimd::apply_simd(int func, int tier, double *a, size_t n, uint8_t *lane) {
+    return CalcSimdLanes<double, 2>::apply(func, tier, a, n, lane);
+}
+inline bool CalcSimd::apply_simd(int func, int tier, float *a, size_t n, uint8_t *lane) {
+    return CalcSimdLanes<float, 4>::apply(func, tier, a, n, lane);
+}
+    #ifdef CALC_SIMD_X86
+inline bool CalcSimd::apply_avx2(int func, int tier, double *a, size_t n, uint8_t *lane) {
+    return CalcSimdLanes<double, 4>::apply(func, tier, a, n, lane);
+}
+inline bool CalcSimd::apply_avx2(int func, int tier, float *a, size_t n, uint8_t *lane) {
+    return CalcSimdLanes<float, 8>::apply(func, tier, a, n, lane);
+}
+inline bool CalcSimd::apply_avx512(int func, int tier, double *a, size_t n, uint8_t *lane) {
+    return CalcSimdLanes<double, 8>::apply(func, tier, a, n, lane);
+}
+inline bool CalcSimd::apply_avx512(int func, int tier, float *a, size_t n, uint8_t *lane) {
+    return CalcSimdLanes<float, 16>::apply(func, tier, a, n, lane);
+}
+    #endif
+#endif
+#endif
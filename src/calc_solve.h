@@ -0,0 +1,507 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_SOLVE_H_
+#define _FUNKII_CALC_SOLVE_H_
+
+/* INCLUDES! */
+#include "calc_grad.h"
+#include <float.h>
+
+/* Default tolerance on the variables */
+#define CALC_SOLVE_TOL      1e-12L
+/* Default budget of evaluations of one search */
+#define CALC_SOLVE_EVALS    1000
+
+/**
+ * CalcSolve Class
+ *
+ *  Searches for the values of the variables of a compiled formula (CalcCode, evaluated
+ *  with CalcProgram::run() so nothing is parsed again):
+ *      - solve() with a bracket: the root of formula = target in [lo, hi] (Brent: inverse
+ *        quadratic interpolation, secant and bisection), the target must be bracketed.
+ *      - solve() from a guess: Newton with the derivatives of CalcGrad, halving the steps
+ *        that don't get closer.
+ *      - minimize() of one variable in [lo, hi]: Brent (golden section and parabolas).
+ *      - minimize() of many variables from a guess: Nelder-Mead.
+ *  The other variables keep the values they have in vars, the answer is written there.
+ *  A search stops when the variables are within tolerance() of the answer, or fails with
+ *  CE_SOLVE_BUDGET after budget() evaluations (a CalcGrad::run() counts as one), evals()
+ *  tells how many it used. The minimizers take the points where the formula fails (i.e:
+ *  ln(x) with x <= 0) as higher than any other, solve() stops with the Error.
+ *
+ *  Usage Example:
+ *      CalcSolve s;
+ *      s.solve("price=12, cost=4.5; qty * (price - cost) - 1500", "qty", 0, 0, 10000);   //break even
+ *      cout << s.x() << " after " << s.evals() << " evaluations";
+ *
+ *      CalcProgram prog("(x - 1)^2 + 3 + (y + 2)^2");
+ *      vector<uint32_t> slots(2); slots[0] = prog.slot("x"); slots[1] = prog.slot("y");
+ *      long double vars[2] = { 0, 0 };
+ *      s.minimize(prog.code(), vars, slots);
+ */
+class CalcSolve {
+public:
+    /**
+     *  CalcSolve Constructor
+     *
+     *  CALC_SOLVE_TOL and CALC_SOLVE_EVALS.
+     */
+    CalcSolve();
+    /**
+     * tolerance
+     *
+     * @param   tol             How close to the answer the variables have to be.
+     */
+    void tolerance(long double);
+    /**
+     * budget
+     *
+     * @param   evals           Max evaluations of the formula per search.
+     */
+    void budget(uint32_t);
+    /**
+     * solve
+     *
+     *  Finds the root of formula = target in a bracket.
+     *
+     * @param   code            Program.
+     * @param   vars            Value of every variable slot, vars[slot] is set to the root.
+     * @param   slot            Variable to solve for.
+     * @param   target          Value the formula has to hit.
+     * @param   lo, hi          Bracket, formula - target must have a different sign at each end.
+     *
+     * @return  true            Found.
+     * @return  false           Error (check get_error()), i.e: CE_SOLVE_NOROOT.
+     */
+    bool solve(const CalcCode &, long double *, uint32_t, long double, long double, long double);
+    /**
+     * solve overload function
+     *
+     *  Newton from vars[slot].
+     *
+     * @param   code            Program.
+     * @param   vars            Value of every variable slot, vars[slot] is the guess and set to the root.
+     * @param   slot            Variable to solve for.
+     * @param   target          Value the formula has to hit.
+     *
+     * @return  true            Found.
+     * @return  false           Error (check get_error()).
+     */
+    bool solve(const CalcCode &, long double *, uint32_t, long double);
+    /**
+     * solve overload function
+     *
+     *  Compiles a formula and finds the root of one of its variables in a bracket, the
+     *  other variables are 0 (or set with the 'a=1,b=2;' prefix). The root is x().
+     *
+     * @param   formula         string containing the raw formula.
+     * @param   var             Variable to solve for.
+     * @param   target          Value the formula has to hit.
+     * @param   lo, hi          Bracket.
+     *
+     * @return  true            Found.
+     * @return  false           Error (check get_error()), i.e: the formula doesn't compile.
+     */
+    bool solve(string, string, long double, long double, long double);
+    /**
+     * minimize
+     *
+     *  Finds the minimum of the formula over one variable in [lo, hi].
+     *
+     * @param   code            Program.
+     * @param   vars            Value of every variable slot, vars[slot] is set to the minimum.
+     * @param   slot            Variable.
+     * @param   lo, hi          Interval.
+     *
+     * @return  true            Found.
+     * @return  false           Error (check get_error()).
+     */
+    bool minimize(const CalcCode &, long double *, uint32_t, long double, long double);
+    /**
+     * minimize overload function
+     *
+     *  Compiles a formula and finds its minimum over one variable, see solve(). The minimum
+     *  is at x(), value() is the formula there.
+     */
+    bool minimize(string, string, long double, long double);
+    /**
+     * minimize overload function
+     *
+     *  Finds a minimum of the formula over many variables (Nelder-Mead), starting from vars.
+     *
+     * @param   code            Program.
+     * @param   vars            Value of every variable slot, set to the minimum.
+     * @param   slots           Variables to move.
+     * @param   step            Size of the first simplex around vars (per variable).
+     *
+     * @return  true            Found.
+     * @return  false           Error (check get_error()).
+     */
+    bool minimize(const CalcCode &, long double *, const vector<uint32_t> &, long double);
+    /**
+     * minimize overload function
+     *
+     *  The first simplex is 5% of every variable (0.00025 for the ones that are 0).
+     */
+    bool minimize(const CalcCode &, long double *, const vector<uint32_t> &);
+    /**
+     * x
+     *
+     * @return  (long double)   Answer of the last search of one variable.
+     */
+    long double x();
+    /**
+     * value
+     *
+     * @return  (long double)   The formula at the answer of the last search.
+     */
+    long double value();
+    /**
+     * evals
+     *
+     * @return  uint32_t        Evaluations the last search used.
+     */
+    uint32_t evals();
+    /**
+     * error
+     *
+     * @return  true    the last search failed :(
+     * @return  false   there was NO error!!
+     */
+    bool error();
+    /**
+     * get_error
+     *
+     * @return  string  the error message
+     */
+    string get_error();
+    /**
+     * get_error_code
+     *
+     * @return  enum FunkiiCalcErrors_t
+     */
+    enum FunkiiCalcErrors_t get_error_code();
+private:
+    enum FunkiiCalcErrors_t mError; /* Error of the last search. */
+    long double mTol;               /* Tolerance on the variables. */
+    uint32_t mBudget;               /* Max evaluations per search. */
+    uint32_t mEvals;                /* Evaluations of the last search. */
+    long double mX;                 /* Answer of the last search of one variable. */
+    long double mValue;             /* Formula at the answer. */
+
+    /**
+     * start
+     *
+     *  Resets the results for a new search.
+     */
+    void start();
+    /**
+     * probe
+     *
+     *  Evaluates the formula with vars[slot] = x.
+     *
+     * @param   f               Set to the formula.
+     * @param   worst           true: a failed evaluation is +Inf (minimizers), false: it's the Error.
+     *
+     * @return  false           Error or out of budget (mError is set).
+     */
+    bool probe(const CalcCode &, long double *, uint32_t, long double, long double &, bool);
+    /**
+     * finish
+     *
+     *  Sets the answer of a search of one variable.
+     *
+     * @return  true
+     */
+    bool finish(long double *, uint32_t, long double, long double);
+};
+inline CalcSolve::CalcSolve() : mError(CE_NADA), mTol(CALC_SOLVE_TOL), mBudget(CALC_SOLVE_EVALS), mEvals(0), mX(0), mValue(0) { }
+inline void CalcSolve::tolerance(long double tol) { mTol = (tol > 0 ? tol : 0); }
+inline void CalcSolve::budget(uint32_t evals) { mBudget = evals; }
+inline long double CalcSolve::x() { return mX; }
+inline long double CalcSolve::value() { return mValue; }
+inline uint32_t CalcSolve::evals() { return mEvals; }
+inline bool CalcSolve::error() { return (mError != CE_NADA); }
+inline string CalcSolve::get_error() { return string(Calc::get_error_c_str(mError)); }
+inline enum FunkiiCalcErrors_t CalcSolve::get_error_code() { return mError; }
+inline void CalcSolve::start() { mError = CE_NADA; mEvals = 0; mX = 0; mValue = 0; }
+inline bool CalcSolve::probe(const CalcCode &code, long double *vars, uint32_t slot, long double x, long double &f, bool worst) {
+    if (mEvals >= mBudget) { mError = CE_SOLVE_BUDGET; return false; }
+    mEvals++;
+    vars[slot] = x;
+    enum FunkiiCalcErrors_t err;
+    f = CalcProgram::run(code, vars, err);
+    if (err == CE_NADA && f != f) { err = CE_EDOM; }
+    if (err != CE_NADA) {
+        if (!worst) { mError = err; return false; }
+        f = HUGE_VALL;
+    }
+    return true;
+}
+inline bool CalcSolve::finish(long double *vars, uint32_t slot, long double x, long double f) {
+    vars[slot] = x;
+    mX = x;
+    mValue = f;
+    return true;
+}
+inline bool CalcSolve::solve(const CalcCode &code, long double *vars, uint32_t slot, long double target, long double lo, long double hi) {
+    start();
+    if (slot >= code.nvars) { mError = CE_REG_UNDEF; return false; }
+    long double a = lo, b = hi, fa, fb;
+    if (!probe(code, vars, slot, a, fa, false) || !probe(code, vars, slot, b, fb, false)) { return false; }
+    fa -= target; fb -= target;
+    if (fa == 0) { return finish(vars, slot, a, fa + target); }
+    if ((fa > 0) == (fb > 0) && fb != 0) { mError = CE_SOLVE_NOROOT; return false; }
+    //b is the best guess, the root is between b and c, a is the previous b
+    long double c = a, fc = fa, d = b - a, e = d;
+    while (true) {
+        if ((fb > 0) == (fc > 0)) { c = a; fc = fa; d = e = b - a; }
+        if (fabsl(fc) < fabsl(fb)) { a = b; b = c; c = a; fa = fb; fb = fc; fc = fa; }
+        long double tol = 2 * LDBL_EPSILON * fabsl(b) + mTol / 2, m = (c - b) / 2;
+        if (fabsl(m) <= tol || fb == 0) { break; }
+        if (fabsl(e) < tol || fabsl(fa) <= fabsl(fb)) { d = e = m; }
+        else {
+            //secant (a == c) or inverse quadratic interpolation, if it lands well inside the bracket
+            long double s = fb / fa, p, q;
+            if (a == c) { p = 2 * m * s; q = 1 - s; }
+            else {
+                long double r = fb / fc;
+                q = fa / fc;
+                p = s * (2 * m * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+            if (p > 0) { q = -q; }
+            else { p = -p; }
+            if (2 * p < 3 * m * q - fabsl(tol * q) && p < fabsl(e * q / 2)) { e = d; d = p / q; }
+            else { d = e = m; }
+        }
+        a = b; fa = fb;
+        b += (fabsl(d) > tol ? d : (m > 0 ? tol : -tol));
+        if (!probe(code, vars, slot, b, fb, false)) { return false; }
+        fb -= target;
+    }
+    return finish(vars, slot, b, fb + target);
+}
+inline bool CalcSolve::solve(const CalcCode &code, long double *vars, uint32_t slot, long double target) {
+    start();
+    if (slot >= code.nvars) { mError = CE_REG_UNDEF; return false; }
+    vector<long double> grad(code.nvars);
+    long double x = vars[slot], r = 0, g = 0;
+    bool first = true;
+    while (true) {
+        if (mEvals >= mBudget) { mError = CE_SOLVE_BUDGET; return false; }
+        mEvals++;
+        vars[slot] = x;
+        enum FunkiiCalcErrors_t err;
+        long double f = CalcGrad::run(code, vars, &grad[0], err);
+        if (err != CE_NADA) { mError = err; return false; }
+        if (!first && fabsl(f - target) > fabsl(r)) {
+            //overshot: half the step back (the derivative of x is the one before it)
+            long double dx = (x - mX) / 2;
+            if (fabsl(dx) <= mTol + LDBL_EPSILON * fabsl(x)) { mError = CE_SOLVE_NOROOT; return false; }
+            x = mX + dx;
+            continue;
+        }
+        first = false;
+        r = f - target; g = grad[slot];
+        mX = x;
+        if (r == 0) { return finish(vars, slot, x, f); }
+        if (g == 0) { mError = CE_SOLVE_NOROOT; return false; }
+        long double dx = r / g;
+        x -= dx;
+        if (fabsl(dx) <= mTol + LDBL_EPSILON * fabsl(x)) {
+            //the last step is within tolerance, check where it landed
+            if (!probe(code, vars, slot, x, f, false)) { return false; }
+            if (fabsl(f - target) > fabsl(r)) { return finish(vars, slot, mX, r + target); }
+            return finish(vars, slot, x, f);
+        }
+    }
+}
+inline bool CalcSolve::solve(string formula, string var, long double target, long double lo, long double hi) {
+    CalcProgram prog(formula);
+    if (prog.error()) { start(); mError = prog.get_error_code(); return false; }
+    int slot = prog.slot(var);
+    if (slot < 0) { start(); mError = CE_REG_UNDEF; return false; }
+    vector<long double> vars(prog.symbols().size(), 0);
+    return solve(prog.code(), &vars[0], (uint32_t)slot, target, lo, hi);
+}
+inline bool CalcSolve::minimize(const CalcCode &code, long double *vars, uint32_t slot, long double lo, long double hi) {
+    start();
+    if (slot >= code.nvars) { mError = CE_REG_UNDEF; return false; }
+    const long double C = 0.381966011250105151795L;   //(3 - sqrt(5)) / 2
+    long double a = (lo < hi ? lo : hi), b = (lo < hi ? hi : lo);
+    //x the lowest so far, w the second lowest, v the one before w, u the last one
+    long double x = a + C * (b - a), w = x, v = x, fx, fw, fv, d = 0, e = 0;
+    if (!probe(code, vars, slot, x, fx, true)) { return false; }
+    fw = fv = fx;
+    while (true) {
+        long double m = (a + b) / 2, tol1 = LDBL_EPSILON * fabsl(x) + mTol / 3, tol2 = 2 * tol1;
+        if (fabsl(x - m) <= tol2 - (b - a) / 2) { break; }
+        bool golden = true;
+        if (fabsl(e) > tol1) {
+            //parabola through x, w and v
+            long double r = (x - w) * (fx - fv), q = (x - v) * (fx - fw), p = (x - v) * q - (x - w) * r;
+            q = 2 * (q - r);
+            if (q > 0) { p = -p; }
+            else { q = -q; }
+            long double etemp = e;
+            e = d;
+            if (fabsl(p) < fabsl(q * etemp / 2) && p > q * (a - x) && p < q * (b - x)) {
+                d = p / q;
+                long double u = x + d;
+                if (u - a < tol2 || b - u < tol2) { d = (m > x ? tol1 : -tol1); }
+                golden = false;
+            }
+        }
+        if (golden) { e = (x >= m ? a - x : b - x); d = C * e; }
+        long double u = (fabsl(d) >= tol1 ? x + d : x + (d > 0 ? tol1 : -tol1)), fu;
+        if (!probe(code, vars, slot, u, fu, true)) { return false; }
+        if (fu <= fx) {
+            if (u >= x) { a = x; }
+            else { b = x; }
+            v = w; fv = fw; w = x; fw = fx; x = u; fx = fu;
+        }
+        else {
+            if (u < x) { a = u; }
+            else { b = u; }
+            if (fu <= fw || w == x) { v = w; fv = fw; w = u; fw = fu; }
+            else if (fu <= fv || v == x || v == w) { v = u; fv = fu; }
+        }
+    }
+    if (fx == HUGE_VALL) {
+        //the formula failed everywhere it was tried
+        long double f;
+        if (probe(code, vars, slot, x, f, false)) { mError = CE_EDOM; }
+        return false;
+    }
+    return finish(vars, slot, x, fx);
+}
+inline bool CalcSolve::minimize(string formula, string var, long double lo, long double hi) {
+    CalcProgram prog(formula);
+    if (prog.error()) { start(); mError = prog.get_error_code(); return false; }
+    int slot = prog.slot(var);
+    if (slot < 0) { start(); mError = CE_REG_UNDEF; return false; }
+    vector<long double> vars(prog.symbols().size(), 0);
+    return minimize(prog.code(), &vars[0], (uint32_t)slot, lo, hi);
+}
+inline bool CalcSolve::minimize(const CalcCode &code, long double *vars, const vector<uint32_t> &slots) {
+    return minimize(code, vars, slots, -1);
+}
+inline bool CalcSolve::minimize(const CalcCode &code, long double *vars, const vector<uint32_t> &slots, long double step) {
+    start();
+    size_t n = slots.size();
+    for (size_t j = 0; j < n; j++) { if (slots[j] >= code.nvars) { mError = CE_REG_UNDEF; return false; } }
+    if (n == 0) { mError = CE_REG_ARGS; return false; }
+    //n + 1 vertices of n coordinates each, f of every vertex
+    vector<long double> p((n + 1) * n), f(n + 1), mid(n), xr(n), xe(n);
+    for (size_t i = 0; i <= n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            long double x0 = vars[slots[j]], s = (step > 0 ? step : (x0 != 0 ? x0 * 0.05L : 0.00025L));
+            p[i * n + j] = x0 + (i == j + 1 ? s : 0);
+        }
+    }
+    //f() of a point: the other slots keep their values
+    vector<long double> at(vars, vars + code.nvars);
+    for (size_t i = 0; i <= n; i++) {
+        for (size_t j = 0; j < n; j++) { at[slots[j]] = p[i * n + j]; }
+        if (!probe(code, &at[0], slots[0], at[slots[0]], f[i], true)) { return false; }
+    }
+    while (true) {
+        //best (lo), worst (hi) and second worst (nh)
+        size_t lo = 0, hi = 0, nh = 0;
+        for (size_t i = 1; i <= n; i++) {
+            if (f[i] < f[lo]) { lo = i; }
+            if (f[i] > f[hi]) { hi = i; }
+        }
+        nh = lo;
+        for (size_t i = 0; i <= n; i++) { if (i != hi && f[i] > f[nh]) { nh = i; } }
+        long double size = 0;
+        for (size_t i = 0; i <= n; i++) {
+            for (size_t j = 0; j < n; j++) {
+                long double dj = fabsl(p[i * n + j] - p[lo * n + j]);
+                if (dj > size) { size = dj; }
+            }
+        }
+        if (size <= mTol) {
+            if (f[lo] == HUGE_VALL) { mError = CE_EDOM; return false; }
+            for (size_t j = 0; j < n; j++) { vars[slots[j]] = p[lo * n + j]; }
+            mValue = f[lo];
+            mX = p[lo * n];
+            return true;
+        }
+        for (size_t j = 0; j < n; j++) {
+            mid[j] = 0;
+            for (size_t i = 0; i <= n; i++) { if (i != hi) { mid[j] += p[i * n + j]; } }
+            mid[j] /= n;
+        }
+        //reflect the worst vertex through the others
+        long double fr, fe;
+        for (size_t j = 0; j < n; j++) { xr[j] = 2 * mid[j] - p[hi * n + j]; at[slots[j]] = xr[j]; }
+        if (!probe(code, &at[0], slots[0], at[slots[0]], fr, true)) { return false; }
+        if (fr < f[lo]) {
+            //better than the best: try going twice as far
+            for (size_t j = 0; j < n; j++) { xe[j] = 3 * mid[j] - 2 * p[hi * n + j]; at[slots[j]] = xe[j]; }
+            if (!probe(code, &at[0], slots[0], at[slots[0]], fe, true)) { return false; }
+            bool ext = (fe < fr);
+            for (size_t j = 0; j < n; j++) { p[hi * n + j] = (ext ? xe[j] : xr[j]); }
+            f[hi] = (ext ? fe : fr);
+            continue;
+        }
+        if (fr < f[nh]) {
+            for (size_t j = 0; j < n; j++) { p[hi * n + j] = xr[j]; }
+            f[hi] = fr;
+            continue;
+        }
+        //contract towards the better of the worst and its reflection
+        bool out = (fr < f[hi]);
+        long double fc;
+        for (size_t j = 0; j < n; j++) {
+            xe[j] = mid[j] + (out ? xr[j] - mid[j] : p[hi * n + j] - mid[j]) / 2;
+            at[slots[j]] = xe[j];
+        }
+        if (!probe(code, &at[0], slots[0], at[slots[0]], fc, true)) { return false; }
+        if (fc < (out ? fr : f[hi])) {
+            for (size_t j = 0; j < n; j++) { p[hi * n + j] = xe[j]; }
+            f[hi] = fc;
+            continue;
+        }
+        //shrink everything towards the best
+        for (size_t i = 0; i <= n; i++) {
+            if (i == lo) { continue; }
+            for (size_t j = 0; j < n; j++) {
+                p[i * n + j] = p[lo * n + j] + (p[i * n + j] - p[lo * n + j]) / 2;
+                at[slots[j]] = p[i * n + j];
+            }
+            if (!probe(code, &at[0], slots[0], at[slots[0]], f[i], true)) { return false; }
+        }
+    }
+}
+#endif
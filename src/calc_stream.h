@@ -0,0 +1,473 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_STREAM_H_
+#define _FUNKII_CALC_STREAM_H_
+
+/* INCLUDES! */
+#include "calc_program.h"
+
+/* Longest window (rows) */
+#define CALC_STREAM_WINDOW  16777216
+/* Rows the block push() evaluates at once */
+#define CALC_STREAM_BLOCK   4096
+
+/**
+ * CalcStream Class
+ *
+ *  Evaluates a formula over a stream of rows (i.e: sensor readings, one per tick), with
+ *  window functions that remember the rows before:
+ *      prev(x, k)      x of k rows ago (prev(x) is prev(x, 1))
+ *      delta(x)        x - prev(x)
+ *      movsum(x, n)    sum of x over the last n rows
+ *      movavg(x, n)    average of x over the last n rows
+ *      movmin(x, n)    smallest x of the last n rows
+ *      movmax(x, n)    largest x of the last n rows
+ *      ewma(x, a)      exponentially weighted average, a (0 to 1] is the weight of the new x
+ *  x is any formula (other window functions too), k, n and a are constant. Until there
+ *  are enough rows the windows use the ones they have (prev() the first row), and a
+ *  window only takes the rows where x could be evaluated.
+ *  Every window function becomes a variable of a plain CalcProgram and x a program of
+ *  its own, the state lives here: ring buffers (prev, movsum and movavg, whose running sum
+ *  is added up again every n rows so the rounding doesn't pile up) and monotonic deques
+ *  (movmin and movmax), every row costs O(1) amortized whatever the window.
+ *  The block push() evaluates every x and the formula CalcProgram::batch() style, only
+ *  the window updates go row by row. A stream is state, one per thread.
+ *
+ *  Usage Example:
+ *      CalcStream s("movavg(temp, 60) - movavg(temp, 600) > 2 && delta(pressure) < 0");
+ *      long double row[2];
+ *      row[s.slot("temp")] = 21.5; row[s.slot("pressure")] = 1013;
+ *      long double alarm = s.push(row);
+ */
+class CalcStream {
+public:
+    /**
+     *  CalcStream Constructor
+     *
+     *  Empty stream (every row is 0)
+     */
+    CalcStream();
+    /**
+     *  CalcStream Constructor
+     *
+     *  Will call CalcStream::compile with the input string
+     *
+     * @param   string     string containing the raw formula.
+     */
+    CalcStream(string);
+    /**
+     *  compile
+     *
+     *  Compiles a new formula, the windows start empty.
+     *
+     * @param   formula         string containing the raw formula.
+     *
+     * @return  true            Compiled.
+     * @return  false           Error (check get_error()): CE_REG_ARGS for the wrong number of
+     *                          arguments to a window function, CE_WIN_ARG for a window or a
+     *                          weight that isn't a constant in range.
+     */
+    bool compile(string);
+    /**
+     *  reset
+     *
+     *  Empties every window, the next row is the first one again.
+     */
+    void reset();
+    /**
+     * slot
+     *
+     * @param   name            Variable name (lowercase).
+     *
+     * @return  int             Its column in the rows pushed, -1 if the formula doesn't use it.
+     */
+    int slot(string);
+    /**
+     * symbols
+     *
+     * @return  vector<string>  Name of every column, in order.
+     */
+    const vector<string> &symbols() const;
+    /**
+     * rows
+     *
+     * @return  uint64_t        Rows pushed since the last reset().
+     */
+    uint64_t rows() const;
+    /**
+     * push
+     *
+     *  Adds one row to the stream.
+     *
+     * @param   row             Value of every column.
+     *
+     * @return  (long double)   Result of the row, 0 on Error (check error()).
+     */
+    long double push(const long double *);
+    /**
+     * push overload function
+     *
+     * @param   row             Value of every column.
+     * @param   err             set to CE_NADA or the Error of the row.
+     *
+     * @return  (long double)   Result of the row, 0 on Error.
+     */
+    long double push(const long double *, enum FunkiiCalcErrors_t &);
+    /**
+     * push overload function
+     *
+     *  Adds many rows at once, the same results as pushing them one by one (evaluated
+     *  in double).
+     *
+     * @param   cols            Every column (rows values each).
+     * @param   rows            Number of rows.
+     * @param   out             Result of every row (0 on Error).
+     * @param   errs            FunkiiCalcErrors_t of every row.
+     */
+    void push(const double *const *, size_t, double *, uint8_t *);
+    /**
+     * error
+     *
+     * @return  true            The formula didn't compile or the last push(row) failed.
+     */
+    bool error();
+    /**
+     * get_error
+     *
+     * @return  string          The Error Message.
+     */
+    string get_error();
+    /**
+     * get_error_code
+     *
+     * @return  FunkiiCalcErrors_t  The Error.
+     */
+    enum FunkiiCalcErrors_t get_error_code();
+private:
+    /* One window function of the formula */
+    struct Window {
+        int func;                   /* Number in the names of window() */
+        size_t n;                   /* Rows it keeps */
+        long double alpha;          /* ewma weight */
+        CalcProgram arg;            /* x */
+        vector<int> from;           /* Where each variable of x comes from: column, or -1 - window */
+        vector<long double> ring;   /* Last n values of x, the monotonic deque of movmin/movmax */
+        vector<uint64_t> at;        /* Row of every deque value */
+        size_t head, count;         /* Next ring position and values in it (front and size of the deque) */
+        size_t fresh;               /* Rows since the running sum was added up again */
+        uint64_t seen;              /* Rows taken */
+        long double sum;            /* Running sum, ewma */
+        long double value;          /* Result of the current row */
+        enum FunkiiCalcErrors_t err;    /* Error of the current row */
+    };
+    /**
+     * window
+     *
+     * @param   name            Function name.
+     *
+     * @return  int             1 prev, 2 delta, 3 movsum, 4 movavg, 5 movmin, 6 movmax, 7 ewma, 0 none.
+     */
+    static int window(const string &);
+    /**
+     * take
+     *
+     *  Adds x to a window.
+     *
+     * @return  (long double)   The window function of the row.
+     */
+    static long double take(Window &, long double);
+    /**
+     * link
+     *
+     *  Where the variables of a program come from: window names are the output of their
+     *  window, everything else a column (added to mSymbols the first time).
+     */
+    bool link(const CalcProgram &, const string &, vector<int> &);
+
+    enum FunkiiCalcErrors_t mError; /* Error of the formula or the last push(row). */
+    bool mBroken;                   /* The formula didn't compile. */
+    vector<Window> mWindows;        /* Innermost first, a window only reads the ones before it */
+    CalcProgram mOut;               /* The formula, windows as variables */
+    vector<int> mFrom;              /* Where each variable of mOut comes from */
+    vector<string> mSymbols;        /* Column names */
+    uint64_t mRows;                 /* Rows pushed */
+    vector<long double> mRow;       /* Variables of one program, push(row) */
+    vector<double> mArg, mVals;     /* x of a block, window results of a block (CALC_STREAM_BLOCK each) */
+    vector<uint8_t> mArgErrs, mErrs;
+    vector<const double *> mCols;   /* Columns of one program, push(block) */
+};
+
+inline CalcStream::CalcStream() : mError(CE_NADA), mBroken(false), mRows(0) { }
+inline CalcStream::CalcStream(string formula) : mError(CE_NADA), mBroken(false), mRows(0) { compile(formula); }
+inline bool CalcStream::compile(string formula) {
+    C_DBG_START;
+    mError = CE_NADA; mBroken = false; mWindows.clear(); mFrom.clear(); mSymbols.clear(); mRows = 0;
+    mOut = CalcProgram();
+    //the plain formula with the 'a=1,b=2;' vars expanded and the commas of every call kept
+    Calc calc;
+    if (!calc.syntax(formula, true) || calc.mError != CE_NADA) { mError = (calc.mError != CE_NADA ? calc.mError : CE_SYNTAX); }
+    string f = calc.mFormula;
+    //a prefix for the window variables that no name of the formula has
+    string pre = "win";
+    while (f.find(pre) != string::npos) { pre += "w"; }
+    //from the last parenthesis backwards, so the windows inside x go first
+    size_t p = f.length();
+    while (mError == CE_NADA && p > 0 && (p = f.rfind('(', p - 1)) != string::npos) {
+        size_t w = p;
+        while (w > 0 && f.at(w - 1) >= 'a' && f.at(w - 1) <= 'z') { w--; }
+        int func = window(f.substr(w, p - w));
+        if (func == 0) { continue; }
+        vector<string> args;
+        size_t from = p + 1, i;
+        int depth = 0;
+        for (i = p + 1; i < f.length(); i++) {
+            char c = f.at(i);
+            if (c == '(') { depth++; }
+            else if (c == ')' && depth > 0) { depth--; }
+            else if ((c == ',' || c == ')') && depth == 0) {
+                args.push_back(f.substr(from, i - from));
+                from = i + 1;
+                if (c == ')') { break; }
+            }
+        }
+        if (i >= f.length()) { mError = CE_SYN_PAR; break; }
+        if (args.size() != (func == 2 ? 1u : 2u) && !(func == 1 && args.size() == 1)) { mError = CE_REG_ARGS; break; }
+        Window win;
+        win.func = func; win.n = 1; win.alpha = 1;
+        if (args.size() == 2) {
+            CalcProgram k(args[1]);
+            enum FunkiiCalcErrors_t err = CE_NADA;
+            long double v = (k.symbols().empty() ? k.eval(NULL, err) : -1);
+            if (err != CE_NADA) { mError = err; break; }
+            if (func == 7) {
+                if (!(v > 0 && v <= 1)) { mError = CE_WIN_ARG; break; }
+                win.alpha = v;
+            }
+            else {
+                if (!(v >= 1 && v <= CALC_STREAM_WINDOW) || v != floor(v)) { mError = CE_WIN_ARG; break; }
+                win.n = (size_t)v;
+            }
+        }
+        if (!win.arg.compile(args[0])) { mError = win.arg.get_error_code(); break; }
+        if (!link(win.arg, pre, win.from)) { break; }
+        ostringstream name;
+        name << pre << mWindows.size();
+        mWindows.push_back(win);
+        f.replace(w, i + 1 - w, name.str());
+        p = w;
+    }
+    if (mError == CE_NADA && !mOut.compile(f)) { mError = mOut.get_error_code(); }
+    if (mError == CE_NADA) { link(mOut, pre, mFrom); }
+    if (mError != CE_NADA) { mBroken = true; mWindows.clear(); mFrom.clear(); mSymbols.clear(); mOut = CalcProgram(); }
+    reset();
+    C_DBG_MSG("stream '%s' :: %d windows, %d columns",f.c_str(),(int)mWindows.size(),(int)mSymbols.size());
+    C_DBG_END;
+    return (mError == CE_NADA);
+}
+inline bool CalcStream::link(const CalcProgram &prog, const string &pre, vector<int> &from) {
+    const vector<string> &syms = prog.symbols();
+    from.clear();
+    for (size_t s = 0; s < syms.size(); s++) {
+        if (syms[s].compare(0, pre.length(), pre) == 0 && syms[s].length() > pre.length() &&
+            syms[s].at(pre.length()) >= '0' && syms[s].at(pre.length()) <= '9') {
+            from.push_back(-1 - atoi(syms[s].c_str() + pre.length()));
+            continue;
+        }
+        size_t c = 0;
+        while (c < mSymbols.size() && mSymbols[c] != syms[s]) { c++; }
+        if (c == mSymbols.size()) { mSymbols.push_back(syms[s]); }
+        from.push_back((int)c);
+    }
+    if (mRow.size() < syms.size()) { mRow.resize(syms.size()); }
+    return true;
+}
+inline void CalcStream::reset() {
+    mRows = 0;
+    for (size_t w = 0; w < mWindows.size(); w++) {
+        Window &win = mWindows[w];
+        win.ring.assign(win.func == 7 ? 0 : win.n, 0);
+        win.at.assign(win.func == 5 || win.func == 6 ? win.n : 0, 0);
+        win.head = 0; win.count = 0; win.fresh = 0; win.seen = 0;
+        win.sum = 0; win.value = 0; win.err = CE_NADA;
+    }
+    if (!mBroken) { mError = CE_NADA; }
+}
+inline int CalcStream::slot(string name) {
+    for (int i = 0; i < (int)mSymbols.size(); i++) {
+        if (mSymbols[i] == name) { return i; }
+    }
+    return -1;
+}
+inline const vector<string> &CalcStream::symbols() const { return mSymbols; }
+inline uint64_t CalcStream::rows() const { return mRows; }
+inline bool CalcStream::error() { return (mError != CE_NADA); }
+inline string CalcStream::get_error() { return string(Calc::get_error_c_str(mError)); }
+inline enum FunkiiCalcErrors_t CalcStream::get_error_code() { return mError; }
+inline int CalcStream::window(const string &name) {
+    static const char *names[] = { "prev", "delta", "movsum", "movavg", "movmin", "movmax", "ewma" };
+    for (int i = 0; i < 7; i++) {
+        if (name.compare(names[i]) == 0) { return i + 1; }
+    }
+    return 0;
+}
+inline long double CalcStream::take(Window &w, long double x) {
+    long double res = x;
+    switch (w.func) {
+        case 1:
+        case 2:
+            //the oldest value is x of n rows ago once the ring is full, the first row until then
+            res = (w.count == 0 ? x : w.ring[w.count < w.n ? 0 : w.head]);
+            if (w.func == 2) { res = x - res; }
+            w.ring[w.head] = x;
+            w.head = (w.head + 1 == w.n ? 0 : w.head + 1);
+            if (w.count < w.n) { w.count++; }
+            break;
+        case 3:
+        case 4:
+            if (w.count == w.n) { w.sum -= w.ring[w.head]; }
+            else { w.count++; }
+            w.ring[w.head] = x;
+            w.head = (w.head + 1 == w.n ? 0 : w.head + 1);
+            w.sum += x;
+            if (++w.fresh >= w.n) {
+                w.fresh = 0; w.sum = 0;
+                for (size_t i = 0; i < w.count; i++) { w.sum += w.ring[i]; }
+            }
+            res = (w.func == 4 ? w.sum / (long double)w.count : w.sum);
+            break;
+        case 5:
+        case 6: {
+                //the deque keeps the rows that may still be the min (max): later and smaller (larger)
+                if (w.count > 0 && w.at[w.head] + w.n <= w.seen) {
+                    w.head = (w.head + 1 == w.n ? 0 : w.head + 1);
+                    w.count--;
+                }
+                while (w.count > 0) {
+                    size_t b = (w.head + w.count - 1) % w.n;
+                    if (w.func == 5 ? w.ring[b] < x : w.ring[b] > x) { break; }
+                    w.count--;
+                }
+                size_t b = (w.head + w.count) % w.n;
+                w.ring[b] = x; w.at[b] = w.seen;
+                w.count++;
+                res = w.ring[w.head];
+            } break;
+        case 7:
+            w.sum = (w.seen == 0 ? x : w.sum + w.alpha * (x - w.sum));
+            res = w.sum;
+            break;
+    }
+    w.seen++;
+    return res;
+}
+inline long double CalcStream::push(const long double *row) {
+    enum FunkiiCalcErrors_t err;
+    return push(row, err);
+}
+inline long double CalcStream::push(const long double *row, enum FunkiiCalcErrors_t &err) {
+    if (mBroken) { err = mError; return 0; }
+    mRows++;
+    err = CE_NADA;
+    for (size_t w = 0; w < mWindows.size(); w++) {
+        Window &win = mWindows[w];
+        win.err = CE_NADA;
+        for (size_t s = 0; s < win.from.size(); s++) {
+            int f = win.from[s];
+            if (f >= 0) { mRow[s] = row[f]; continue; }
+            const Window &dep = mWindows[-1 - f];
+            if (dep.err != CE_NADA && win.err == CE_NADA) { win.err = dep.err; }
+            mRow[s] = dep.value;
+        }
+        long double x = (win.err == CE_NADA ? win.arg.eval(mRow.empty() ? NULL : &mRow[0], win.err) : 0);
+        win.value = (win.err == CE_NADA ? take(win, x) : 0);
+    }
+    for (size_t s = 0; s < mFrom.size(); s++) {
+        int f = mFrom[s];
+        if (f >= 0) { mRow[s] = row[f]; continue; }
+        const Window &dep = mWindows[-1 - f];
+        if (dep.err != CE_NADA && err == CE_NADA) { err = dep.err; }
+        mRow[s] = dep.value;
+    }
+    long double res = 0;
+    if (err == CE_NADA) { res = mOut.eval(mRow.empty() ? NULL : &mRow[0], err); }
+    mError = err;
+    return (err == CE_NADA ? res : 0);
+}
+inline void CalcStream::push(const double *const *cols, size_t rows, double *out, uint8_t *errs) {
+    if (mBroken) {
+        for (size_t i = 0; i < rows; i++) { out[i] = 0; errs[i] = (uint8_t)mError; }
+        return;
+    }
+    const size_t B = CALC_STREAM_BLOCK;
+    if (mVals.size() < mWindows.size() * B) { mVals.resize(mWindows.size() * B); mErrs.resize(mWindows.size() * B); }
+    if (mArg.size() < B) { mArg.resize(B); mArgErrs.resize(B); }
+    for (size_t from = 0; from < rows; from += B) {
+        size_t n = (rows - from < B ? rows - from : B);
+        for (size_t w = 0; w < mWindows.size(); w++) {
+            Window &win = mWindows[w];
+            mCols.resize(win.from.size());
+            for (size_t s = 0; s < win.from.size(); s++) {
+                int f = win.from[s];
+                mCols[s] = (f >= 0 ? cols[f] + from : &mVals[(size_t)(-1 - f) * B]);
+            }
+            win.arg.eval(mCols.empty() ? NULL : &mCols[0], n, &mArg[0], &mArgErrs[0]);
+            double *val = &mVals[w * B];
+            uint8_t *err = &mErrs[w * B];
+            for (size_t i = 0; i < n; i++) {
+                err[i] = CE_NADA;
+                for (size_t s = 0; s < win.from.size() && err[i] == CE_NADA; s++) {
+                    if (win.from[s] < 0) { err[i] = mErrs[(size_t)(-1 - win.from[s]) * B + i]; }
+                }
+                if (err[i] == CE_NADA) { err[i] = mArgErrs[i]; }
+                val[i] = (err[i] == CE_NADA ? (double)take(win, mArg[i]) : 0);
+            }
+        }
+        mCols.resize(mFrom.size());
+        for (size_t s = 0; s < mFrom.size(); s++) {
+            int f = mFrom[s];
+            mCols[s] = (f >= 0 ? cols[f] + from : &mVals[(size_t)(-1 - f) * B]);
+        }
+        //the rows a window failed on fail with its Error
+        memset(&mArgErrs[0], CE_NADA, n);
+        for (size_t s = 0; s < mFrom.size(); s++) {
+            if (mFrom[s] < 0) {
+                const uint8_t *err = &mErrs[(size_t)(-1 - mFrom[s]) * B];
+                for (size_t i = 0; i < n; i++) { if (mArgErrs[i] == CE_NADA) { mArgErrs[i] = err[i]; } }
+            }
+        }
+        mOut.eval(mCols.empty() ? NULL : &mCols[0], n, out + from, errs + from);
+        for (size_t i = 0; i < n; i++) {
+            if (mArgErrs[i] != CE_NADA) { out[from + i] = 0; errs[from + i] = mArgErrs[i]; }
+        }
+        mRows += n;
+    }
+}
+#endif
@@ -0,0 +1,499 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_TABLE_H_
+#define _FUNKII_CALC_TABLE_H_
+
+/* INCLUDES! */
+#include "calc_errors.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* Rows the batch apply() takes down the keys together */
+#define CALC_TABLE_CHUNK    64
+/* How far (in steps) a key may be from its place for the keys to count as a uniform grid */
+#define CALC_TABLE_GRID     0.001
+
+/* Table functions (Calc::tab_array, 1 based) */
+enum FunkiiCalcTableFuncs_t {
+    calc_tab_lookup     =   1,      //Value of the key x, CE_TABLE_KEY if there's none
+    calc_tab_interp     =   2,      //Between the values of the keys around x, flat past both ends
+    calc_tab_step       =   3       //Value of the last key <= x (the first value below the first key)
+};
+/* How interp() goes from one key to the next */
+enum FunkiiCalcTableKinds_t {
+    calc_table_linear   =   0,      //Straight lines
+    calc_table_cubic    =   1       //Monotone cubic (Hermite, Fritsch-Carlson slopes): smooth, never overshoots the values
+};
+
+/**
+ * CalcTable Class
+ *
+ *  A numeric table for the table functions of the formulas (see Calc::table()):
+ *      lookup(t, x)    value of the key x, CE_TABLE_KEY if t has no key x
+ *      step(t, x)      value of the last key <= x (the first value below the first key)
+ *      interp(t, x)    between the keys around x (see FunkiiCalcTableKinds_t), flat past both ends
+ *  A NaN x gives NaN. The keys are kept sorted and found with a branchless binary search,
+ *  or straight from x when they are a uniform grid (0, 0.5, 1, 1.5...). A table never
+ *  changes once built, so the same one can be used from many Calc, CalcProgram and
+ *  threads at once, they only keep a pointer to it.
+ *
+ *  Usage Example:
+ *      double km[4] = { 0, 10, 50, 200 }, fare[4] = { 3, 2.5, 1.8, 1.2 };
+ *      CalcTable rates(km, fare, 4);
+ *      Calc calculator;
+ *      calculator.table("rates", &rates);
+ *      calculator.assign("d=60;d * step(rates, d)");
+ *
+ *  Output:
+ *      108
+ */
+class CalcTable {
+public:
+    /**
+     *  CalcTable Constructor
+     *
+     *  Empty table (every function of it is CE_TABLE_DATA).
+     */
+    CalcTable();
+    /**
+     *  CalcTable Constructor
+     *
+     *  Will call CalcTable::assign with the input keys and values.
+     *
+     * @param   keys            The keys, in any order.
+     * @param   values          The value of every key.
+     * @param   n               Number of keys.
+     */
+    CalcTable(const double *, const double *, size_t);
+    /**
+     *  CalcTable Constructor
+     *
+     * @param   keys            The keys, in any order.
+     * @param   values          The value of every key.
+     * @param   n               Number of keys.
+     * @param   kind            How interp() goes from one key to the next.
+     */
+    CalcTable(const double *, const double *, size_t, enum FunkiiCalcTableKinds_t);
+    /**
+     *  assign
+     *
+     *  Builds the table (linear interp()), sets the error on failure: the keys and the values
+     *  have to be finite and the keys different (CE_TABLE_DATA).
+     *
+     * @param   keys            The keys, in any order (copied).
+     * @param   values          The value of every key (copied).
+     * @param   n               Number of keys (at least 1).
+     *
+     * @return  true            Built.
+     * @return  false           Error (check get_error_code()), the table is empty.
+     */
+    bool assign(const double *, const double *, size_t);
+    /**
+     *  assign overload function
+     *
+     * @param   kind            How interp() goes from one key to the next.
+     */
+    bool assign(const double *, const double *, size_t, enum FunkiiCalcTableKinds_t);
+    /**
+     *  read
+     *
+     *  Builds the table from text (linear interp()): one 'key value' per line, separated
+     *  by spaces, tabs, ',' or ';'. Empty lines and anything after a '#' are skipped.
+     *
+     *  Example:
+     *      # km    fare
+     *      0,      3
+     *      10,     2.5
+     *
+     * @param   text            The table.
+     *
+     * @return  true            Built.
+     * @return  false           Error (check get_error_code() and error_line()), the table is empty.
+     */
+    bool read(const std::string &);
+    /**
+     *  read overload function
+     *
+     * @param   kind            How interp() goes from one key to the next.
+     */
+    bool read(const std::string &, enum FunkiiCalcTableKinds_t);
+    /**
+     *  load
+     *
+     *  read() of a file, CE_LIB_IO if it can't be read.
+     *
+     * @param   path            File with the table.
+     *
+     * @return  true            Built.
+     * @return  false           Error (check get_error_code() and error_line()), the table is empty.
+     */
+    bool load(const char *);
+    /**
+     *  load overload function
+     *
+     * @param   kind            How interp() goes from one key to the next.
+     */
+    bool load(const char *, enum FunkiiCalcTableKinds_t);
+    /**
+     * error
+     *
+     * @return  true    the table couldn't be built :(
+     * @return  false   there was NO error!!
+     */
+    bool error() const;
+    /**
+     * get_error_code
+     *
+     *  (the message is Calc::get_error_c_str() of it)
+     *
+     * @return  enum FunkiiCalcErrors_t
+     */
+    enum FunkiiCalcErrors_t get_error_code() const;
+    /**
+     * error_line
+     *
+     * @return  int     Line of the text the Error is on, 0 if it isn't about one line.
+     */
+    int error_line() const;
+    /**
+     * size
+     *
+     * @return  size_t  Number of keys.
+     */
+    size_t size() const;
+    /**
+     * uniform
+     *
+     * @return  true    The keys are a uniform grid, found straight from x.
+     */
+    bool uniform() const;
+    /**
+     * kind
+     *
+     * @return  enum FunkiiCalcTableKinds_t     How interp() goes from one key to the next.
+     */
+    enum FunkiiCalcTableKinds_t kind() const;
+    /**
+     * apply
+     *
+     *  Applies a table function.
+     *
+     * @param   fn              FunkiiCalcTableFuncs_t.
+     * @param   x               The key looked for.
+     * @param   err             set to the Error, if any (it isn't touched otherwise).
+     *
+     * @return  T               Result, 0 on Error.
+     */
+    template <typename T>
+    T apply(int, T, enum FunkiiCalcErrors_t &) const;
+    /**
+     * apply overload function
+     *
+     *  Applies a table function to many rows: CALC_TABLE_CHUNK rows at a time go down the
+     *  keys together, one halving of all of them per step (every row takes the same number
+     *  of steps), so the loads of the rows overlap instead of waiting on each other and the
+     *  compiler can vectorize the search. x and out may be the same array.
+     *
+     * @param   fn              FunkiiCalcTableFuncs_t.
+     * @param   x               The keys looked for.
+     * @param   n               Number of rows.
+     * @param   out             Result of every row (0 on Error).
+     * @param   errs            set to the Error of the rows that have one (the others aren't touched).
+     */
+    template <typename T>
+    void apply(int, const T *, size_t, T *, uint8_t *) const;
+    /**
+     * slope
+     *
+     *  Derivative of interp() (0 past both ends, the one after x at a key).
+     *
+     * @param   x               Where.
+     *
+     * @return  T               interp'(x), 0 for an empty table.
+     */
+    template <typename T>
+    T slope(T) const;
+private:
+    struct Row {
+        double key;
+        double value;
+        int line;                   /* Line of the text it came from, 0 if none */
+        bool operator<(const Row &o) const { return (key < o.key); }
+    };
+    enum FunkiiCalcErrors_t mError; /* Build Error. */
+    int mLine;                      /* Line of the text with the Error. */
+    enum FunkiiCalcTableKinds_t mKind;  /* How interp() goes from one key to the next. */
+    std::vector<double> mKeys;      /* Sorted keys. */
+    std::vector<double> mValues;    /* Value of every key. */
+    std::vector<double> mSlopes;    /* Slope of interp() at every key (cubic only). */
+    double mFirst;                  /* First key. */
+    double mInv;                    /* 1 / the step of a uniform grid, 0 if it isn't one. */
+
+    /**
+     * build
+     *
+     *  Sorts and checks the rows and builds the table from them.
+     */
+    bool build(std::vector<Row> &, enum FunkiiCalcTableKinds_t);
+    /**
+     * find
+     *
+     * @return  size_t  Index of the last key <= x, 0 if there's none (or x is NaN).
+     */
+    template <typename T>
+    size_t find(T) const;
+    /**
+     * cell
+     *
+     *  find() on a uniform grid: the place of x on the grid, fixed up by one key.
+     */
+    template <typename T>
+    size_t cell(T) const;
+    /**
+     * value
+     *
+     *  The result of a table function once the key i of x is known.
+     *
+     * @return  T       Result, 0 and err set to CE_TABLE_KEY if lookup() has no key x.
+     */
+    template <typename T>
+    T value(int, size_t, T, enum FunkiiCalcErrors_t &) const;
+};
+inline CalcTable::CalcTable() : mError(CE_NADA), mLine(0), mKind(calc_table_linear), mFirst(0), mInv(0) { }
+inline CalcTable::CalcTable(const double *keys, const double *values, size_t n) : mError(CE_NADA), mLine(0), mKind(calc_table_linear), mFirst(0), mInv(0) {
+    assign(keys, values, n);
+}
+inline CalcTable::CalcTable(const double *keys, const double *values, size_t n, enum FunkiiCalcTableKinds_t kind) : mError(CE_NADA), mLine(0), mKind(calc_table_linear), mFirst(0), mInv(0) {
+    assign(keys, values, n, kind);
+}
+inline bool CalcTable::assign(const double *keys, const double *values, size_t n) { return assign(keys, values, n, calc_table_linear); }
+inline bool CalcTable::assign(const double *keys, const double *values, size_t n, enum FunkiiCalcTableKinds_t kind) {
+    std::vector<Row> rows(n);
+    for (size_t i = 0; i < n; i++) { rows[i].key = keys[i]; rows[i].value = values[i]; rows[i].line = 0; }
+    return build(rows, kind);
+}
+inline bool CalcTable::read(const std::string &text) { return read(text, calc_table_linear); }
+inline bool CalcTable::read(const std::string &text, enum FunkiiCalcTableKinds_t kind) {
+    std::vector<Row> rows;
+    std::stringstream lines(text);
+    std::string line;
+    int n = 0;
+    while (std::getline(lines, line)) {
+        n++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) { line.erase(hash); }
+        for (size_t i = 0; i < line.length(); i++) {
+            char c = line.at(i);
+            if (c == ',' || c == ';' || c == '\t' || c == '\r') { line.at(i) = ' '; }
+        }
+        //0 numbers is an empty line, 2 a row, anything else is broken
+        double f[2];
+        int got = 0;
+        const char *p = line.c_str();
+        while (got >= 0) {
+            while (*p == ' ') { p++; }
+            if (*p == '\0') { break; }
+            char *end;
+            if (got < 2) { f[got] = strtod(p, &end); }
+            if (got == 2 || end == p) { got = -1; break; }
+            got++;
+            p = end;
+        }
+        if (got == 0) { continue; }
+        if (got != 2) {
+            mKeys.clear(); mValues.clear(); mSlopes.clear(); mFirst = 0; mInv = 0;
+            mError = CE_TABLE_DATA; mLine = n;
+            return false;
+        }
+        Row r;
+        r.key = f[0]; r.value = f[1]; r.line = n;
+        rows.push_back(r);
+    }
+    return build(rows, kind);
+}
+inline bool CalcTable::load(const char *path) { return load(path, calc_table_linear); }
+inline bool CalcTable::load(const char *path, enum FunkiiCalcTableKinds_t kind) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        mKeys.clear(); mValues.clear(); mSlopes.clear(); mFirst = 0; mInv = 0;
+        mError = CE_LIB_IO; mLine = 0;
+        return false;
+    }
+    std::string text;
+    char buf[4096];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0) { text.append(buf, got); }
+    fclose(f);
+    return read(text, kind);
+}
+inline bool CalcTable::build(std::vector<Row> &rows, enum FunkiiCalcTableKinds_t kind) {
+    mKeys.clear(); mValues.clear(); mSlopes.clear(); mFirst = 0; mInv = 0;
+    mError = CE_NADA; mLine = 0; mKind = kind;
+    if (rows.empty()) { mError = CE_TABLE_DATA; return false; }
+    std::stable_sort(rows.begin(), rows.end());
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (!std::isfinite(rows[i].key) || !std::isfinite(rows[i].value) || (i > 0 && rows[i].key == rows[i - 1].key)) {
+            mError = CE_TABLE_DATA; mLine = rows[i].line;
+            return false;
+        }
+    }
+    size_t n = rows.size();
+    mKeys.resize(n); mValues.resize(n);
+    for (size_t i = 0; i < n; i++) { mKeys[i] = rows[i].key; mValues[i] = rows[i].value; }
+    mFirst = mKeys[0];
+    //a uniform grid (every key within CALC_TABLE_GRID steps of its place) is found straight from x
+    if (n >= 2) {
+        double h = (mKeys[n - 1] - mKeys[0]) / (double)(n - 1);
+        bool grid = (std::isfinite(h) && h > 0 && std::isfinite(1 / h));
+        for (size_t i = 1; i + 1 < n && grid; i++) { grid = (std::fabs(mKeys[i] - (mKeys[0] + (double)i * h)) <= h * CALC_TABLE_GRID); }
+        if (grid) { mInv = 1 / h; }
+    }
+    if (kind == calc_table_cubic && n >= 2) {
+        //the slopes of PCHIP: 0 at a peak or a valley, else a weighted harmonic mean of the
+        //secants around the key (never more than 3 times either, so the curve stays monotone)
+        std::vector<double> d(n - 1);
+        for (size_t i = 0; i + 1 < n; i++) { d[i] = (mValues[i + 1] - mValues[i]) / (mKeys[i + 1] - mKeys[i]); }
+        mSlopes.assign(n, 0);
+        mSlopes[0] = d[0]; mSlopes[n - 1] = d[n - 2];
+        for (size_t i = 1; i + 1 < n; i++) {
+            if (d[i - 1] * d[i] <= 0) { continue; }
+            double h0 = mKeys[i] - mKeys[i - 1], h1 = mKeys[i + 1] - mKeys[i], w0 = 2 * h1 + h0, w1 = h1 + 2 * h0;
+            mSlopes[i] = (w0 + w1) / (w0 / d[i - 1] + w1 / d[i]);
+        }
+    }
+    return true;
+}
+inline bool CalcTable::error() const { return (mError != CE_NADA); }
+inline enum FunkiiCalcErrors_t CalcTable::get_error_code() const { return mError; }
+inline int CalcTable::error_line() const { return mLine; }
+inline size_t CalcTable::size() const { return mKeys.size(); }
+inline bool CalcTable::uniform() const { return (mInv != 0); }
+inline enum FunkiiCalcTableKinds_t CalcTable::kind() const { return mKind; }
+template <typename T>
+size_t CalcTable::cell(T x) const {
+    const double *k = &mKeys[0];
+    size_t n = mKeys.size();
+    double f = ((double)x - mFirst) * mInv;
+    size_t i = (f > 0 ? (f < (double)(n - 1) ? (size_t)f : n - 1) : 0);
+    //the keys are within a step of their place (and x may have been rounded on the way)
+    i += (size_t)(i + 1 < n && k[i + 1] <= x);
+    i -= (size_t)(i > 0 && k[i] > x);
+    return i;
+}
+template <typename T>
+size_t CalcTable::find(T x) const {
+    if (mInv != 0) { return cell(x); }
+    //the half of the keys x is in, with a conditional move instead of a branch
+    const double *k = &mKeys[0];
+    size_t base = 0, n = mKeys.size();
+    while (n > 1) {
+        size_t half = n / 2;
+        base = (k[base + half] <= x ? base + half : base);
+        n -= half;
+    }
+    return base;
+}
+template <typename T>
+T CalcTable::value(int fn, size_t i, T x, enum FunkiiCalcErrors_t &err) const {
+    const double *k = &mKeys[0], *v = &mValues[0];
+    size_t n = mKeys.size();
+    if (x != x) { return x; }
+    if (fn == calc_tab_step) { return (T)v[i]; }
+    if (fn == calc_tab_lookup) {
+        if (k[i] == x) { return (T)v[i]; }
+        err = CE_TABLE_KEY;
+        return 0;
+    }
+    if (x <= k[0]) { return (T)v[0]; }
+    if (x >= k[n - 1]) { return (T)v[n - 1]; }
+    T h = (T)(k[i + 1] - k[i]), t = (x - (T)k[i]) / h, a = (T)v[i], b = (T)v[i + 1];
+    if (mKind == calc_table_linear) { return a + t * (b - a); }
+    //Hermite: the values and the slopes at both keys
+    T t2 = t * t, t3 = t2 * t;
+    return (2 * t3 - 3 * t2 + 1) * a + (t3 - 2 * t2 + t) * h * (T)mSlopes[i] + (3 * t2 - 2 * t3) * b + (t3 - t2) * h * (T)mSlopes[i + 1];
+}
+template <typename T>
+T CalcTable::apply(int fn, T x, enum FunkiiCalcErrors_t &err) const {
+    if (mKeys.empty() || fn < calc_tab_lookup || fn > calc_tab_step) { err = CE_TABLE_DATA; return 0; }
+    if (x != x) { return x; }
+    return value(fn, find(x), x, err);
+}
+template <typename T>
+void CalcTable::apply(int fn, const T *x, size_t n, T *out, uint8_t *errs) const {
+    if (mKeys.empty() || fn < calc_tab_lookup || fn > calc_tab_step) {
+        for (size_t i = 0; i < n; i++) { out[i] = 0; errs[i] = (uint8_t)CE_TABLE_DATA; }
+        return;
+    }
+    const double *k = &mKeys[0];
+    size_t idx[CALC_TABLE_CHUNK];
+    T y[CALC_TABLE_CHUNK];
+    for (size_t from = 0; from < n; from += CALC_TABLE_CHUNK) {
+        size_t m = std::min(n - from, (size_t)CALC_TABLE_CHUNK);
+        const T *xs = x + from;
+        //NaN rows look for the first key (comparing a NaN would raise FE_INVALID)
+        for (size_t i = 0; i < m; i++) { y[i] = (xs[i] == xs[i] ? xs[i] : (T)mFirst); }
+        if (mInv != 0) {
+            for (size_t i = 0; i < m; i++) { idx[i] = cell(y[i]); }
+        }
+        else {
+            //all the rows halve their range together, one load each per step
+            for (size_t i = 0; i < m; i++) { idx[i] = 0; }
+            for (size_t len = mKeys.size(); len > 1; len -= len / 2) {
+                size_t half = len / 2;
+                for (size_t i = 0; i < m; i++) { idx[i] = (k[idx[i] + half] <= y[i] ? idx[i] + half : idx[i]); }
+            }
+        }
+        for (size_t i = 0; i < m; i++) {
+            enum FunkiiCalcErrors_t err = CE_NADA;
+            T r = value(fn, idx[i], xs[i], err);
+            out[from + i] = r;
+            if (err != CE_NADA) { errs[from + i] = (uint8_t)err; }
+        }
+    }
+}
+template <typename T>
+T CalcTable::slope(T x) const {
+    size_t n = mKeys.size();
+    if (n < 2 || x != x) { return (n < 2 ? 0 : x); }
+    if (x < mKeys[0] || x >= mKeys[n - 1]) { return 0; }
+    size_t i = find(x);
+    T h = (T)(mKeys[i + 1] - mKeys[i]), a = (T)mValues[i], b = (T)mValues[i + 1];
+    if (mKind == calc_table_linear) { return (b - a) / h; }
+    T t = (x - (T)mKeys[i]) / h, t2 = t * t;
+    return (6 * t2 - 6 * t) * (a - b) / h + (3 * t2 - 4 * t + 1) * (T)mSlopes[i] + (3 * t2 - 2 * t) * (T)mSlopes[i + 1];
+}
+#endif
@@ -0,0 +1,763 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+#ifndef _FUNKII_CALC_TRACE_H_
+#define _FUNKII_CALC_TRACE_H_
+
+/* INCLUDES! */
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <time.h>
+
+#define CALC_TRACE_MAGIC    "FKCALCTR"
+#define CALC_TRACE_VERSION  1
+/* Events in the ring of every thread (a power of 2), a full ring drops (and counts) the new ones */
+#define CALC_TRACE_RING     16384
+/* Threads that can trace at once, the rings of the ones that exited get reused */
+#define CALC_TRACE_THREADS  256
+/* Different stage (function) names */
+#define CALC_TRACE_STAGES   1024
+/* Text carried by one event, longer ones go on in calc_ev_more events */
+#define CALC_TRACE_TEXT     32
+/* Longest message or formula kept */
+#define CALC_TRACE_TEXT_MAX 256
+/* Sessions (calcthis() calls) nested in one thread */
+#define CALC_TRACE_NEST     8
+/* How often the rings are written to the file (ms) */
+#define CALC_TRACE_DRAIN_MS 10
+
+/* What gets traced, every level has the events of the ones below */
+enum FunkiiCalcTraceLevels_t {
+    calc_trace_off      =   0,
+    calc_trace_session  =   1,      //Every calcthis() (formula, result and error)
+    calc_trace_stage    =   2,      //Begin and end of every C_DBG_START / C_DBG_END function
+    calc_trace_msg      =   3       //And the C_DBG_MSG messages (formatted, so the slowest)
+};
+enum FunkiiCalcTraceKinds_t {
+    calc_ev_stage       =   1,      //Name of a stage id (text)
+    calc_ev_open        =   2,      //A session starts (text: the formula)
+    calc_ev_close       =   3,      //A session ends (value: the result, error)
+    calc_ev_begin       =   4,      //A stage starts
+    calc_ev_end         =   5,      //A stage ends
+    calc_ev_msg         =   6,      //A message (text)
+    calc_ev_more        =   7,      //More text of the event before it
+    calc_ev_lost        =   8       //Events the thread dropped on a full ring (value)
+};
+
+/**
+ *  Trace file layout
+ *
+ *  A CalcTraceHeader and the events, in the order they were drained: the events of a
+ *  thread are in order, the threads are interleaved in blocks. A stage id is named (by a
+ *  calc_ev_stage event) before the first event that uses it.
+ */
+struct CalcTraceHeader {
+    char magic[8];                  /* CALC_TRACE_MAGIC */
+    uint32_t version;               /* CALC_TRACE_VERSION */
+    uint32_t event_size;            /* sizeof(CalcTraceEvent) */
+    uint64_t start;                 /* Wall clock of start() (ns since the epoch) */
+    uint64_t reserved;
+};
+/**
+ *  CalcTraceEvent
+ *
+ *  One binary event, 64 bytes.
+ */
+struct CalcTraceEvent {
+    uint64_t ns;                    /* Since start() (CLOCK_MONOTONIC) */
+    double value;                   /* Result of a session, count of lost events */
+    uint32_t formula;               /* Id of the formula of the session (CalcTrace::id()), 0 outside one */
+    uint32_t line;                  /* Source line of the event */
+    uint16_t stage;                 /* Stage id */
+    uint16_t thread;                /* Ring the event came from */
+    uint8_t kind;                   /* FunkiiCalcTraceKinds_t */
+    uint8_t depth;                  /* Stages open in the thread */
+    uint16_t error;                 /* FunkiiCalcErrors_t of a session */
+    char text[CALC_TRACE_TEXT];     /* Not terminated when it's full */
+};
+/**
+ *  CalcTraceStats
+ *
+ *  Counters of the trace since start().
+ */
+struct CalcTraceStats {
+    uint64_t events;                /* Written to the file */
+    uint64_t lost;                  /* Dropped on a full ring (or with no ring left) */
+    uint64_t sessions;              /* Sessions traced */
+    uint64_t skipped;               /* Sessions left out by the sampling */
+    uint64_t bytes;                 /* Size of the file */
+    uint32_t threads;               /* Rings in use */
+    uint32_t stages;                /* Stage names */
+};
+
+/**
+ * CalcTrace Class
+ *
+ *  Binary trace of the C_DBG_* macros (build with CALC_DEBUG_TRACE): the events go in a
+ *  lock-free ring of the thread that made them (one writer, one reader, the thread never
+ *  waits and never takes a lock) and a background thread writes the rings to the file
+ *  every CALC_TRACE_DRAIN_MS (or as soon as a ring is half full). A message is formatted only when the level is
+ *  calc_trace_msg, everything else is a few stores and a clock read.
+ *  The level and the sampling may be changed at any time, from any thread. Sampling keeps
+ *  one session (calcthis()) in n of every thread, whole: its stages and messages too.
+ *  Events out of every session (compiling, loading a library...) aren't sampled.
+ *  Everything is static, there's one trace per process. tools/calc_trace reads the file.
+ *
+ *  Started on its own with the environment too (on the first session):
+ *      CALC_TRACE=/tmp/calc.fct CALC_TRACE_LEVEL=2 CALC_TRACE_SAMPLE=100 ./app
+ *
+ *  Usage Example:
+ *      CalcTrace::start("calc.fct");
+ *      CalcTrace::level(calc_trace_stage);
+ *      CalcTrace::sample(10);
+ *      ...
+ *      CalcTrace::stop();
+ */
+class CalcTrace {
+public:
+    /**
+     *  start
+     *
+     *  Creates the file and starts the thread that writes it. stop() is called at exit.
+     *
+     * @param   path            Trace file (replaced).
+     *
+     * @return  true            Tracing.
+     * @return  false           Can't create it, or already tracing.
+     */
+    static bool start(const char *);
+    /**
+     *  stop
+     *
+     *  Writes what's left in the rings, stops the thread and closes the file.
+     */
+    static void stop();
+    /**
+     *  flush
+     *
+     *  Writes the rings to the file now.
+     */
+    static void flush();
+    /**
+     * running
+     *
+     * @return  bool            Between start() and stop().
+     */
+    static bool running();
+    /**
+     *  level
+     *
+     * @param   level           FunkiiCalcTraceLevels_t, calc_trace_off (the default) traces nothing.
+     */
+    static void level(int);
+    /**
+     *  level overload function
+     *
+     * @return  int             The level.
+     */
+    static int level();
+    /**
+     *  sample
+     *
+     * @param   n               Trace one session in n (1, the default, all of them).
+     */
+    static void sample(uint32_t);
+    /**
+     * on
+     *
+     * @param   level           FunkiiCalcTraceLevels_t.
+     *
+     * @return  bool            Events of that level are traced.
+     */
+    static bool on(int);
+    /**
+     * stats
+     *
+     * @return  CalcTraceStats  The counters.
+     */
+    static CalcTraceStats stats();
+    /**
+     * id
+     *
+     * @param   formula         A formula.
+     *
+     * @return  uint32_t        Its id (FNV-1a).
+     */
+    static uint32_t id(const std::string &);
+    /**
+     *  stage
+     *
+     *  Id of a stage name, the same name always gets the same id. Meant to be kept in a
+     *  static of the call site (C_DBG_START does).
+     *
+     * @param   name            Name (i.e: __FUNCTION__), must outlive the trace.
+     *
+     * @return  uint16_t        Its id (0 once CALC_TRACE_STAGES names were taken).
+     */
+    static uint16_t stage(const char *);
+    /**
+     *  open
+     *
+     *  A session starts (C_DBG_INIT), decides whether it's sampled.
+     *
+     * @param   formula         The formula.
+     *
+     * @return  true            A session was opened, close() it.
+     * @return  false           Not tracing (or the level is calc_trace_off).
+     */
+    static bool open(const std::string &);
+    /**
+     *  close
+     *
+     *  The session open() opened ends (C_DBG_FINISH).
+     *
+     * @param   error           FunkiiCalcErrors_t of it.
+     * @param   result          Its result.
+     */
+    static void close(int, long double);
+    /**
+     *  begin
+     *
+     * @param   stage           Stage id.
+     * @param   line            Source line.
+     */
+    static void begin(uint16_t, int);
+    /**
+     *  end
+     *
+     * @param   stage           Stage id.
+     * @param   line            Source line.
+     */
+    static void end(uint16_t, int);
+    /**
+     *  msg
+     *
+     * @param   stage           Stage id.
+     * @param   line            Source line.
+     * @param   fmt             printf() format and its arguments.
+     */
+    static void msg(uint16_t, int, const char *, ...) __attribute__((format(printf, 3, 4)));
+private:
+    enum { RING_FREE = 0, RING_OWNED = 1, RING_DEAD = 2 };
+    /* A thread's events, only that thread writes head and only the drain writes tail */
+    struct Ring {
+        volatile uint64_t head;
+        char pad0[64 - sizeof(uint64_t)];
+        volatile uint64_t tail;
+        uint64_t lost_seen;         /* lost the last drain saw */
+        uint64_t lost_base, sessions_base, skipped_base;    /* The counters at start() */
+        char pad1[64 - 5 * sizeof(uint64_t)];
+        volatile uint64_t lost;
+        volatile uint64_t sessions, skipped;
+        volatile int state;         /* RING_ */
+        uint16_t index;
+        uint8_t depth;
+        uint32_t formula;           /* Session open, 0 none */
+        bool sampled;               /* Events of the open session (or out of every session) are traced */
+        uint32_t count;             /* Sessions opened, for the sampling */
+        int nest;                   /* Sessions open */
+        struct Saved {
+            uint32_t formula;
+            bool sampled;
+            uint8_t depth;
+        } saved[CALC_TRACE_NEST];
+        CalcTraceEvent ev[CALC_TRACE_RING];
+    };
+    /* The level, a template static so on() reads it with no guard (-1 until state() read the environment) */
+    template <int N>
+    struct Level {
+        static volatile int value;
+    };
+    struct State {
+        State();
+
+        volatile uint32_t sample;
+        Ring *volatile rings[CALC_TRACE_THREADS];
+        volatile uint32_t nrings;           /* Rings ever allocated (a high water mark) */
+        volatile uint64_t noring;           /* Events of the threads with no ring */
+        const char *stages[CALC_TRACE_STAGES];
+        volatile uint32_t nstages;          /* stages[0] is unused */
+        uint32_t written;                   /* Stage names in the file */
+        uint64_t events, bytes;             /* Written */
+        uint64_t base;                      /* CLOCK_MONOTONIC of start() */
+        FILE *file;
+        volatile int running;
+        bool stopping;
+        bool exiting;                       /* stop() is registered with atexit() */
+        char autopath[512];                 /* CALC_TRACE, started by the first session */
+        pthread_t drainer;
+        pthread_mutex_t control;            /* start(), stop(), stage() and the drainer's sleep */
+        pthread_cond_t wake;
+        pthread_mutex_t drain;              /* One drain at a time */
+        pthread_key_t key;                  /* Marks the ring of an exiting thread RING_DEAD */
+    };
+    /**
+     * state
+     *
+     * @return  State&          The one trace (built on the first use).
+     */
+    static State &state();
+    /**
+     * ring
+     *
+     * @return  Ring*           The calling thread's ring, NULL if every one is taken.
+     */
+    static Ring *ring();
+    /**
+     * now
+     *
+     * @return  uint64_t        ns since start().
+     */
+    static uint64_t now();
+    /**
+     *  push
+     *
+     *  Writes an event in a ring, with its text in as many events as it takes.
+     *
+     * @param   r               The ring.
+     * @param   ev              The event (ns, thread, formula and depth are filled here).
+     * @param   text            Text (NULL none).
+     * @param   len             Its length.
+     */
+    static void push(Ring *, CalcTraceEvent &, const char *, size_t);
+    /**
+     *  drain_locked
+     *
+     *  Writes every ring to the file, with State::drain held.
+     */
+    static void drain_locked(State &);
+    /**
+     * drainer
+     *
+     *  The background thread.
+     */
+    static void *drainer(void *);
+    /**
+     * release
+     *
+     *  Destructor of State::key, the thread is exiting.
+     */
+    static void release(void *);
+    /**
+     * at_exit
+     *
+     *  stop() for atexit().
+     */
+    static void at_exit();
+};
+
+template <int N>
+volatile int CalcTrace::Level<N>::value = -1;
+
+inline CalcTrace::State::State() : sample(1), nrings(0), noring(0), nstages(1), written(1),
+        events(0), bytes(0), base(0), file(NULL), running(0), stopping(false), exiting(false) {
+    memset((void *)rings, 0, sizeof(rings));
+    memset((void *)stages, 0, sizeof(stages));
+    autopath[0] = '\0';
+    pthread_mutex_init(&control, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_mutex_init(&drain, NULL);
+    pthread_key_create(&key, release);
+    int level = calc_trace_off;
+#ifdef CALC_TRACE_DEFAULT_LEVEL
+    level = CALC_TRACE_DEFAULT_LEVEL;
+#endif
+#ifdef CALC_TRACE_DEFAULT_FILE
+    strncpy(autopath, CALC_TRACE_DEFAULT_FILE, sizeof(autopath) - 1);
+    autopath[sizeof(autopath) - 1] = '\0';
+#endif
+    const char *env = getenv("CALC_TRACE");
+    if (env != NULL && env[0] != '\0') {
+        strncpy(autopath, env, sizeof(autopath) - 1);
+        autopath[sizeof(autopath) - 1] = '\0';
+        if (level == calc_trace_off) { level = calc_trace_stage; }
+    }
+    env = getenv("CALC_TRACE_LEVEL");
+    if (env != NULL && env[0] != '\0') { level = atoi(env); }
+    env = getenv("CALC_TRACE_SAMPLE");
+    if (env != NULL && atoi(env) > 1) { sample = (uint32_t)atoi(env); }
+    __atomic_store_n(&Level<0>::value, (level < 0 ? 0 : level), __ATOMIC_RELAXED);
+}
+inline CalcTrace::State &CalcTrace::state() {
+    static State s;
+    return s;
+}
+inline bool CalcTrace::start(const char *path) {
+    State &s = state();
+    pthread_mutex_lock(&s.control);
+    if (s.running || s.stopping) { pthread_mutex_unlock(&s.control); return false; }
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) { pthread_mutex_unlock(&s.control); return false; }
+    CalcTraceHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CALC_TRACE_MAGIC, sizeof(h.magic));
+    h.version = CALC_TRACE_VERSION;
+    h.event_size = sizeof(CalcTraceEvent);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    h.start = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    s.base = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    if (fwrite(&h, sizeof(h), 1, f) != 1) { fclose(f); pthread_mutex_unlock(&s.control); return false; }
+    //whatever the rings hold from before belongs to no file
+    pthread_mutex_lock(&s.drain);
+    for (uint32_t i = 0; i < s.nrings; i++) {
+        Ring *r = s.rings[i];
+        if (r == NULL) { continue; }
+        __atomic_store_n(&r->tail, __atomic_load_n(&r->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        r->lost_seen = r->lost_base = __atomic_load_n(&r->lost, __ATOMIC_RELAXED);
+        r->sessions_base = r->sessions;
+        r->skipped_base = r->skipped;
+    }
+    s.file = f;
+    s.written = 1;
+    s.events = 0;
+    s.bytes = sizeof(h);
+    s.noring = 0;
+    pthread_mutex_unlock(&s.drain);
+    if (pthread_create(&s.drainer, NULL, drainer, &s) != 0) {
+        fclose(f);
+        s.file = NULL;
+        pthread_mutex_unlock(&s.control);
+        return false;
+    }
+    if (!s.exiting) { s.exiting = true; atexit(at_exit); }
+    __atomic_store_n(&s.running, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&s.control);
+    return true;
+}
+inline void CalcTrace::stop() {
+    State &s = state();
+    pthread_mutex_lock(&s.control);
+    if (!s.running) { pthread_mutex_unlock(&s.control); return; }
+    __atomic_store_n(&s.running, 0, __ATOMIC_RELEASE);
+    s.stopping = true;
+    pthread_cond_signal(&s.wake);
+    pthread_mutex_unlock(&s.control);
+    pthread_join(s.drainer, NULL);
+    pthread_mutex_lock(&s.drain);
+    drain_locked(s);
+    fclose(s.file);
+    s.file = NULL;
+    pthread_mutex_unlock(&s.drain);
+    pthread_mutex_lock(&s.control);
+    s.stopping = false;
+    pthread_mutex_unlock(&s.control);
+}
+inline void CalcTrace::flush() {
+    State &s = state();
+    pthread_mutex_lock(&s.drain);
+    if (s.file != NULL) { drain_locked(s); }
+    pthread_mutex_unlock(&s.drain);
+}
+inline bool CalcTrace::running() { return (__atomic_load_n(&state().running, __ATOMIC_ACQUIRE) != 0); }
+inline void CalcTrace::level(int level) {
+    state();
+    __atomic_store_n(&Level<0>::value, (level < 0 ? 0 : level), __ATOMIC_RELAXED);
+}
+inline int CalcTrace::level() {
+    state();
+    return __atomic_load_n(&Level<0>::value, __ATOMIC_RELAXED);
+}
+inline void CalcTrace::sample(uint32_t n) { __atomic_store_n(&state().sample, (n < 1 ? 1 : n), __ATOMIC_RELAXED); }
+inline bool CalcTrace::on(int level) {
+    int v = __atomic_load_n(&Level<0>::value, __ATOMIC_RELAXED);
+    if (v < 0) { state(); v = __atomic_load_n(&Level<0>::value, __ATOMIC_RELAXED); }
+    return (v >= level);
+}
+inline CalcTraceStats CalcTrace::stats() {
+    State &s = state();
+    CalcTraceStats st;
+    memset(&st, 0, sizeof(st));
+    pthread_mutex_lock(&s.drain);
+    st.events = s.events;
+    st.bytes = s.bytes;
+    st.lost = s.noring;
+    for (uint32_t i = 0; i < s.nrings; i++) {
+        Ring *r = s.rings[i];
+        if (r == NULL) { continue; }
+        st.lost += __atomic_load_n(&r->lost, __ATOMIC_RELAXED) - r->lost_base;
+        st.sessions += r->sessions - r->sessions_base;
+        st.skipped += r->skipped - r->skipped_base;
+        if (__atomic_load_n(&r->state, __ATOMIC_RELAXED) == RING_OWNED) { st.threads++; }
+    }
+    pthread_mutex_unlock(&s.drain);
+    st.stages = __atomic_load_n(&s.nstages, __ATOMIC_ACQUIRE) - 1;
+    return st;
+}
+inline uint32_t CalcTrace::id(const std::string &formula) {
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < formula.length(); i++) { h = (h ^ (unsigned char)formula[i]) * 16777619U; }
+    return h;
+}
+inline uint16_t CalcTrace::stage(const char *name) {
+    State &s = state();
+    pthread_mutex_lock(&s.control);
+    uint32_t n = s.nstages;
+    for (uint32_t i = 1; i < n; i++) {
+        if (strcmp(s.stages[i], name) == 0) { pthread_mutex_unlock(&s.control); return (uint16_t)i; }
+    }
+    uint16_t id = 0;
+    if (n < CALC_TRACE_STAGES) {
+        s.stages[n] = name;
+        __atomic_store_n(&s.nstages, n + 1, __ATOMIC_RELEASE);
+        id = (uint16_t)n;
+    }
+    pthread_mutex_unlock(&s.control);
+    return id;
+}
+inline CalcTrace::Ring *CalcTrace::ring() {
+    static __thread Ring *mine = NULL;
+    static __thread bool none = false;
+    if (mine != NULL) { return mine; }
+    if (none) { return NULL; }
+    State &s = state();
+    //a ring some thread left (drained already) or a new one
+    for (uint32_t i = 0; i < CALC_TRACE_THREADS; i++) {
+        Ring *r = __atomic_load_n(&s.rings[i], __ATOMIC_ACQUIRE);
+        if (r != NULL && __sync_bool_compare_and_swap(&r->state, (int)RING_FREE, (int)RING_OWNED)) { mine = r; break; }
+    }
+    if (mine == NULL) {
+        uint32_t i = __sync_fetch_and_add(&s.nrings, 1U);
+        if (i >= CALC_TRACE_THREADS) { none = true; return NULL; }
+        Ring *r = new Ring;
+        memset((void *)r, 0, sizeof(Ring) - sizeof(r->ev));
+        r->state = RING_OWNED;
+        r->index = (uint16_t)i;
+        __atomic_store_n(&s.rings[i], r, __ATOMIC_RELEASE);
+        mine = r;
+    }
+    mine->depth = 0; mine->formula = 0; mine->sampled = true; mine->count = 0; mine->nest = 0;
+    pthread_setspecific(s.key, mine);
+    return mine;
+}
+inline void CalcTrace::release(void *p) {
+    Ring *r = (Ring *)p;
+    __atomic_store_n(&r->state, (int)RING_DEAD, __ATOMIC_RELEASE);
+}
+inline uint64_t CalcTrace::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec - state().base;
+}
+inline void CalcTrace::push(Ring *r, CalcTraceEvent &ev, const char *text, size_t len) {
+    if (!__atomic_load_n(&state().running, __ATOMIC_RELAXED)) { return; }
+    if (len > CALC_TRACE_TEXT_MAX) { len = CALC_TRACE_TEXT_MAX; }
+    uint64_t n = (len <= CALC_TRACE_TEXT ? 1 : (len + CALC_TRACE_TEXT - 1) / CALC_TRACE_TEXT);
+    uint64_t h = r->head, used = h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if (used + n > CALC_TRACE_RING) {
+        __atomic_store_n(&r->lost, r->lost + n, __ATOMIC_RELAXED);
+        return;
+    }
+    //half full: the drainer shouldn't wait for its next turn (once per half ring, it's a syscall)
+    if (used < CALC_TRACE_RING / 2 && used + n >= CALC_TRACE_RING / 2) { pthread_cond_signal(&state().wake); }
+    ev.ns = now();
+    ev.thread = r->index;
+    ev.formula = r->formula;
+    ev.depth = r->depth;
+    for (uint64_t k = 0; k < n; k++) {
+        CalcTraceEvent &e = r->ev[(h + k) & (CALC_TRACE_RING - 1)];
+        e = ev;
+        if (k > 0) { e.kind = calc_ev_more; }
+        size_t c = len - (size_t)k * CALC_TRACE_TEXT;
+        if (c > CALC_TRACE_TEXT) { c = CALC_TRACE_TEXT; }
+        memset(e.text, 0, CALC_TRACE_TEXT);
+        if (text != NULL && c > 0) { memcpy(e.text, text + k * CALC_TRACE_TEXT, c); }
+    }
+    __atomic_store_n(&r->head, h + n, __ATOMIC_RELEASE);
+}
+inline bool CalcTrace::open(const std::string &formula) {
+    State &s = state();
+    if (!on(calc_trace_session)) { return false; }
+    if (!__atomic_load_n(&s.running, __ATOMIC_ACQUIRE) && s.autopath[0] != '\0') {
+        //only the first session tries, and only if nobody started (and stopped) it before
+        char path[sizeof(s.autopath)];
+        pthread_mutex_lock(&s.control);
+        bool first = (s.autopath[0] != '\0' && !s.running && !s.stopping && !s.exiting);
+        memcpy(path, s.autopath, sizeof(path));
+        s.autopath[0] = '\0';
+        pthread_mutex_unlock(&s.control);
+        if (first) { start(path); }
+    }
+    if (!__atomic_load_n(&s.running, __ATOMIC_ACQUIRE)) { return false; }
+    Ring *r = ring();
+    if (r == NULL) { __sync_fetch_and_add(&s.noring, 1ULL); return false; }
+    if (r->nest < CALC_TRACE_NEST) {
+        Ring::Saved &sv = r->saved[r->nest];
+        sv.formula = r->formula; sv.sampled = r->sampled; sv.depth = r->depth;
+    }
+    r->nest++;
+    if (r->sampled) {
+        uint32_t n = __atomic_load_n(&s.sample, __ATOMIC_RELAXED);
+        r->sampled = (n <= 1 || r->count++ % n == 0);
+    }
+    r->formula = id(formula);
+    //only this thread writes them, the collector reads them
+    if (!r->sampled) { __atomic_store_n(&r->skipped, __atomic_load_n(&r->skipped, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED); return true; }
+    __atomic_store_n(&r->sessions, __atomic_load_n(&r->sessions, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    CalcTraceEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.kind = calc_ev_open;
+    push(r, ev, formula.data(), formula.length());
+    return true;
+}
+inline void CalcTrace::close(int error, long double result) {
+    Ring *r = ring();
+    if (r == NULL || r->nest == 0) { return; }
+    if (r->sampled) {
+        CalcTraceEvent ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.kind = calc_ev_close;
+        ev.value = (double)result;
+        ev.error = (uint16_t)error;
+        push(r, ev, NULL, 0);
+    }
+    r->nest--;
+    if (r->nest < CALC_TRACE_NEST) {
+        const Ring::Saved &sv = r->saved[r->nest];
+        r->formula = sv.formula; r->sampled = sv.sampled; r->depth = sv.depth;
+    }
+}
+inline void CalcTrace::begin(uint16_t stage, int line) {
+    if (!running()) { return; }
+    Ring *r = ring();
+    if (r == NULL) { __sync_fetch_and_add(&state().noring, 1ULL); return; }
+    if (!r->sampled) { return; }
+    CalcTraceEvent ev;
+    ev.value = 0; ev.line = (uint32_t)line; ev.stage = stage; ev.kind = calc_ev_begin; ev.error = 0;
+    push(r, ev, NULL, 0);
+    if (r->depth < 255) { r->depth++; }
+}
+inline void CalcTrace::end(uint16_t stage, int line) {
+    if (!running()) { return; }
+    Ring *r = ring();
+    if (r == NULL) { __sync_fetch_and_add(&state().noring, 1ULL); return; }
+    if (!r->sampled) { return; }
+    if (r->depth > 0) { r->depth--; }
+    CalcTraceEvent ev;
+    ev.value = 0; ev.line = (uint32_t)line; ev.stage = stage; ev.kind = calc_ev_end; ev.error = 0;
+    push(r, ev, NULL, 0);
+}
+inline void CalcTrace::msg(uint16_t stage, int line, const char *fmt, ...) {
+    if (!running()) { return; }
+    Ring *r = ring();
+    if (r == NULL) { __sync_fetch_and_add(&state().noring, 1ULL); return; }
+    if (!r->sampled) { return; }
+    char buf[CALC_TRACE_TEXT_MAX + 1];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) { n = 0; }
+    if (n > CALC_TRACE_TEXT_MAX) { n = CALC_TRACE_TEXT_MAX; }
+    CalcTraceEvent ev;
+    ev.value = 0; ev.line = (uint32_t)line; ev.stage = stage; ev.kind = calc_ev_msg; ev.error = 0;
+    push(r, ev, buf, (size_t)n);
+}
+inline void CalcTrace::drain_locked(State &s) {
+    if (s.file == NULL) { return; }
+    //the heads first: a stage used by any of those events was named before it
+    uint32_t nrings = __atomic_load_n(&s.nrings, __ATOMIC_ACQUIRE);
+    if (nrings > CALC_TRACE_THREADS) { nrings = CALC_TRACE_THREADS; }
+    uint64_t heads[CALC_TRACE_THREADS];
+    for (uint32_t i = 0; i < nrings; i++) {
+        Ring *r = __atomic_load_n(&s.rings[i], __ATOMIC_ACQUIRE);
+        heads[i] = (r == NULL ? 0 : __atomic_load_n(&r->head, __ATOMIC_ACQUIRE));
+    }
+    uint32_t nstages = __atomic_load_n(&s.nstages, __ATOMIC_ACQUIRE);
+    CalcTraceEvent ev;
+    for (; s.written < nstages; s.written++) {
+        memset(&ev, 0, sizeof(ev));
+        ev.kind = calc_ev_stage;
+        ev.stage = (uint16_t)s.written;
+        memcpy(ev.text, s.stages[s.written], std::min(strlen(s.stages[s.written]), (size_t)CALC_TRACE_TEXT));
+        fwrite(&ev, sizeof(ev), 1, s.file);
+        s.events++;
+    }
+    for (uint32_t i = 0; i < nrings; i++) {
+        Ring *r = __atomic_load_n(&s.rings[i], __ATOMIC_ACQUIRE);
+        if (r == NULL) { continue; }
+        int st = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+        uint64_t t = r->tail, h = heads[i];
+        if (h > t) {
+            size_t from = (size_t)(t & (CALC_TRACE_RING - 1)), n = (size_t)(h - t);
+            size_t first = (from + n > CALC_TRACE_RING ? CALC_TRACE_RING - from : n);
+            fwrite(&r->ev[from], sizeof(CalcTraceEvent), first, s.file);
+            if (first < n) { fwrite(&r->ev[0], sizeof(CalcTraceEvent), n - first, s.file); }
+            s.events += n;
+            __atomic_store_n(&r->tail, h, __ATOMIC_RELEASE);
+        }
+        uint64_t lost = __atomic_load_n(&r->lost, __ATOMIC_RELAXED);
+        if (lost != r->lost_seen) {
+            memset(&ev, 0, sizeof(ev));
+            ev.kind = calc_ev_lost;
+            ev.thread = r->index;
+            ev.value = (double)(lost - r->lost_seen);
+            ev.ns = now();
+            fwrite(&ev, sizeof(ev), 1, s.file);
+            s.events++;
+            r->lost_seen = lost;
+        }
+        //the thread is gone and all it wrote is out: the ring may be taken again
+        if (st == RING_DEAD && __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == h) {
+            __sync_bool_compare_and_swap(&r->state, (int)RING_DEAD, (int)RING_FREE);
+        }
+    }
+    s.bytes = sizeof(CalcTraceHeader) + s.events * sizeof(CalcTraceEvent);
+    fflush(s.file);
+}
+inline void *CalcTrace::drainer(void *arg) {
+    State &s = *(State *)arg;
+    pthread_mutex_lock(&s.control);
+    while (!s.stopping) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += CALC_TRACE_DRAIN_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec += ts.tv_nsec / 1000000000L; ts.tv_nsec %= 1000000000L; }
+        pthread_cond_timedwait(&s.wake, &s.control, &ts);
+        if (s.stopping) { break; }
+        pthread_mutex_unlock(&s.control);
+        pthread_mutex_lock(&s.drain);
+        drain_locked(s);
+        pthread_mutex_unlock(&s.drain);
+        pthread_mutex_lock(&s.control);
+    }
+    pthread_mutex_unlock(&s.control);
+    return NULL;
+}
+inline void CalcTrace::at_exit() { stop(); }
+
+#endif /* _FUNKII_CALC_TRACE_H_ */
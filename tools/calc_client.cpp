@@ -0,0 +1,226 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+/**
+**  calc_client
+**
+**  Load test for calc_server: every thread opens a connection and keeps up to
+**  'depth' pipelined requests in flight, then the results are checked against
+**  CalcProgram and the latencies and server stats are printed.
+**
+**      g++ -O2 -pthread -o calc_client tools/calc_client.cpp
+**
+**  Usage:
+**      calc_client [-t threads] [-n requests per thread] [-p depth] [-r rows] /tmp/calc.sock
+*/
+#include "../src/calc_protocol.h"
+#include <algorithm>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *formulas[] = { "x^2 + y", "sqrt(x) * y", "x / (y - 3)", "sin(x) + cos(y)", "x*y > 20" };
+static const uint32_t nformulas = 5;
+static const char *path = NULL;
+static int requests = 1000, depth = 16, nrows = 64;
+
+struct Result {
+    vector<uint64_t> latency;       /* Round trip of every request (microseconds) */
+    uint64_t wrong;                 /* Results that don't match CalcProgram */
+    string error;                   /* Connection error */
+};
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+static int connect_to(const char *p) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, p, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) { close(fd); fd = -1; }
+    return fd;
+}
+static bool send_all(int fd, const string &s) {
+    size_t at = 0;
+    while (at < s.length()) {
+        ssize_t n = send(fd, s.data() + at, s.length() - at, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+        at += (size_t)n;
+    }
+    return true;
+}
+static bool recv_all(int fd, char *p, size_t size) {
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+        p += n; size -= (size_t)n;
+    }
+    return true;
+}
+/**
+ *  receive
+ *
+ *  Reads one whole response.
+ */
+static bool receive(int fd, CalcMsgHeader &h, string &payload) {
+    if (!recv_all(fd, (char *)&h, sizeof(h))) { return false; }
+    payload.resize(h.size);
+    return (h.size == 0 || recv_all(fd, &payload[0], h.size));
+}
+/**
+ *  request
+ *
+ *  Builds a CALC_MSG_EVAL request, the rows depend on the request id so the answer can be checked.
+ */
+static string request(uint32_t id) {
+    CalcMsgWriter w(CALC_MSG_EVAL, id, CE_NADA);
+    w.put32(nformulas); w.put32(2); w.put32((uint32_t)nrows);
+    for (uint32_t f = 0; f < nformulas; f++) { w.puts(formulas[f]); }
+    w.puts("x"); w.puts("y");
+    for (int r = 0; r < nrows; r++) { w.putd((double)(id % 97) + r * 0.25); w.putd((double)(r % 7)); }
+    return w.finish();
+}
+static uint64_t check(uint32_t id, const string &payload, const vector<CalcProgram> &progs) {
+    CalcMsgReader in(payload.data(), payload.length());
+    uint32_t nf, nr;
+    const char *res, *errs;
+    if (!in.get32(nf) || !in.get32(nr) || nf != nformulas || nr != (uint32_t)nrows ||
+        !in.skip((size_t)nf * nr * sizeof(double), res) || !in.skip((size_t)nf * nr, errs)) { return 1; }
+    uint64_t wrong = 0;
+    for (uint32_t r = 0; r < nr; r++) {
+        for (uint32_t f = 0; f < nf; f++) {
+            long double vars[2] = { 0, 0 };
+            const vector<string> &sym = progs[f].symbols();
+            for (size_t s = 0; s < sym.size(); s++) { vars[s] = (sym[s] == "x" ? (double)(id % 97) + r * 0.25 : (double)(r % 7)); }
+            enum FunkiiCalcErrors_t err;
+            double expect = (double)progs[f].eval(vars, err), got;
+            if (err != CE_NADA) { expect = 0; }
+            memcpy(&got, res + ((size_t)r * nf + f) * sizeof(double), sizeof(got));
+            if (got != expect || (uint8_t)errs[r * nf + f] != (uint8_t)err) { wrong++; }
+        }
+    }
+    return wrong;
+}
+static void *client(void *arg) {
+    Result *res = (Result *)arg;
+    res->wrong = 0;
+    vector<CalcProgram> progs;
+    for (uint32_t f = 0; f < nformulas; f++) { progs.push_back(CalcProgram(formulas[f])); }
+    int fd = connect_to(path);
+    if (fd < 0) { res->error = strerror(errno); return NULL; }
+    vector<uint64_t> sent((size_t)requests);
+    int next = 0, got = 0;
+    CalcMsgHeader h;
+    string payload;
+    while (got < requests) {
+        //keep the pipe full
+        string batch;
+        while (next < requests && next - got < depth) {
+            sent[next] = now_us();
+            batch.append(request((uint32_t)next));
+            next++;
+        }
+        if (!batch.empty() && !send_all(fd, batch)) { res->error = "send failed"; break; }
+        if (!receive(fd, h, payload)) { res->error = "connection closed"; break; }
+        if (h.id >= (uint32_t)requests || h.status != CE_NADA) { res->error = "bad response"; break; }
+        res->latency.push_back(now_us() - sent[h.id]);
+        res->wrong += check(h.id, payload, progs);
+        got++;
+    }
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int threads = 4;
+    for (int i = 1; i < argc; i++) {
+        string a(argv[i]);
+        if (a == "-t" && i + 1 < argc) { threads = atoi(argv[++i]); }
+        else if (a == "-n" && i + 1 < argc) { requests = atoi(argv[++i]); }
+        else if (a == "-p" && i + 1 < argc) { depth = atoi(argv[++i]); }
+        else if (a == "-r" && i + 1 < argc) { nrows = atoi(argv[++i]); }
+        else if (path == NULL && a.at(0) != '-') { path = argv[i]; }
+        else { path = NULL; break; }
+    }
+    if (path == NULL || threads < 1 || requests < 1 || depth < 1 || nrows < 0) {
+        cerr << "usage: " << argv[0] << " [-t threads] [-n requests] [-p depth] [-r rows] socket\n";
+        return 2;
+    }
+    vector<Result> results((size_t)threads);
+    vector<pthread_t> pool((size_t)threads);
+    uint64_t start = now_us();
+    for (int i = 0; i < threads; i++) { pthread_create(&pool[i], NULL, client, &results[i]); }
+    for (int i = 0; i < threads; i++) { pthread_join(pool[i], NULL); }
+    double secs = (double)(now_us() - start) / 1e6;
+
+    vector<uint64_t> lat;
+    uint64_t wrong = 0;
+    int failed = 0;
+    for (int i = 0; i < threads; i++) {
+        if (!results[i].error.empty()) { cerr << "thread " << i << ": " << results[i].error << "\n"; failed++; }
+        lat.insert(lat.end(), results[i].latency.begin(), results[i].latency.end());
+        wrong += results[i].wrong;
+    }
+    sort(lat.begin(), lat.end());
+    double evals = (double)lat.size() * nrows * nformulas;
+    printf("%zu requests in %.3fs: %.0f req/s, %.0f evals/s, %llu wrong results\n",
+           lat.size(), secs, lat.size() / secs, evals / secs, (unsigned long long)wrong);
+    if (!lat.empty()) {
+        printf("round trip us: p50 %llu  p90 %llu  p99 %llu  max %llu\n",
+               (unsigned long long)lat[lat.size() / 2], (unsigned long long)lat[lat.size() * 9 / 10],
+               (unsigned long long)lat[lat.size() * 99 / 100], (unsigned long long)lat.back());
+    }
+
+    int fd = connect_to(path);
+    CalcMsgHeader h;
+    string payload;
+    if (fd >= 0 && send_all(fd, CalcMsgWriter(CALC_MSG_STATS, 0, CE_NADA).finish()) &&
+        receive(fd, h, payload) && payload.length() == sizeof(CalcServerStats)) {
+        CalcServerStats s;
+        memcpy(&s, payload.data(), sizeof(s));
+        printf("server: %llu requests, %llu evals, %llu errors, cache %llu (%llu hits, %llu misses), "
+               "queue max %llu, latency avg %.1fus max %lluus, %llu workers\n",
+               (unsigned long long)s.requests, (unsigned long long)s.evals, (unsigned long long)s.errors,
+               (unsigned long long)s.cache_size, (unsigned long long)s.cache_hits, (unsigned long long)s.cache_misses,
+               (unsigned long long)s.queue_max, s.requests ? (double)s.latency_total / s.requests : 0.0,
+               (unsigned long long)s.latency_max, (unsigned long long)s.workers);
+    }
+    if (fd >= 0) { close(fd); }
+    return (failed > 0 || wrong > 0) ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+/**
+**  calc_compile
+**
+**  Build time tool that compiles a text file of formulas into a formula library
+**  (see src/calc_library.h), so services can mmap it instead of parsing every formula.
+**
+**      g++ -O2 -o calc_compile tools/calc_compile.cpp
+**
+**  Usage:
+**      calc_compile formulas.txt formulas.fcl          compile
+**      calc_compile --check formulas.txt formulas.fcl  exit code 1 if formulas.fcl is stale
+**      calc_compile --explain formulas.txt             dump the compiled formulas (CalcProgram::explain)
+**
+**  Source format, one formula per line:
+**      # comment
+**      name: formula           named formula (CalcLibrary::find("name"))
+**      formula                 unnamed formula (only by number)
+*/
+#include "../src/calc_library.h"
+#include <fstream>
+
+int main(int argc, char *argv[]) {
+    bool check = (argc == 4 && string(argv[1]) == "--check");
+    bool explain = (argc == 3 && string(argv[1]) == "--explain");
+    if ((argc != 3 || string(argv[1]).at(0) == '-') && !check && !explain) {
+        cerr << "usage: " << argv[0] << " [--check] formulas.txt formulas.fcl\n"
+             << "       " << argv[0] << " --explain formulas.txt\n";
+        return 2;
+    }
+    const char *in = argv[(check || explain) ? 2 : 1], *out = argv[check ? 3 : 2];
+    ifstream f(in, ios::in | ios::binary);
+    if (!f) { cerr << in << ": can't read it\n"; return 2; }
+    stringstream ss;
+    ss << f.rdbuf();
+    string source = ss.str();
+
+    if (check) {
+        CalcLibrary lib;
+        if (!lib.open(out)) { cout << out << ": " << lib.get_error() << "\n"; return 1; }
+        if (lib.stale(source)) { cout << out << ": stale, recompile it from " << in << "\n"; return 1; }
+        cout << out << ": up to date (" << lib.size() << " formulas)\n";
+        return 0;
+    }
+
+    vector<string> names, sources;
+    vector<CalcProgram> progs;
+    int errors = 0, n = 0;
+    string line;
+    stringstream lines(source);
+    while (getline(lines, line)) {
+        n++;
+        if (!line.empty() && line.at(line.length() - 1) == '\r') { line.erase(line.length() - 1); }
+        size_t b = line.find_first_not_of(" \t");
+        if (b == string::npos || line.at(b) == '#') { continue; }
+        string name, formula(line);
+        size_t colon = line.find(':');
+        if (colon != string::npos) {
+            name = line.substr(b, colon - b);
+            name.erase(name.find_last_not_of(" \t") + 1);
+            formula = line.substr(colon + 1);
+        }
+        progs.push_back(CalcProgram());
+        if (!progs.back().compile(formula)) {
+            cerr << in << ":" << n << ": " << progs.back().get_error() << "\n";
+            errors++;
+        }
+        names.push_back(name);
+        sources.push_back(formula);
+    }
+    if (explain) {
+        for (size_t i = 0; i < progs.size(); i++) {
+            cout << "#" << i << (names[i].empty() ? "" : " " + names[i]) << ": " << sources[i] << "\n" << progs[i].explain() << "\n";
+        }
+        return (errors > 0 ? 1 : 0);
+    }
+    if (errors > 0) { cerr << errors << " formula(s) with errors, nothing written\n"; return 1; }
+    FunkiiCalcErrors_t err;
+    if (!CalcLibrary::write(out, names, sources, progs, CalcLibrary::hash(source.data(), source.length()), err)) {
+        cerr << out << ": " << Calc::get_error_c_str(err) << "\n";
+        return 1;
+    }
+    cout << out << ": " << progs.size() << " formulas\n";
+    return 0;
+}
@@ -0,0 +1,340 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+/**
+**  calc_csv
+**
+**  Computes new columns of a CSV file: every row goes through one or more formulas
+**  whose variables are the header names (not case sensitive), the results are
+**  appended to the row. A formula can use the columns computed before it.
+**  The input is read in chunks of whole lines (so it can be bigger than RAM, or a pipe),
+**  the fields are parsed where they are, the workers evaluate a chunk at a time with
+**  CalcProgram batches and a writer puts the chunks back in order.
+**
+**      g++ -O2 -pthread -o calc_csv tools/calc_csv.cpp
+**
+**  Usage:
+**      calc_csv [-t threads] [-d delimiter] [-o out.csv] in.csv "name: formula" [...]
+**      cat in.csv | calc_csv - "total: price * qty" "tax: total * 0.21"
+**
+**  A row whose field (or earlier column) a formula needs isn't a number, or whose
+**  formula fails, gets an empty field there, the count of each goes to stderr.
+**  Quoted fields are fine as long as they don't have line breaks in them.
+*/
+#include "../src/calc_program.h"
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define CALC_CSV_CHUNK      (4 << 20)   /* Bytes read at once (whole lines) */
+
+struct Chunk {
+    uint64_t seq;                   /* Order in the file */
+    string in;                      /* Whole lines */
+    string out;                     /* The same lines with the new columns */
+    vector<uint64_t> errors;        /* Rows each formula failed on */
+};
+struct Column {
+    string name;                    /* Lowercase */
+    CalcProgram prog;
+    vector<int> from;               /* Variable slot -> input field (>= 0) or computed column (-1 - n) */
+};
+
+static char delim = ',';
+static vector<Column> columns;
+static size_t nfields = 0;          /* Fields of the header */
+static vector<int> wanted;          /* Field -> index among the parsed fields, -1 if no formula uses it */
+static size_t nwanted = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static deque<Chunk *> todo;         /* Read, waiting for a worker */
+static map<uint64_t, Chunk *> done; /* Evaluated, waiting for the writer */
+static size_t inflight = 0;         /* Chunks read and not written yet */
+static bool eof = false;
+
+static string lower(string s) {
+    for (size_t i = 0; i < s.length(); i++) {
+        if (s.at(i) >= 'A' && s.at(i) <= 'Z') { s.at(i) = (char)(s.at(i) + 32); }
+    }
+    return s;
+}
+/**
+ *  field_end
+ *
+ *  End of the field that starts at p (the delimiter, '\r' or '\n' after it).
+ */
+static const char *field_end(const char *p) {
+    if (*p == '"') {
+        for (p++; *p != '\n'; p++) {
+            if (*p == '"') {
+                if (p[1] != '"') { p++; break; }
+                p++;
+            }
+        }
+    }
+    while (*p != delim && *p != '\n' && *p != '\r') { p++; }
+    return p;
+}
+/**
+ *  number
+ *
+ *  Parses a field where it is: spaces and quotes around the number are fine, nothing else.
+ */
+static bool number(const char *p, const char *end, double &v) {
+    while (p < end && (*p == ' ' || *p == '"')) { p++; }
+    if (p == end) { return false; }
+    char *e;
+    v = strtod(p, &e);
+    if (e == p) { return false; }
+    for (p = e; p < end; p++) {
+        if (*p != ' ' && *p != '"') { return false; }
+    }
+    return true;
+}
+/**
+ *  evaluate
+ *
+ *  Parses the fields of a chunk, runs every formula over all of its rows and writes
+ *  the rows back with the new columns.
+ */
+static void evaluate(Chunk *c) {
+    vector<const char *> lines;
+    for (size_t at = 0; at < c->in.length(); at = c->in.find('\n', at) + 1) { lines.push_back(c->in.data() + at); }
+    size_t rows = lines.size();
+    vector<double> vals(nwanted * rows);
+    vector<uint8_t> bad(nwanted * rows, 0);
+    for (size_t r = 0; r < rows; r++) {
+        const char *p = lines[r];
+        for (size_t f = 0; f < nfields; f++) {
+            const char *end = field_end(p);
+            if (wanted[f] >= 0 && !number(p, end, vals[wanted[f] * rows + r])) { bad[wanted[f] * rows + r] = 1; }
+            if (*end != delim) {
+                //short row, the missing fields aren't numbers
+                for (f++; f < nfields; f++) { if (wanted[f] >= 0) { bad[wanted[f] * rows + r] = 1; } }
+                break;
+            }
+            p = end + 1;
+        }
+    }
+    vector<vector<double> > res(columns.size(), vector<double>(rows));
+    vector<vector<uint8_t> > errs(columns.size(), vector<uint8_t>(rows));
+    c->errors.assign(columns.size(), 0);
+    for (size_t n = 0; n < columns.size(); n++) {
+        Column &col = columns[n];
+        vector<const double *> vars(col.from.size() + 1);
+        for (size_t s = 0; s < col.from.size(); s++) {
+            vars[s] = (col.from[s] >= 0 ? &vals[wanted[col.from[s]] * rows] : &res[-1 - col.from[s]][0]);
+        }
+        col.prog.eval(&vars[0], rows, &res[n][0], &errs[n][0]);
+        for (size_t s = 0; s < col.from.size(); s++) {
+            const uint8_t *b = (col.from[s] >= 0 ? &bad[wanted[col.from[s]] * rows] : &errs[-1 - col.from[s]][0]);
+            for (size_t r = 0; r < rows; r++) { if (b[r]) { errs[n][r] = CE_SYNTAX; } }
+        }
+        for (size_t r = 0; r < rows; r++) { if (errs[n][r] != CE_NADA) { c->errors[n]++; } }
+    }
+    c->out.reserve(c->in.length() + rows * columns.size() * 16);
+    char buf[64];
+    for (size_t r = 0; r < rows; r++) {
+        const char *end = strchr(lines[r], '\n');
+        size_t len = (size_t)(end - lines[r]);
+        if (len > 0 && lines[r][len - 1] == '\r') { len--; }
+        c->out.append(lines[r], len);
+        for (size_t n = 0; n < columns.size(); n++) {
+            c->out.push_back(delim);
+            if (errs[n][r] == CE_NADA) { c->out.append(buf, (size_t)snprintf(buf, sizeof(buf), "%.15g", res[n][r])); }
+        }
+        c->out.push_back('\n');
+    }
+    string().swap(c->in);
+}
+static void *worker(void *) {
+    while (true) {
+        pthread_mutex_lock(&lock);
+        while (todo.empty() && !eof) { pthread_cond_wait(&cond, &lock); }
+        if (todo.empty()) { pthread_mutex_unlock(&lock); return NULL; }
+        Chunk *c = todo.front();
+        todo.pop_front();
+        pthread_mutex_unlock(&lock);
+        evaluate(c);
+        pthread_mutex_lock(&lock);
+        done[c->seq] = c;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+/**
+ *  read_lines
+ *
+ *  Reads up to CALC_CSV_CHUNK bytes of whole lines, the partial line at the end stays in rest.
+ *
+ * @return  false           Nothing left.
+ */
+static bool read_lines(int fd, string &rest, string &out) {
+    out.swap(rest);
+    rest.clear();
+    size_t have = out.length();
+    bool end = false;
+    while (!end && (out.length() < CALC_CSV_CHUNK || out.find('\n', have) == string::npos)) {
+        size_t at = out.length();
+        out.resize(at + CALC_CSV_CHUNK / 4);
+        ssize_t n = read(fd, &out[at], CALC_CSV_CHUNK / 4);
+        if (n < 0 && errno == EINTR) { n = 0; }
+        else if (n <= 0) { end = true; n = 0; }
+        out.resize(at + (size_t)n);
+    }
+    size_t last = out.find_last_of('\n');
+    if (!end && last != string::npos) {
+        rest.assign(out, last + 1, string::npos);
+        out.erase(last + 1);
+    }
+    //the last line may not have a '\n'
+    if (!out.empty() && out.at(out.length() - 1) != '\n') { out.push_back('\n'); }
+    return !out.empty();
+}
+
+int main(int argc, char *argv[]) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *in = NULL, *out = NULL;
+    vector<string> specs;
+    for (int i = 1; i < argc; i++) {
+        string a(argv[i]);
+        if (a == "-t" && i + 1 < argc) { threads = atoi(argv[++i]); }
+        else if (a == "-d" && i + 1 < argc) { delim = argv[++i][0]; }
+        else if (a == "-o" && i + 1 < argc) { out = argv[++i]; }
+        else if (in == NULL && (a == "-" || a.at(0) != '-')) { in = argv[i]; }
+        else if (in != NULL) { specs.push_back(a); }
+        else { in = NULL; break; }
+    }
+    if (in == NULL || specs.empty() || threads < 1 || delim == '\0' || delim == '\n' || delim == '"') {
+        cerr << "usage: " << argv[0] << " [-t threads] [-d delimiter] [-o out.csv] in.csv|- \"name: formula\" [...]\n";
+        return 2;
+    }
+    int ifd = (string(in) == "-" ? 0 : open(in, O_RDONLY));
+    if (ifd < 0) { cerr << in << ": " << strerror(errno) << "\n"; return 2; }
+    int ofd = (out == NULL ? 1 : open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (ofd < 0) { cerr << out << ": " << strerror(errno) << "\n"; return 2; }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(ifd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    //the header: one variable per field
+    string rest, head;
+    if (!read_lines(ifd, rest, head)) { cerr << in << ": empty\n"; return 1; }
+    size_t eol = head.find('\n');
+    string header = head.substr(0, eol + 1);
+    rest = head.substr(eol + 1) + rest;
+    map<string, int> names;
+    for (const char *p = header.c_str(); ; ) {
+        const char *end = field_end(p);
+        string name(p, end);
+        name.erase(0, name.find_first_not_of(" \""));
+        name.erase(name.find_last_not_of(" \"") + 1);
+        names[lower(name)] = (int)nfields++;
+        if (*end != delim) { break; }
+        p = end + 1;
+    }
+    wanted.assign(nfields, -1);
+    for (size_t i = 0; i < specs.size(); i++) {
+        size_t colon = specs[i].find(':');
+        if (colon == string::npos) { cerr << specs[i] << ": not 'name: formula'\n"; return 2; }
+        Column col;
+        col.name = specs[i].substr(0, colon);
+        col.name.erase(0, col.name.find_first_not_of(" "));
+        col.name.erase(col.name.find_last_not_of(" ") + 1);
+        if (!col.prog.compile(specs[i].substr(colon + 1))) { cerr << specs[i] << ": " << col.prog.get_error() << "\n"; return 2; }
+        const vector<string> &vars = col.prog.symbols();
+        for (size_t s = 0; s < vars.size(); s++) {
+            int from = 0;
+            bool found = false;
+            //the columns computed before win over the fields of the same name
+            for (size_t n = 0; n < columns.size() && !found; n++) {
+                if (lower(columns[n].name) == vars[s]) { from = -1 - (int)n; found = true; }
+            }
+            map<string, int>::iterator it = names.find(vars[s]);
+            if (!found && it != names.end()) { from = it->second; found = true; }
+            if (!found) { cerr << specs[i] << ": there's no column '" << vars[s] << "'\n"; return 2; }
+            if (from >= 0 && wanted[from] < 0) { wanted[from] = (int)nwanted++; }
+            col.from.push_back(from);
+        }
+        columns.push_back(col);
+    }
+    header.erase(header.find_last_not_of("\r\n") + 1);
+    for (size_t n = 0; n < columns.size(); n++) { header += delim + columns[n].name; }
+    header += "\n";
+    if (write(ofd, header.data(), header.length()) < 0) { cerr << "can't write\n"; return 1; }
+
+    vector<pthread_t> pool((size_t)threads);
+    for (int i = 0; i < threads; i++) { pthread_create(&pool[i], NULL, worker, NULL); }
+    //the reader runs here, the writer is whoever gets the next chunk in order: this thread too
+    vector<uint64_t> errors(columns.size(), 0);
+    uint64_t next = 0, seq = 0;
+    bool more = true, failed = false;
+    while (more || inflight > 0) {
+        Chunk *c = NULL;
+        if (more) {
+            c = new Chunk;
+            c->seq = seq;
+            more = read_lines(ifd, rest, c->in);
+        }
+        pthread_mutex_lock(&lock);
+        if (c != NULL && more) { todo.push_back(c); inflight++; seq++; pthread_cond_broadcast(&cond); }
+        else { delete c; }
+        if (!more) { eof = true; pthread_cond_broadcast(&cond); }
+        //keep up to 2 chunks per thread in memory
+        while (inflight > 0 && (inflight >= (size_t)threads * 2 || !more || done.count(next) > 0)) {
+            map<uint64_t, Chunk *>::iterator it = done.find(next);
+            if (it == done.end()) { pthread_cond_wait(&cond, &lock); continue; }
+            Chunk *d = it->second;
+            done.erase(it);
+            pthread_mutex_unlock(&lock);
+            for (size_t at = 0; at < d->out.length() && !failed; ) {
+                ssize_t n = write(ofd, d->out.data() + at, d->out.length() - at);
+                if (n < 0 && errno == EINTR) { continue; }
+                if (n <= 0) { failed = true; break; }
+                at += (size_t)n;
+            }
+            for (size_t n = 0; n < columns.size(); n++) { errors[n] += d->errors[n]; }
+            delete d;
+            next++;
+            pthread_mutex_lock(&lock);
+            inflight--;
+        }
+        pthread_mutex_unlock(&lock);
+    }
+    for (int i = 0; i < threads; i++) { pthread_join(pool[i], NULL); }
+    if (ofd != 1) { close(ofd); }
+    if (failed) { cerr << "can't write\n"; return 1; }
+    for (size_t n = 0; n < columns.size(); n++) {
+        if (errors[n] > 0) { cerr << columns[n].name << ": " << errors[n] << " row(s) without a result\n"; }
+    }
+    return 0;
+}
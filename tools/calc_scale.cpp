@@ -0,0 +1,152 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+/**
+**  calc_scale
+**
+**  Scaling benchmark of CalcPool: the formulas are compiled, every variable gets a column
+**  of pseudo random values in [0.5, 10) and the whole set is evaluated over the rows with
+**  1, 2, ... threads. Prints the rows per second, the speedup against a single
+**  CalcProgram::batch() and whether the results are the same as that batch (they must).
+**
+**      g++ -O2 -pthread -o calc_scale tools/calc_scale.cpp
+**
+**  Usage:
+**      calc_scale [-t max threads] [-n rows] [-r repeats] [-f float|double] ["formula" ...]
+**      calc_scale -t 16 -n 4000000 "sqrt(x^2 + y^2)" "ln(x) * (sin(y)) + x / y"
+*/
+#include "../src/calc_parallel.h"
+#include <cstring>
+
+template <typename T>
+static int bench(const vector<CalcProgram *> &progs, int threads, size_t rows, int repeats) {
+    size_t n = progs.size();
+    vector<CalcCode> codes(n);
+    vector<vector<T> > cols;        /* One per variable name */
+    map<string, size_t> byname;
+    vector<vector<const T *> > vars(n);
+    vector<const T *const *> pvars(n);
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < n; i++) {
+        codes[i] = progs[i]->code();
+        const vector<string> &names = progs[i]->symbols();
+        vars[i].resize(names.size() + 1);
+        for (size_t s = 0; s < names.size(); s++) {
+            if (byname.count(names[s]) == 0) {
+                byname[names[s]] = cols.size();
+                cols.push_back(vector<T>(rows));
+                vector<T> &c = cols.back();
+                for (size_t r = 0; r < rows; r++) {
+                    seed = seed * 1103515245 + 12345;
+                    c[r] = (T)(0.5 + 9.5 * ((seed >> 8) / 16777216.0));
+                }
+            }
+        }
+        pvars[i] = &vars[i][0];
+    }
+    for (size_t i = 0; i < n; i++) {
+        const vector<string> &names = progs[i]->symbols();
+        for (size_t s = 0; s < names.size(); s++) { vars[i][s] = &cols[byname[names[s]]][0]; }
+    }
+    vector<vector<T> > want(n, vector<T>(rows)), got(n, vector<T>(rows));
+    vector<vector<uint8_t> > wanterr(n, vector<uint8_t>(rows)), goterr(n, vector<uint8_t>(rows));
+    vector<T *> pout(n);
+    vector<uint8_t *> perr(n);
+    for (size_t i = 0; i < n; i++) { pout[i] = &got[i][0]; perr[i] = &goterr[i][0]; }
+
+    //the baseline: one batch per formula, no pool
+    double base = 1e300;
+    for (int k = 0; k < repeats; k++) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (size_t i = 0; i < n; i++) { CalcProgram::batch(codes[i], pvars[i], rows, &want[i][0], &wanterr[i][0]); }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        if (s < base) { base = s; }
+    }
+    printf("%8s %14s %8s %s\n", "threads", "rows/s", "speedup", "same");
+    printf("%8s %14.0f %8.2f %s\n", "batch", rows * n / base, 1.0, "-");
+    int bad = 0;
+    for (int th = 1; th <= threads; th++) {
+        CalcPool pool(th);
+        double best = 1e300;
+        bool same = true;
+        for (int k = 0; k < repeats; k++) {
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            pool.eval(&codes[0], n, &pvars[0], rows, &pout[0], &perr[0]);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            double s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+            if (s < best) { best = s; }
+            for (size_t i = 0; i < n; i++) {
+                same = same && memcmp(&got[i][0], &want[i][0], rows * sizeof(T)) == 0 &&
+                       memcmp(&goterr[i][0], &wanterr[i][0], rows) == 0;
+            }
+        }
+        if (!same) { bad++; }
+        printf("%8d %14.0f %8.2f %s\n", th, rows * n / best, base / best, (same ? "yes" : "NO"));
+    }
+    return (bad == 0 ? 0 : 1);
+}
+
+int main(int argc, char *argv[]) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t rows = 2000000;
+    int repeats = 5;
+    string type = "double";
+    vector<string> formulas;
+    for (int i = 1; i < argc; i++) {
+        string a(argv[i]);
+        if (a == "-t" && i + 1 < argc) { threads = atoi(argv[++i]); }
+        else if (a == "-n" && i + 1 < argc) { rows = strtoul(argv[++i], NULL, 10); }
+        else if (a == "-r" && i + 1 < argc) { repeats = atoi(argv[++i]); }
+        else if (a == "-f" && i + 1 < argc) { type = argv[++i]; }
+        else if (a.at(0) != '-') { formulas.push_back(a); }
+        else { threads = 0; break; }
+    }
+    if (threads < 1 || rows == 0 || repeats < 1 || (type != "double" && type != "float")) {
+        cerr << "usage: " << argv[0] << " [-t max threads] [-n rows] [-r repeats] [-f float|double] [\"formula\" ...]\n";
+        return 2;
+    }
+    if (formulas.empty()) { formulas.push_back("sqrt(x^2 + y^2) * (sin(x)) + (ln(y) / (1 + x))"); }
+    vector<CalcProgram *> progs;
+    for (size_t i = 0; i < formulas.size(); i++) {
+        progs.push_back(new CalcProgram(formulas[i]));
+        if (progs.back()->get_error_code() != CE_NADA) {
+            cerr << formulas[i] << ": " << progs.back()->get_error() << "\n";
+            return 1;
+        }
+    }
+    printf("%lu rows, %lu formula(s), %s, best of %d\n", (unsigned long)rows, (unsigned long)progs.size(),
+           type.c_str(), repeats);
+    int res = (type == "float" ? bench<float>(progs, threads, rows, repeats) : bench<double>(progs, threads, rows, repeats));
+    for (size_t i = 0; i < progs.size(); i++) { delete progs[i]; }
+    return res;
+}
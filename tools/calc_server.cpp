@@ -0,0 +1,445 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+/**
+**  calc_server
+**
+**  Local evaluation daemon: processes that can't (or don't want to) link calc.h send
+**  formulas and rows over a Unix domain socket (protocol in src/calc_protocol.h).
+**  One epoll thread does all the socket work, a fixed pool of workers evaluates, and
+**  every client shares one cache of compiled formulas.
+**
+**      g++ -O2 -pthread -o calc_server tools/calc_server.cpp
+**
+**  Usage:
+**      calc_server [-w workers] [-c cache size] /tmp/calc.sock
+*/
+#include "../src/calc_protocol.h"
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CALC_SERVER_PENDING 1024    /* Requests of one connection in flight before it stops reading */
+
+struct Job {
+    uint64_t conn;                  /* Connection id */
+    string msg;                     /* Request: header + payload */
+    string reply;                   /* Response: header + payload */
+    uint64_t queued;                /* Microseconds */
+};
+struct Conn {
+    int fd;
+    uint64_t id;
+    string in;                      /* Received, not parsed yet */
+    string out;                     /* To send */
+    size_t sent;                    /* Bytes of out already sent */
+    int pending;                    /* Requests in the queue or being evaluated */
+    uint32_t events;                /* epoll events registered */
+};
+
+static volatile sig_atomic_t quit = 0;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static deque<Job *> queue;          /* Waiting for a worker */
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static vector<Job *> done;          /* Answered, waiting for the epoll thread */
+static int done_fd = -1;            /* eventfd, wakes the epoll thread up */
+static pthread_rwlock_t cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+static map<string, CalcProgram *> cache;
+static size_t cache_max = 100000;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static CalcServerStats stats;
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+static void on_signal(int) { quit = 1; }
+
+/**
+ *  program
+ *
+ *  Finds a formula in the cache or compiles it. When the cache is full the formula is
+ *  compiled into tmp instead.
+ */
+static CalcProgram *program(const string &formula, CalcProgram &tmp, bool &hit) {
+    pthread_rwlock_rdlock(&cache_lock);
+    map<string, CalcProgram *>::iterator it = cache.find(formula);
+    CalcProgram *p = (it == cache.end() ? NULL : it->second);
+    pthread_rwlock_unlock(&cache_lock);
+    hit = (p != NULL);
+    if (p != NULL) { return p; }
+    p = new CalcProgram(formula);
+    pthread_rwlock_wrlock(&cache_lock);
+    it = cache.find(formula);
+    if (it != cache.end()) { delete p; p = it->second; }
+    else if (cache.size() < cache_max) { cache[formula] = p; }
+    else { tmp = *p; delete p; p = &tmp; }
+    pthread_rwlock_unlock(&cache_lock);
+    return p;
+}
+/**
+ *  eval
+ *
+ *  Answers a CALC_MSG_EVAL request.
+ */
+static void eval(Job *job, const CalcMsgHeader &h, CalcMsgReader &in) {
+    uint32_t nf, nv, nr;
+    vector<string> formulas, vars;
+    const char *rows = NULL;
+    bool ok = in.get32(nf) && in.get32(nv) && in.get32(nr);
+    for (uint32_t i = 0; ok && i < nf; i++) { string s; ok = in.gets(s); formulas.push_back(s); }
+    for (uint32_t i = 0; ok && i < nv; i++) { string s; ok = in.gets(s); vars.push_back(s); }
+    ok = ok && (uint64_t)nr * nv * sizeof(double) == in.left() && in.skip(in.left(), rows);
+    if (!ok || (nv == 0 && nr > CALC_MSG_MAX)) {
+        job->reply = CalcMsgWriter(h.type | CALC_MSG_RESPONSE, h.id, CE_MSG_FORMAT).finish();
+        return;
+    }
+    //the answer is a double and an error byte per row and formula, it can't be bigger than a request
+    if ((uint64_t)nr * nf > (uint64_t)CALC_MSG_MAX / (sizeof(double) + 1)) {
+        job->reply = CalcMsgWriter(h.type | CALC_MSG_RESPONSE, h.id, CE_MSG_SIZE).finish();
+        return;
+    }
+    CalcMsgWriter out(h.type | CALC_MSG_RESPONSE, h.id, CE_NADA);
+    out.put32(nf); out.put32(nr);
+    size_t results = out.buf.length();
+    out.buf.resize(results + (size_t)nr * nf * (sizeof(double) + 1));
+    char *res = &out.buf[results];
+    uint8_t *errs = (uint8_t *)res + (size_t)nr * nf * sizeof(double);
+    uint64_t hits = 0, misses = 0, errors = 0;
+    vector<long double> slots;
+    vector<int> cols;
+    for (uint32_t f = 0; f < nf; f++) {
+        CalcProgram tmp;
+        bool hit;
+        CalcProgram *p = program(formulas[f], tmp, hit);
+        if (hit) { hits++; } else { misses++; }
+        //columns of the request every variable slot of the formula reads (-1 is 0)
+        const vector<string> &sym = p->symbols();
+        slots.assign(sym.size() + 1, 0);
+        cols.assign(sym.size(), -1);
+        for (size_t s = 0; s < sym.size(); s++) {
+            for (uint32_t v = 0; v < nv; v++) { if (vars[v] == sym[s]) { cols[s] = (int)v; break; } }
+        }
+        for (uint32_t r = 0; r < nr; r++) {
+            enum FunkiiCalcErrors_t err = CE_NADA;
+            double d;
+            const char *row = rows + (size_t)r * nv * sizeof(double);
+            for (size_t s = 0; s < cols.size(); s++) {
+                if (cols[s] >= 0) { memcpy(&d, row + cols[s] * sizeof(double), sizeof(d)); slots[s] = d; }
+            }
+            if (p->error()) { err = p->get_error_code(); d = 0; }
+            else { d = (double)p->eval(&slots[0], err); }
+            if (err != CE_NADA) { errors++; }
+            memcpy(res + ((size_t)r * nf + f) * sizeof(double), &d, sizeof(d));
+            errs[(size_t)r * nf + f] = (uint8_t)err;
+        }
+    }
+    job->reply = out.finish();
+    pthread_mutex_lock(&stats_lock);
+    stats.rows += nr;
+    stats.evals += (uint64_t)nr * nf;
+    stats.errors += errors;
+    stats.cache_hits += hits;
+    stats.cache_misses += misses;
+    pthread_mutex_unlock(&stats_lock);
+}
+static void *worker(void *) {
+    for (;;) {
+        pthread_mutex_lock(&queue_lock);
+        while (queue.empty() && !quit) { pthread_cond_wait(&queue_cond, &queue_lock); }
+        if (queue.empty()) { pthread_mutex_unlock(&queue_lock); return NULL; }
+        Job *job = queue.front();
+        queue.pop_front();
+        pthread_mutex_unlock(&queue_lock);
+
+        CalcMsgHeader h;
+        memcpy(&h, job->msg.data(), sizeof(h));
+        CalcMsgReader in(job->msg.data() + sizeof(h), h.size);
+        if (h.type == CALC_MSG_EVAL) {
+            //out of memory fails the request, not the daemon
+            try { eval(job, h, in); }
+            catch (bad_alloc &) { job->reply = CalcMsgWriter(h.type | CALC_MSG_RESPONSE, h.id, CE_MSG_SIZE).finish(); }
+        }
+        else if (h.type == CALC_MSG_STATS && h.size == 0) {
+            CalcServerStats s;
+            pthread_mutex_lock(&stats_lock);
+            s = stats;
+            pthread_mutex_unlock(&stats_lock);
+            pthread_mutex_lock(&queue_lock);
+            s.queue_depth = queue.size();
+            pthread_mutex_unlock(&queue_lock);
+            pthread_rwlock_rdlock(&cache_lock);
+            s.cache_size = cache.size();
+            pthread_rwlock_unlock(&cache_lock);
+            CalcMsgWriter out(h.type | CALC_MSG_RESPONSE, h.id, CE_NADA);
+            out.put(&s, sizeof(s));
+            job->reply = out.finish();
+        }
+        else { job->reply = CalcMsgWriter(h.type | CALC_MSG_RESPONSE, h.id, CE_MSG_FORMAT).finish(); }
+        job->msg.clear();
+
+        uint64_t lat = now_us() - job->queued;
+        int b = 0;
+        while (b < 31 && (1ULL << b) <= lat) { b++; }
+        pthread_mutex_lock(&stats_lock);
+        stats.requests++;
+        stats.latency_total += lat;
+        if (lat > stats.latency_max) { stats.latency_max = lat; }
+        stats.latency[b]++;
+        pthread_mutex_unlock(&stats_lock);
+
+        pthread_mutex_lock(&done_lock);
+        done.push_back(job);
+        pthread_mutex_unlock(&done_lock);
+        uint64_t one = 1;
+        if (write(done_fd, &one, sizeof(one)) < 0) { /* the counter can't overflow, ignore */ }
+    }
+}
+
+static int epfd = -1;
+static map<uint64_t, Conn *> conns;
+
+/**
+ *  watch
+ *
+ *  Registers the epoll events a connection needs: read unless too many of its requests
+ *  are in flight, write while there is output left.
+ */
+static void watch(Conn *c) {
+    uint32_t ev = 0;
+    if (c->pending < CALC_SERVER_PENDING) { ev |= EPOLLIN; }
+    if (c->sent < c->out.length()) { ev |= EPOLLOUT; }
+    if (ev == c->events) { return; }
+    struct epoll_event e;
+    e.events = ev;
+    e.data.u64 = c->id;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &e);
+    c->events = ev;
+}
+static void drop(Conn *c) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    conns.erase(c->id);
+    delete c;
+    pthread_mutex_lock(&stats_lock);
+    stats.connections--;
+    pthread_mutex_unlock(&stats_lock);
+}
+/**
+ *  flush
+ *
+ * @return  false   the connection is gone.
+ */
+static bool flush(Conn *c) {
+    while (c->sent < c->out.length()) {
+        ssize_t n = send(c->fd, c->out.data() + c->sent, c->out.length() - c->sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+        if (n <= 0) { drop(c); return false; }
+        c->sent += (size_t)n;
+    }
+    if (c->sent == c->out.length()) { c->out.clear(); c->sent = 0; }
+    else if (c->sent > (1 << 20)) { c->out.erase(0, c->sent); c->sent = 0; }
+    watch(c);
+    return true;
+}
+/**
+ *  receive
+ *
+ *  Reads what the client sent and queues every complete request.
+ *
+ * @return  false   the connection is gone.
+ */
+static bool receive(Conn *c) {
+    char buf[65536];
+    for (;;) {
+        ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+        if (n <= 0) { drop(c); return false; }
+        c->in.append(buf, (size_t)n);
+        if ((size_t)n < sizeof(buf)) { break; }
+    }
+    size_t at = 0;
+    vector<Job *> jobs;
+    uint64_t t = now_us();
+    while (c->in.length() - at >= sizeof(CalcMsgHeader)) {
+        CalcMsgHeader h;
+        memcpy(&h, c->in.data() + at, sizeof(h));
+        if (h.size > CALC_MSG_MAX) {
+            //can't skip it without reading it all, answer and hang up (nobody is left to answer the rest)
+            for (size_t i = 0; i < jobs.size(); i++) { delete jobs[i]; }
+            c->out.append(CalcMsgWriter(h.type | CALC_MSG_RESPONSE, h.id, CE_MSG_SIZE).finish());
+            if (flush(c)) { drop(c); }
+            return false;
+        }
+        if (c->in.length() - at < sizeof(h) + h.size) { break; }
+        Job *job = new Job;
+        job->conn = c->id;
+        job->msg.assign(c->in, at, sizeof(h) + h.size);
+        job->queued = t;
+        jobs.push_back(job);
+        at += sizeof(h) + h.size;
+    }
+    c->in.erase(0, at);
+    if (jobs.empty()) { return true; }
+    c->pending += (int)jobs.size();
+    pthread_mutex_lock(&queue_lock);
+    queue.insert(queue.end(), jobs.begin(), jobs.end());
+    uint64_t depth = queue.size();
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_lock(&stats_lock);
+    if (depth > stats.queue_max) { stats.queue_max = depth; }
+    pthread_mutex_unlock(&stats_lock);
+    watch(c);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        string a(argv[i]);
+        if (a == "-w" && i + 1 < argc) { workers = atoi(argv[++i]); }
+        else if (a == "-c" && i + 1 < argc) { cache_max = (size_t)atol(argv[++i]); }
+        else if (path == NULL && a.at(0) != '-') { path = argv[i]; }
+        else { path = NULL; break; }
+    }
+    if (path == NULL || workers < 1) {
+        cerr << "usage: " << argv[0] << " [-w workers] [-c cache size] socket\n";
+        return 2;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { cerr << path << ": path too long\n"; return 2; }
+    strcpy(addr.sun_path, path);
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 128) < 0) {
+        cerr << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    memset(&stats, 0, sizeof(stats));
+    stats.workers = (uint64_t)workers;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event e;
+    e.events = EPOLLIN; e.data.u64 = 0;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &e);
+    e.events = EPOLLIN; e.data.u64 = 1;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, done_fd, &e);
+
+    vector<pthread_t> pool((size_t)workers);
+    for (int i = 0; i < workers; i++) { pthread_create(&pool[i], NULL, worker, NULL); }
+    cout << "calc_server: " << path << ", " << workers << " workers\n";
+
+    uint64_t next_id = 2;           /* 0 is the listening socket, 1 the eventfd */
+    struct epoll_event events[64];
+    while (!quit) {
+        int n = epoll_wait(epfd, events, 64, 500);
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == 0) {
+                int fd;
+                while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    Conn *c = new Conn;
+                    c->fd = fd; c->id = next_id++; c->sent = 0; c->pending = 0; c->events = EPOLLIN;
+                    conns[c->id] = c;
+                    e.events = EPOLLIN; e.data.u64 = c->id;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &e);
+                    pthread_mutex_lock(&stats_lock);
+                    stats.connections++;
+                    pthread_mutex_unlock(&stats_lock);
+                }
+            }
+            else if (id == 1) {
+                uint64_t v;
+                if (read(done_fd, &v, sizeof(v)) < 0) { /* nothing new */ }
+                vector<Job *> ready;
+                pthread_mutex_lock(&done_lock);
+                ready.swap(done);
+                pthread_mutex_unlock(&done_lock);
+                vector<uint64_t> touched;
+                for (size_t j = 0; j < ready.size(); j++) {
+                    map<uint64_t, Conn *>::iterator it = conns.find(ready[j]->conn);
+                    if (it != conns.end()) {
+                        //answers of a gone client are dropped
+                        it->second->out.append(ready[j]->reply);
+                        it->second->pending--;
+                        touched.push_back(it->first);
+                    }
+                    delete ready[j];
+                }
+                for (size_t j = 0; j < touched.size(); j++) {
+                    //flush() may drop the connection, look it up again
+                    if (j > 0 && touched[j] == touched[j - 1]) { continue; }
+                    map<uint64_t, Conn *>::iterator it = conns.find(touched[j]);
+                    if (it != conns.end()) { flush(it->second); }
+                }
+            }
+            else {
+                map<uint64_t, Conn *>::iterator it = conns.find(id);
+                if (it == conns.end()) { continue; }
+                Conn *c = it->second;
+                if ((events[i].events & EPOLLOUT) && !flush(c)) { continue; }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    //out of memory hangs up on that client only
+                    try { receive(c); }
+                    catch (bad_alloc &) { if (conns.count(id)) { drop(c); } }
+                }
+            }
+        }
+    }
+    pthread_mutex_lock(&queue_lock);
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    for (int i = 0; i < workers; i++) { pthread_join(pool[i], NULL); }
+    while (!conns.empty()) { drop(conns.begin()->second); }
+    close(lfd);
+    unlink(path);
+    cout << "calc_server: " << stats.requests << " requests, " << stats.evals << " evaluations\n";
+    return 0;
+}
@@ -0,0 +1,188 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+/**
+**  calc_simd_check
+**
+**  Accuracy check of the CalcSimd kernels: every function, in double and float, both tiers
+**  and every instruction set the CPU has, over pseudo random arguments in the ranges
+**  below, against the long double libm. Prints the worst error of each one and exits with
+**  1 if any of them is past its bound (CALC_SIMD_ULP_ACCURATE, CALC_SIMD_ULP_FAST) or a
+**  lane in (or out of) the domain isn't marked the way it should (CE_EDOM).
+**  Functions a tier leaves to libm aren't checked.
+**
+**      g++ -O2 -o calc_simd_check tools/calc_simd_check.cpp
+**
+**  Usage:
+**      calc_simd_check [-n arguments per range] [-i isa] [-f function] [-v]
+**      calc_simd_check -n 4000000 -i avx2 -f tanh
+*/
+#include "../src/calc_simd.h"
+#include <cstring>
+
+/* Arguments of a function: [lo, hi), or +-e^[lo, hi) when exp is set */
+struct Range {
+    int func;
+    double lo, hi;
+    bool exp;
+};
+static const Range ranges[] = {
+    { 4, -10, 10, false },      { 4, -60000, 60000, false },    { 4, -700, 700, true },
+    { 5, -10, 10, false },      { 5, -60000, 60000, false },    { 5, -700, 700, true },
+    { 6, -10, 10, false },      { 6, -700, 700, true },
+    { 7, -1.1, 1.1, false },    { 7, -40, 0.1, true },
+    { 8, -1.1, 1.1, false },    { 8, -40, 0.1, true },
+    { 9, -10, 10, false },      { 9, -40, 40, true },
+    { 10, -5, 5, false },       { 10, -750, 750, false },       { 10, -40, 7, true },
+    { 11, -5, 5, false },       { 11, -750, 750, false },       { 11, -40, 7, true },
+    { 12, -3, 3, false },       { 12, -30, 30, false },         { 12, -40, 5, true },
+    { 13, 0, 4, false },        { 13, -745, 709, true },
+    { 14, 0, 4, false },        { 14, -745, 709, true }
+};
+/* Arguments every function gets on top of the random ones */
+static const double specials[] = { 0.0, -0.0, 1.0, -1.0, 0.5, -0.5, 1e-300, -1e-300, 1e-40, 3e38, -3e38,
+                                   1e300, -1e300, HUGE_VAL, -HUGE_VAL, NAN };
+
+static const char *names[] = { "", "", "", "", "sin", "cos", "tan", "asin", "acos", "atan", "sinh", "cosh", "tanh", "ln", "log" };
+
+static long double exact(int func, long double x) {
+    switch (func) {
+        case 4: return sinl(x);
+        case 5: return cosl(x);
+        case 6: return tanl(x);
+        case 7: return asinl(x);
+        case 8: return acosl(x);
+        case 9: return atanl(x);
+        case 10: return sinhl(x);
+        case 11: return coshl(x);
+        case 12: return tanhl(x);
+        case 13: return logl(x);
+        case 14: return log10l(x);
+    }
+    return x;
+}
+/* Error of got in ulp of the exact result rounded to T, 1e9 if one of them isn't finite and the other is */
+template <typename T>
+static double ulps(T got, long double want) {
+    T w = (T)want;
+    if (want != want || got != got) { return ((want != want) == (got != got) ? 0 : 1e9); }
+    if (!isfinite(w) || !isfinite(got)) { return (w == got ? 0 : 1e9); }
+    T aw = (w < 0 ? -w : w);
+    long double u = (long double)nextafter(aw, (T)HUGE_VAL) - aw;
+    return (double)(fabsl((long double)got - want) / u);
+}
+template <typename T>
+static bool check(int isa, enum FunkiiCalcMathTiers_t tier, int func, size_t n, bool verbose) {
+    const char *type = (sizeof(T) == 8 ? "double" : "float");
+    const char *name = names[func];
+    double bound = (tier == calc_math_fast ? CALC_SIMD_ULP_FAST : CALC_SIMD_ULP_ACCURATE);
+    vector<T> x, y;
+    uint64_t seed = 12345 + func;
+    for (size_t r = 0; r < sizeof(ranges) / sizeof(*ranges); r++) {
+        if (ranges[r].func != func) { continue; }
+        for (size_t i = 0; i < n; i++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            double u = (double)(seed >> 11) / 9007199254740992.0, v = ranges[r].lo + (ranges[r].hi - ranges[r].lo) * u;
+            if (ranges[r].exp) { v = ((seed >> 10) & 1 ? -exp(v) : exp(v)); }
+            x.push_back((T)v);
+        }
+    }
+    for (size_t i = 0; i < sizeof(specials) / sizeof(*specials); i++) { x.push_back((T)specials[i]); }
+    y = x;
+    vector<uint8_t> lane(x.size(), 0);
+    if (!CalcSimd::apply(func, tier, &y[0], y.size(), &lane[0], isa)) {
+        if (verbose) { printf("%-7s %-6s %-9s %-5s libm\n", CalcSimd::isa(isa), type, (tier == calc_math_fast ? "fast" : "accurate"), name); }
+        return true;
+    }
+    double worst = 0;
+    size_t at = 0, bad = 0;
+    for (size_t i = 0; i < x.size(); i++) {
+        long double want = exact(func, (long double)x[i]);
+        //out of the domain is CE_EDOM, in the domain isn't (batch() runs a marked row again on its own,
+        //so NaN and Inf arguments may be marked either way)
+        if (!isfinite(x[i]) && lane[i] == CE_EDOM) { continue; }
+        if ((want != want) != (lane[i] == CE_EDOM) && isfinite(x[i])) {
+            if (bad++ == 0) { printf("\t%s(%.17g): lane %d\n", name, (double)x[i], (int)lane[i]); }
+            continue;
+        }
+        if (lane[i] == CE_EDOM) { continue; }
+        double e = ulps<T>(y[i], want);
+        if (e > worst) { worst = e; at = i; }
+    }
+    bool ok = (worst <= bound && bad == 0);
+    if (verbose || !ok) {
+        printf("%-7s %-6s %-9s %-5s %8.3f ulp (bound %.2f) at %.17g", CalcSimd::isa(isa), type,
+               (tier == calc_math_fast ? "fast" : "accurate"), name, worst, bound, (double)x[at]);
+        if (bad > 0) { printf(", %lu lanes marked wrong", (unsigned long)bad); }
+        printf("%s\n", (ok ? "" : "  FAILED"));
+    }
+    return ok;
+}
+int main(int argc, char *argv[]) {
+    size_t n = 1000000;
+    int only = -1, func_only = 0;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        string a(argv[i]);
+        if (a == "-n" && i + 1 < argc) { n = strtoul(argv[++i], NULL, 10); }
+        else if (a == "-v") { verbose = true; }
+        else if (a == "-f" && i + 1 < argc) {
+            a = argv[++i];
+            for (int f = 4; f <= 14; f++) { if (a == names[f]) { func_only = f; } }
+            if (func_only == 0) { n = 0; break; }
+        }
+        else if (a == "-i" && i + 1 < argc) {
+            a = argv[++i];
+            for (int l = 1; l <= 3; l++) { if (a == CalcSimd::isa(l)) { only = l; } }
+            if (only < 0) { n = 0; break; }
+        }
+        else { n = 0; break; }
+    }
+    if (n == 0) {
+        cerr << "usage: " << argv[0] << " [-n arguments per range] [-i sse2|avx2|avx512] [-f function] [-v]\n";
+        return 2;
+    }
+    if (CalcSimd::level() == 0) { printf("no vector extensions, nothing to check\n"); return 0; }
+    if (only > CalcSimd::level()) { printf("this CPU doesn't have %s\n", CalcSimd::isa(only)); return 2; }
+    int failed = 0, checked = 0;
+    for (int isa = (only > 0 ? only : 1); isa <= (only > 0 ? only : CalcSimd::level()); isa++) {
+        for (int t = 0; t < 2; t++) {
+            enum FunkiiCalcMathTiers_t tier = (t == 0 ? calc_math_accurate : calc_math_fast);
+            for (int func = 4; func <= 14; func++) {
+                if (func_only > 0 && func != func_only) { continue; }
+                if (!check<double>(isa, tier, func, n, verbose)) { failed++; }
+                if (!check<float>(isa, tier, func, n, verbose)) { failed++; }
+                checked += 2;
+            }
+        }
+    }
+    printf("%d of %d kernel(s) past their bound\n", failed, checked);
+    return (failed > 0 ? 1 : 0);
+}
@@ -0,0 +1,247 @@
+/************************************************************************************\
+** Copyright (c) 2010-2011, Rafael Medina                                           **
+** All rights reserved.                                                             **
+**                                                                                  **
+** Redistribution and use in source and binary forms, with or without               **
+** modification, are permitted provided that the following conditions are met:      **
+**     * Redistributions of source code must retain the above copyright             **
+**       notice, this list of conditions and the following disclaimer.              **
+**     * Redistributions in binary form must reproduce the above copyright          **
+**       notice, this list of conditions and the following disclaimer in the        **
+**       documentation and/or other materials provided with the distribution.       **
+**     * Neither the name of the Developer nor the names of its contributors        **
+**       may be used to endorse or promote products derived from this software      **
+**       without specific prior written permission.                                 **
+**                                                                                  **
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND  **
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    **
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           **
+** DISCLAIMED. IN NO EVENT SHALL THE DEVELOPER BE LIABLE FOR ANY DIRECT, INDIRECT,  **
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT     **
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,      **
+** OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF        **
+** LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  **
+** OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN           **
+** IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                                    **
+\************************************************************************************/
+/**
+*   $Rev$
+*   $LastChangedDate$
+*/
+/**
+**  calc_trace
+**
+**  Reads the binary traces of CalcTrace (a build with CALC_DEBUG_TRACE or CALC_DEBUG_FILE)
+**  and prints them, one line per event: the time since the trace started, the thread, the
+**  formula id and the event indented by how deep it is. The end of a stage and of a
+**  session get how long they took. -s prints the calls and times of every stage instead.
+**  -w records a trace of its own: every thread assign()s the formulas n times, once
+**  without tracing and once with it, and prints the evaluations per second of both.
+**
+**      g++ -O2 -pthread -o calc_trace tools/calc_trace.cpp
+**
+**  Usage:
+**      calc_trace [-s] [-t thread] [-i formula id] trace.fct
+**      calc_trace -w out.fct [-l level] [-S sample] [-j threads] [-n evaluations] ["formula" ...]
+*/
+#define CALC_DEBUG_TRACE
+#include "../src/calc.h"
+#include "../src/calc_trace.h"
+#include <algorithm>
+#include <cstring>
+
+/* A stage or session that began and hasn't ended yet */
+struct Open {
+    uint16_t stage;
+    uint64_t ns;
+};
+/* Calls and times of a stage */
+struct Total {
+    uint64_t calls, ns, max;
+};
+
+static string text_of(const CalcTraceEvent &ev) {
+    return string(ev.text, strnlen(ev.text, CALC_TRACE_TEXT));
+}
+static string duration(uint64_t ns) {
+    char buf[32];
+    if (ns < 1000) { snprintf(buf, sizeof(buf), "%luns", (unsigned long)ns); }
+    else if (ns < 1000000) { snprintf(buf, sizeof(buf), "%.1fus", ns / 1e3); }
+    else if (ns < 1000000000) { snprintf(buf, sizeof(buf), "%.2fms", ns / 1e6); }
+    else { snprintf(buf, sizeof(buf), "%.3fs", ns / 1e9); }
+    return string(buf);
+}
+//ns since the begin of the innermost open stage it ends (0 if it began before the trace)
+static uint64_t close_stage(vector<Open> &open, uint16_t stage, uint64_t ns) {
+    for (size_t i = open.size(); i > 0; i--) {
+        if (open[i - 1].stage == stage) {
+            uint64_t d = ns - open[i - 1].ns;
+            open.resize(i - 1);
+            return d;
+        }
+    }
+    return 0;
+}
+
+static int decode(const char *path, bool summary, int thread, bool byid, uint32_t formula) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) { cerr << path << ": can't open it\n"; return 1; }
+    CalcTraceHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, CALC_TRACE_MAGIC, sizeof(h.magic)) != 0 ||
+        h.version != CALC_TRACE_VERSION || h.event_size != sizeof(CalcTraceEvent)) {
+        cerr << path << ": not a trace (or another version of it)\n";
+        fclose(f);
+        return 1;
+    }
+    time_t secs = (time_t)(h.start / 1000000000ULL);
+    char when[64];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", gmtime(&secs));
+    printf("%s: started %s.%06lu UTC\n", path, when, (unsigned long)(h.start % 1000000000ULL / 1000));
+    vector<string> names(1, "?");
+    map<int, vector<Open> > stages, sessions;
+    map<string, Total> totals;
+    Total runs = { 0, 0, 0 };
+    uint64_t events = 0, lost = 0, errors = 0;
+    CalcTraceEvent ev, next;
+    bool have = (fread(&ev, sizeof(ev), 1, f) == 1);
+    while (have) {
+        //the text of an event goes on in the calc_ev_more ones right after it
+        string text = text_of(ev);
+        while ((have = (fread(&next, sizeof(next), 1, f) == 1)) && next.kind == calc_ev_more) { text += text_of(next); }
+        events++;
+        if (ev.kind == calc_ev_stage) {
+            if (names.size() <= ev.stage) { names.resize(ev.stage + 1, "?"); }
+            names[ev.stage] = text;
+        }
+        else if (ev.kind == calc_ev_lost) { lost += (uint64_t)ev.value; }
+        string name = (ev.stage < names.size() ? names[ev.stage] : string("?"));
+        uint64_t took = 0;
+        if (ev.kind == calc_ev_open) { Open o = { 0, ev.ns }; sessions[ev.thread].push_back(o); }
+        else if (ev.kind == calc_ev_close) {
+            took = close_stage(sessions[ev.thread], 0, ev.ns);
+            runs.calls++; runs.ns += took; runs.max = max(runs.max, took);
+            if (ev.error != CE_NADA) { errors++; }
+        }
+        else if (ev.kind == calc_ev_begin) { Open o = { ev.stage, ev.ns }; stages[ev.thread].push_back(o); }
+        else if (ev.kind == calc_ev_end) {
+            took = close_stage(stages[ev.thread], ev.stage, ev.ns);
+            Total &t = totals[name];
+            t.calls++; t.ns += took; t.max = max(t.max, took);
+        }
+        bool shown = !summary && ev.kind != calc_ev_stage && (thread < 0 || ev.thread == thread) && (!byid || ev.formula == formula);
+        if (shown) {
+            string what(2 * ev.depth, ' ');
+            char buf[64];
+            switch (ev.kind) {
+                case calc_ev_open: what += "open \"" + text + "\""; break;
+                case calc_ev_close:
+                    if (ev.error != CE_NADA) { what += string("close ") + Calc::get_error_c_str((enum FunkiiCalcErrors_t)ev.error); }
+                    else { snprintf(buf, sizeof(buf), "close = %.15g", ev.value); what += buf; }
+                    what += "  (" + duration(took) + ")";
+                    break;
+                case calc_ev_begin: what += name + " {"; break;
+                case calc_ev_end: what += "} " + name + "  (" + duration(took) + ")"; break;
+                case calc_ev_msg: what += name + ": " + text; break;
+                case calc_ev_lost: snprintf(buf, sizeof(buf), "*** %.0f events lost ***", ev.value); what += buf; break;
+                default: what += "?"; break;
+            }
+            if (ev.line != 0) { snprintf(buf, sizeof(buf), "  :%u", ev.line); what += buf; }
+            printf("%12.6f %4u  %08x  %s\n", ev.ns / 1e9, ev.thread, ev.formula, what.c_str());
+        }
+        ev = next;
+    }
+    fclose(f);
+    if (summary) {
+        vector<pair<uint64_t, string> > order;
+        for (map<string, Total>::iterator it = totals.begin(); it != totals.end(); ++it) { order.push_back(make_pair(it->second.ns, it->first)); }
+        sort(order.rbegin(), order.rend());
+        printf("%-24s %10s %12s %10s %10s\n", "stage", "calls", "total", "mean", "max");
+        for (size_t i = 0; i < order.size(); i++) {
+            const Total &t = totals[order[i].second];
+            printf("%-24s %10lu %12s %10s %10s\n", order[i].second.c_str(), (unsigned long)t.calls, duration(t.ns).c_str(),
+                   duration(t.calls == 0 ? 0 : t.ns / t.calls).c_str(), duration(t.max).c_str());
+        }
+        printf("%-24s %10lu %12s %10s %10s\n", "(sessions)", (unsigned long)runs.calls, duration(runs.ns).c_str(),
+               duration(runs.calls == 0 ? 0 : runs.ns / runs.calls).c_str(), duration(runs.max).c_str());
+    }
+    printf("%lu events, %lu sessions (%lu errors), %lu events lost\n", (unsigned long)events, (unsigned long)runs.calls,
+           (unsigned long)errors, (unsigned long)lost);
+    return 0;
+}
+
+struct Work {
+    const vector<string> *formulas;
+    size_t n;
+    long double sum;
+};
+static void *work(void *arg) {
+    Work &w = *(Work *)arg;
+    Calc calc;
+    for (size_t i = 0; i < w.n; i++) {
+        calc.assign((*w.formulas)[i % w.formulas->size()]);
+        w.sum += calc.result_d();
+    }
+    return NULL;
+}
+//evaluations per second of every thread assign()ing n formulas
+static double run(const vector<string> &formulas, int threads, size_t n) {
+    vector<pthread_t> ids(threads);
+    vector<Work> works(threads);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; i++) {
+        works[i].formulas = &formulas; works[i].n = n; works[i].sum = 0;
+        pthread_create(&ids[i], NULL, work, &works[i]);
+    }
+    for (int i = 0; i < threads; i++) { pthread_join(ids[i], NULL); }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return threads * (double)n / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+}
+
+static int record(const char *path, int level, uint32_t sample, int threads, size_t n, const vector<string> &formulas) {
+    CalcTrace::level(calc_trace_off);
+    double off = run(formulas, threads, n);
+    if (!CalcTrace::start(path)) { cerr << path << ": can't create it\n"; return 1; }
+    CalcTrace::level(level);
+    CalcTrace::sample(sample);
+    double on = run(formulas, threads, n);
+    CalcTrace::stop();
+    CalcTraceStats st = CalcTrace::stats();
+    printf("%d thread(s), %lu evaluations each, level %d, 1 in %u sessions\n", threads, (unsigned long)n, level, sample);
+    printf("off   %14.0f evaluations/s\n", off);
+    printf("on    %14.0f evaluations/s  (%.2fx)\n", on, off / on);
+    printf("%lu events (%.1f MB), %lu sessions, %lu skipped, %lu events lost\n", (unsigned long)st.events, st.bytes / 1e6,
+           (unsigned long)st.sessions, (unsigned long)st.skipped, (unsigned long)st.lost);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool summary = false, byid = false, usage = false;
+    int thread = -1, level = calc_trace_stage, threads = 1;
+    uint32_t formula = 0, sample = 1;
+    size_t n = 100000;
+    const char *in = NULL, *out = NULL;
+    vector<string> formulas;
+    for (int i = 1; i < argc; i++) {
+        string a(argv[i]);
+        if (a == "-s") { summary = true; }
+        else if (a == "-t" && i + 1 < argc) { thread = atoi(argv[++i]); }
+        else if (a == "-i" && i + 1 < argc) { formula = (uint32_t)strtoul(argv[++i], NULL, 16); byid = true; }
+        else if (a == "-w" && i + 1 < argc) { out = argv[++i]; }
+        else if (a == "-l" && i + 1 < argc) { level = atoi(argv[++i]); }
+        else if (a == "-S" && i + 1 < argc) { sample = (uint32_t)atoi(argv[++i]); }
+        else if (a == "-j" && i + 1 < argc) { threads = atoi(argv[++i]); }
+        else if (a == "-n" && i + 1 < argc) { n = strtoul(argv[++i], NULL, 10); }
+        else if (a.at(0) != '-') { if (out == NULL && in == NULL) { in = argv[i]; } else { formulas.push_back(a); } }
+        else { usage = true; break; }
+    }
+    if (out != NULL && in != NULL) { formulas.insert(formulas.begin(), string(in)); in = NULL; }
+    if (usage || (in == NULL) == (out == NULL) || threads < 1 || n == 0 || sample < 1) {
+        cerr << "usage: " << argv[0] << " [-s] [-t thread] [-i formula id] trace.fct\n"
+             << "       " << argv[0] << " -w out.fct [-l level] [-S sample] [-j threads] [-n evaluations] [\"formula\" ...]\n";
+        return 2;
+    }
+    if (in != NULL) { return decode(in, summary, thread, byid, formula); }
+    if (formulas.empty()) { formulas.push_back("sqrt(3^2 + 4^2) * sin(pi / 4) + ln(10) / (1 + 2)"); }
+    return record(out, level, sample, threads, n, formulas);
+}